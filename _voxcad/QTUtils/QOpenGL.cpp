@@ -4,6 +4,7 @@
 #include <QMessageBox>
 #include <QTime>
 #include <vector>
+#include <cstring>
 #include <math.h>
 
 #include "GL/glu.h"
@@ -134,8 +135,9 @@ void CQOpenGL::paintGL()
 	if (AutoSaveFrame){
 		QString SavePath = "";
 		emit GetFrameFilePath(&SavePath);
-		if (SavePath != "") GlSaveScreenShot(SavePath);
+		if (SavePath != "") QueueVideoFrame(SavePath);
 	}
+	else if (FrameWriter.IsRunning()) FrameWriter.Finish(); //recording ended: flush the last frames
 
 	Drawing = false;
 
@@ -710,6 +712,33 @@ void CQOpenGL::GLSaveScreenShot(void)
 	GlSaveScreenShot(QFileDialog::getSaveFileName(this, "Save Screenshot (jpg)", "", "JPEG File (*.jpg)"));
 }
 
+static bool SaveFrameJpg(const CVXS_Frame& Frame) //runs in the frame writer's thread
+{
+	QImage Image(&Frame.Pixels[0], Frame.Width, Frame.Height, 3*Frame.Width, QImage::Format_RGB888);
+	return Image.save(QString::fromStdString(Frame.FilePath), 0, 95);
+}
+
+void CQOpenGL::QueueVideoFrame(QString FilePath)
+{
+	if (!FrameWriter.IsRunning()){
+		FrameWriter.SetEncoder(SaveFrameJpg);
+		FrameWriter.Start();
+	}
+
+	int W = width(), H = height(), RowSize = 3*W;
+	VideoFrame.Width = W;
+	VideoFrame.Height = H;
+	VideoFrame.Pixels.resize(RowSize*H);
+	ReadBackRows.resize(RowSize*H);
+	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1); //rows of 3*W bytes
+	glReadPixels(0, 0, W, H, GL_RGB, GL_UNSIGNED_BYTE, &ReadBackRows[0]);
+	glPopClientAttrib();
+	for (int y=0; y<H; y++) memcpy(&VideoFrame.Pixels[y*RowSize], &ReadBackRows[(H-1-y)*RowSize], RowSize); //top row first
+	VideoFrame.FilePath = FilePath.toStdString();
+	FrameWriter.Push(VideoFrame); //JPEG encoding and disk access happen in the writer thread
+}
+
 void CQOpenGL::GlSaveScreenShot(QString FilePath)
 {
 	QImage Image;
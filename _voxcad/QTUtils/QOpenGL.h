@@ -39,6 +39,7 @@
 #include <qgl.h>
 #include <QTimer>
 #include "../Voxelyze/Utils/Vec3D.h"
+#include "../Voxelyze/VXS_FrameWriter.h"
 
 //Predefined views
 enum ViewType {VTOP, VBOTTOM, VLEFT, VRIGHT, VFRONT, VBACK, VPERSPECTIVE}; 
@@ -151,6 +152,11 @@ protected: //functions and variables only needed internally
 	bool AutoRedraw; //is the view being updated externally (IE timer)? if not, update it when we change the view...
 	bool Drawing; //flag to ignore draw commands if we're still drawing a previous frame...
 
+	CVXS_FrameWriter FrameWriter; //saves video frames in the background while recording
+	CVXS_Frame VideoFrame; //the frame being read back
+	std::vector<unsigned char> ReadBackRows; //as glReadPixels() returns them, bottom row first
+	void QueueVideoFrame(QString FilePath); //reads the frame just drawn and hands it to FrameWriter
+
 	Vec3D<> CurEnv; //current envelope
 	Vec3D<> CurEnvOff; //current envelope offset
 	bool GLGetDim(Vec3D<>* pDim, Vec3D<>* pOff);
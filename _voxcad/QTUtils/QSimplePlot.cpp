@@ -32,6 +32,12 @@ QSimplePlot::QSimplePlot()
 
 //	LeftMargin = 50;
 
+	Ring.resize(PLOT_RING_SIZE);
+	Head = 0;
+	Tail = 0;
+	NumDropped = 0;
+	PointsPerBucket = 1;
+	NumPoints = 0;
 }
 
 QSimplePlot::~QSimplePlot()
@@ -41,6 +47,8 @@ QSimplePlot::~QSimplePlot()
 
 void QSimplePlot::paintEvent(QPaintEvent *)
 {
+	TakeNewPoints();
+
 	QPainter painter(this);
 
 	painter.fillRect(QRect(PlotUL(), PlotLR()), QColor(240, 240, 240));
@@ -83,12 +91,27 @@ void QSimplePlot::paintEvent(QPaintEvent *)
 
 	painter.setPen(QColor(0,0,0));
 
-	if (X.size() > 1){
-		DataMutex.lock();
-		for (int i=0; i<X.size()-1; i++){
-			painter.drawLine(ToPlotXCoord(X[i]), ToPlotYCoord(Y[i]), ToPlotXCoord(X[i+1]), ToPlotYCoord(Y[i+1]));
+	if (NumPoints > 1){ //one vertical min-max line per pixel column, joined from the last point of one column to the first of the next
+		int Col = 0, PrevCol = 0;
+		double ColFirst = 0, ColLast = 0, ColMin = 0, ColMax = 0, PrevLast = 0;
+		bool HaveCol = false, HavePrev = false;
+		for (int i=0; i<=(int)Buckets.size(); i++){
+			int ThisCol = i<(int)Buckets.size() ? (int)ToPlotXCoord(Buckets[i].X) : 0;
+			if (HaveCol && (i==(int)Buckets.size() || ThisCol != Col)){ //draw the finished column
+				if (HavePrev) painter.drawLine(PrevCol, ToPlotYCoord(PrevLast), Col, ToPlotYCoord(ColFirst));
+				if (ColMax > ColMin) painter.drawLine(Col, ToPlotYCoord(ColMin), Col, ToPlotYCoord(ColMax));
+				PrevCol = Col;
+				PrevLast = ColLast;
+				HavePrev = true;
+				HaveCol = false;
+			}
+			if (i==(int)Buckets.size()) break;
+
+			const PlotBucket& B = Buckets[i];
+			if (!HaveCol){Col = ThisCol; ColFirst = B.YFirst; ColMin = B.YMin; ColMax = B.YMax; HaveCol = true;}
+			else {if (B.YMin < ColMin) ColMin = B.YMin; if (B.YMax > ColMax) ColMax = B.YMax;}
+			ColLast = B.YLast;
 		}
-		DataMutex.unlock();
 	}
 
 
@@ -105,69 +128,105 @@ void QSimplePlot::paintEvent(QPaintEvent *)
 
 void QSimplePlot::AddPoint(double XIn, double YIn)
 {
-	DataMutex.lock();
-	X.push_back(XIn);
-	Y.push_back(YIn);
-
-
-	if (X.size() == 1) { //if this is the first point
-		MinX = MaxX = XIn;
-		MinY = MaxY = YIn;
-	}
-	else {
-		if (XIn>MaxX) MaxX = XIn;
-		if (YIn>MaxY) MaxY = YIn;
-		if (XIn<MinX) MinX = XIn;
-		if (YIn<MinY) MinY = YIn;
+	unsigned int CurHead = Head.load(std::memory_order_relaxed);
+	if (CurHead - Tail.load(std::memory_order_acquire) >= PLOT_RING_SIZE){ //the GUI is behind: drop rather than wait
+		NumDropped.fetch_add(1, std::memory_order_relaxed);
+		return;
 	}
 
-	//keep within limits
-	while (X.size() > MaxPoints){
-		double RemovedVal=X.front();
-		X.pop_front();
-		if (RemovedVal >= MaxX) MaxX = FindMax(&X);
-		if (RemovedVal <= MinX) MinX = FindMin(&X);
+	PlotPoint& P = Ring[CurHead & (PLOT_RING_SIZE-1)];
+	P.X = XIn;
+	P.Y = YIn;
+	Head.store(CurHead+1, std::memory_order_release); //publishes the point
+}
 
+void QSimplePlot::TakeNewPoints(void)
+{
+	unsigned int CurTail = Tail.load(std::memory_order_relaxed);
+	unsigned int CurHead = Head.load(std::memory_order_acquire);
+	if (CurTail == CurHead) return;
+
+	for (; CurTail != CurHead; CurTail++){
+		const PlotPoint& P = Ring[CurTail & (PLOT_RING_SIZE-1)];
+		AddToBuckets(P.X, P.Y);
+		SavedPoints.push_back(P);
 	}
-	while (Y.size() > MaxPoints){
-		double RemovedVal=Y.front();
-		Y.pop_front();
-		if (RemovedVal >= MaxY) MaxY = FindMax(&Y);
-		if (RemovedVal <= MinY) MinY = FindMin(&Y);
-	}
+	Tail.store(CurTail, std::memory_order_release); //hands the slots back to the producer
 
-	DataMutex.unlock();
+	//keep within limits (whole buckets)
+	while (!Buckets.empty() && NumPoints - Buckets.front().Count >= MaxPoints){
+		NumPoints -= Buckets.front().Count;
+		Buckets.pop_front();
+	}
+	int MaxSaved = NumPoints < MAX_SAVED_POINTS ? NumPoints : MAX_SAVED_POINTS; //the same points as the buckets, or the newest of them
+	while ((int)SavedPoints.size() > MaxSaved) SavedPoints.pop_front();
+	if (PointsPerBucket > 1 && (int)Buckets.size() < MAX_PLOT_BUCKETS/4) PointsPerBucket /= 2; //the window got shorter: new points can be kept in more detail again
 
-//	MaxX = FindMax(&X);
-//	MinX = FindMin(&X);
-//	MaxY = FindMax(&Y);
-//	MinY = FindMin(&Y);
+	UpdateRange();
 }
 
-double QSimplePlot::FindMax(std::deque<double>* pData)
+void QSimplePlot::AddToBuckets(double XIn, double YIn)
 {
-	double CurMax = pData->front();
-	for (std::deque<double>::iterator it = pData->begin(); it != pData->end(); it++){
-		if (*it > CurMax) CurMax = *it;
+	NumPoints++;
+	if (!Buckets.empty() && Buckets.back().Count < PointsPerBucket){
+		PlotBucket& B = Buckets.back();
+		B.XLast = XIn;
+		B.YLast = YIn;
+		if (YIn < B.YMin) B.YMin = YIn;
+		if (YIn > B.YMax) B.YMax = YIn;
+		B.YSum += YIn;
+		B.Count++;
+		return;
+	}
+
+	PlotBucket B;
+	B.X = B.XLast = XIn;
+	B.YFirst = B.YLast = B.YMin = B.YMax = B.YSum = YIn;
+	B.Count = 1;
+	Buckets.push_back(B);
+
+	if ((int)Buckets.size() > MAX_PLOT_BUCKETS){ //merge neighbors pairwise
+		std::deque<PlotBucket> Merged;
+		for (int i=0; i<(int)Buckets.size(); i+=2){
+			PlotBucket M = Buckets[i];
+			if (i+1 < (int)Buckets.size()){
+				const PlotBucket& N = Buckets[i+1];
+				M.XLast = N.XLast;
+				M.YLast = N.YLast;
+				if (N.YMin < M.YMin) M.YMin = N.YMin;
+				if (N.YMax > M.YMax) M.YMax = N.YMax;
+				M.YSum += N.YSum;
+				M.Count += N.Count;
+			}
+			Merged.push_back(M);
+		}
+		Buckets.swap(Merged);
+		PointsPerBucket *= 2;
 	}
-	return CurMax;
 }
 
-double QSimplePlot::FindMin(std::deque<double>* pData)
+void QSimplePlot::UpdateRange(void)
 {
-	double CurMin = pData->front();
-	for (std::deque<double>::iterator it = pData->begin(); it != pData->end(); it++){
-		if (*it < CurMin) CurMin = *it;
+	if (Buckets.empty()) return;
+
+	MinX = Buckets.front().X;
+	MaxX = Buckets.back().XLast;
+	MinY = Buckets.front().YMin;
+	MaxY = Buckets.front().YMax;
+	for (std::deque<PlotBucket>::iterator it = Buckets.begin(); it != Buckets.end(); it++){
+		if (it->YMin < MinY) MinY = it->YMin;
+		if (it->YMax > MaxY) MaxY = it->YMax;
 	}
-	return CurMin;
 }
 
 void QSimplePlot::Reset()
 {
-	DataMutex.lock();
-	X.clear();
-	Y.clear();
-	DataMutex.unlock();
+	Tail.store(Head.load(std::memory_order_acquire), std::memory_order_release); //discard anything not taken yet
+	NumDropped = 0;
+	Buckets.clear();
+	SavedPoints.clear();
+	PointsPerBucket = 1;
+	NumPoints = 0;
 
 	MinX=0;
 	MaxX=0;
@@ -177,11 +236,14 @@ void QSimplePlot::Reset()
 
 void QSimplePlot::SaveData()
 {
+	TakeNewPoints();
+
 	QFile data(QFileDialog::getSaveFileName(NULL, "Save trace data", "", "Text files (*.txt)"));
 	if (data.open(QFile::WriteOnly | QFile::Truncate)) {
 		QTextStream out(&data);
-		for (int i=0; i<X.size(); i++) {
-			out << X[i] << "\t" << Y[i] << "\n";
+		if (NumPoints > (int)SavedPoints.size()) out << "# last " << SavedPoints.size() << " of " << NumPoints << " points shown\n"; //window longer than the points kept
+		for (int i=0; i<(int)SavedPoints.size(); i++) {
+			out << SavedPoints[i].X << "\t" << SavedPoints[i].Y << "\n";
 		}
 	}
 	data.close();
@@ -34,8 +34,15 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 
 #include <qwidget.h>
 #include <deque>
-#include <qmutex.h>
+#include <vector>
+#include <atomic>
 
+#define PLOT_RING_SIZE 8192 //points the producer can add between two paints before it starts dropping them (power of 2)
+#define MAX_PLOT_BUCKETS 2048 //the shown window is kept as at most this many min/max buckets
+#define MAX_SAVED_POINTS 1048576 //the last this many points of the window are also kept unmerged, for SaveData() (16 MB)
+
+//Plots a trace that another thread adds points to.
+//AddPoint() may be called from one thread (the simulation) while the plot paints in the GUI thread: points go through a lock-free single producer/single consumer ring buffer, so neither side ever waits for the other. The plot only keeps the last MaxPoints points, merged into min/max buckets so that memory and drawing time stay bounded however many points that is.
 class QSimplePlot : public QWidget
 {
 	Q_OBJECT
@@ -44,19 +51,36 @@ public:
 	QSimplePlot();
 	~QSimplePlot();
 
-	void AddPoint(double XIn, double YIn);
-	void SetMaxToShow(int MaxIn) {MaxPoints = MaxIn;}
+	void AddPoint(double XIn, double YIn); //producer side: never blocks. Drops the point if the GUI has not taken the last PLOT_RING_SIZE yet.
+	void SetMaxToShow(int MaxIn) {MaxPoints = MaxIn;} //GUI thread only, as Reset() and SaveData()
 	void Reset();
-	void SaveData();
+	void SaveData(); //writes the unmerged points of the window (its last MAX_SAVED_POINTS if longer, noted in the first line of the file)
+	int GetNumDropped() {return NumDropped.load(std::memory_order_relaxed);} //points AddPoint() had to drop since the last Reset()
 
  protected:
      void paintEvent(QPaintEvent *event);
 	 virtual QSize sizeHint() const;
 
-	 QMutex DataMutex;
+	 struct PlotPoint {double X, Y;};
+	 std::vector<PlotPoint> Ring; //PLOT_RING_SIZE points
+	 std::atomic<unsigned int> Head; //next slot the producer writes (only written by the producer)
+	 std::atomic<unsigned int> Tail; //next slot the consumer reads (only written by the consumer)
+	 std::atomic<int> NumDropped;
+	 void TakeNewPoints(void); //moves everything in the ring into the buckets (GUI thread)
+	 std::deque<PlotPoint> SavedPoints; //the newest points of the window as they were added, for SaveData()
+
+	 struct PlotBucket { //consecutive points merged together
+		 double X, XLast; //of the first and last point
+		 double YFirst, YLast, YMin, YMax, YSum;
+		 int Count;
+	 };
+	 std::deque<PlotBucket> Buckets; //oldest first
+	 int PointsPerBucket; //points merged into each new bucket (doubles when there are too many buckets)
+	 int NumPoints; //points in all buckets
+	 void AddToBuckets(double XIn, double YIn);
+	 void UpdateRange(void);
 
 	 int MaxPoints; //the maximum number of points to keep...
-	 std::deque<double> X, Y;
 
 	 double MinX, MaxX, MinY, MaxY;
 	 int PlotLeftMarg, PlotRightMarg, PlotUpMarg, PlotDownMarg; //in pixels
@@ -71,10 +95,6 @@ public:
 	 QPoint PlotLL() {return QPoint(PlotLeft(), PlotLower());}
 	 QPoint PlotLR() {return QPoint(PlotRight(), PlotLower());}
 
-
-	 double FindMax(std::deque<double>* pData);
-	 double FindMin(std::deque<double>* pData);
-
 	 double ToPlotXCoord(double DataXVal) {return (DataXVal-MinX)/(MaxX-MinX)*(width()-PlotLeftMarg-PlotRightMarg)+PlotLeftMarg;}
 	 double ToPlotYCoord(double DataYVal) {return PlotUpMarg + (height()-PlotUpMarg-PlotDownMarg)-((DataYVal-MinY)/(MaxY-MinY)*(height()-PlotUpMarg-PlotDownMarg));}
 
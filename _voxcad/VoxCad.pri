@@ -20,8 +20,11 @@ HEADERS += ./VoxCad/VoxCad.h \
     ./Voxelyze/Utils/GL_Utils.h \
     ./Voxelyze/Utils/MarchCube.h \
     ./Voxelyze/Utils/Mesh.h \
+    ./Voxelyze/Utils/MeshBVH.h \
+    ./Voxelyze/Utils/PagedArray.h \
     ./Voxelyze/Utils/Vec3D.h \
     ./Voxelyze/Utils/XML_Rip.h \
+    ./Voxelyze/Utils/XML_Pull.h \
     ./Voxelyze/VX_Benchmark.h \
     ./Voxelyze/VX_Bond.h \
     ./Voxelyze/VX_Enums.h \
@@ -31,12 +34,19 @@ HEADERS += ./VoxCad/VoxCad.h \
     ./Voxelyze/VX_FRegion.h \
     ./Voxelyze/VX_MeshUtil.h \
     ./Voxelyze/VX_Object.h \
+    ./Voxelyze/VX_ResultWriter.h \
+    ./Voxelyze/VX_PCGSolver.h \
+    ./Voxelyze/VX_SettleCache.h \
+    ./Voxelyze/VX_SimBatch.h \
     ./Voxelyze/VX_Sim.h \
     ./Voxelyze/VX_Voxel.h \
     ./Voxelyze/VXS_Bond.h \
     ./Voxelyze/VXS_BondCollision.h \
     ./Voxelyze/VXS_BondInternal.h \
+    ./Voxelyze/VXS_FrameWriter.h \
     ./Voxelyze/VXS_SimGLView.h \
+    ./Voxelyze/VXS_RenderSnapshot.h \
+    ./Voxelyze/VXS_GLBatch.h \
     ./Voxelyze/VXS_Voxel.h
 SOURCES += ./VoxCad/main.cpp \
     ./VoxCad/VoxCad.cpp \
@@ -61,7 +71,9 @@ SOURCES += ./VoxCad/main.cpp \
     ./Voxelyze/Utils/GL_Utils.cpp \
     ./Voxelyze/Utils/MarchCube.cpp \
     ./Voxelyze/Utils/Mesh.cpp \
+    ./Voxelyze/Utils/MeshBVH.cpp \
     ./Voxelyze/Utils/XML_Rip.cpp \
+    ./Voxelyze/Utils/XML_Pull.cpp \
     ./Voxelyze/VX_Benchmark.cpp \
     ./Voxelyze/VX_Bond.cpp \
     ./Voxelyze/VX_SimGA.cpp \
@@ -70,12 +82,19 @@ SOURCES += ./VoxCad/main.cpp \
     ./Voxelyze/VX_FRegion.cpp \
     ./Voxelyze/VX_MeshUtil.cpp \
     ./Voxelyze/VX_Object.cpp \
+    ./Voxelyze/VX_ResultWriter.cpp \
+    ./Voxelyze/VX_PCGSolver.cpp \
+    ./Voxelyze/VX_SettleCache.cpp \
+    ./Voxelyze/VX_SimBatch.cpp \
     ./Voxelyze/VX_Sim.cpp \
     ./Voxelyze/VX_Voxel.cpp \
     ./Voxelyze/VXS_Bond.cpp \
     ./Voxelyze/VXS_BondCollision.cpp \
     ./Voxelyze/VXS_BondInternal.cpp \
+    ./Voxelyze/VXS_FrameWriter.cpp \
     ./Voxelyze/VXS_SimGLView.cpp \
+    ./Voxelyze/VXS_RenderSnapshot.cpp \
+    ./Voxelyze/VXS_GLBatch.cpp \
     ./Voxelyze/VXS_Voxel.cpp
 FORMS += ./VoxCad/vBCs.ui \
     ./VoxCad/vFEAInfo.ui \
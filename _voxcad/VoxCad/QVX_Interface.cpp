@@ -320,9 +320,11 @@ void QVX_Sim::SimLoop(QString* pSimMessage)
 	std::string RetMsg;
 	QTime tLastPlot; //plot point add every...
 	QTime tLastStatus; //status text box updated...
+	QTime tLastSnapshot; //render snapshot published every...
 //	QTime tLastStatCalc; //simulation max/mins calculated every...
 	tLastPlot.start();
 	tLastStatus.start();
+	tLastSnapshot.start();
 //	tLastStatCalc.start();
 
 	emit ReqUiUpdate(); //for slider ranges that depend on dt or other sim params
@@ -335,11 +337,15 @@ void QVX_Sim::SimLoop(QString* pSimMessage)
 	IniCM=GetCM();
 	Vec3D<> LastCM = IniCM;
 
-	int StatusNumber = 1, PlotPointNumber = 1;
+	int StatusNumber = 1, PlotPointNumber = 1, SnapshotNumber = 1;
 	double UpStatEv = 500; //Updates status pane every X ms
 	int UpPlotEv = 30; //updates plot every X ms when not plotting every point.
+	int UpSnapEv = DEFAULT_DISPLAY_UPDATE_MS/2; //publishes a snapshot for the view every X ms (twice per redraw, so each redraw finds a fresh one)
 	char PlotDataTypes;
 	bool PlotVis, StatusVis;
+	emit IsPlotVisible(&PlotVis); //the GUI is only asked again on steps that publish a snapshot
+	emit GetPlotRqdStats(&PlotDataTypes);
+	emit IsStatusTextVisible(&StatusVis);
 
  	bool usingGUI = true;
 //	double volumeStart = pSimView->VoxMesh.computeAndStoreRobotVolumeStart();
@@ -356,23 +362,23 @@ void QVX_Sim::SimLoop(QString* pSimMessage)
 		//figure out what stats we need to calculate
 		StatToCalc=CALCSTAT_NONE;
 
-		emit IsPlotVisible(&PlotVis);
-		bool PlottingPoint = (LogEvery?true:tLastPlot.elapsed() > PlotPointNumber*UpPlotEv) && PlotVis;
-		if (PlottingPoint){ //ensure we calculate the info we want to plot
-			emit GetPlotRqdStats(&PlotDataTypes);
-			StatToCalc |= PlotDataTypes;
-		}
-		emit IsStatusTextVisible(&StatusVis);
-		bool UpdatingStatus = (tLastStatus.elapsed() > StatusNumber*UpStatEv) && StatusVis;
-		if (UpdatingStatus){StatToCalc |= CALCSTAT_COM;} //calc any data we need in the text status box
-
 		bool DrawingGLLocal = (GLUpdateEveryNFrame != -1 && Count%GLUpdateEveryNFrame==0);
-		if (DrawingGLLocal || pSimView->NeedStatsUpdate){ //calc any data we need to draw the opengl view...
+		bool PublishingSnapshot = DrawingGLLocal || pSimView->NeedStatsUpdate || tLastSnapshot.elapsed() > SnapshotNumber*UpSnapEv;
+		if (PublishingSnapshot){ //calc any data we need to draw the opengl view...
 			StatToCalc |= pSimView->StatRqdToDraw();
 			pSimView->NeedStatsUpdate = false;
 			if (LockCoMToCenter) StatToCalc |= CALCSTAT_COM;
+
+			emit IsPlotVisible(&PlotVis);
+			emit GetPlotRqdStats(&PlotDataTypes);
+			emit IsStatusTextVisible(&StatusVis);
 		}
 
+		bool PlottingPoint = (LogEvery?true:tLastPlot.elapsed() > PlotPointNumber*UpPlotEv) && PlotVis;
+		if (PlottingPoint) StatToCalc |= PlotDataTypes; //ensure we calculate the info we want to plot
+		bool UpdatingStatus = (tLastStatus.elapsed() > StatusNumber*UpStatEv) && StatusVis;
+		if (UpdatingStatus){StatToCalc |= CALCSTAT_COM;} //calc any data we need in the text status box
+
 		//input
 		if (DraggingVoxel){
 			Vec3D<> Dist = DraggingVoxel->GetCurPos() - InputPoint ;
@@ -400,6 +406,11 @@ void QVX_Sim::SimLoop(QString* pSimMessage)
 
 		if (!TimeStep(&RetMsg)){InternalEnding = true; break;}//if something happened in this timestep
 
+		if (PublishingSnapshot){ //hand the new state to the view (which draws from the latest snapshot instead of the voxels)
+			pSimView->PublishSnapshot();
+			if (!DrawingGLLocal) SnapshotNumber++;
+		}
+
 		if (DrawingGLLocal){
 			IsStillDrawing = true;
 			ReqGLDrawingStatus(&IsStillDrawing);
@@ -414,6 +425,12 @@ void QVX_Sim::SimLoop(QString* pSimMessage)
 		while(Paused){
 			ActuallyPaused = true;
 			if (StopSim) break; //kick out of the loop if we've stopped...
+			if (pSimView->NeedStatsUpdate){ //view color changed while paused: recolor the current step
+				pSimView->NeedStatsUpdate = false;
+				StatToCalc = pSimView->StatRqdToDraw();
+				UpdateStats();
+				pSimView->PublishSnapshot();
+			}
 			LOCALSLEEP(100);
 		}
 
@@ -489,6 +506,7 @@ void QVX_Sim::SimLoop(QString* pSimMessage)
 //		if (StatCalcNumber == INT_MAX){StatCalcNumber=1; tLastStatCalc.restart();} //avoid int rollover for our counters
 		if (StatusNumber == INT_MAX){StatusNumber=1; tLastStatus.restart();}
 		if (PlotPointNumber == INT_MAX){PlotPointNumber=1; tLastPlot.restart();}
+		if (SnapshotNumber == INT_MAX){SnapshotNumber=1; tLastSnapshot.restart();}
 
 
 		Count++;
@@ -508,6 +526,7 @@ void QVX_Sim::SimLoop(QString* pSimMessage)
 
 	DraggingVoxel=NULL;
 	emit StopExternalGLUpdate();
+	pSimView->StopPublishing(); //draw the final state directly
 
 //	emit SetExternalGLUpdate(false);
 	Running = false;
@@ -1 +1,3 @@
- 
+#ifdef USE_OPEN_GL
+#include <GL/gl.h> //default for builds without Qt
+#endif
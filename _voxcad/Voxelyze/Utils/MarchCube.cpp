@@ -11,6 +11,11 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 
 #include "MarchCube.h"
 #include <vector>
+#include <thread>
+#include <math.h>
+
+#define MC_PARALLEL_MIN 65536 //padded samples below which the slabs are not worth a thread each
+#define MC_MAX_THREADS 8
 
 	static int edgeTable[256]={
 	0x0  , 0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c,
@@ -314,177 +319,277 @@ CMarchCube::~CMarchCube(void)
 {
 }
 
-void CMarchCube::SingleMaterial(CMesh* pMeshOut, CArray3Df* pArray, float Thresh, float Scale)
+//where the samples come from: the arrays passed to MultiMaterial() or SingleMaterialMultiColor(), read one z plane at a time instead of being copied into padded arrays
+struct CMarchSource {
+	std::vector<CArray3Df*> Mats; //materials (just one for SingleMaterialMultiColor())
+	bool SumMat; //sum the materials instead of taking the max
+	CColor* pColors; //color of each material (or NULL)
+	CArray3Df* pRGB[3]; //per sample colors (SingleMaterialMultiColor()) or NULL
+	float OutsideVal; //value of the padding around the arrays
+	int XSize, YSize, ZSize; //unpadded size
+
+	void FillPlane(int k, float* pVal, CColor* pCol) const; //padded plane k (0 and ZSize+1 are all padding), (XSize+2)*(YSize+2) samples
+};
+
+void CMarchSource::FillPlane(int k, float* pVal, CColor* pCol) const
 {
-	std::vector<CArray3Df> tmpVec; //put in an stl vector to call MultiMaterial()
-	tmpVec.push_back(*pArray);
-	CColor DefaultColor(0.5, 0.5, 0.5); //defaults to grey
-	CMarchCube::MultiMaterial(pMeshOut, &tmpVec, true, &DefaultColor, Thresh, Scale);
-}
+	int PX = XSize+2, PY = YSize+2;
+	for (int j=0; j<PY; j++){
+		for (int i=0; i<PX; i++){
+			int n = i+PX*j;
+			pVal[n] = OutsideVal;
+			pCol[n] = CColor(0, 0, 0);
+			if (i<1 || i>XSize || j<1 || j>YSize || k<1 || k>ZSize) continue;
+			int Index = (i-1) + XSize*(j-1) + XSize*YSize*(k-1);
+
+			if (pRGB[0] != NULL){
+				pVal[n] = (*Mats[0])[Index];
+				pCol[n] = CColor((*pRGB[0])[Index], (*pRGB[1])[Index], (*pRGB[2])[Index]);
+				continue;
+			}
 
-void CMarchCube::SingleMaterialMultiColor(CMesh* pMeshOut, CArray3Df* pArray, CArray3Df* rColorArray, CArray3Df* gColorArray, CArray3Df* bColorArray, float Thresh, float Scale)
-{	
+			float max = -9e9f; //find the max, for color (or for thresh, as well if !SumMat)
+			float Sum = 0;
+			for (int m=0; m<(int)Mats.size(); m++){
+				float ThisVal = (*Mats[m])[Index];
+				if (ThisVal > max){
+					max = ThisVal;
+					if (pColors != NULL) pCol[n] = CColor(pColors[m].r, pColors[m].g, pColors[m].b);
+				}
+				if (m==0) Sum = ThisVal;
+				else Sum += ThisVal;
+			}
+			pVal[n] = SumMat ? Sum : max;
+		}
+	}
+}
 
-	std::vector<CArray3Df> tmpVec; //put in an stl vector to call MultiMaterial()
-	tmpVec.push_back(*pArray);
+//one thread's share of the cubes: a slab of z layers. Vertices are cached by the lattice edge (or corner) they lie on, so each is created once, and only the planes between slabs are shared with the neighboring threads.
+class CMarchSlab
+{
+public:
+	const CMarchSource* pSrc;
+	double Iso;
+	float Scale;
+	int FirstLayer, LastLayer; //cube layers FirstLayer to LastLayer-1 (layer k spans padded planes k and k+1)
+
+	std::vector<CVertex> Vertices; //this slab's vertices
+	std::vector<int> Tris; //three vertex indices per facet
+	std::vector<int> FirstCaches[3], LastCaches[3]; //vertex of each corner, x edge and y edge of the bottom plane of the first layer and of the top plane of the last layer, to merge the slabs
+	std::vector<int> Map; //index of each vertex in the merged mesh
+
+	void Run(void);
+
+private:
+	int PX, PY, CurK; //padded plane size, bottom plane of the current layer
+	std::vector<float> Val[2]; //samples of the bottom and top planes
+	std::vector<CColor> Col[2];
+	std::vector<int> Corner[2], XEdge[2], YEdge[2], ZEdge; //vertex indices (-1 if not created yet)
+
+	Vec3D<> Position(int i, int j, int Layer) const {return Vec3D<>(Scale*(i-0.5f), Scale*(j-0.5f), Scale*(CurK+Layer-0.5f));}
+	int GetCorner(int i, int j, int Layer);
+	int GetEdge(int Axis, int i, int j, int Layer);
+};
 
-	
-	//of course, assumes cubic structure!!!
-	GRIDCELL GridCell;
-	pMeshOut->Clear();
-	
-	//innefficient!
-	CArray3Df Padded;
-	CArray3Df aR;
-	CArray3Df aG;
-	CArray3Df aB;
-	
-	Padded.IniSpace(pArray->GetXSize()+2, pArray->GetYSize()+2, pArray->GetZSize()+2, -1e6);
-	aR.IniSpace(Padded.GetXSize(), Padded.GetYSize(), Padded.GetZSize(), 0.0);
-	aG.IniSpace(Padded.GetXSize(), Padded.GetYSize(), Padded.GetZSize(), 0.0);
-	aB.IniSpace(Padded.GetXSize(), Padded.GetYSize(), Padded.GetZSize(), 0.0);
-	
-	for (int i=0; i<pArray->GetXSize(); i++)
-		for (int j=0; j<pArray->GetYSize(); j++)
-			for (int k=0; k<pArray->GetZSize(); k++){
+int CMarchSlab::GetCorner(int i, int j, int Layer)
+{
+	int& Index = Corner[Layer][i+PX*j];
+	if (Index == -1){
+		Vertices.push_back(CVertex(Position(i, j, Layer), Col[Layer][i+PX*j]));
+		Index = (int)Vertices.size()-1;
+	}
+	return Index;
+}
 
-				//existince array	
-				Padded(i+1, j+1, k+1) = (*pArray)(i,j,k);
+int CMarchSlab::GetEdge(int Axis, int i, int j, int Layer) //edge from (i, j, Layer) in the positive Axis direction
+{
+	int n = i+PX*j;
+	int& Index = (Axis == 0) ? XEdge[Layer][n] : (Axis == 1) ? YEdge[Layer][n] : ZEdge[n];
+	if (Index != -1) return Index;
+
+	int i2 = i + (Axis == 0 ? 1 : 0), j2 = j + (Axis == 1 ? 1 : 0), Layer2 = Layer + (Axis == 2 ? 1 : 0);
+	int n2 = i2+PX*j2;
+	double v1 = Val[Layer][n], v2 = Val[Layer2][n2];
+
+	//same cases as VertexInterp(): on a lattice point the vertex is shared by all of its edges
+	if (fabs(Iso-v1) < 0.00001 || (fabs(Iso-v2) >= 0.00001 && fabs(v1-v2) < 0.00001)) Index = GetCorner(i, j, Layer);
+	else if (fabs(Iso-v2) < 0.00001) Index = GetCorner(i2, j2, Layer2);
+	else {
+		Vertices.push_back(CMarchCube::VertexInterp(Iso, CVertex(Position(i, j, Layer), Col[Layer][n]), CVertex(Position(i2, j2, Layer2), Col[Layer2][n2]), v1, v2));
+		Index = (int)Vertices.size()-1;
+	}
+	return Index;
+}
 
-				//color arrays
-				aR(i+1, j+1, k+1) = (*rColorArray)(i,j,k);
-				aG(i+1, j+1, k+1) = (*gColorArray)(i,j,k);
-				aB(i+1, j+1, k+1) = (*bColorArray)(i,j,k);
-			}
-	
-	
-	//form cubes
-	float ai, aj, ak; //jmc: for speed, declare them only once
-	
-	for (int i=0; i<Padded.GetXSize()-1; i++){
-		for (int j=0; j<Padded.GetYSize()-1; j++){
-			for (int k=0; k<Padded.GetZSize()-1; k++){
-				ai = i-0.5f;
-				aj = j-0.5f;
-				ak = k-0.5f;
-				GridCell.p[0] = CVertex(Vec3D<>(Scale*ai, Scale*aj, Scale*ak), CColor(aR(i, j, k), aG(i, j, k), aB(i, j, k))); //put in ccppn-generated rgb here. 
-				GridCell.val[0] = Padded(i, j, k);
-				GridCell.p[1] = CVertex(Vec3D<>(Scale*(ai+1), Scale*aj, Scale*ak), CColor(aR(i+1, j, k), aG(i+1, j, k), aB(i+1, j, k)));
-				GridCell.val[1] = Padded(i+1, j, k);
-				GridCell.p[2] = CVertex(Vec3D<>(Scale*(ai+1), Scale*(aj+1), Scale*ak), CColor(aR(i+1, j+1, k), aG(i+1, j+1, k), aB(i+1, j+1, k)));
-				GridCell.val[2] = Padded(i+1, j+1, k);
-				GridCell.p[3] = CVertex(Vec3D<>(Scale*ai, Scale*(aj+1), Scale*ak), CColor(aR(i, j+1, k), aG(i, j+1, k), aB(i, j+1, k)));
-				GridCell.val[3] = Padded(i, j+1, k);
-				GridCell.p[4] = CVertex(Vec3D<>(Scale*ai, Scale*aj, Scale*(ak+1)), CColor(aR(i, j, k+1), aG(i, j, k+1), aB(i, j, k+1)));
-				GridCell.val[4] = Padded(i, j, k+1);
-				GridCell.p[5] = CVertex(Vec3D<>(Scale*(ai+1), Scale*aj, Scale*(ak+1)), CColor(aR(i+1, j, k+1), aG(i+1, j, k+1), aB(i+1, j, k+1)));
-				GridCell.val[5] = Padded(i+1, j, k+1);
-				GridCell.p[6] = CVertex(Vec3D<>(Scale*(ai+1), Scale*(aj+1), Scale*(ak+1)), CColor(aR(i+1, j+1, k+1), aG(i+1, j+1, k+1), aB(i+1, j+1, k+1)));
-				GridCell.val[6] = Padded(i+1, j+1, k+1);
-				GridCell.p[7] = CVertex(Vec3D<>(Scale*ai, Scale*(aj+1), Scale*(ak+1)), CColor(aR(i, j+1, k+1), aG(i, j+1, k+1), aB(i, j+1, k+1)));
-				GridCell.val[7] = Padded(i, j+1, k+1);
-				
-				Polygonise(GridCell, Thresh, pMeshOut); //crunch this cube and add the vertices...
+void CMarchSlab::Run(void)
+{
+	//the 12 edges of a cube (in the order of edgeTable and triTable): axis, plane (0: bottom, 1: top) and offset of the lower end
+	static const int EdgeAxis[12] = {0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2};
+	static const int EdgeLayer[12] = {0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0};
+	static const int EdgeDi[12] = {0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 1, 0};
+	static const int EdgeDj[12] = {0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 1};
+
+	PX = pSrc->XSize+2;
+	PY = pSrc->YSize+2;
+	int NP = PX*PY;
+	for (int l=0; l<2; l++){
+		Val[l].resize(NP);
+		Col[l].resize(NP);
+		Corner[l].assign(NP, -1);
+		XEdge[l].assign(NP, -1);
+		YEdge[l].assign(NP, -1);
+	}
+	pSrc->FillPlane(FirstLayer, &Val[0][0], &Col[0][0]);
+
+	int Vi[12];
+	for (CurK=FirstLayer; CurK<LastLayer; CurK++){
+		pSrc->FillPlane(CurK+1, &Val[1][0], &Col[1][0]);
+		Corner[1].assign(NP, -1);
+		XEdge[1].assign(NP, -1);
+		YEdge[1].assign(NP, -1);
+		ZEdge.assign(NP, -1);
+
+		for (int j=0; j<PY-1; j++){
+			for (int i=0; i<PX-1; i++){
+				int n = i+PX*j;
+				int cubeindex = 0; //which corners are inside of the surface
+				if (Val[0][n] < Iso) cubeindex |= 1;
+				if (Val[0][n+1] < Iso) cubeindex |= 2;
+				if (Val[0][n+1+PX] < Iso) cubeindex |= 4;
+				if (Val[0][n+PX] < Iso) cubeindex |= 8;
+				if (Val[1][n] < Iso) cubeindex |= 16;
+				if (Val[1][n+1] < Iso) cubeindex |= 32;
+				if (Val[1][n+1+PX] < Iso) cubeindex |= 64;
+				if (Val[1][n+PX] < Iso) cubeindex |= 128;
+				if (edgeTable[cubeindex] == 0) continue; //cube is entirely in/out of the surface
+
+				for (int e=0; e<12; e++) if (edgeTable[cubeindex] & (1<<e)) Vi[e] = GetEdge(EdgeAxis[e], i+EdgeDi[e], j+EdgeDj[e], EdgeLayer[e]);
+
+				for (int t=0; triTable[cubeindex][t]!=-1; t+=3){
+					int V0 = Vi[triTable[cubeindex][t]], V1 = Vi[triTable[cubeindex][t+1]], V2 = Vi[triTable[cubeindex][t+2]];
+					if (V0 == V1 || V0 == V2 || V1 == V2) continue; //collapsed onto a lattice point
+					Tris.push_back(V0);
+					Tris.push_back(V1);
+					Tris.push_back(V2);
+				}
 			}
 		}
+
+		if (CurK == FirstLayer){FirstCaches[0] = Corner[0]; FirstCaches[1] = XEdge[0]; FirstCaches[2] = YEdge[0];}
+		Val[0].swap(Val[1]); //the top plane becomes the bottom of the next layer
+		Col[0].swap(Col[1]);
+		Corner[0].swap(Corner[1]);
+		XEdge[0].swap(XEdge[1]);
+		YEdge[0].swap(YEdge[1]);
 	}
-	
-	pMeshOut->WeldClose(Scale/2);
+	LastCaches[0].swap(Corner[0]);
+	LastCaches[1].swap(XEdge[0]);
+	LastCaches[2].swap(YEdge[0]);
+}
+
+
+void CMarchCube::SingleMaterial(CMesh* pMeshOut, CArray3Df* pArray, float Thresh, float Scale)
+{
+	CColor DefaultColor(0.5, 0.5, 0.5); //defaults to grey
+	CMarchSource Src;
+	Src.Mats.push_back(pArray);
+	Src.SumMat = true;
+	Src.pColors = &DefaultColor;
+	Src.pRGB[0] = Src.pRGB[1] = Src.pRGB[2] = NULL;
+	Src.OutsideVal = 0;
+	March(pMeshOut, Src, Thresh, Scale);
+}
+
+void CMarchCube::SingleMaterialMultiColor(CMesh* pMeshOut, CArray3Df* pArray, CArray3Df* rColorArray, CArray3Df* gColorArray, CArray3Df* bColorArray, float Thresh, float Scale)
+{	
+	CMarchSource Src;
+	Src.Mats.push_back(pArray);
+	Src.SumMat = true;
+	Src.pColors = NULL;
+	Src.pRGB[0] = rColorArray;
+	Src.pRGB[1] = gColorArray;
+	Src.pRGB[2] = bColorArray;
+	Src.OutsideVal = -1e6;
+	March(pMeshOut, Src, Thresh, Scale);
 }
 
 
 void CMarchCube::MultiMaterial(CMesh* pMeshOut, void* pArrays, bool SumMat, CColor* pColors, float Thresh, float Scale)
 {
 	std::vector<CArray3Df>* pDA = (std::vector<CArray3Df>*) pArrays;
-	int NumMat = (*pDA).size();
-
-	int Resolution=1;
-	Scale=Scale/Resolution;
+	CMarchSource Src;
+	for (int m=0; m<(int)pDA->size(); m++) Src.Mats.push_back(&(*pDA)[m]);
+	Src.SumMat = SumMat;
+	Src.pColors = pColors;
+	Src.pRGB[0] = Src.pRGB[1] = Src.pRGB[2] = NULL;
+	Src.OutsideVal = 0;
+	March(pMeshOut, Src, Thresh, Scale);
+}
 
+void CMarchCube::March(CMesh* pMeshOut, CMarchSource& Src, float Thresh, float Scale)
+{
 	//of course, assumes cubic structure!!!
-	GRIDCELL GridCell;
 	pMeshOut->Clear();
+	if (Src.Mats.empty()) return;
+	Src.XSize = Src.Mats[0]->GetXSize();
+	Src.YSize = Src.Mats[0]->GetYSize();
+	Src.ZSize = Src.Mats[0]->GetZSize();
+
+	int NumLayers = Src.ZSize+1; //cubes between the padded planes
+	int NumThreads = 1;
+	if ((Src.XSize+2)*(Src.YSize+2)*(Src.ZSize+2) >= MC_PARALLEL_MIN){
+		NumThreads = (int)std::thread::hardware_concurrency();
+		if (NumThreads > MC_MAX_THREADS) NumThreads = MC_MAX_THREADS;
+		if (NumThreads > NumLayers/2) NumThreads = NumLayers/2;
+		if (NumThreads < 1) NumThreads = 1;
+	}
 
-	//innefficient!
-	CArray3Df Padded;
-	CArray3Df aR;
-	CArray3Df aG;
-	CArray3Df aB;
-	
-	Padded.IniSpace(((*pDA)[0].GetXSize()*Resolution)+2, ((*pDA)[0].GetYSize()*Resolution)+2, ((*pDA)[0].GetZSize()*Resolution)+2, 0);
-	aR.IniSpace(Padded.GetXSize()*Resolution, Padded.GetYSize()*Resolution, Padded.GetZSize()*Resolution, 0.0);
-	aG.IniSpace(Padded.GetXSize()*Resolution, Padded.GetYSize()*Resolution, Padded.GetZSize()*Resolution, 0.0);
-	aB.IniSpace(Padded.GetXSize()*Resolution, Padded.GetYSize()*Resolution, Padded.GetZSize()*Resolution, 0.0);
-
-	for (int i=0; i<(*pDA)[0].GetXSize()*Resolution; i++)
-		for (int j=0; j<(*pDA)[0].GetYSize()*Resolution; j++)
-			for (int k=0; k<(*pDA)[0].GetZSize()*Resolution; k++){
-
-				//find the max, for color (or for thresh, as well if !SumMat)
-				float max = -9e9f;
-//				float max = 0.0f;
-
-				for (int  m=0; m<NumMat; m++){
-					if ((*pDA)[m](i, j, k) > max){
-						max = (*pDA)[m](i, j, k);
-						if (pColors != NULL){ //grab the colors!
-							aR(i+1, j+1, k+1) = pColors[m].r;
-							aG(i+1, j+1, k+1) = pColors[m].g;
-							aB(i+1, j+1, k+1) = pColors[m].b;
-							//fill in outside of padded here if we wish...
-							}
-						}
-					}
-
-				if (SumMat){ //if we're summing the materials to create the mesh...
-					for (int  m=0; m<NumMat; m++){
-						float ToAdd = ((*pDA)[m])(i, j, k);
-						if (m==0) Padded(i+1, j+1, k+1) = ToAdd;
-						else Padded(i+1, j+1, k+1) += ToAdd;
-					}
-				}
-				else { //if we're not summing the materials...
-					Padded(i+1, j+1, k+1) = max;
-				}
-				//TRACE("%f\n", Padded(i+1, j+1, k+1));
-				}
-
+	std::vector<CMarchSlab> Slabs(NumThreads);
+	for (int t=0; t<NumThreads; t++){
+		Slabs[t].pSrc = &Src;
+		Slabs[t].Iso = Thresh;
+		Slabs[t].Scale = Scale;
+		Slabs[t].FirstLayer = NumLayers*t/NumThreads;
+		Slabs[t].LastLayer = NumLayers*(t+1)/NumThreads;
+	}
+	if (NumThreads == 1) Slabs[0].Run();
+	else {
+		std::vector<std::thread> Threads;
+		for (int t=0; t<NumThreads; t++) Threads.push_back(std::thread(&CMarchSlab::Run, &Slabs[t]));
+		for (int t=0; t<NumThreads; t++) Threads[t].join();
+	}
 
-	//form cubes
-	float ai, aj, ak; //jmc: for speed, declare them only once
-	
-	for (int i=0; i<Padded.GetXSize()*Resolution-1; i++){
-		for (int j=0; j<Padded.GetYSize()*Resolution-1; j++){
-			for (int k=0; k<Padded.GetZSize()*Resolution-1; k++){
-				ai = i-0.5f;
-				aj = j-0.5f;
-				ak = k-0.5f;
-				GridCell.p[0] = CVertex(Vec3D<>(Scale*ai, Scale*aj, Scale*ak), CColor(aR(i, j, k), aG(i, j, k), aB(i, j, k))); 
-				GridCell.val[0] = Padded(i, j, k);
-				GridCell.p[1] = CVertex(Vec3D<>(Scale*(ai+1), Scale*aj, Scale*ak), CColor(aR(i+1, j, k), aG(i+1, j, k), aB(i+1, j, k)));
-				GridCell.val[1] = Padded(i+1, j, k);
-				GridCell.p[2] = CVertex(Vec3D<>(Scale*(ai+1), Scale*(aj+1), Scale*ak), CColor(aR(i+1, j+1, k), aG(i+1, j+1, k), aB(i+1, j+1, k)));
-				GridCell.val[2] = Padded(i+1, j+1, k);
-				GridCell.p[3] = CVertex(Vec3D<>(Scale*ai, Scale*(aj+1), Scale*ak), CColor(aR(i, j+1, k), aG(i, j+1, k), aB(i, j+1, k)));
-				GridCell.val[3] = Padded(i, j+1, k);
-				GridCell.p[4] = CVertex(Vec3D<>(Scale*ai, Scale*aj, Scale*(ak+1)), CColor(aR(i, j, k+1), aG(i, j, k+1), aB(i, j, k+1)));
-				GridCell.val[4] = Padded(i, j, k+1);
-				GridCell.p[5] = CVertex(Vec3D<>(Scale*(ai+1), Scale*aj, Scale*(ak+1)), CColor(aR(i+1, j, k+1), aG(i+1, j, k+1), aB(i+1, j, k+1)));
-				GridCell.val[5] = Padded(i+1, j, k+1);
-				GridCell.p[6] = CVertex(Vec3D<>(Scale*(ai+1), Scale*(aj+1), Scale*(ak+1)), CColor(aR(i+1, j+1, k+1), aG(i+1, j+1, k+1), aB(i+1, j+1, k+1)));
-				GridCell.val[6] = Padded(i+1, j+1, k+1);
-				GridCell.p[7] = CVertex(Vec3D<>(Scale*ai, Scale*(aj+1), Scale*(ak+1)), CColor(aR(i, j+1, k+1), aG(i, j+1, k+1), aB(i, j+1, k+1)));
-				GridCell.val[7] = Padded(i, j+1, k+1);
-
-				Polygonise(GridCell, Thresh, pMeshOut); //crunch this cube and add the vertices...
+	//merge the slabs in order: vertices on the plane between two slabs were created by both, and are kept from the lower one
+	size_t NumVert = 0, NumTris = 0;
+	for (int t=0; t<NumThreads; t++){NumVert += Slabs[t].Vertices.size(); NumTris += Slabs[t].Tris.size()/3;}
+	pMeshOut->Vertices.reserve(NumVert);
+	pMeshOut->Facets.reserve(NumTris);
+
+	for (int t=0; t<NumThreads; t++){
+		CMarchSlab& S = Slabs[t];
+		S.Map.assign(S.Vertices.size(), -1);
+		if (t>0){
+			CMarchSlab& Below = Slabs[t-1];
+			for (int c=0; c<3; c++){
+				for (int n=0; n<(int)S.FirstCaches[c].size(); n++){
+					if (S.FirstCaches[c][n] != -1 && Below.LastCaches[c][n] != -1) S.Map[S.FirstCaches[c][n]] = Below.Map[Below.LastCaches[c][n]];
+				}
 			}
+			std::vector<CVertex>().swap(Below.Vertices);
+		}
+
+		for (int i=0; i<(int)S.Vertices.size(); i++){
+			if (S.Map[i] != -1) continue;
+			S.Map[i] = (int)pMeshOut->Vertices.size();
+			pMeshOut->Vertices.push_back(S.Vertices[i]);
 		}
+		for (int i=0; i<(int)S.Tris.size(); i+=3) pMeshOut->Facets.push_back(CFacet(S.Map[S.Tris[i]], S.Map[S.Tris[i+1]], S.Map[S.Tris[i+2]]));
+		std::vector<int>().swap(S.Tris);
 	}
 
-	pMeshOut->WeldClose(Scale/2);
+	pMeshOut->MeshChanged();
 	pMeshOut->CalcFaceNormals();
 	pMeshOut->CalcVertNormals();
-	//pMeshOut->WeldClose(Scale);
 }
 
 
@@ -27,6 +27,8 @@ typedef struct {
    double val[8];
 } GRIDCELL;
 
+struct CMarchSource;
+
 class CMarchCube
 {
 public:
@@ -43,6 +45,9 @@ public:
 	static int PolygoniseCube(GRIDCELL grid, double iso, CMesh* pMeshOut);
 	static int PolygoniseTet(GRIDCELL g, double iso, CMesh* pMeshOut, int v0,int v1,int v2,int v3);
 	static CVertex VertexInterp(double iso, CVertex p1, CVertex p2, double valp1, double valp2);
+
+private:
+	static void March(CMesh* pMeshOut, CMarchSource& Src, float Thresh, float Scale); //polygonises the padded field of Src in slabs of z layers on several threads, sharing the vertices of each lattice edge between its cubes (so no welding is needed)
 };
 
 #endif
@@ -295,6 +295,10 @@ bool CMesh::LoadBinarySTL(std::string filename)
 	fread(&facenum, sizeof(int), 1, fp);
 
 	Clear();
+	if (facenum > 0){
+		Facets.reserve(facenum);
+		Vertices.reserve(facenum/2+2); //closed meshes have about half as many vertices as facets
+	}
 
 	// For each triangle read the normal, the three coords and a short set to zero
 	float N[3];
@@ -713,12 +717,8 @@ void CMesh::AddFacet(const Vec3D<>& v1, const Vec3D<>& v2, const Vec3D<>& v3, co
 		FoundIndex[j] = -1;
 
 		if (!QuickAdd){
-			for (int k=Vertices.size()-1; k>=0; k--){ //DO THIS BACKWARDS!!!! (more likely to have just added one next to us...)
-				if (abs(Points[j].x - Vertices[k].v.x) < WeldThresh  &&  abs(Points[j].y - Vertices[k].v.y) < WeldThresh  &&  abs(Points[j].z - Vertices[k].v.z) < WeldThresh){ //if points are identical...
-					FoundIndex[j] = k;
-					break; //kicks out of for loop, because we've found!
-				}
-			}
+			UpdateVertexHash(2*WeldThresh); //index any vertices added since the last lookup
+			FoundIndex[j] = FindVertex(Points[j], WeldThresh); //the most recently added vertex here, like searching the list backwards
 		}
 
 		if (FoundIndex[j] == -1){ //if we didn't find one...
@@ -738,7 +738,12 @@ void CMesh::AddFacet(const Vec3D<>& v1, const Vec3D<>& v2, const Vec3D<>& v3, co
 //	for (int m=0; m<3; m++) ThisFacet.vi[m] = FoundIndex[m];
 
 	Facets.push_back(CFacet(FoundIndex[0], FoundIndex[1], FoundIndex[2])); //TODO... select whether to create new object or add to existing...
-	MeshChanged();
+
+	//invalidate the voxelizing info (but not the vertex hash, like MeshChanged() would)
+	_TriLayerZ = -1;
+	TriLayer.clear();
+	_TriLineY = -1;
+	TriLine.clear();
 
 }
 
@@ -938,7 +943,7 @@ int CMesh::GetXIntersections(vfloat z, vfloat y, vfloat* pIntersections, int Num
 }
 
 //---------------------------------------------------------------------------
-bool CMesh::InsideTri(Vec3D<>& p, Vec3D<>& v0, Vec3D<>& v1, Vec3D<>& v2)
+bool CMesh::InsideTri(const Vec3D<>& p, const Vec3D<>& v0, const Vec3D<>& v1, const Vec3D<>& v2)
 //---------------------------------------------------------------------------
 {// True if point p projects to within triangle (v0;v1;v2)
 
@@ -965,7 +970,7 @@ bool CMesh::InsideTri(Vec3D<>& p, Vec3D<>& v0, Vec3D<>& v1, Vec3D<>& v2)
 }
 
 //---------------------------------------------------------------------------
-vfloat CMesh::Det(Vec3D<>& v0, Vec3D<>& v1, Vec3D<>& v2)
+vfloat CMesh::Det(const Vec3D<>& v0, const Vec3D<>& v1, const Vec3D<>& v2)
 //---------------------------------------------------------------------------
 { // Compute determinant of 3x3 matrix v0,v1,v2
 
@@ -978,7 +983,7 @@ vfloat CMesh::Det(Vec3D<>& v0, Vec3D<>& v1, Vec3D<>& v2)
 }
 
 //---------------------------------------------------------------------------
-bool CMesh::IntersectXRay(CFacet* pFacet, vfloat y, vfloat z, Vec3D<>& p, vfloat& pu, vfloat& pv)
+bool CMesh::IntersectXRay(const CFacet* pFacet, vfloat y, vfloat z, Vec3D<>& p, vfloat& pu, vfloat& pv) const
 //---------------------------------------------------------------------------
 {
 	// compute intersection point P of triangle plane with ray from origin O in direction D
@@ -1024,39 +1029,71 @@ bool CMesh::IntersectXRay(CFacet* pFacet, vfloat y, vfloat z, Vec3D<>& p, vfloat
 
 }
 
-void CMesh::WeldClose(float Distance)
+static int WeldRoot(std::vector<int>& ConsolidateMap, int i) //iterates ConsolidateMap to get the final value, shortening the path on the way so repeated lookups stay fast
 {
-
-	int* NumVertHere = new int[Vertices.size()]; //keeps track of how many vertices have been averaged to get here...
-	int* ConsolidateMap = new int[Vertices.size()]; //maps the whole vertex list to the welded vertex list (IE has holes)
-	int* OldNewMap = new int [Vertices.size()]; //maps the old, larger vertex list to the new, smaller one.
-	for (int i=0; i<(int)Vertices.size(); i++){
-		NumVertHere[i] = 1;
-		ConsolidateMap[i] = i;
-		OldNewMap[i] = -1;
+	while (ConsolidateMap[i] != i){
+		ConsolidateMap[i] = ConsolidateMap[ConsolidateMap[i]];
+		i = ConsolidateMap[i];
 	}
+	return i;
+}
 
-	for (int i=0; i<(int)Facets.size(); i++){ //look through facets so we don't have to do exhaustive On2 search of all vertex combos
-		for (int j=0; j<3; j++){ //look at all three combinations of vertices...
-			int Vi1 = Facets[i].vi[j];
-			int np = -1; while (np != Vi1){ np = Vi1; Vi1 = ConsolidateMap[Vi1]; } //iterates NewMap to get the final value...
-
-			int Vi2 = Facets[i].vi[(j+1)%3];
-			np = -1; while (np != Vi2){ np = Vi2; Vi2 = ConsolidateMap[Vi2]; } //iterates NewMap to get the final value...
-
-			if (Vi1 != Vi2 && (Vertices[Vi1].v-Vertices[Vi2].v).Length() < Distance){ //if they are close enough but not already the same...
-				Vertices[Vi1].v = (Vertices[Vi1].v*NumVertHere[Vi1] + Vertices[Vi2].v*NumVertHere[Vi2]) / (NumVertHere[Vi1]+NumVertHere[Vi2]); //Vertex 1 is the weighted average
-				NumVertHere[Vi1] = NumVertHere[Vi1] + NumVertHere[Vi2]; //count how many vertices make up this point now...
-				
-				ConsolidateMap[Vi2] = Vi1; //effectively deletes Vi2... (points to Vi1)
+void CMesh::WeldClose(float Distance, bool AnyVertex)
+{
+	int NumVert = (int)Vertices.size();
+	std::vector<int> NumVertHere(NumVert, 1); //keeps track of how many vertices have been averaged to get here...
+	std::vector<int> ConsolidateMap(NumVert); //maps the whole vertex list to the welded vertex list (IE has holes)
+	std::vector<int> OldNewMap(NumVert, -1); //maps the old, larger vertex list to the new, smaller one.
+	for (int i=0; i<NumVert; i++) ConsolidateMap[i] = i;
+
+	if (!AnyVertex){
+		for (int i=0; i<(int)Facets.size(); i++){ //look through facets so we don't have to do exhaustive On2 search of all vertex combos
+			for (int j=0; j<3; j++){ //look at all three combinations of vertices...
+				int Vi1 = WeldRoot(ConsolidateMap, Facets[i].vi[j]);
+				int Vi2 = WeldRoot(ConsolidateMap, Facets[i].vi[(j+1)%3]);
+
+				if (Vi1 != Vi2 && (Vertices[Vi1].v-Vertices[Vi2].v).Length() < Distance){ //if they are close enough but not already the same...
+					Vertices[Vi1].v = (Vertices[Vi1].v*NumVertHere[Vi1] + Vertices[Vi2].v*NumVertHere[Vi2]) / (NumVertHere[Vi1]+NumVertHere[Vi2]); //Vertex 1 is the weighted average
+					NumVertHere[Vi1] = NumVertHere[Vi1] + NumVertHere[Vi2]; //count how many vertices make up this point now...
+					
+					ConsolidateMap[Vi2] = Vi1; //effectively deletes Vi2... (points to Vi1)
+				}
 			}
 		}
 	}
+	else if (Distance > 0){ //look up the neighbors of every vertex in the vertex hash, with cells as big as the weld distance
+		BuildVertexHash(Distance);
+		for (int i=0; i<NumVert; i++){
+			const Vec3D<>& v = Vertices[i].v;
+			long long Lo[3] = {HashCellCoord(v.x-Distance), HashCellCoord(v.y-Distance), HashCellCoord(v.z-Distance)};
+			long long Hi[3] = {HashCellCoord(v.x+Distance), HashCellCoord(v.y+Distance), HashCellCoord(v.z+Distance)};
+			for (long long ix=Lo[0]; ix<=Hi[0]; ix++){
+				for (long long iy=Lo[1]; iy<=Hi[1]; iy++){
+					for (long long iz=Lo[2]; iz<=Hi[2]; iz++){
+						std::unordered_map<unsigned long long, int>::const_iterator it = _VertHashHead.find(HashCellKey(ix, iy, iz));
+						if (it == _VertHashHead.end()) continue;
+						for (int k=it->second; k!=-1; k=_VertHashNext[k]){
+							if (k >= i || (Vertices[k].v-v).Length() >= Distance) continue; //each pair once, compared at their original positions
+							int Vi1 = WeldRoot(ConsolidateMap, k), Vi2 = WeldRoot(ConsolidateMap, i);
+							if (Vi1 == Vi2) continue;
+							if (Vi2 < Vi1) {int tmp = Vi1; Vi1 = Vi2; Vi2 = tmp;} //keep the first vertex of each group
+							NumVertHere[Vi1] += NumVertHere[Vi2];
+							ConsolidateMap[Vi2] = Vi1;
+						}
+					}
+				}
+			}
+		}
+
+		std::vector<Vec3D<> > Sum(NumVert, Vec3D<>(0,0,0)); //each group ends up at the average of its vertices
+		for (int i=0; i<NumVert; i++) Sum[WeldRoot(ConsolidateMap, i)] += Vertices[i].v;
+		for (int i=0; i<NumVert; i++) if (ConsolidateMap[i] == i && NumVertHere[i] > 1) Vertices[i].v = Sum[i]/NumVertHere[i];
+	}
 
 	std::vector<CFacet> NewFacets;
 	std::vector<CVertex> NewVertices;
 
-	for (int i=0; i<(int)Vertices.size(); i++){
+	for (int i=0; i<NumVert; i++){
 		if (ConsolidateMap[i] == i) { //if this vertex ended up being part of the welded part
 			NewVertices.push_back(Vertices[i]); //add to the new vertex list
 			OldNewMap[i] = NewVertices.size()-1;
@@ -1066,10 +1103,7 @@ void CMesh::WeldClose(float Distance)
 	//update the vertex indices
 	for (int i=0; i<(int)Facets.size(); i++){ //look through facets so we don't have to do exhaustive On2 search of all vertex combos
 		for (int j=0; j<3; j++){ //look at all three combinations of vertices...
-			int n = Facets[i].vi[j];
-			int np = -1; while (np != n){ np = n; n = ConsolidateMap[n]; } //iterates NewMap to get the final value...
-
-			Facets[i].vi[j] = OldNewMap[n];
+			Facets[i].vi[j] = OldNewMap[WeldRoot(ConsolidateMap, Facets[i].vi[j])];
 		}
 		if (!(Facets[i].vi[0] == Facets[i].vi[1] || Facets[i].vi[0] == Facets[i].vi[2] || Facets[i].vi[2] == Facets[i].vi[1])) //if there aren't any the same...
 			NewFacets.push_back(Facets[i]);
@@ -1078,13 +1112,6 @@ void CMesh::WeldClose(float Distance)
 	Facets = NewFacets;
 	Vertices = NewVertices;
 
-	delete [] NumVertHere;
-	NumVertHere = NULL;
-	delete [] ConsolidateMap;
-	ConsolidateMap = NULL;
-	delete [] OldNewMap;
-	OldNewMap = NULL;
-
 	CalcVertNormals(); //re-calculate normals!
 	MeshChanged();
 	
@@ -1123,6 +1150,83 @@ void CMesh::MeshChanged(void) //invalidates all cached voxelizing info!
 	TriLayer.clear();
 	_TriLineY = -1;
 	TriLine.clear();
+	ClearVertexHash();
+}
+
+void CMesh::ClearVertexHash(void)
+{
+	_VertHashCell = 0;
+	_VertHashBuiltCount = 0;
+	_VertHashHead.clear();
+	_VertHashNext.clear();
+}
+
+void CMesh::BuildVertexHash(vfloat Cell)
+{
+	_VertHashHead.clear();
+	_VertHashNext.clear();
+	_VertHashCell = Cell;
+	_VertHashBuiltCount = (int)Vertices.size();
+	_VertHashHead.reserve(Vertices.size());
+	_VertHashNext.reserve(Vertices.capacity());
+
+	UpdateVertexHash(Cell);
+}
+
+void CMesh::UpdateVertexHash(vfloat MinCell)
+{
+	int NumVert = (int)Vertices.size();
+	if (_VertHashCell == 0 || (int)_VertHashNext.size() > NumVert || NumVert >= 2*_VertHashBuiltCount + 16){ //first time, vertices were removed, or the mesh has doubled: choose the cell size from the current extent
+		vfloat Cell = 0;
+		if (NumVert > 0){
+			Vec3D<> Min = Vertices[0].v, Max = Vertices[0].v;
+			for (int i=1; i<NumVert; i++){
+				const Vec3D<>& v = Vertices[i].v;
+				if (v.x < Min.x) Min.x = v.x; else if (v.x > Max.x) Max.x = v.x;
+				if (v.y < Min.y) Min.y = v.y; else if (v.y > Max.y) Max.y = v.y;
+				if (v.z < Min.z) Min.z = v.z; else if (v.z > Max.z) Max.z = v.z;
+			}
+			Vec3D<> Size = Max-Min;
+			vfloat Extent = Size.x > Size.y ? (Size.x > Size.z ? Size.x : Size.z) : (Size.y > Size.z ? Size.y : Size.z);
+			Cell = Extent/sqrt((vfloat)NumVert); //about one vertex per cell for a surface mesh
+		}
+		if (!(Cell > MinCell)) Cell = MinCell; //(also catches NaN)
+		BuildVertexHash(Cell);
+		return;
+	}
+
+	for (int i=(int)_VertHashNext.size(); i<NumVert; i++){
+		const Vec3D<>& v = Vertices[i].v;
+		std::pair<std::unordered_map<unsigned long long, int>::iterator, bool> Ins = _VertHashHead.insert(std::make_pair(HashCellKey(HashCellCoord(v.x), HashCellCoord(v.y), HashCellCoord(v.z)), i));
+		_VertHashNext.push_back(Ins.second ? -1 : Ins.first->second);
+		Ins.first->second = i;
+	}
+}
+
+int CMesh::FindVertex(const Vec3D<>& p, vfloat Tolerance)
+{
+	if (_VertHashHead.empty()) return -1;
+
+	long long Lo[3] = {HashCellCoord(p.x-Tolerance), HashCellCoord(p.y-Tolerance), HashCellCoord(p.z-Tolerance)};
+	long long Hi[3] = {HashCellCoord(p.x+Tolerance), HashCellCoord(p.y+Tolerance), HashCellCoord(p.z+Tolerance)};
+
+	int Found = -1;
+	for (long long ix=Lo[0]; ix<=Hi[0]; ix++){ //the cells overlapping the tolerance box (one or two in each dimension, as cells are bigger than twice the tolerance)
+		for (long long iy=Lo[1]; iy<=Hi[1]; iy++){
+			for (long long iz=Lo[2]; iz<=Hi[2]; iz++){
+				std::unordered_map<unsigned long long, int>::const_iterator it = _VertHashHead.find(HashCellKey(ix, iy, iz));
+				if (it == _VertHashHead.end()) continue;
+				for (int k=it->second; k>Found; k=_VertHashNext[k]){ //newest first, so stop at the best found so far
+					const Vec3D<>& v = Vertices[k].v;
+					if (abs(p.x - v.x) < Tolerance  &&  abs(p.y - v.y) < Tolerance  &&  abs(p.z - v.z) < Tolerance){
+						Found = k;
+						break;
+					}
+				}
+			}
+		}
+	}
+	return Found;
 }
 
 void CMesh::FillTriLayer(vfloat z) //fills in TriHeight with all triangles that bridge this plane
@@ -12,6 +12,7 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #define MESH_H
 
 #include <vector>
+#include <unordered_map>
 #include "Vec3D.h"
 #include "XML_Rip.h"
 
@@ -118,7 +119,7 @@ public:
 	void AddQuadFacet(const Vec3D<>& v1, const Vec3D<>& v2, const Vec3D<>& v3, const Vec3D<>& v4) {AddFacet(v1, v2, v3); AddFacet(v3, v4, v1);}; //Vertices should be CCW from outside
 
 	// clear/reset the list of trianges
-	void Clear() { Facets.clear(); Vertices.clear(); Lines.clear();}
+	void Clear() { Facets.clear(); Vertices.clear(); Lines.clear(); ClearVertexHash();}
 	
 	void ComputeBoundingBox(Vec3D<>& pmin, Vec3D<>& pmax);
 	void UpdateBoundingBox(void);
@@ -136,7 +137,7 @@ public:
 	void RotZ(vfloat a);
 
 	//voxelizing stuff!
-	void MeshChanged(void); //invalidates all cached voxelizing info!
+	void MeshChanged(void); //invalidates all cached voxelizing info! (and the vertex hash: call after moving vertices)
 
 	bool IsInside(Vec3D<>* Point);
 	std::vector<int> TriLayer; //array of all triangle indices that cross the current z height
@@ -150,15 +151,27 @@ public:
 	
 
 
-	static bool InsideTri(Vec3D<>& p, Vec3D<>& v0, Vec3D<>& v1, Vec3D<>& v2);
-	static vfloat Det(Vec3D<>& v0, Vec3D<>& v1, Vec3D<>& v2);
-	bool IntersectXRay(CFacet* pFacet, vfloat y, vfloat z, Vec3D<>& p, vfloat& pu, vfloat& pv);
+	static bool InsideTri(const Vec3D<>& p, const Vec3D<>& v0, const Vec3D<>& v1, const Vec3D<>& v2);
+	static vfloat Det(const Vec3D<>& v0, const Vec3D<>& v1, const Vec3D<>& v2);
+	bool IntersectXRay(const CFacet* pFacet, vfloat y, vfloat z, Vec3D<>& p, vfloat& pu, vfloat& pv) const;
 
-	void WeldClose(float Distance); //welds vertices that are nearby (within Distance). Removes deleted triangles...
+	void WeldClose(float Distance, bool AnyVertex = false); //welds vertices that are nearby (within Distance). Removes deleted triangles... By default only vertices joined by an edge are welded, AnyVertex also welds unconnected ones (such as the duplicate corners of a triangle soup)
 	void RemoveDupLines(void);
 
 protected:
 	bool LoadBinarySTL(std::string filename);
 	bool LoadAsciiSTL(std::string filename);
+
+	//spatial hash of the vertex positions, so AddFacet() finds existing vertices in constant time (vertices appended to Vertices are indexed lazily, vertices moved in place need MeshChanged())
+	vfloat _VertHashCell; //size of the cubic hash cells (0 if not built)
+	int _VertHashBuiltCount; //number of vertices when the cell size was chosen
+	std::unordered_map<unsigned long long, int> _VertHashHead; //last vertex indexed in each cell
+	std::vector<int> _VertHashNext; //previous vertex indexed in the same cell, for each vertex indexed so far (-1 if none)
+	void ClearVertexHash(void);
+	void BuildVertexHash(vfloat Cell); //indexes all vertices with this cell size
+	void UpdateVertexHash(vfloat MinCell); //indexes the vertices added since the last call, choosing a new cell size each time the mesh doubles
+	int FindVertex(const Vec3D<>& p, vfloat Tolerance); //returns the highest index of the vertices within Tolerance of p in each dimension, or -1 if none
+	long long HashCellCoord(vfloat c) const {vfloat q = floor(c/_VertHashCell); if (!(q > -1e15)) q = -1e15; else if (q > 1e15) q = 1e15; return (long long)q;} //cell index along one dimension (clamped, NaN safe)
+	static unsigned long long HashCellKey(long long ix, long long iy, long long iz) {return (unsigned long long)ix*73856093ULL ^ (unsigned long long)iy*19349663ULL ^ (unsigned long long)iz*83492791ULL;} //different cells may share a key: candidates are always checked against the actual positions
 };
 #endif
@@ -0,0 +1,144 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#include "MeshBVH.h"
+#include <algorithm>
+
+#define BVH_LEAF_SIZE 4 //most facets in a leaf
+#define BVH_MAX_DEPTH 64 //traversal stack (median splits keep the tree balanced, so this is never reached)
+
+struct CBVHCenterLess { //orders facets by the center of their box along one axis
+	CBVHCenterLess(const std::vector<vfloat>& CenterIn, int AxisIn) : Center(CenterIn), Axis(AxisIn) {}
+	bool operator()(int a, int b) const {return Center[2*a+Axis] < Center[2*b+Axis];}
+	const std::vector<vfloat>& Center;
+	int Axis;
+};
+
+void CMeshBVH::Build(const CMesh* pMeshIn)
+{
+	Clear();
+	pMesh = pMeshIn;
+	int NumFacets = (int)pMesh->Facets.size();
+	if (NumFacets == 0) return;
+
+	std::vector<vfloat> Box(4*NumFacets), Center(2*NumFacets);
+	for (int i=0; i<NumFacets; i++){
+		const Vec3D<>& a = pMesh->Vertices[pMesh->Facets[i].vi[0]].v;
+		const Vec3D<>& b = pMesh->Vertices[pMesh->Facets[i].vi[1]].v;
+		const Vec3D<>& c = pMesh->Vertices[pMesh->Facets[i].vi[2]].v;
+		Box[4*i] = std::min(a.y, std::min(b.y, c.y));
+		Box[4*i+1] = std::max(a.y, std::max(b.y, c.y));
+		Box[4*i+2] = std::min(a.z, std::min(b.z, c.z));
+		Box[4*i+3] = std::max(a.z, std::max(b.z, c.z));
+		Center[2*i] = 0.5*(Box[4*i]+Box[4*i+1]);
+		Center[2*i+1] = 0.5*(Box[4*i+2]+Box[4*i+3]);
+	}
+	FacetBox.swap(Box);
+
+	FacetOrder.resize(NumFacets);
+	for (int i=0; i<NumFacets; i++) FacetOrder[i] = i;
+	Nodes.reserve(2*NumFacets/BVH_LEAF_SIZE+1);
+	BuildNode(0, NumFacets, Center);
+
+	//store the facet boxes in leaf order, so each leaf reads them contiguously
+	Box.resize(4*NumFacets);
+	for (int i=0; i<NumFacets; i++) for (int j=0; j<4; j++) Box[4*i+j] = FacetBox[4*FacetOrder[i]+j];
+	FacetBox.swap(Box);
+}
+
+void CMeshBVH::Clear(void)
+{
+	pMesh = NULL;
+	Nodes.clear();
+	FacetOrder.clear();
+	FacetBox.clear();
+}
+
+int CMeshBVH::BuildNode(int First, int Count, std::vector<vfloat>& Center)
+{
+	CBVHNode ThisNode;
+	ThisNode.YMin = ThisNode.ZMin = 1e300;
+	ThisNode.YMax = ThisNode.ZMax = -1e300;
+	vfloat CYMin = 1e300, CYMax = -1e300, CZMin = 1e300, CZMax = -1e300; //bounds of the centers, to pick the split axis
+	for (int i=First; i<First+Count; i++){
+		int f = FacetOrder[i];
+		ThisNode.YMin = std::min(ThisNode.YMin, FacetBox[4*f]);
+		ThisNode.YMax = std::max(ThisNode.YMax, FacetBox[4*f+1]);
+		ThisNode.ZMin = std::min(ThisNode.ZMin, FacetBox[4*f+2]);
+		ThisNode.ZMax = std::max(ThisNode.ZMax, FacetBox[4*f+3]);
+		CYMin = std::min(CYMin, Center[2*f]); CYMax = std::max(CYMax, Center[2*f]);
+		CZMin = std::min(CZMin, Center[2*f+1]); CZMax = std::max(CZMax, Center[2*f+1]);
+	}
+
+	int Index = (int)Nodes.size();
+	ThisNode.First = First;
+	ThisNode.Count = Count;
+	Nodes.push_back(ThisNode);
+	if (Count <= BVH_LEAF_SIZE) return Index;
+
+	//split at the median along the longer axis
+	int Half = Count/2;
+	int Axis = (CZMax-CZMin > CYMax-CYMin) ? 1 : 0;
+	std::nth_element(FacetOrder.begin()+First, FacetOrder.begin()+First+Half, FacetOrder.begin()+First+Count, CBVHCenterLess(Center, Axis));
+
+	BuildNode(First, Half, Center); //left child: Index+1
+	int Right = BuildNode(First+Half, Count-Half, Center);
+	Nodes[Index].First = Right;
+	Nodes[Index].Count = 0;
+	return Index;
+}
+
+int CMeshBVH::GetXIntersections(vfloat y, vfloat z, std::vector<vfloat>* pIntersections) const
+{
+	pIntersections->clear();
+	if (Nodes.empty()) return 0;
+
+	Vec3D<> p;
+	vfloat pu, pv;
+	int Stack[BVH_MAX_DEPTH];
+	int Top = 0;
+	Stack[Top++] = 0;
+	while (Top > 0){
+		int NodeIndex = Stack[--Top];
+		const CBVHNode& ThisNode = Nodes[NodeIndex];
+		if (y < ThisNode.YMin || y > ThisNode.YMax || !(z > ThisNode.ZMin && z < ThisNode.ZMax)) continue; //same (inclusive in y, exclusive in z) as the facet tests below
+
+		if (ThisNode.Count == 0){
+			if (Top+2 > BVH_MAX_DEPTH) continue; //(cannot happen)
+			Stack[Top++] = ThisNode.First;
+			Stack[Top++] = NodeIndex+1;
+			continue;
+		}
+
+		for (int i=ThisNode.First; i<ThisNode.First+ThisNode.Count; i++){
+			const vfloat* pBox = &FacetBox[4*i];
+			if (!(pBox[2] < z && pBox[3] > z)) continue; //not strictly across the z plane (as in CMesh::FillTriLayer())
+			if (pBox[1] < y || pBox[0] > y) continue; //all on one side of the y line (as in CMesh::FillTriLine())
+
+			const CFacet& ThisFacet = pMesh->Facets[FacetOrder[i]];
+			if (pMesh->IntersectXRay(&ThisFacet, y, z, p, pu, pv) && CMesh::InsideTri(p, pMesh->Vertices[ThisFacet.vi[0]].v, pMesh->Vertices[ThisFacet.vi[1]].v, pMesh->Vertices[ThisFacet.vi[2]].v))
+				pIntersections->push_back(p.x);
+		}
+	}
+
+	std::sort(pIntersections->begin(), pIntersections->end());
+	return (int)pIntersections->size();
+}
+
+int CMeshBVH::GetDepth(void) const
+{
+	return Nodes.empty() ? 0 : NodeDepth(0);
+}
+
+int CMeshBVH::NodeDepth(int Node) const
+{
+	if (Nodes[Node].Count != 0) return 1;
+	return 1 + std::max(NodeDepth(Node+1), NodeDepth(Nodes[Node].First));
+}
@@ -0,0 +1,49 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#ifndef MESHBVH_H
+#define MESHBVH_H
+
+#include "Mesh.h"
+#include <vector>
+
+//bounding volume hierarchy of the facets of a mesh, for casting rays in the x direction (as CMesh::IsInside() does to voxelize)
+//Since every ray is parallel to x, the boxes only bound y and z. Build() once, then GetXIntersections() may be called from several threads at once (the mesh must not change in between).
+class CMeshBVH
+{
+public:
+	CMeshBVH(void) {pMesh = NULL;}
+	~CMeshBVH(void) {}
+
+	void Build(const CMesh* pMeshIn); //builds the hierarchy over all facets of pMeshIn
+	void Clear(void);
+	bool IsBuilt(void) const {return pMesh != NULL;}
+
+	int GetXIntersections(vfloat y, vfloat z, std::vector<vfloat>* pIntersections) const; //fills pIntersections with the sorted x coordinates where the line through (y, z) parallel to x crosses the mesh, with the same test as CMesh::IsInside(). Returns their number.
+	static bool IsInside(vfloat x, const std::vector<vfloat>& Intersections) {int Count = 0; while (Count < (int)Intersections.size() && !(x < Intersections[Count])) Count++; return Count%2 == 1;} //true if x is past an odd number of intersections
+
+	int GetDepth(void) const; //number of levels (for benchmarks)
+
+private:
+	struct CBVHNode {
+		vfloat YMin, YMax, ZMin, ZMax; //bounds of all facets below this node
+		int First, Count; //leaf: Count facets starting at FacetOrder[First]. Inner node (Count == 0): the left child follows this node, the right one is Nodes[First]
+	};
+
+	const CMesh* pMesh;
+	std::vector<CBVHNode> Nodes; //depth first, root first
+	std::vector<int> FacetOrder; //facet indices, grouped by leaf
+	std::vector<vfloat> FacetBox; //YMin, YMax, ZMin, ZMax of each facet (in FacetOrder)
+
+	int BuildNode(int First, int Count, std::vector<vfloat>& Center); //returns the index of the new node
+	int NodeDepth(int Node) const;
+};
+
+#endif //MESHBVH_H
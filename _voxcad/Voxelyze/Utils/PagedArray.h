@@ -0,0 +1,52 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#ifndef CPAGEDARRAY_H
+#define CPAGEDARRAY_H
+
+#include <vector>
+
+//!Sparse 1D array allocated in fixed-size pages
+/*!Behaves like a dense array of Size elements that are all Default until set. Storage is only allocated for pages (2^PageBits consecutive elements) that have been set to something other than Default, so a mostly empty workspace costs memory in proportion to the number of occupied pages rather than its volume. Element access is a shift and a mask. NextSet() skips unallocated pages, which lets callers iterate over the occupied elements in index order without touching the empty ones.*/
+template <typename T, int PageBits = 10>
+class CPagedArray
+{
+public:
+	CPagedArray(void) : Count(0), Default(T()) {} //!< Constructor
+
+	void Resize(int Size, T DefaultIn = T()) {Pages.clear(); Count = Size > 0 ? Size : 0; Default = DefaultIn; Pages.resize((Count+PageSize-1)>>PageBits);} //!< Sets every element to DefaultIn and releases all pages. @param[in] Size Number of elements. @param[in] DefaultIn Value of all elements that have not been set.
+	void Clear(void) {Pages.clear(); Count = 0;} //!< Releases everything.
+	int Size(void) const {return Count;} //!< Returns the number of elements.
+	T GetDefault(void) const {return Default;} //!< Returns the value of elements that have not been set.
+
+	T operator [](int i) const {const std::vector<T>& ThisPage = Pages[i>>PageBits]; return ThisPage.empty() ? Default : ThisPage[i&PageMask];} //!< Returns element i. @param[in] i Index of the element (0 to Size()-1).
+	void Set(int i, T Value) {std::vector<T>& ThisPage = Pages[i>>PageBits]; if (ThisPage.empty()){if (Value == Default) return; ThisPage.assign(PageSize, Default);} ThisPage[i&PageMask] = Value;} //!< Sets element i, allocating its page if needed. @param[in] i Index of the element (0 to Size()-1). @param[in] Value The new value.
+
+	int NextSet(int i) const { //!< Returns the index of the first element at or after i that is not Default, or -1 if there is none. @param[in] i Index to start searching from.
+		if (i < 0) i = 0;
+		for (int p = i>>PageBits; p < (int)Pages.size(); p++, i = p<<PageBits){
+			const std::vector<T>& ThisPage = Pages[p];
+			if (ThisPage.empty()) continue;
+			for (int k = i&PageMask; k < PageSize && (p<<PageBits)+k < Count; k++) if (!(ThisPage[k] == Default)) return (p<<PageBits)+k;
+		}
+		return -1;
+	}
+	int NumPagesAllocated(void) const {int n=0; for (int p=0; p<(int)Pages.size(); p++) if (!Pages[p].empty()) n++; return n;} //!< Returns the number of pages holding storage.
+
+	static const int PageSize = 1<<PageBits; //!< Number of elements per page.
+
+private:
+	static const int PageMask = PageSize-1;
+	std::vector<std::vector<T> > Pages; //empty vector: page not allocated (all Default)
+	int Count;
+	T Default;
+};
+
+#endif //CPAGEDARRAY_H
@@ -0,0 +1,379 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#include "XML_Pull.h"
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <fstream>
+#ifdef _WIN32
+#define XML_PULL_NO_MMAP
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static inline bool IsXmlSpace(char c) {return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';}
+static inline bool IsNameEnd(char c) {return IsXmlSpace(c) || c == '/' || c == '>';}
+
+static const char* FindStr(const char* p, const char* End, const char* Str) //first occurrence of Str in [p, End) or NULL
+{
+	size_t Len = strlen(Str);
+	while (p + Len <= End){
+		p = (const char*)memchr(p, Str[0], End-p-Len+1);
+		if (!p) return NULL;
+		if (memcmp(p, Str, Len) == 0) return p;
+		p++;
+	}
+	return NULL;
+}
+
+static inline bool StartsWith(const char* p, const char* End, const char* Str)
+{
+	size_t Len = strlen(Str);
+	return (size_t)(End-p) >= Len && memcmp(p, Str, Len) == 0;
+}
+
+CXML_PullDoc::CXML_PullDoc(void)
+{
+	Data = NULL;
+	Size = 0;
+	pMap = NULL;
+	MapSize = 0;
+}
+
+CXML_PullDoc::~CXML_PullDoc(void)
+{
+	Clear();
+}
+
+void CXML_PullDoc::Clear(void)
+{
+#ifndef XML_PULL_NO_MMAP
+	if (pMap) munmap(pMap, MapSize);
+#endif
+	pMap = NULL;
+	MapSize = 0;
+	Buffer.clear();
+	Data = NULL;
+	Size = 0;
+	Nodes.clear();
+}
+
+bool CXML_PullDoc::LoadFile(std::string filename, std::string* pRetMsg)
+{
+	Clear();
+
+#ifndef XML_PULL_NO_MMAP
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0){
+		if (pRetMsg) *pRetMsg += "Xml read error: could not open " + filename + "\n";
+		return false;
+	}
+	struct stat St;
+	if (fstat(fd, &St) == 0 && St.st_size > 0){
+		void* pTry = mmap(NULL, (size_t)St.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (pTry != MAP_FAILED){
+			pMap = pTry;
+			MapSize = (size_t)St.st_size;
+			Data = (const char*)pMap;
+			Size = MapSize;
+#ifdef MADV_SEQUENTIAL
+			madvise(pMap, MapSize, MADV_SEQUENTIAL); //single forward pass
+#endif
+		}
+	}
+	close(fd);
+#endif
+
+	if (!Data){ //no mapping available (or empty/special file): read it in one block
+		std::ifstream File(filename.c_str(), std::ios::in | std::ios::binary);
+		if (!File.is_open()){
+			if (pRetMsg) *pRetMsg += "Xml read error: could not open " + filename + "\n";
+			return false;
+		}
+		std::ostringstream Contents;
+		Contents << File.rdbuf();
+		Buffer = Contents.str();
+		Data = Buffer.data();
+		Size = Buffer.size();
+	}
+
+	return BuildIndex(pRetMsg);
+}
+
+bool CXML_PullDoc::LoadText(const std::string& Text, std::string* pRetMsg)
+{
+	Clear();
+	Buffer = Text;
+	Data = Buffer.data();
+	Size = Buffer.size();
+	return BuildIndex(pRetMsg);
+}
+
+bool CXML_PullDoc::Error(const char* Where, const char* Msg, std::string* pRetMsg)
+{
+	if (pRetMsg){
+		int Line = 1;
+		for (const char* p = Data; p < Where; p++) if (*p == '\n') Line++;
+		std::ostringstream os;
+		os << "Xml read error: " << Msg << " (line " << Line << ")\n";
+		*pRetMsg += os.str();
+	}
+	Clear();
+	return false;
+}
+
+bool CXML_PullDoc::BuildIndex(std::string* pRetMsg)
+{
+	Nodes.clear();
+	const char* p = Data;
+	const char* End = Data + Size;
+	if (StartsWith(p, End, "\xEF\xBB\xBF")) p += 3; //UTF-8 byte order mark
+
+	std::vector<int> Open; //stack of elements whose end tag has not been seen yet
+	std::vector<int> LastChild; //last child element of each open element
+	std::vector<char> HasContent; //whether each open element has any child node yet (only the first one can be its text)
+	int LastTopLevel = -1;
+
+	while (p < End){
+		const char* Lt = (const char*)memchr(p, '<', End-p);
+		const char* TextEnd = Lt ? Lt : End;
+
+		//character data up to the next tag
+		if (!Open.empty()){
+			const char* t = p;
+			while (t < TextEnd && IsXmlSpace(*t)) t++;
+			if (t < TextEnd){ //blank runs are not nodes (same as TinyXML when condensing whitespace)
+				if (!HasContent.back()){
+					const char* e = TextEnd;
+					while (e > t && IsXmlSpace(*(e-1))) e--;
+					CXML_PullNode& Cur = Nodes[Open.back()];
+					Cur.Text = t;
+					Cur.TextLength = (int)(e-t);
+					Cur.TextIsCDATA = false;
+				}
+				HasContent.back() = 1;
+			}
+		}
+		if (!Lt) break;
+		p = Lt;
+
+		if (StartsWith(p, End, "<![CDATA[")){
+			const char* s = p + 9;
+			const char* e = FindStr(s, End, "]]>");
+			if (!e) return Error(p, "Unterminated CDATA section", pRetMsg);
+			if (Open.empty()) return Error(p, "CDATA section outside of the root element", pRetMsg);
+			if (!HasContent.back()){
+				CXML_PullNode& Cur = Nodes[Open.back()];
+				Cur.Text = s;
+				Cur.TextLength = (int)(e-s);
+				Cur.TextIsCDATA = true;
+			}
+			HasContent.back() = 1;
+			p = e + 3;
+		}
+		else if (StartsWith(p, End, "<!--")){
+			const char* e = FindStr(p+4, End, "-->");
+			if (!e) return Error(p, "Unterminated comment", pRetMsg);
+			if (!Open.empty()) HasContent.back() = 1;
+			p = e + 3;
+		}
+		else if (StartsWith(p, End, "<?")){
+			const char* e = FindStr(p+2, End, "?>");
+			if (!e) return Error(p, "Unterminated declaration", pRetMsg);
+			p = e + 2;
+		}
+		else if (StartsWith(p, End, "<!")){ //DOCTYPE etc.
+			const char* e = (const char*)memchr(p, '>', End-p);
+			if (!e) return Error(p, "Unterminated declaration", pRetMsg);
+			p = e + 1;
+		}
+		else if (StartsWith(p, End, "</")){
+			const char* n = p + 2;
+			const char* ne = n;
+			while (ne < End && !IsNameEnd(*ne)) ne++;
+			if (Open.empty()) return Error(p, "End tag without a start tag", pRetMsg);
+			const CXML_PullNode& Cur = Nodes[Open.back()];
+			if (ne-n != Cur.NameLength || memcmp(n, Cur.Name, ne-n) != 0) return Error(p, ("Mismatched end tag </" + std::string(n, ne) + ">").c_str(), pRetMsg);
+			while (ne < End && IsXmlSpace(*ne)) ne++;
+			if (ne >= End || *ne != '>') return Error(p, "Malformed end tag", pRetMsg);
+			Open.pop_back();
+			LastChild.pop_back();
+			HasContent.pop_back();
+			p = ne + 1;
+		}
+		else { //start tag
+			const char* n = p + 1;
+			const char* ne = n;
+			while (ne < End && !IsNameEnd(*ne)) ne++;
+			if (ne == n) return Error(p, "Missing tag name", pRetMsg);
+
+			const char* q = ne; //find the closing '>' (not inside a quoted attribute value)
+			char Quote = 0;
+			while (q < End && (Quote || *q != '>')){
+				if (Quote){if (*q == Quote) Quote = 0;}
+				else if (*q == '"' || *q == '\'') Quote = *q;
+				q++;
+			}
+			if (q >= End) return Error(p, "Unterminated start tag", pRetMsg);
+			bool EmptyElement = (*(q-1) == '/');
+
+			CXML_PullNode NewNode;
+			NewNode.Name = n;
+			NewNode.NameLength = (int)(ne-n);
+			NewNode.Attributes = ne;
+			NewNode.AttributesLength = (int)((EmptyElement ? q-1 : q) - ne);
+			NewNode.Text = NULL;
+			NewNode.TextLength = 0;
+			NewNode.TextIsCDATA = false;
+			NewNode.FirstChild = -1;
+			NewNode.NextSibling = -1;
+			int ThisIndex = (int)Nodes.size();
+			Nodes.push_back(NewNode);
+
+			if (Open.empty()){
+				if (LastTopLevel != -1) Nodes[LastTopLevel].NextSibling = ThisIndex;
+				LastTopLevel = ThisIndex;
+			}
+			else {
+				if (LastChild.back() == -1) Nodes[Open.back()].FirstChild = ThisIndex;
+				else Nodes[LastChild.back()].NextSibling = ThisIndex;
+				LastChild.back() = ThisIndex;
+				HasContent.back() = 1;
+			}
+
+			if (!EmptyElement){
+				Open.push_back(ThisIndex);
+				LastChild.push_back(-1);
+				HasContent.push_back(0);
+			}
+			p = q + 1;
+		}
+	}
+
+	if (!Open.empty()){
+		const CXML_PullNode& Cur = Nodes[Open.back()];
+		return Error(End, ("Unclosed element <" + std::string(Cur.Name, Cur.NameLength) + ">").c_str(), pRetMsg);
+	}
+	if (Nodes.empty()) return Error(End, "No root element", pRetMsg);
+	return true;
+}
+
+void CXML_PullDoc::AppendText(const char* Begin, const char* End, bool Decode, bool Condense, std::string* pString)
+{
+	static const struct {const char* Str; int Len; char Chr;} Entities[] = {{"&amp;", 5, '&'}, {"&lt;", 4, '<'}, {"&gt;", 4, '>'}, {"&quot;", 6, '\"'}, {"&apos;", 6, '\''}};
+
+	bool Whitespace = false;
+	for (const char* p = Begin; p < End; ){
+		char c = *p;
+		if (Condense && IsXmlSpace(c)){Whitespace = true; p++; continue;}
+		if (Whitespace){*pString += ' '; Whitespace = false;}
+
+		if (c == '\r'){ //TinyXML normalizes all line breaks to '\n' on load
+			*pString += '\n';
+			p += (p+1 < End && *(p+1) == '\n') ? 2 : 1;
+		}
+		else if (c == '&' && Decode){
+			const char* Semi = (const char*)memchr(p, ';', End-p);
+			bool Found = false;
+			if (Semi && p+1 < End && *(p+1) == '#'){ //numeric character reference
+				bool Hex = (p+2 < End && *(p+2) == 'x');
+				char* NumEnd;
+				unsigned long ucs = strtoul(p + (Hex ? 3 : 2), &NumEnd, Hex ? 16 : 10);
+				if (NumEnd == Semi){
+					if (ucs < 0x100) *pString += (char)ucs;
+					else if (ucs < 0x800){*pString += (char)(0xC0 | (ucs >> 6)); *pString += (char)(0x80 | (ucs & 0x3F));}
+					else if (ucs < 0x10000){*pString += (char)(0xE0 | (ucs >> 12)); *pString += (char)(0x80 | ((ucs >> 6) & 0x3F)); *pString += (char)(0x80 | (ucs & 0x3F));}
+					else {*pString += (char)(0xF0 | (ucs >> 18)); *pString += (char)(0x80 | ((ucs >> 12) & 0x3F)); *pString += (char)(0x80 | ((ucs >> 6) & 0x3F)); *pString += (char)(0x80 | (ucs & 0x3F));}
+					p = Semi + 1;
+					Found = true;
+				}
+			}
+			else {
+				for (int i=0; i<(int)(sizeof(Entities)/sizeof(Entities[0])); i++){
+					if (End-p >= Entities[i].Len && memcmp(p, Entities[i].Str, Entities[i].Len) == 0){
+						*pString += Entities[i].Chr;
+						p += Entities[i].Len;
+						Found = true;
+						break;
+					}
+				}
+			}
+			if (!Found){*pString += '&'; p++;} //unrecognized: keep it literally
+		}
+		else {
+			const char* Run = p + 1; //copy plain runs in one go
+			while (Run < End && *Run != '\r' && *Run != '&' && !(Condense && IsXmlSpace(*Run))) Run++;
+			pString->append(p, Run-p);
+			p = Run;
+		}
+	}
+}
+
+bool CXML_PullDoc::GetText(int Index, std::string* pString) const
+{
+	const CXML_PullNode& ThisNode = Nodes[Index];
+	if (!ThisNode.Text) return false;
+	pString->clear();
+	AppendText(ThisNode.Text, ThisNode.Text + ThisNode.TextLength, !ThisNode.TextIsCDATA, !ThisNode.TextIsCDATA, pString);
+	return true;
+}
+
+bool CXML_PullDoc::GetTextView(int Index, const char** ppData, int* pLength) const
+{
+	const CXML_PullNode& ThisNode = Nodes[Index];
+	if (!ThisNode.Text) return false;
+	const char* End = ThisNode.Text + ThisNode.TextLength;
+	if (ThisNode.TextIsCDATA){
+		if (memchr(ThisNode.Text, '\r', ThisNode.TextLength)) return false;
+	}
+	else {
+		for (const char* p = ThisNode.Text; p < End; p++){
+			if (*p == '&' || (IsXmlSpace(*p) && (*p != ' ' || IsXmlSpace(*(p+1))))) return false; //would be changed by decoding/condensing (ends are already trimmed)
+		}
+	}
+	*ppData = ThisNode.Text;
+	*pLength = ThisNode.TextLength;
+	return true;
+}
+
+bool CXML_PullDoc::GetAttribute(int Index, const std::string& Att, std::string* pString) const
+{
+	const CXML_PullNode& ThisNode = Nodes[Index];
+	const char* p = ThisNode.Attributes;
+	const char* End = p + ThisNode.AttributesLength;
+
+	while (p < End){
+		while (p < End && IsXmlSpace(*p)) p++;
+		const char* n = p;
+		while (p < End && *p != '=' && !IsXmlSpace(*p)) p++;
+		const char* ne = p;
+		while (p < End && IsXmlSpace(*p)) p++;
+		if (p >= End || *p != '=') return false;
+		p++;
+		while (p < End && IsXmlSpace(*p)) p++;
+		if (p >= End || (*p != '"' && *p != '\'')) return false;
+		char Quote = *p++;
+		const char* v = p;
+		while (p < End && *p != Quote) p++;
+		if (p >= End) return false;
+
+		if ((size_t)(ne-n) == Att.size() && Att.compare(0, Att.size(), n, ne-n) == 0){
+			pString->clear();
+			AppendText(v, p, true, false, pString);
+			return true;
+		}
+		p++;
+	}
+	return false;
+}
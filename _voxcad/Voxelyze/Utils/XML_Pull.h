@@ -0,0 +1,70 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#ifndef CXML_PULL_H
+#define CXML_PULL_H
+
+#include <string>
+#include <vector>
+
+//!One element of a CXML_PullDoc. All pointers are views into the document buffer.
+struct CXML_PullNode
+{
+	const char* Name; //!< Start of the tag name.
+	int NameLength; //!< Length of the tag name.
+	const char* Attributes; //!< Start of the raw attribute list (everything between the tag name and the closing '>' or '/>').
+	int AttributesLength; //!< Length of the raw attribute list.
+	const char* Text; //!< Start of the first child if it is text or CDATA, otherwise NULL.
+	int TextLength; //!< Length of the first text child.
+	bool TextIsCDATA; //!< True if the first child is a CDATA section (returned verbatim), false if it is character data (whitespace condensed, entities decoded).
+	int FirstChild; //!< Index of the first child element or -1.
+	int NextSibling; //!< Index of the next sibling element or -1.
+};
+
+//!Lightweight read-only XML document
+/*!The file is memory-mapped (read in one block where mapping is unavailable) and scanned once in a single forward pass that records the position of every element, its attribute list and its first text child in a flat array. Nothing is copied or decoded until a value is actually requested, so large CDATA sections (voxel layers, controller weights) are never duplicated. Supports the subset of XML written by Voxelyze and VoxCad: elements, attributes, character data, CDATA, comments, processing instructions and DOCTYPE declarations (skipped).*/
+class CXML_PullDoc
+{
+public:
+	CXML_PullDoc(void); //!< Constructor
+	~CXML_PullDoc(void); //!< Destructor
+
+	bool LoadFile(std::string filename, std::string* pRetMsg = NULL); //!< Maps and indexes an XML file. Returns false and appends to pRetMsg if the file cannot be read or is not well formed. @param[in] filename Path to the file. @param[out] pRetMsg Optional error message.
+	bool LoadText(const std::string& Text, std::string* pRetMsg = NULL); //!< Indexes a copy of an in-memory XML document. @param[in] Text The XML document. @param[out] pRetMsg Optional error message.
+	void Clear(void); //!< Releases the buffer and all indexed elements.
+
+	int Root(void) const {return Nodes.empty() ? -1 : 0;} //!< Returns the index of the root element or -1 if nothing is loaded.
+	int NumNodes(void) const {return (int)Nodes.size();} //!< Returns the number of indexed elements.
+	const CXML_PullNode& Node(int Index) const {return Nodes[Index];} //!< Returns an indexed element. @param[in] Index Index of the element.
+	int FirstChild(int Index) const {return Nodes[Index].FirstChild;} //!< Returns the first child element of an element or -1. @param[in] Index Index of the parent element.
+	int NextSibling(int Index) const {return Nodes[Index].NextSibling;} //!< Returns the next sibling element of an element or -1. @param[in] Index Index of the element.
+	bool NameIs(int Index, const std::string& Tag) const {return Tag.size() == (size_t)Nodes[Index].NameLength && Tag.compare(0, Tag.size(), Nodes[Index].Name, Nodes[Index].NameLength) == 0;} //!< Returns true if the tag name of an element matches. @param[in] Index Index of the element. @param[in] Tag Tag name to compare against.
+
+	bool GetText(int Index, std::string* pString) const; //!< Copies the first text child of an element into pString with the same whitespace and entity handling as TinyXML. Returns false if the first child is not text. @param[in] Index Index of the element. @param[out] pString The text.
+	bool GetTextView(int Index, const char** ppData, int* pLength) const; //!< Returns a pointer into the buffer for the first text child of an element if it can be used without decoding (CDATA or plain character data without entities, line breaks or runs of whitespace). Returns false otherwise. @param[in] Index Index of the element. @param[out] ppData Start of the text. @param[out] pLength Length of the text.
+	bool GetAttribute(int Index, const std::string& Att, std::string* pString) const; //!< Copies the decoded value of an attribute into pString. Returns false if the element does not have this attribute. @param[in] Index Index of the element. @param[in] Att Attribute name. @param[out] pString The value.
+
+private:
+	const char* Data; //pointer to the document (mapped file or Buffer)
+	size_t Size; //size of the document in bytes
+	void* pMap; //base of the mapping (NULL if Buffer is used)
+	size_t MapSize;
+	std::string Buffer; //holds the document when it could not be mapped
+	std::vector<CXML_PullNode> Nodes;
+
+	CXML_PullDoc(const CXML_PullDoc&); //not copyable: Nodes point into the mapping
+	CXML_PullDoc& operator=(const CXML_PullDoc&);
+
+	bool BuildIndex(std::string* pRetMsg); //scans the whole document, filling in Nodes
+	bool Error(const char* Where, const char* Msg, std::string* pRetMsg); //reports a parse error with its line number and clears everything
+	static void AppendText(const char* Begin, const char* End, bool Decode, bool Condense, std::string* pString); //appends text with line breaks normalized and (optionally) entities decoded and whitespace condensed the same way TinyXML does
+};
+
+#endif //CXML_PULL_H
@@ -13,8 +13,13 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #include <QTextStream>
 #endif
 
+bool CXML_Rip::DefaultPullParser = false;
+
 CXML_Rip::CXML_Rip(void)
 {
+	UsePullParser = DefaultPullParser;
+	PullLoaded = false;
+
 #ifndef QT_XML_LIB
 	TiXmlDeclaration* declaration = new TiXmlDeclaration( "1.0", "", "" );
 	doc.LinkEndChild(declaration);
@@ -53,12 +58,26 @@ void CXML_Rip::toXMLText(std::string* Text)
 	QString tmp = doc.toString(Indent);
 	*Text = tmp.toStdString();
 #else //TINY_XML
-	//implement me!
+	TiXmlPrinter Printer;
+	doc.Accept(&Printer);
+	*Text = Printer.CStr();
 #endif
 }
 
 bool CXML_Rip::LoadFile(std::string filename, std::string* pRetMsg) 
 {
+	PullLoaded = false;
+	PullStack.clear();
+	ViewCopies.clear();
+	if (UsePullParser){
+		if (!PullDoc.LoadFile(filename, pRetMsg)) return false;
+		PullLoaded = true;
+		PullStack.push_back(PullDoc.Root()); //start with the root element!
+		StrStack.clear();
+		StrStack.push_back("Root");
+		return true;
+	}
+
 #ifdef QT_XML_LIB
 	file.setFileName(filename.c_str());
 	QString ErrorMsg;
@@ -85,6 +104,18 @@ bool CXML_Rip::LoadFile(std::string filename, std::string* pRetMsg)
 
 bool CXML_Rip::fromXMLText(std::string* Text) 
 {
+	PullLoaded = false;
+	PullStack.clear();
+	ViewCopies.clear();
+	if (UsePullParser){
+		if (!PullDoc.LoadText(*Text)) return false;
+		PullLoaded = true;
+		PullStack.push_back(PullDoc.Root()); //start with the root element!
+		StrStack.clear();
+		StrStack.push_back("Root");
+		return true;
+	}
+
 #ifdef QT_XML_LIB
 	if (!doc.setContent(QString(Text->c_str()), true)) return false;
 	ElStack.clear();
@@ -119,7 +150,8 @@ void CXML_Rip::DownLevel(std::string tag)
 
 void CXML_Rip::UpLevel(void)
 {
-	ElStack.pop_back();
+	if (PullLoaded) PullStack.pop_back();
+	else ElStack.pop_back();
 	StrStack.pop_back();
 }
 
@@ -160,6 +192,25 @@ void CXML_Rip::SetElAttribute(std::string Att, std::string Value){
 
 bool CXML_Rip::FindElement(std::string tag) //finds element if it exists and appends ptr to stack. if called subsequently with the same tag, looks for siblings, not children.
 {
+	if (PullLoaded){
+		bool IsSameTag = (tag == StrStack.back()); //flag to see if we just searched for this one
+		int StartIndex = IsSameTag ? PullDoc.NextSibling(PullStack.back()) : PullDoc.FirstChild(PullStack.back());
+
+		for (int Iter = StartIndex; Iter != -1; Iter = PullDoc.NextSibling(Iter)){
+			if (PullDoc.NameIs(Iter, tag)){
+				if (IsSameTag) PullStack.back() = Iter; //move the bottom element of the stack to next sibling
+				else {
+					PullStack.push_back(Iter); //if first element of this type
+					StrStack.push_back(tag);
+				}
+				return true; 
+			}
+		}
+
+		if (IsSameTag) UpLevel();
+		return false;
+	}
+
 #ifdef QT_XML_LIB
 	QDomElement StartElement;
 	QDomElement IterElement;
@@ -208,6 +259,12 @@ bool CXML_Rip::FindLoadElement(std::string tag, std::string* pString, bool StayD
 {
 	if (!FindElement(tag)) return false;
 
+	if (PullLoaded){
+		if (!PullDoc.GetText(PullStack.back(), pString)) return false;
+		if (!StayDown) UpLevel();
+		return true;
+	}
+
 #ifdef QT_XML_LIB
 	if (CDATA){
 		QDomCDATASection childData = (ElStack.back().firstChild()).toCDATASection();
@@ -231,10 +288,48 @@ bool CXML_Rip::FindLoadElement(std::string tag, std::string* pString, bool StayD
 	return true;
 }
 
+bool CXML_Rip::FindLoadElementView(std::string tag, const char** ppData, int* pLength, bool StayDown)
+{
+	if (PullLoaded){
+		if (!FindElement(tag)) return false;
+		if (!PullDoc.GetTextView(PullStack.back(), ppData, pLength)){ //needs decoding: fall back to a copy
+			if (!PullDoc.GetText(PullStack.back(), &tmp)) return false;
+			ViewCopies.push_back(tmp);
+			*ppData = ViewCopies.back().data();
+			*pLength = (int)ViewCopies.back().size();
+		}
+		if (!StayDown) UpLevel();
+		return true;
+	}
+
+#ifdef QT_XML_LIB
+	if (!FindLoadElement(tag, &tmp, StayDown)) return false; //CDATA sections are text nodes too
+	ViewCopies.push_back(tmp);
+	*ppData = ViewCopies.back().data();
+	*pLength = (int)ViewCopies.back().size();
+#else //TINY_XML
+	if (!FindElement(tag)) return false;
+	TiXmlText* pText = ElStack.back()->FirstChild() ? ElStack.back()->FirstChild()->ToText() : 0;
+	if (pText == 0) return false;
+	*ppData = pText->ValueStr().data(); //points into the document
+	*pLength = (int)pText->ValueStr().size();
+	if (!StayDown) UpLevel();
+#endif
+
+	return true;
+}
+
 void CXML_Rip::GetElAttribute(std::string Att, std::string* pString) {
+	if (PullLoaded){
+		if (!PullDoc.GetAttribute(PullStack.back(), Att, pString)) pString->clear();
+		return;
+	}
+
 #ifdef QT_XML_LIB
 	*pString = ElStack.back().attribute(Att.c_str()).toStdString();
 #else //TINY_XML
-	*pString = ElStack.back()->Attribute(Att.c_str());
+	const char* pAtt = ElStack.back()->Attribute(Att.c_str());
+	if (pAtt) *pString = pAtt;
+	else pString->clear(); //missing attribute
 #endif
 }
@@ -18,8 +18,10 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #else
 #include "tinyxml.h"
 #endif
+#include "XML_Pull.h"
 
 #include <vector>
+#include <list>
 #include <sstream>
 
 //for quick run-through xml encoding
@@ -43,6 +45,11 @@ public:
 	std::string tmp; //temporary string (to avoid creating a bunch of these...)
 	std::vector <std::string> StrStack; //used on loading to keep track of which tags were last looked for
 
+	//streaming backend for loading (no DOM is built: elements are indexed in place in the memory-mapped file)
+	static bool DefaultPullParser; //backend used by newly created objects. false (TinyXML/Qt) by default, voxelyze turns it on at startup.
+	void SetPullParser(bool Enable) {UsePullParser = Enable;} //selects the backend for subsequent LoadFile() / fromXMLText() calls
+	bool IsPullParser(void) const {return UsePullParser;}
+
 
 	void SaveFile(std::string filename);
 	void toXMLText(std::string* Text);
@@ -70,6 +77,7 @@ public:
 
 	//these functions do not change the level of the stack by default.
 	bool FindLoadElement(std::string tag, std::string* pString, bool StayDown = false, bool CDATA = false); 
+	bool FindLoadElementView(std::string tag, const char** ppData, int* pLength, bool StayDown = false); //like FindLoadElement, but returns a pointer to the text instead of a copy. Valid until the next load call on this object (so views of several elements can be held at once). Not null terminated.
 	bool FindLoadElement(std::string tag, double* pDouble, bool StayDown = false) {if (FindLoadElement(tag, &tmp, StayDown)){*pDouble = atof(tmp.c_str()); return true;} return false;};
 	bool FindLoadElement(std::string tag, float* pFloat, bool StayDown = false) {if (FindLoadElement(tag, &tmp, StayDown)){*pFloat = (float)atof(tmp.c_str()); return true;} return false;};
 	bool FindLoadElement(std::string tag, long int* pLong, bool StayDown = false) {if (FindLoadElement(tag, &tmp, StayDown)){*pLong = atol(tmp.c_str()); return true;} return false;};
@@ -82,6 +90,12 @@ public:
 	void GetElAttribute(std::string Att, float* pFloat) {GetElAttribute(Att, &tmp); *pFloat = (float)atof(tmp.c_str());};
 	void GetElAttribute(std::string Att, int* pInt) {GetElAttribute(Att, &tmp); *pInt = atoi(tmp.c_str());};
 
+private:
+	bool UsePullParser;
+	bool PullLoaded; //true if the current document was loaded with the streaming backend
+	CXML_PullDoc PullDoc;
+	std::vector <int> PullStack; //element indices into PullDoc (used in place of ElStack)
+	std::list <std::string> ViewCopies; //backing store for FindLoadElementView() results that had to be decoded (list: stable addresses)
 };
 
 #endif //CXML_RIP_H
\ No newline at end of file
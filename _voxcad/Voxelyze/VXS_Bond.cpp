@@ -11,6 +11,7 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #include "VXS_Bond.h"
 #include "VXS_Voxel.h"
 #include "VX_Sim.h"
+#include "VX_SettleCache.h"
 
 CVXS_Bond::CVXS_Bond(CVX_Sim* p_SimIn) : CVX_Bond(p_SimIn)
 {
@@ -85,6 +86,34 @@ void CVXS_Bond::ResetBond(void) //resets this voxel to its default (imported) st
 
 }
 
+void CVXS_Bond::WriteState(std::ostream& os) const
+{
+	SCWrite(os, Force1); SCWrite(os, Force2); SCWrite(os, Moment1); SCWrite(os, Moment2);
+	SCWrite(os, _Pos2); SCWrite(os, _Angle1); SCWrite(os, _Angle2);
+	SCWrite(os, _LastPos2); SCWrite(os, _LastAngle1); SCWrite(os, _LastAngle2);
+	SCWrite(os, StrainEnergy);
+	SCWrite(os, CurStrainTot); SCWrite(os, CurStrainV1); SCWrite(os, CurStrainV2); SCWrite(os, CurStress);
+	SCWrite(os, MaxStrain); SCWrite(os, StrainOffset);
+	SCWrite(os, Yielded); SCWrite(os, Broken);
+	SCWrite(os, NormForce1);
+	SCWrite(os, TStrainSum1); SCWrite(os, TStrainSum2);
+	SCWrite(os, CSArea1); SCWrite(os, CSArea2);
+}
+
+bool CVXS_Bond::ReadState(std::istream& is)
+{
+	SCRead(is, &Force1); SCRead(is, &Force2); SCRead(is, &Moment1); SCRead(is, &Moment2);
+	SCRead(is, &_Pos2); SCRead(is, &_Angle1); SCRead(is, &_Angle2);
+	SCRead(is, &_LastPos2); SCRead(is, &_LastAngle1); SCRead(is, &_LastAngle2);
+	SCRead(is, &StrainEnergy);
+	SCRead(is, &CurStrainTot); SCRead(is, &CurStrainV1); SCRead(is, &CurStrainV2); SCRead(is, &CurStress);
+	SCRead(is, &MaxStrain); SCRead(is, &StrainOffset);
+	SCRead(is, &Yielded); SCRead(is, &Broken);
+	SCRead(is, &NormForce1);
+	SCRead(is, &TStrainSum1); SCRead(is, &TStrainSum2);
+	SCRead(is, &CSArea1);
+	return SCRead(is, &CSArea2);
+}
 
 vfloat CVXS_Bond::GetMaxVoxKinE(){
 	vfloat Ke1 = pVox1->GetCurKineticE(), Ke2 = pVox2->GetCurKineticE();
@@ -12,6 +12,7 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #define VXS_BOND_H
 
 #include "VX_Bond.h"
+#include <iostream>
 
 class CVXS_Bond : public CVX_Bond
 {
@@ -27,6 +28,10 @@ public:
 	virtual void UpdateBond(void) {}; //calculates force, positive for tension, negative for compression
 	virtual void ResetBond(void); //resets this bond to its default (imported) state.
 
+	//settled state caching
+	virtual void WriteState(std::ostream& os) const; //writes all time-varying state of this bond (binary)
+	virtual bool ReadState(std::istream& is); //restores the state written by WriteState(). Returns false if the stream ran out.
+
 	//Get information about this bond
 	vfloat GetStrainEnergy(void) const {return StrainEnergy;}
 	vfloat GetEngStrain(void) const {return CurStrainTot;}
@@ -11,6 +11,7 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #include "VXS_BondInternal.h"
 #include "VXS_Voxel.h"
 #include "VX_Sim.h"
+#include "VX_SettleCache.h"
 
 
 
@@ -52,6 +53,18 @@ void CVXS_BondInternal::ResetBond() //calculates force, positive for tension, ne
 	MidPoint = 0.5;
 }
 
+void CVXS_BondInternal::WriteState(std::ostream& os) const
+{
+	CVXS_Bond::WriteState(os);
+	SCWrite(os, SmallAngle);
+}
+
+bool CVXS_BondInternal::ReadState(std::istream& is)
+{
+	CVXS_Bond::ReadState(is);
+	return SCRead(is, &SmallAngle);
+}
+
 //sub force calculation types...
 void CVXS_BondInternal::CalcLinForce() //get bond forces given positions, angles, and stiffnesses...
 {
@@ -63,7 +76,9 @@ void CVXS_BondInternal::CalcLinForce() //get bond forces given positions, angles
 	ToXDirBond(&CurXAng2);
 	
 	Vec3D<double> Ang1AlignedRelPos(CurXAng1.RotateVec3DInv(CurXRelPos)); //undo current voxel rotation to put in line with original bond according to Angle 1
+	if (OffsetBond) Ang1AlignedRelPos -= RestOffset; //measure from where vox2 sits at rest
 	CQuat<double> NewAng2(CurXAng1.Conjugate()*CurXAng2); 
+	Vec3D<> Arm = RestOffset; //lever arm of an offset bond in the local bond frame
 
 	//todo: lump into stress calculations
 	double NomDistance;
@@ -103,7 +118,8 @@ void CVXS_BondInternal::CalcLinForce() //get bond forces given positions, angles
 		Pos2AlignedRotAng.FromAngleToPosX(Ang1AlignedRelPos); //get the angle to align this with the X axis
 		TotalRot = Pos2AlignedRotAng * CurXAng1.Conjugate();
 
-		vfloat Length = CurXRelPos.Length(); //Ang1AlignedRelPos.x<0 ? -Ang1AlignedRelPos.Length() : Ang1AlignedRelPos.Length();
+		vfloat Length = OffsetBond ? Ang1AlignedRelPos.Length() : CurXRelPos.Length(); //Ang1AlignedRelPos.x<0 ? -Ang1AlignedRelPos.Length() : Ang1AlignedRelPos.Length();
+		if (OffsetBond) Arm = Pos2AlignedRotAng.RotateVec3D(Arm);
 		_Pos2 = Vec3D<>(Length - NomDistance, 0, 0); //Small angle optimization target!!
 //		Vec3D<> Pos2a = Pos2AlignedRotAng.RotateVec3D(Ang1AlignedRelPos); //high performance (but slow version) for special cases. should never crop up. (i.e. 1dof sim dragging voxel past each other)
 //		_Pos2 = Vec3D<>(Pos2a.x - NomDistance, 0, 0); 
@@ -156,6 +172,11 @@ void CVXS_BondInternal::CalcLinForce() //get bond forces given positions, angles
 	if (p_Sim->StatToCalc & CALCSTAT_STRAINE) StrainEnergy = CalcStrainEnergy(); //depends on Force1, Force2, Moment1, Moment2 being set!
 	if (!ChangedSaState) AddDampForces();
 
+	if (OffsetBond){ //the bond acts on the larger voxel off its center: add the moment of the arm so angular momentum is conserved
+		if (ArmOnVox1) Moment1 -= Arm.Cross(Force1);
+		else Moment2 -= Arm.Cross(Force1);
+	}
+
 	//Unrotate back to global coordinate system:
 	//!!possible optimization: Do this after summing forces for a voxel!
 	Force1 = TotalRot.RotateVec3DInv(Force1);
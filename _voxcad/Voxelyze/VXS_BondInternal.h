@@ -35,6 +35,8 @@ public:
 
 	virtual void UpdateBond(void); //calculates force, positive for tension, negative for compression
 	virtual void ResetBond(void); //resets this voxel to its default (imported) state.
+	virtual void WriteState(std::ostream& os) const;
+	virtual bool ReadState(std::istream& is);
 
 	bool const IsSmallAngle(void) const {return SmallAngle;}
 
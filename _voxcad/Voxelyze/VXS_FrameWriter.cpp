@@ -0,0 +1,124 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#include "VXS_FrameWriter.h"
+#include <cstdio>
+#include <sstream>
+
+CVXS_FrameWriter::CVXS_FrameWriter(void)
+{
+	pEncoder = NULL;
+	MaxQueued = 8;
+	Running = StopRequested = false;
+	NumWritten = NumFailed = NumStalls = 0;
+}
+
+CVXS_FrameWriter::~CVXS_FrameWriter(void)
+{
+	Finish();
+}
+
+bool CVXS_FrameWriter::Start(int MaxQueuedIn)
+{
+	if (Running) return false;
+
+	MaxQueued = MaxQueuedIn < 1 ? 1 : MaxQueuedIn;
+	StopRequested = false;
+	NumWritten = NumFailed = NumStalls = 0;
+	Running = true;
+	Thread = std::thread(&CVXS_FrameWriter::WriterLoop, this);
+	return true;
+}
+
+void CVXS_FrameWriter::Push(CVXS_Frame& Frame)
+{
+	if (!Running){ //nothing to hand it to: write it here
+		if ((pEncoder ? pEncoder : WritePPM)(Frame)) NumWritten++;
+		else NumFailed++;
+		return;
+	}
+
+	std::unique_lock<std::mutex> Lock(QueueMutex);
+	if ((int)Queue.size() >= MaxQueued){
+		NumStalls++;
+		FrameTaken.wait(Lock, [this]{return (int)Queue.size() < MaxQueued;});
+	}
+
+	Queue.push_back(CVXS_Frame());
+	std::swap(Queue.back(), Frame);
+	if (!Spare.empty()){ //give the caller a buffer of the right size back
+		std::swap(Frame.Pixels, Spare.back().Pixels);
+		Spare.pop_back();
+	}
+	Lock.unlock();
+	FrameQueued.notify_one();
+}
+
+bool CVXS_FrameWriter::Finish(std::string* RetMessage)
+{
+	if (Running){
+		{
+			std::lock_guard<std::mutex> Lock(QueueMutex);
+			StopRequested = true;
+		}
+		FrameQueued.notify_one();
+		Thread.join();
+		Running = false;
+		Spare.clear();
+	}
+
+	if (RetMessage){
+		std::ostringstream os;
+		os << NumWritten << " frames written";
+		if (NumFailed) os << ", " << NumFailed << " failed";
+		os << " (renderer waited for the writer " << NumStalls << " times)\n";
+		*RetMessage += os.str();
+	}
+	return NumFailed == 0;
+}
+
+void CVXS_FrameWriter::WriterLoop(void)
+{
+	EncodeFunc pWrite = pEncoder ? pEncoder : WritePPM;
+	CVXS_Frame Frame;
+
+	std::unique_lock<std::mutex> Lock(QueueMutex);
+	while (true){
+		FrameQueued.wait(Lock, [this]{return !Queue.empty() || StopRequested;});
+		if (Queue.empty()) break; //stop requested and everything written
+
+		std::swap(Frame, Queue.front());
+		Queue.pop_front();
+		Lock.unlock();
+		FrameTaken.notify_one();
+
+		bool Written = pWrite(Frame); //the slow part, unlocked
+
+		Lock.lock();
+		if (Written) NumWritten++;
+		else NumFailed++;
+		if ((int)Spare.size() < MaxQueued){
+			Spare.push_back(CVXS_Frame());
+			std::swap(Spare.back().Pixels, Frame.Pixels);
+		}
+	}
+}
+
+bool CVXS_FrameWriter::WritePPM(const CVXS_Frame& Frame)
+{
+	if (Frame.Width <= 0 || Frame.Height <= 0 || (int)Frame.Pixels.size() < 3*Frame.Width*Frame.Height) return false;
+
+	FILE* pFile = fopen(Frame.FilePath.c_str(), "wb");
+	if (!pFile) return false;
+	fprintf(pFile, "P6\n%d %d\n255\n", Frame.Width, Frame.Height);
+	size_t Size = 3*(size_t)Frame.Width*Frame.Height;
+	bool Ok = fwrite(&Frame.Pixels[0], 1, Size, pFile) == Size;
+	return fclose(pFile) == 0 && Ok;
+}
@@ -0,0 +1,67 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#ifndef VXS_FRAMEWRITER_H
+#define VXS_FRAMEWRITER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct CVXS_Frame { //one rendered video frame
+	CVXS_Frame(void) {Width = Height = 0;}
+	int Width, Height;
+	std::vector<unsigned char> Pixels; //RGB, 3 bytes per pixel, top row first
+	std::string FilePath; //where to write it
+};
+
+//!Writes video frames to disk in a background thread
+/*!The renderer Push()es each frame as soon as it has read it back and carries on. Frames wait in a queue of at most MaxQueued until the writer thread has encoded and saved them, so a slow disk or encoder only holds up the renderer once the queue is full (counted in GetNumStalls()) and never loses a frame. Pixel buffers go back and forth between the queue and the caller instead of being reallocated for every frame.
+
+Frames are saved as binary PPM unless an encoder is set (VoxCad sets one that writes JPEG through QImage). Only one thread may Push().*/
+class CVXS_FrameWriter
+{
+public:
+	CVXS_FrameWriter(void); //!< Constructor
+	~CVXS_FrameWriter(void); //!< Destructor. Writes any queued frames first.
+
+	typedef bool (*EncodeFunc)(const CVXS_Frame& Frame); //!< Saves Frame to Frame.FilePath. Returns false on failure. Called from the writer thread.
+	void SetEncoder(EncodeFunc pEncoderIn) {pEncoder = pEncoderIn;} //!< Sets the function frames are saved with (NULL: binary PPM). Only while stopped.
+
+	bool Start(int MaxQueuedIn = 8); //!< Starts the writer thread. Returns false if it is already running. @param[in] MaxQueuedIn Number of frames that may wait to be written before Push() blocks.
+	void Push(CVXS_Frame& Frame); //!< Queues Frame to be written, blocking while the queue is full. Frame is left with the (recycled) pixel buffer of an earlier frame to render the next one into. @param[in,out] Frame The frame to write.
+	bool Finish(std::string* RetMessage = NULL); //!< Waits until all queued frames are written and stops the writer thread. Returns false if any frame could not be written. @param[out] RetMessage Appends a summary of what was written.
+	bool IsRunning(void) const {return Running;} //!< Returns true between Start() and Finish().
+
+	int GetNumWritten(void) const {return NumWritten;} //!< Frames saved since Start()
+	int GetNumFailed(void) const {return NumFailed;} //!< Frames that could not be saved since Start()
+	int GetNumStalls(void) const {return NumStalls;} //!< Number of times Push() had to wait for the writer since Start()
+
+	static bool WritePPM(const CVXS_Frame& Frame); //!< Saves Frame as a binary PPM. @param[in] Frame The frame to save.
+
+private:
+	void WriterLoop(void);
+
+	EncodeFunc pEncoder;
+	int MaxQueued;
+	bool Running, StopRequested;
+	int NumWritten, NumFailed, NumStalls;
+
+	std::deque<CVXS_Frame> Queue; //waiting to be written, oldest first
+	std::vector<CVXS_Frame> Spare; //written frames whose pixel buffers Push() hands back
+	std::mutex QueueMutex; //guards everything above Thread
+	std::condition_variable FrameQueued, FrameTaken;
+	std::thread Thread;
+};
+
+#endif //VXS_FRAMEWRITER_H
@@ -0,0 +1,327 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#ifdef USE_OPEN_GL
+
+#include "VXS_GLBatch.h"
+#include <cstddef>
+
+#ifdef QT_GUI_LIB
+#include <qgl.h>
+#else
+#include "OpenGLInclude.h" //If not using QT's openGL system, make a header file "OpenGLInclude.h" that includes openGL library functions
+#endif
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#define MAXNUMWINDOWS 10 //as in GL_Utils.cpp (one set of GL objects per context)
+
+#define VXGL_ARRAY_BUFFER 0x8892
+#define VXGL_STREAM_DRAW 0x88E0
+#define VXGL_STATIC_DRAW 0x88E4
+#define VXGL_FRAGMENT_SHADER 0x8B30
+#define VXGL_VERTEX_SHADER 0x8B31
+#define VXGL_COMPILE_STATUS 0x8B81
+#define VXGL_LINK_STATUS 0x8B82
+
+//OpenGL 1.5/2.0 and instancing entry points (the headers on some platforms stop at 1.1, so they are always looked up)
+typedef void (APIENTRY *PVXGLGENBUFFERS)(GLsizei n, GLuint* buffers);
+typedef void (APIENTRY *PVXGLBINDBUFFER)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *PVXGLBUFFERDATA)(GLenum target, ptrdiff_t size, const void* data, GLenum usage);
+typedef GLuint (APIENTRY *PVXGLCREATESHADER)(GLenum type);
+typedef void (APIENTRY *PVXGLSHADERSOURCE)(GLuint shader, GLsizei count, const char* const* string, const GLint* length);
+typedef void (APIENTRY *PVXGLCOMPILESHADER)(GLuint shader);
+typedef void (APIENTRY *PVXGLGETSHADERIV)(GLuint shader, GLenum pname, GLint* params);
+typedef GLuint (APIENTRY *PVXGLCREATEPROGRAM)(void);
+typedef void (APIENTRY *PVXGLATTACHSHADER)(GLuint program, GLuint shader);
+typedef void (APIENTRY *PVXGLBINDATTRIBLOCATION)(GLuint program, GLuint index, const char* name);
+typedef void (APIENTRY *PVXGLLINKPROGRAM)(GLuint program);
+typedef void (APIENTRY *PVXGLGETPROGRAMIV)(GLuint program, GLenum pname, GLint* params);
+typedef void (APIENTRY *PVXGLUSEPROGRAM)(GLuint program);
+typedef GLint (APIENTRY *PVXGLGETUNIFORMLOCATION)(GLuint program, const char* name);
+typedef void (APIENTRY *PVXGLUNIFORM1I)(GLint location, GLint v0);
+typedef void (APIENTRY *PVXGLENABLEVERTEXATTRIBARRAY)(GLuint index);
+typedef void (APIENTRY *PVXGLDISABLEVERTEXATTRIBARRAY)(GLuint index);
+typedef void (APIENTRY *PVXGLVERTEXATTRIBPOINTER)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer);
+typedef void (APIENTRY *PVXGLVERTEXATTRIBDIVISOR)(GLuint index, GLuint divisor);
+typedef void (APIENTRY *PVXGLDRAWARRAYSINSTANCED)(GLenum mode, GLint first, GLsizei count, GLsizei primcount);
+
+enum {ATTR_VERT_POS, ATTR_VERT_NORMAL, ATTR_ORIGIN, ATTR_QUAT, ATTR_SCALE, ATTR_COLOR, ATTR_COUNT}; //attribute locations in the shader
+#define ATTR_FIRST_INSTANCED ATTR_ORIGIN
+
+static const char* BoxVertexShader =
+	"#version 120\n"
+	"attribute vec3 VertPos;\n"
+	"attribute vec3 VertNormal;\n"
+	"attribute vec3 InstOrigin;\n"
+	"attribute vec4 InstQuat;\n"
+	"attribute vec3 InstScale;\n"
+	"attribute vec4 InstColor;\n"
+	"uniform int NumLights;\n"
+	"uniform int Lighting;\n"
+	"uniform int EdgePass;\n"
+	"varying vec4 Color;\n"
+	"vec3 Rotate(vec4 q, vec3 v) {return v + 2.0*cross(q.xyz, cross(q.xyz, v) + q.w*v);}\n" //as CQuat::RotateVec3D()
+	"void main(){\n"
+	"	vec4 EyePos = gl_ModelViewMatrix*vec4(InstOrigin + Rotate(InstQuat, InstScale*VertPos), 1.0);\n"
+	"	gl_Position = gl_ProjectionMatrix*EyePos;\n"
+	"	if (EdgePass != 0) {Color = vec4(0.0, 0.0, 0.0, 1.0); return;}\n"
+	"	if (InstColor.a == 0.0) {gl_Position = vec4(2.0, 2.0, 2.0, 1.0); return;}\n" //clipped: transparent boxes only get their edges (as CGL_Utils::DrawCube())
+	"	if (Lighting == 0) {Color = InstColor; return;}\n"
+	"	vec3 N = normalize(gl_NormalMatrix*Rotate(InstQuat, VertNormal/InstScale));\n"
+	"	vec3 ToEye = (gl_ProjectionMatrix[3][3] == 1.0) ? vec3(0.0, 0.0, 1.0) : -EyePos.xyz;\n" //orthographic or perspective
+	"	if (dot(N, ToEye) < 0.0) N = -N;\n" //two sided lighting (the same for every vertex of a face, so it agrees with the side the face is seen from)
+	"	vec4 C = gl_LightModel.ambient*InstColor;\n" //fixed function lighting with the material color tracking InstColor (non-local viewer)
+	"	for (int i=0; i<NumLights; i++){\n"
+	"		vec3 L = normalize(gl_LightSource[i].position.xyz - gl_LightSource[i].position.w*EyePos.xyz);\n"
+	"		float NdotL = max(dot(N, L), 0.0);\n"
+	"		C += gl_LightSource[i].ambient*InstColor + NdotL*gl_LightSource[i].diffuse*InstColor;\n"
+	"		if (NdotL > 0.0) C += pow(max(dot(N, normalize(L + vec3(0.0, 0.0, 1.0))), 0.0), gl_FrontMaterial.shininess)*gl_LightSource[i].specular*gl_FrontMaterial.specular;\n"
+	"	}\n"
+	"	Color = vec4(clamp(C.rgb, 0.0, 1.0), InstColor.a);\n"
+	"}\n";
+
+static const char* BoxFragmentShader =
+	"#version 120\n"
+	"varying vec4 Color;\n"
+	"void main(){gl_FragColor = Color;}\n";
+
+struct CBoxContext { //everything DrawBoxes() needs in one GL context
+	bool Tried, Ok;
+	GLuint Program, FaceBuffer, EdgeBuffer, InstanceBuffer;
+	GLint NumLightsLoc, LightingLoc, EdgePassLoc;
+
+	PVXGLGENBUFFERS GenBuffers;
+	PVXGLBINDBUFFER BindBuffer;
+	PVXGLBUFFERDATA BufferData;
+	PVXGLCREATESHADER CreateShader;
+	PVXGLSHADERSOURCE ShaderSource;
+	PVXGLCOMPILESHADER CompileShader;
+	PVXGLGETSHADERIV GetShaderiv;
+	PVXGLCREATEPROGRAM CreateProgram;
+	PVXGLATTACHSHADER AttachShader;
+	PVXGLBINDATTRIBLOCATION BindAttribLocation;
+	PVXGLLINKPROGRAM LinkProgram;
+	PVXGLGETPROGRAMIV GetProgramiv;
+	PVXGLUSEPROGRAM UseProgram;
+	PVXGLGETUNIFORMLOCATION GetUniformLocation;
+	PVXGLUNIFORM1I Uniform1i;
+	PVXGLENABLEVERTEXATTRIBARRAY EnableVertexAttribArray;
+	PVXGLDISABLEVERTEXATTRIBARRAY DisableVertexAttribArray;
+	PVXGLVERTEXATTRIBPOINTER VertexAttribPointer;
+	PVXGLVERTEXATTRIBDIVISOR VertexAttribDivisor;
+	PVXGLDRAWARRAYSINSTANCED DrawArraysInstanced;
+};
+static CBoxContext BoxContexts[MAXNUMWINDOWS]; //zero initialized: nothing tried yet
+
+#ifdef QT_GUI_LIB
+static void* QtGetProcAddress(const char* Name)
+{
+	const QGLContext* pContext = QGLContext::currentContext();
+	return pContext ? (void*)pContext->getProcAddress(QString(Name)) : NULL;
+}
+void* (*CVXS_BoxInstancer::GetProcAddress)(const char* Name) = QtGetProcAddress;
+#else
+void* (*CVXS_BoxInstancer::GetProcAddress)(const char* Name) = NULL;
+#endif
+
+template <typename T> static bool LoadProc(T* pProc, const char* Name, const char* AltName = NULL) //looks up an entry point (or its extension version). Returns false if neither exists.
+{
+	void* pAddress = CVXS_BoxInstancer::GetProcAddress(Name);
+	if (!pAddress && AltName) pAddress = CVXS_BoxInstancer::GetProcAddress(AltName);
+	*pProc = (T)pAddress;
+	return pAddress != NULL;
+}
+
+static GLuint CompileShader(CBoxContext& C, GLenum Type, const char* Source) //returns 0 on failure
+{
+	GLuint Shader = C.CreateShader(Type);
+	C.ShaderSource(Shader, 1, &Source, NULL);
+	C.CompileShader(Shader);
+	GLint Compiled = 0;
+	C.GetShaderiv(Shader, VXGL_COMPILE_STATUS, &Compiled);
+	return Compiled ? Shader : 0;
+}
+
+static bool InitBoxContext(CBoxContext& C) //looks up the entry points and builds the shader and the unit cube. Returns false if instancing is not supported.
+{
+	if (!CVXS_BoxInstancer::GetProcAddress) return false;
+
+	bool Found = true;
+	Found &= LoadProc(&C.GenBuffers, "glGenBuffers", "glGenBuffersARB");
+	Found &= LoadProc(&C.BindBuffer, "glBindBuffer", "glBindBufferARB");
+	Found &= LoadProc(&C.BufferData, "glBufferData", "glBufferDataARB");
+	Found &= LoadProc(&C.CreateShader, "glCreateShader");
+	Found &= LoadProc(&C.ShaderSource, "glShaderSource");
+	Found &= LoadProc(&C.CompileShader, "glCompileShader");
+	Found &= LoadProc(&C.GetShaderiv, "glGetShaderiv");
+	Found &= LoadProc(&C.CreateProgram, "glCreateProgram");
+	Found &= LoadProc(&C.AttachShader, "glAttachShader");
+	Found &= LoadProc(&C.BindAttribLocation, "glBindAttribLocation");
+	Found &= LoadProc(&C.LinkProgram, "glLinkProgram");
+	Found &= LoadProc(&C.GetProgramiv, "glGetProgramiv");
+	Found &= LoadProc(&C.UseProgram, "glUseProgram");
+	Found &= LoadProc(&C.GetUniformLocation, "glGetUniformLocation");
+	Found &= LoadProc(&C.Uniform1i, "glUniform1i");
+	Found &= LoadProc(&C.EnableVertexAttribArray, "glEnableVertexAttribArray");
+	Found &= LoadProc(&C.DisableVertexAttribArray, "glDisableVertexAttribArray");
+	Found &= LoadProc(&C.VertexAttribPointer, "glVertexAttribPointer");
+	Found &= LoadProc(&C.VertexAttribDivisor, "glVertexAttribDivisor", "glVertexAttribDivisorARB");
+	Found &= LoadProc(&C.DrawArraysInstanced, "glDrawArraysInstanced", "glDrawArraysInstancedARB");
+	if (!Found) return false;
+
+	GLuint VertexShader = CompileShader(C, VXGL_VERTEX_SHADER, BoxVertexShader);
+	GLuint FragmentShader = CompileShader(C, VXGL_FRAGMENT_SHADER, BoxFragmentShader);
+	if (!VertexShader || !FragmentShader) return false;
+
+	C.Program = C.CreateProgram();
+	C.AttachShader(C.Program, VertexShader);
+	C.AttachShader(C.Program, FragmentShader);
+	const char* AttrNames[ATTR_COUNT] = {"VertPos", "VertNormal", "InstOrigin", "InstQuat", "InstScale", "InstColor"};
+	for (int i=0; i<ATTR_COUNT; i++) C.BindAttribLocation(C.Program, i, AttrNames[i]);
+	C.LinkProgram(C.Program);
+	GLint Linked = 0;
+	C.GetProgramiv(C.Program, VXGL_LINK_STATUS, &Linked);
+	if (!Linked) return false;
+	C.NumLightsLoc = C.GetUniformLocation(C.Program, "NumLights");
+	C.LightingLoc = C.GetUniformLocation(C.Program, "Lighting");
+	C.EdgePassLoc = C.GetUniformLocation(C.Program, "EdgePass");
+
+	//unit cube (as CGL_Utils::DrawCubeFace() and DrawCubeEdge()): 6 faces of 2 triangles, then 12 edges. Position and normal per vertex.
+	std::vector<float> Faces, Edges;
+	for (int Axis=0; Axis<3; Axis++){
+		for (int Sign=-1; Sign<=1; Sign+=2){
+			int a1 = (Axis+1)%3, a2 = (Axis+2)%3;
+			float Corners[4][2] = {{-0.5f,-0.5f}, {0.5f,-0.5f}, {0.5f,0.5f}, {-0.5f,0.5f}};
+			int Order[2][6] = {{0, 2, 1, 0, 3, 2}, {0, 1, 2, 0, 2, 3}}; //counterclockwise seen from outside
+			for (int k=0; k<6; k++){
+				float v[3], n[3] = {0, 0, 0};
+				v[Axis] = 0.5f*Sign; v[a1] = Corners[Order[Sign>0][k]][0]; v[a2] = Corners[Order[Sign>0][k]][1];
+				n[Axis] = (float)Sign;
+				Faces.insert(Faces.end(), v, v+3);
+				Faces.insert(Faces.end(), n, n+3);
+			}
+		}
+		for (int k=0; k<4; k++){ //the four edges along this axis
+			for (int End=0; End<2; End++){
+				float v[3], n[3] = {0, 0, 0};
+				v[Axis] = End ? 0.5f : -0.5f; v[(Axis+1)%3] = (k&1) ? 0.5f : -0.5f; v[(Axis+2)%3] = (k&2) ? 0.5f : -0.5f;
+				Edges.insert(Edges.end(), v, v+3);
+				Edges.insert(Edges.end(), n, n+3);
+			}
+		}
+	}
+
+	GLuint Buffers[3];
+	C.GenBuffers(3, Buffers);
+	C.FaceBuffer = Buffers[0];
+	C.EdgeBuffer = Buffers[1];
+	C.InstanceBuffer = Buffers[2];
+	C.BindBuffer(VXGL_ARRAY_BUFFER, C.FaceBuffer);
+	C.BufferData(VXGL_ARRAY_BUFFER, Faces.size()*sizeof(float), &Faces[0], VXGL_STATIC_DRAW);
+	C.BindBuffer(VXGL_ARRAY_BUFFER, C.EdgeBuffer);
+	C.BufferData(VXGL_ARRAY_BUFFER, Edges.size()*sizeof(float), &Edges[0], VXGL_STATIC_DRAW);
+	C.BindBuffer(VXGL_ARRAY_BUFFER, 0);
+	return true;
+}
+
+static CBoxContext* GetBoxContext(void) //returns the state for the current context, or NULL if instancing is not available in it
+{
+	if (CGL_Utils::CurContextID < 0 || CGL_Utils::CurContextID >= MAXNUMWINDOWS) return NULL;
+	CBoxContext& C = BoxContexts[CGL_Utils::CurContextID];
+	if (!C.Tried){
+		C.Tried = true;
+		C.Ok = InitBoxContext(C);
+	}
+	return C.Ok ? &C : NULL;
+}
+
+bool CVXS_BoxInstancer::IsAvailable(void)
+{
+	GLint RenderMode;
+	glGetIntegerv(GL_RENDER_MODE, &RenderMode);
+	return RenderMode == GL_RENDER && GetBoxContext() != NULL;
+}
+
+bool CVXS_BoxInstancer::DrawBoxes(const std::vector<CVXS_BoxInstance>& Boxes, bool Edges)
+{
+	if (!IsAvailable()) return false;
+	if (Boxes.empty()) return true;
+	CBoxContext& C = *GetBoxContext();
+
+	C.UseProgram(C.Program);
+	GLint NumLights = 0, MaxLights = 0;
+	glGetIntegerv(GL_MAX_LIGHTS, &MaxLights);
+	while (NumLights < MaxLights && glIsEnabled(GL_LIGHT0+NumLights)) NumLights++; //the lights in use are always the first few
+	C.Uniform1i(C.NumLightsLoc, NumLights);
+	C.Uniform1i(C.LightingLoc, glIsEnabled(GL_LIGHTING) ? 1 : 0);
+
+	//all the boxes in one upload (orphaning the last frame's buffer so it never has to wait for it)
+	C.BindBuffer(VXGL_ARRAY_BUFFER, C.InstanceBuffer);
+	C.BufferData(VXGL_ARRAY_BUFFER, Boxes.size()*sizeof(CVXS_BoxInstance), NULL, VXGL_STREAM_DRAW);
+	C.BufferData(VXGL_ARRAY_BUFFER, Boxes.size()*sizeof(CVXS_BoxInstance), &Boxes[0], VXGL_STREAM_DRAW);
+	GLsizei Stride = sizeof(CVXS_BoxInstance);
+	C.VertexAttribPointer(ATTR_ORIGIN, 3, GL_FLOAT, GL_FALSE, Stride, (const void*)offsetof(CVXS_BoxInstance, Origin));
+	C.VertexAttribPointer(ATTR_QUAT, 4, GL_FLOAT, GL_FALSE, Stride, (const void*)offsetof(CVXS_BoxInstance, Quat));
+	C.VertexAttribPointer(ATTR_SCALE, 3, GL_FLOAT, GL_FALSE, Stride, (const void*)offsetof(CVXS_BoxInstance, Scale));
+	C.VertexAttribPointer(ATTR_COLOR, 4, GL_FLOAT, GL_FALSE, Stride, (const void*)offsetof(CVXS_BoxInstance, Color));
+	for (int i=0; i<ATTR_COUNT; i++) C.EnableVertexAttribArray(i);
+	for (int i=ATTR_FIRST_INSTANCED; i<ATTR_COUNT; i++) C.VertexAttribDivisor(i, 1);
+
+	GLsizei VertStride = 6*sizeof(float);
+	C.BindBuffer(VXGL_ARRAY_BUFFER, C.FaceBuffer);
+	C.VertexAttribPointer(ATTR_VERT_POS, 3, GL_FLOAT, GL_FALSE, VertStride, (const void*)0);
+	C.VertexAttribPointer(ATTR_VERT_NORMAL, 3, GL_FLOAT, GL_FALSE, VertStride, (const void*)(3*sizeof(float)));
+	C.Uniform1i(C.EdgePassLoc, 0);
+	C.DrawArraysInstanced(GL_TRIANGLES, 0, 36, (GLsizei)Boxes.size());
+
+	if (Edges){
+		C.BindBuffer(VXGL_ARRAY_BUFFER, C.EdgeBuffer);
+		C.VertexAttribPointer(ATTR_VERT_POS, 3, GL_FLOAT, GL_FALSE, VertStride, (const void*)0);
+		C.VertexAttribPointer(ATTR_VERT_NORMAL, 3, GL_FLOAT, GL_FALSE, VertStride, (const void*)(3*sizeof(float)));
+		C.Uniform1i(C.EdgePassLoc, 1);
+		glLineWidth(1.0);
+		C.DrawArraysInstanced(GL_LINES, 0, 24, (GLsizei)Boxes.size());
+	}
+
+	//leave everything as the fixed function drawing expects it
+	for (int i=ATTR_FIRST_INSTANCED; i<ATTR_COUNT; i++) C.VertexAttribDivisor(i, 0);
+	for (int i=0; i<ATTR_COUNT; i++) C.DisableVertexAttribArray(i);
+	C.BindBuffer(VXGL_ARRAY_BUFFER, 0);
+	C.UseProgram(0);
+	return true;
+}
+
+void CVXS_LineBatch::Draw(float LineWidth)
+{
+	if (Verts.empty()) return;
+
+	float PrevLineWidth;
+	glGetFloatv(GL_LINE_WIDTH, &PrevLineWidth);
+	glLineWidth(LineWidth);
+	GLboolean WasLighting = glIsEnabled(GL_LIGHTING);
+	glDisable(GL_LIGHTING);
+	glLoadName(-1); //to disable picking
+
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, &Verts[0]);
+	glColorPointer(4, GL_FLOAT, 0, &Colors[0]);
+	glDrawArrays(GL_LINES, 0, (GLsizei)(Verts.size()/3));
+	glPopClientAttrib();
+
+	glLineWidth(PrevLineWidth);
+	if (WasLighting) glEnable(GL_LIGHTING);
+}
+
+#endif //USE_OPEN_GL
@@ -0,0 +1,61 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#ifndef VXS_GLBATCH_H
+#define VXS_GLBATCH_H
+
+#include "Utils/Mesh.h" //CColor
+#include <vector>
+
+#ifdef USE_OPEN_GL
+
+struct CVXS_BoxInstance { //one box as CVXS_BoxInstancer draws it: each corner v of the unit cube goes to Origin + Quat.RotateVec3D(Scale*v)
+	float Origin[3];
+	float Quat[4]; //x, y, z, w
+	float Scale[3];
+	float Color[4];
+};
+
+//!Draws many boxes with one instanced draw call
+/*!The unit cube is kept in buffer objects and all boxes are uploaded as per-instance attributes in a single buffer per frame. Lit in a vertex shader the way the fixed function pipeline lights the rest of the scene (the enabled lights, color material and two sided lighting). Needs OpenGL 2.0 with ARB_instanced_arrays and ARB_draw_instanced, looked up at run time through GetProcAddress: if anything is missing DrawBoxes() returns false and the caller draws the boxes itself. Instances cannot carry picking names, so nothing is drawn in GL_SELECT mode either.*/
+class CVXS_BoxInstancer
+{
+public:
+	CVXS_BoxInstancer(void) {} //!< Constructor
+	~CVXS_BoxInstancer(void) {} //!< Destructor (the GL objects belong to their contexts)
+
+	bool DrawBoxes(const std::vector<CVXS_BoxInstance>& Boxes, bool Edges = true); //!< Draws the boxes (with black edges if Edges) in the current context. Returns false (having drawn nothing) if instanced drawing is not available. @param[in] Boxes The boxes to draw. @param[in] Edges Outline each box in black (as CGL_Utils::DrawCube()).
+	static bool IsAvailable(void); //!< Returns true if DrawBoxes() can draw in the current context (initializes it on the first call).
+
+	static void* (*GetProcAddress)(const char* Name); //!< Looks up OpenGL entry points in the current context. Defaults to the current QGLContext under Qt and to nothing otherwise (set it, e.g. to eglGetProcAddress, to enable instancing without Qt).
+};
+
+//!Collects colored line segments and draws them with a single glDrawArrays() call
+class CVXS_LineBatch
+{
+public:
+	CVXS_LineBatch(void) {} //!< Constructor
+
+	void Clear(void) {Verts.clear(); Colors.clear();} //!< Empties the batch (keeps the memory).
+	void Reserve(int NumLines) {Verts.reserve(6*NumLines); Colors.reserve(8*NumLines);} //!< Makes room for NumLines segments.
+	void AddLine(const Vec3D<>& P1, const Vec3D<>& P2, const CColor& Color) {AddVertex(P1, Color); AddVertex(P2, Color);} //!< Adds a segment from P1 to P2.
+	int GetNumLines(void) const {return (int)Verts.size()/6;} //!< Returns the number of segments.
+	void Draw(float LineWidth); //!< Draws all segments from client side arrays (OpenGL 1.1), unlit and unpickable.
+
+private:
+	void AddVertex(const Vec3D<>& P, const CColor& C) {Verts.push_back((float)P.x); Verts.push_back((float)P.y); Verts.push_back((float)P.z); Colors.push_back((float)C.r); Colors.push_back((float)C.g); Colors.push_back((float)C.b); Colors.push_back((float)C.a);}
+
+	std::vector<float> Verts; //x, y, z per vertex
+	std::vector<float> Colors; //r, g, b, a per vertex
+};
+
+#endif //USE_OPEN_GL
+
+#endif //VXS_GLBATCH_H
@@ -0,0 +1,200 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#include "VXS_OffscreenView.h"
+
+#ifdef USE_OPEN_GL
+
+#include "VXS_SimGLView.h"
+#include "VX_Object.h"
+#include <EGL/egl.h>
+#include <cstring>
+#include <cmath>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+typedef EGLDisplay (*PEGLGETPLATFORMDISPLAYEXT)(EGLenum Platform, void* pNativeDisplay, const EGLint* pAttribs);
+
+#define OFFSCREEN_CONTEXT_ID 9 //CGL_Utils display lists and buffer objects of this context (VoxCad's windows count up from 0)
+
+static void* EGLProcAddress(const char* Name) {return (void*)eglGetProcAddress(Name);}
+
+CVXS_OffscreenView::CVXS_OffscreenView(CVXS_SimGLView* pViewIn)
+{
+	pView = pViewIn;
+	Width = Height = 0;
+	pDisplay = pSurface = pContext = NULL;
+	XRot = 280.0f; YRot = 210.0f; Persp = 30.0f; //VoxCad's default perspective camera
+}
+
+CVXS_OffscreenView::~CVXS_OffscreenView(void)
+{
+	Close();
+}
+
+bool CVXS_OffscreenView::Open(int WidthIn, int HeightIn, std::string* RetMessage)
+{
+	Close();
+
+	//prefer Mesa's surfaceless platform, which needs no display server at all
+	EGLDisplay Display = EGL_NO_DISPLAY;
+	const char* ClientExts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (ClientExts && strstr(ClientExts, "EGL_MESA_platform_surfaceless")){
+		PEGLGETPLATFORMDISPLAYEXT pGetPlatformDisplay = (PEGLGETPLATFORMDISPLAYEXT)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (pGetPlatformDisplay) Display = pGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (Display == EGL_NO_DISPLAY) Display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint Major, Minor;
+	if (Display == EGL_NO_DISPLAY || !eglInitialize(Display, &Major, &Minor)){
+		if (RetMessage) *RetMessage += "Could not initialize an EGL display for offscreen rendering.\n";
+		return false;
+	}
+
+	const EGLint ConfigAttribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_DEPTH_SIZE, 24, EGL_NONE};
+	EGLConfig Config;
+	EGLint NumConfigs = 0;
+	if (!eglChooseConfig(Display, ConfigAttribs, &Config, 1, &NumConfigs) || NumConfigs < 1){
+		if (RetMessage) *RetMessage += "No EGL configuration supports desktop OpenGL pbuffers.\n";
+		eglTerminate(Display);
+		return false;
+	}
+
+	const EGLint SurfaceAttribs[] = {EGL_WIDTH, WidthIn, EGL_HEIGHT, HeightIn, EGL_NONE};
+	EGLSurface Surface = eglCreatePbufferSurface(Display, Config, SurfaceAttribs);
+	EGLContext Context = EGL_NO_CONTEXT;
+	if (Surface != EGL_NO_SURFACE && eglBindAPI(EGL_OPENGL_API)) Context = eglCreateContext(Display, Config, EGL_NO_CONTEXT, NULL); //default attributes: a compatibility profile context, as the view uses the fixed function pipeline
+	if (Context == EGL_NO_CONTEXT || !eglMakeCurrent(Display, Surface, Surface, Context)){
+		if (RetMessage) *RetMessage += "Could not create an offscreen OpenGL context.\n";
+		if (Context != EGL_NO_CONTEXT) eglDestroyContext(Display, Context);
+		if (Surface != EGL_NO_SURFACE) eglDestroySurface(Display, Surface);
+		eglTerminate(Display);
+		return false;
+	}
+
+	pDisplay = Display;
+	pSurface = Surface;
+	pContext = Context;
+	Width = WidthIn;
+	Height = HeightIn;
+	ReadBuffer.resize(3*Width*Height);
+
+	if (!CVXS_BoxInstancer::GetProcAddress) CVXS_BoxInstancer::GetProcAddress = EGLProcAddress;
+	CGL_Utils::CurContextID = OFFSCREEN_CONTEXT_ID;
+	SetupState();
+	return true;
+}
+
+void CVXS_OffscreenView::Close(void)
+{
+	if (!pDisplay) return;
+
+	eglMakeCurrent((EGLDisplay)pDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (pContext) eglDestroyContext((EGLDisplay)pDisplay, (EGLContext)pContext);
+	if (pSurface) eglDestroySurface((EGLDisplay)pDisplay, (EGLSurface)pSurface);
+	eglTerminate((EGLDisplay)pDisplay);
+	pDisplay = pSurface = pContext = NULL;
+}
+
+void CVXS_OffscreenView::SetupState(void)
+{
+	glViewport(0, 0, Width, Height);
+	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+	glClearDepth(1.0f);
+	glFrontFace(GL_CCW);
+	glCullFace(GL_BACK);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+	glLineWidth(1.0);
+
+	//high quality mode
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glHint(GL_POLYGON_SMOOTH_HINT, GL_NICEST);
+	glDisable(GL_LINE_SMOOTH);
+	glEnable(GL_POLYGON_SMOOTH);
+	glEnable(GL_NORMALIZE);
+	glPolygonOffset(1.0, 2);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1); //rows of 3*Width bytes
+}
+
+void CVXS_OffscreenView::SetupCamera(void)
+{
+	Vec3D<> Env = pView->pSim->pEnv->pObj->GetWorkSpace();
+	Vec3D<> Target = pView->pSim->GetCM();
+	float Aspect = (float)Width/(float)Height;
+	float Scale = (float)Env.Length();
+	float Zoom = (float)fmax(100*fmax(Env.x, Env.y)/Aspect, 100*Env.z); //as CQOpenGL::GLCenterView()
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	float Near = Scale/100, Far = Scale*100;
+	float Top = Near*(float)tan(Persp*3.14159265358979/360.0); //gluPerspective()
+	glFrustum(-Aspect*Top, Aspect*Top, -Top, Top, Near, Far);
+
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glTranslatef(0.0f, 0.0f, -Zoom/Persp);
+	glRotatef(XRot, 1.0f, 0.0f, 0.0f);
+	glRotatef(YRot, 0.0f, 0.0f, 1.0f);
+	glTranslatef((float)-Target.x, (float)-Target.y, (float)-Target.z);
+
+	//lights as CQOpenGL::GLSetLighting(), positioned in the workspace frame
+	glShadeModel(GL_SMOOTH);
+	glEnable(GL_LIGHTING);
+	float AmbientLight[] = {0.5f, 0.5f, 0.5f, 1.0f};
+	glLightfv(GL_LIGHT0, GL_AMBIENT, AmbientLight);
+
+	const float Diffuse[3][4] = {{90/255.0f, 90/255.0f, 90/255.0f, 1.0f}, {60/255.0f, 60/255.0f, 60/255.0f, 1.0f}, {90/255.0f, 90/255.0f, 90/255.0f, 1.0f}};
+	const float Specular[3][4] = {{40/255.0f, 40/255.0f, 40/255.0f, 1.0f}, {60/255.0f, 20/255.0f, 20/255.0f, 1.0f}, {20/255.0f, 20/255.0f, 60/255.0f, 1.0f}};
+	const float Position[3][3] = {{-0.5f, 0.5f, 2.0f}, {-2.0f, -0.5f, 1.0f}, {1.0f, -1.0f, -1.0f}};
+	float LightScale = 100*(float)fmax(Env.x, fmax(Env.y, Env.z));
+	for (int i=0; i<3; i++){
+		float P[4] = {Position[i][0]*LightScale, Position[i][1]*LightScale, Position[i][2]*LightScale, 1.0f};
+		glEnable(GL_LIGHT0+i);
+		glLightfv(GL_LIGHT0+i, GL_DIFFUSE, Diffuse[i]);
+		glLightfv(GL_LIGHT0+i, GL_SPECULAR, Specular[i]);
+		glLightfv(GL_LIGHT0+i, GL_POSITION, P);
+	}
+
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	GLfloat MatSpecular[] = {1.0f, 1.0f, 1.0f, 1.0f};
+	GLfloat MatShininess[] = {70};
+	glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, MatSpecular);
+	glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, MatShininess);
+	glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+	glEnable(GL_COLOR_MATERIAL);
+	glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+}
+
+bool CVXS_OffscreenView::RenderFrame(CVXS_Frame* pFrame)
+{
+	if (!IsOpen()) return false;
+
+	CGL_Utils::CurContextID = OFFSCREEN_CONTEXT_ID;
+	glRenderMode(GL_RENDER);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	SetupCamera();
+	pView->Draw();
+
+	glReadPixels(0, 0, Width, Height, GL_RGB, GL_UNSIGNED_BYTE, &ReadBuffer[0]);
+
+	int RowSize = 3*Width;
+	pFrame->Width = Width;
+	pFrame->Height = Height;
+	pFrame->Pixels.resize(RowSize*Height);
+	for (int y=0; y<Height; y++) memcpy(&pFrame->Pixels[y*RowSize], &ReadBuffer[(Height-1-y)*RowSize], RowSize); //flip to top row first
+	return true;
+}
+
+#endif //USE_OPEN_GL
@@ -0,0 +1,50 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#ifndef VXS_OFFSCREENVIEW_H
+#define VXS_OFFSCREENVIEW_H
+
+#include "VXS_FrameWriter.h"
+#include "Utils/Vec3D.h"
+#include <string>
+
+#ifdef USE_OPEN_GL
+
+class CVXS_SimGLView;
+
+//!Renders a simulation without a window or display
+/*!Creates its own OpenGL context on an EGL pbuffer (on Mesa the surfaceless platform, so no X server is needed) and draws a CVXS_SimGLView into it the way VoxCad's perspective view does: same lights, camera angle and zoom, centered on the center of mass. RenderFrame() reads the result back into a CVXS_Frame for a CVXS_FrameWriter. Link with -lEGL -lGL.*/
+class CVXS_OffscreenView
+{
+public:
+	CVXS_OffscreenView(CVXS_SimGLView* pViewIn); //!< Constructor. @param[in] pViewIn The view to draw (and through it the simulation).
+	~CVXS_OffscreenView(void); //!< Destructor
+
+	bool Open(int WidthIn, int HeightIn, std::string* RetMessage = NULL); //!< Creates the context and makes it current in the calling thread. Returns false if no suitable EGL display or config is available. @param[in] WidthIn Frame width in pixels. @param[in] HeightIn Frame height in pixels. @param[out] RetMessage Appends the reason for a failure.
+	void Close(void); //!< Destroys the context.
+	bool IsOpen(void) const {return pContext != NULL;} //!< Returns true between a successful Open() and Close().
+
+	void SetCamera(float XRotIn, float YRotIn, float PerspIn) {XRot = XRotIn; YRot = YRotIn; Persp = PerspIn;} //!< Sets the view angles (degrees, as VoxCad's camera). Defaults to VoxCad's perspective view. @param[in] XRotIn Rotation about x. @param[in] YRotIn Rotation about z. @param[in] PerspIn Vertical field of view.
+	bool RenderFrame(CVXS_Frame* pFrame); //!< Draws the current state of the simulation and reads it into pFrame (Width, Height and Pixels; FilePath is left alone). Returns false if not open. @param[out] pFrame The frame to fill.
+
+private:
+	CVXS_SimGLView* pView;
+	int Width, Height;
+	void *pDisplay, *pSurface, *pContext; //EGL handles (kept opaque so this header does not need EGL)
+	float XRot, YRot, Persp;
+	std::vector<unsigned char> ReadBuffer; //bottom row first, as glReadPixels() returns it
+
+	void SetupState(void); //as CQOpenGL::initializeGL()
+	void SetupCamera(void); //as CQOpenGL::GLDrawScene() in perspective view
+};
+
+#endif //USE_OPEN_GL
+
+#endif //VXS_OFFSCREENVIEW_H
@@ -0,0 +1,74 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#include "VXS_RenderSnapshot.h"
+#include "VXS_SimGLView.h"
+
+void CVXS_RenderSnapshot::Clear(void)
+{
+	StepCount = -1;
+	Time = 0;
+	ViewCol = -1;
+	CurCM = Vec3D<>(0,0,0);
+	MaxVoxDisp = MaxVoxKinE = MaxBondStrain = MaxBondStress = MaxBondStrainE = MaxPressure = MinPressure = 0;
+	Voxels.clear();
+	Bonds.clear();
+	ColBonds.clear();
+}
+
+void CVXS_RenderSnapshot::Capture(CVX_Sim* pSim, CVXS_SimGLView* pView, bool WantBonds)
+{
+	StepCount = pSim->CurStepCount;
+	Time = pSim->CurTime;
+	ViewCol = (int)pView->GetCurViewCol();
+	CurCM = pSim->SS.CurCM;
+	MaxVoxDisp = pSim->SS.MaxVoxDisp;
+	MaxVoxKinE = pSim->SS.MaxVoxKinE;
+	MaxBondStrain = pSim->SS.MaxBondStrain;
+	MaxBondStress = pSim->SS.MaxBondStress;
+	MaxBondStrainE = pSim->SS.MaxBondStrainE;
+	MaxPressure = pSim->SS.MaxPressure;
+	MinPressure = pSim->SS.MinPressure;
+
+	int NumVox = pSim->NumVox();
+	Voxels.resize(NumVox); //keeps its capacity from the last capture
+	for (int i=0; i<NumVox; i++){
+		const CVXS_Voxel& CurVox = pSim->VoxArray[i];
+		CVXS_RenderVoxel& ThisVox = Voxels[i];
+		ThisVox.Pos = CurVox.GetCurPos();
+		ThisVox.Angle = CurVox.GetCurAngle();
+		ThisVox.CornerNeg = CurVox.GetCornerNeg();
+		ThisVox.CornerPos = CurVox.GetCornerPos();
+		ThisVox.ScaleFact = CurVox.GetCurScale() / CurVox.GetNominalSize();
+		ThisVox.Color = pView->GetCurVoxColor(i, -1);
+		ThisVox.XIndex = pSim->StoXIndexMap[i];
+		ThisVox.StaticFric = CurVox.GetCurStaticFric();
+	}
+
+	Bonds.clear();
+	ColBonds.clear();
+	if (WantBonds && NumVox > 0){
+		const CVXS_Voxel* pVoxBase = &pSim->VoxArray[0];
+		Bonds.resize(pSim->NumBond());
+		for (int i=0; i<(int)Bonds.size(); i++){
+			CVXS_BondInternal* pBond = &pSim->BondArrayInternal[i];
+			Bonds[i].V1 = (int)(pBond->GetpV1() - pVoxBase);
+			Bonds[i].V2 = (int)(pBond->GetpV2() - pVoxBase);
+			Bonds[i].Color = pView->GetInternalBondColor(pBond);
+		}
+		ColBonds.resize(pSim->NumColBond());
+		for (int i=0; i<(int)ColBonds.size(); i++){
+			CVXS_BondCollision* pBond = &pSim->BondArrayCollision[i];
+			ColBonds[i].V1 = (int)(pBond->GetpV1() - pVoxBase);
+			ColBonds[i].V2 = (int)(pBond->GetpV2() - pVoxBase);
+			ColBonds[i].Color = pView->GetCollisionBondColor(pBond);
+		}
+	}
+}
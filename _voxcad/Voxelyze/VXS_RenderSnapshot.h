@@ -0,0 +1,78 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#ifndef VXS_RENDERSNAPSHOT_H
+#define VXS_RENDERSNAPSHOT_H
+
+#include "Utils/Mesh.h" //CColor
+#include <vector>
+#include <atomic>
+
+class CVX_Sim;
+class CVXS_SimGLView;
+
+struct CVXS_RenderVoxel { //state of one voxel as the view draws it
+	Vec3D<> Pos;
+	CQuat<> Angle;
+	Vec3D<> CornerNeg, CornerPos; //current offsets of the corners from Pos (in the voxel's frame)
+	vfloat ScaleFact; //current scale over nominal size (for mesh vertices that are not at a corner)
+	CColor Color; //in the current view color, without the selection highlight
+	int XIndex; //CVX_Object index (for picking and selection)
+	bool StaticFric; //held by static friction
+};
+
+struct CVXS_RenderBond { //a bond as the view draws it
+	int V1, V2; //simulation indices of its voxels
+	CColor Color;
+};
+
+//!Everything CVXS_SimGLView needs to draw one step of a simulation
+/*!Taken by the simulation thread (Capture()) at the display rate, so drawing never reads the voxels while they are being integrated and the view does not need the simulation to calculate its statistics every step.*/
+class CVXS_RenderSnapshot
+{
+public:
+	CVXS_RenderSnapshot(void) {Clear();} //!< Constructor
+	void Clear(void); //!< Empties the snapshot.
+	void Capture(CVX_Sim* pSim, CVXS_SimGLView* pView, bool WantBonds); //!< Copies the current state of pSim, with colors in the current view color of pView. @param[in] pSim The simulation. @param[in] pView The view whose color settings to use. @param[in] WantBonds Also copy the bonds (only drawn in the bond view).
+	bool IsValid(void) const {return StepCount >= 0;} //!< Returns true once something has been captured.
+
+	int StepCount; //!< Simulation step (-1: empty)
+	vfloat Time; //!< Simulation time
+	int ViewCol; //!< ViewColor the colors were calculated for
+	Vec3D<> CurCM; //!< Center of mass
+
+	vfloat MaxVoxDisp, MaxVoxKinE, MaxBondStrain, MaxBondStress, MaxBondStrainE, MaxPressure, MinPressure; //!< Statistics the colors were scaled by (as in SimState)
+
+	std::vector<CVXS_RenderVoxel> Voxels; //!< In simulation order
+	std::vector<CVXS_RenderBond> Bonds; //!< Internal bonds, in simulation order (empty unless captured with WantBonds)
+	std::vector<CVXS_RenderBond> ColBonds; //!< Collision bonds (empty unless captured with WantBonds)
+};
+
+//!Hands snapshots from the simulation thread to the drawing thread without locks
+/*!Three snapshots rotate between the writer (the one being captured), the reader (the one being drawn) and the latest published one in between. Publish() and Acquire() only exchange indices, so neither side ever waits for the other: the reader always gets the newest complete snapshot, and snapshots it does not get around to drawing are simply overwritten. Only one thread may write and only one may read.*/
+class CVXS_SnapshotBuffer
+{
+public:
+	CVXS_SnapshotBuffer(void) {Back = 0; Middle = 1; Front = 2;} //!< Constructor
+
+	CVXS_RenderSnapshot* GetWriteBuffer(void) {return &Buffers[Back];} //!< Returns the snapshot to capture into (writer only).
+	void Publish(void) {Back = Middle.exchange(Back | FRESH_FLAG) & ~FRESH_FLAG;} //!< Makes the snapshot just captured the latest one (writer only).
+	const CVXS_RenderSnapshot* Acquire(void) {if (Middle.load() & FRESH_FLAG) Front = Middle.exchange(Front) & ~FRESH_FLAG; return &Buffers[Front];} //!< Returns the latest published snapshot, which stays valid until the next Acquire() (reader only).
+
+private:
+	enum {FRESH_FLAG = 4}; //set in Middle while it holds a snapshot the reader has not taken yet
+
+	CVXS_RenderSnapshot Buffers[3];
+	int Back; //written by the writer
+	std::atomic<int> Middle; //latest published (with FRESH_FLAG)
+	int Front; //drawn by the reader
+};
+
+#endif //VXS_RENDERSNAPSHOT_H
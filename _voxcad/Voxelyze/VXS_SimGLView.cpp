@@ -22,8 +22,11 @@ CVXS_SimGLView::CVXS_SimGLView(CVX_Sim* pSimIn)
 
 	ViewForce = false;
 	ViewAngles = false;
+	UseInstancing = true;
 
 	NeedStatsUpdate=true;
+	Publishing = false;
+	pSnap = NULL;
 	vectorsScalingView = 5.0;
 	plottingForces = false;
 
@@ -41,6 +44,7 @@ CVXS_SimGLView& CVXS_SimGLView::operator=(const CVXS_SimGLView& rGlView) //overl
 	NeedStatsUpdate = rGlView.NeedStatsUpdate;
 	ViewForce = rGlView.ViewForce;
 	ViewAngles = rGlView.ViewAngles;
+	UseInstancing = rGlView.UseInstancing;
 	CurViewMode = rGlView.CurViewMode;
 	CurViewCol = rGlView.CurViewCol;
 	CurViewVox = rGlView.CurViewVox;
@@ -53,7 +57,16 @@ void CVXS_SimGLView::Draw(int Selected, bool ViewSection, int SectionLayer)
 	if (!pSim->IsInitalized()) return;
 
 	if (CurViewMode == RVM_NONE) return;
-	else if (CurViewMode == RVM_VOXELS){ 
+
+	//draw the latest snapshot from the simulation thread, or take one now if it is not stepping
+	if (Publishing) pSnap = Snapshots.Acquire();
+	else {
+		LocalSnapshot.Capture(pSim, this, SnapshotWantsBonds());
+		pSnap = &LocalSnapshot;
+	}
+	if (!pSnap->IsValid() || pSnap->Voxels.size() != (size_t)pSim->NumVox()) return;
+
+	if (CurViewMode == RVM_VOXELS){ 
 		switch (CurViewVox){
 		case RVV_DISCRETE: DrawGeometry(Selected, ViewSection, SectionLayer); break; //section view only currently enabled in voxel view mode
 		case RVV_DEFORMED: DrawVoxMesh(Selected); break;
@@ -89,11 +102,16 @@ void CVXS_SimGLView::Draw(int Selected, bool ViewSection, int SectionLayer)
 
 	// if (pSim->IsFeatureEnabled(VXSFEAT_FLOOR)) DrawFloor(); //draw the floor if its in use
 //	if (pEnv->IsFloorEnabled()) DrawFloor(); //draw the floor if its in use
+}
 
-	NeedStatsUpdate=true;
+void CVXS_SimGLView::PublishSnapshot(void)
+{
+	Snapshots.GetWriteBuffer()->Capture(pSim, this, SnapshotWantsBonds());
+	Snapshots.Publish();
+	Publishing = true;
 }
 
-void CVXS_SimGLView::DrawForce(void)
+void CVXS_SimGLView::DrawForce(void) //reads the forces from the bonds of the simulation directly (they are not in the snapshots)
 {
 	CVXS_Voxel* pVox;
 
@@ -233,21 +251,24 @@ void CVXS_SimGLView::DrawFloor(void)
 
 void CVXS_SimGLView::DrawGeometry(int Selected, bool ViewSection, int SectionLayer, vfloat ScaleVox)
 {
+	if (UseInstancing && DrawGeometryInstanced(Selected, ViewSection, SectionLayer, ScaleVox)) return;
+
 	Vec3D<> Center;
 	Vec3D<> tmp(0,0,0);
 
-	int iT = pSim->NumVox();
+	int iT = (int)pSnap->Voxels.size();
 	int x, y, z;
 	CColor ThisColor;
 	for (int i = 0; i<iT; i++) //go through all the voxels...
 	{
-		pSim->pEnv->pObj->GetXYZNom(&x, &y, &z, pSim->StoXIndexMap[i]);
+		const CVXS_RenderVoxel& ThisVox = pSnap->Voxels[i];
+		pSim->pEnv->pObj->GetXYZNom(&x, &y, &z, ThisVox.XIndex);
 		if (ViewSection && z>SectionLayer) continue; //exit if obscured in a section view!
 
 
-		Center = pSim->VoxArray[i].GetCurPos();
+		Center = ThisVox.Pos;
 
-		ThisColor = GetCurVoxColor(i, Selected);
+		ThisColor = GetDrawColor(ThisVox, Selected);
 		glColor4d(ThisColor.r, ThisColor.g, ThisColor.b, ThisColor.a);
 		
 		// nac: debug: color surface voxels black
@@ -256,21 +277,21 @@ void CVXS_SimGLView::DrawGeometry(int Selected, bool ViewSection, int SectionLay
 		// 	glColor4d(0.0, 0.0, 0.0, 1.0);
 		// }
 		
-		Vec3D<> CenterOff = ScaleVox*(pSim->VoxArray[i].GetCornerPos() + pSim->VoxArray[i].GetCornerNeg())/2;
+		Vec3D<> CenterOff = ScaleVox*(ThisVox.CornerPos + ThisVox.CornerNeg)/2;
 
 
 		glPushMatrix();
 		glTranslated(Center.x + CenterOff.x, Center.y + CenterOff.y, Center.z + CenterOff.z);
 
-		glLoadName (pSim->StoXIndexMap[i]); //to enable picking
+		glLoadName (ThisVox.XIndex); //to enable picking
 
 		//generate rotation matrix here!!! (from quaternion)
 		Vec3D<> Axis;
 		vfloat AngleAmt;
-		CQuat<>(pSim->VoxArray[i].GetCurAngle()).AngleAxis(AngleAmt, Axis);
+		CQuat<>(ThisVox.Angle).AngleAxis(AngleAmt, Axis);
 		glRotated(AngleAmt*180/3.1415926, Axis.x, Axis.y, Axis.z);
 	
-		Vec3D<> CurrentSizeDisplay = pSim->VoxArray[i].GetSizeCurrent();
+		Vec3D<> CurrentSizeDisplay = ThisVox.CornerPos - ThisVox.CornerNeg;
 		glScaled(CurrentSizeDisplay.x, CurrentSizeDisplay.y, CurrentSizeDisplay.z); 
 
 		pSim->LocalVXC.Voxel.DrawVoxel(&Center, ScaleVox); //draw unit size since we scaled just now
@@ -323,6 +344,44 @@ void CVXS_SimGLView::DrawGeometry(int Selected, bool ViewSection, int SectionLay
 
 }
 
+bool CVXS_SimGLView::DrawGeometryInstanced(int Selected, bool ViewSection, int SectionLayer, vfloat ScaleVox)
+{
+	const CVXC_Voxel& VoxShape = pSim->LocalVXC.Voxel;
+	if (VoxShape.GetVoxName() != VS_BOX || !BoxInstancer.IsAvailable()) return false; //other shapes, picking or no instancing in this context
+
+	Vec3D<> Squeeze(VoxShape.GetXSqueeze(), VoxShape.GetYSqueeze(), VoxShape.GetZSqueeze());
+	int iT = (int)pSnap->Voxels.size();
+	BoxInstances.resize(iT);
+	int NumBoxes = 0;
+	int x, y, z;
+	for (int i = 0; i<iT; i++){
+		const CVXS_RenderVoxel& ThisVox = pSnap->Voxels[i];
+		pSim->pEnv->pObj->GetXYZNom(&x, &y, &z, ThisVox.XIndex);
+		if (ViewSection && z>SectionLayer) continue; //exit if obscured in a section view!
+
+		//the same transform DrawGeometry() builds on the matrix stack (including DrawVoxel() translating by the center again within the scaled frame)
+		Vec3D<> CurrentSizeDisplay = ThisVox.CornerPos - ThisVox.CornerNeg;
+		Vec3D<> CenterOff = ScaleVox*(ThisVox.CornerPos + ThisVox.CornerNeg)/2;
+		Vec3D<> Origin = ThisVox.Pos + CenterOff + ThisVox.Angle.RotateVec3D(CurrentSizeDisplay.Scale(ThisVox.Pos));
+		Vec3D<> Scale = ScaleVox*CurrentSizeDisplay.Scale(Squeeze);
+		CColor ThisColor = GetDrawColor(ThisVox, Selected);
+
+		CVXS_BoxInstance& ThisBox = BoxInstances[NumBoxes++];
+		ThisBox.Origin[0] = (float)Origin.x; ThisBox.Origin[1] = (float)Origin.y; ThisBox.Origin[2] = (float)Origin.z;
+		ThisBox.Quat[0] = (float)ThisVox.Angle.x; ThisBox.Quat[1] = (float)ThisVox.Angle.y; ThisBox.Quat[2] = (float)ThisVox.Angle.z; ThisBox.Quat[3] = (float)ThisVox.Angle.w;
+		ThisBox.Scale[0] = (float)Scale.x; ThisBox.Scale[1] = (float)Scale.y; ThisBox.Scale[2] = (float)Scale.z;
+		ThisBox.Color[0] = (float)ThisColor.r; ThisBox.Color[1] = (float)ThisColor.g; ThisBox.Color[2] = (float)ThisColor.b; ThisBox.Color[3] = (float)ThisColor.a;
+	}
+	BoxInstances.resize(NumBoxes);
+
+	return BoxInstancer.DrawBoxes(BoxInstances);
+}
+
+bool CVXS_SimGLView::ColorChangesWithStep(ViewColor Col)
+{
+	return !(Col == RVC_TYPE && pSim->pEnv->getGrowthAmplitude() <= 0); //as GetCurVoxColor(): only the material color is fixed
+}
+
 CColor CVXS_SimGLView::GetCurVoxColor(int SIndex, int Selected)
 {
 	if (pSim->StoXIndexMap[SIndex] == Selected) return CColor(1.0f, 0.0f, 1.0f, 1.0f); //highlight selected voxel (takes precedence...)
@@ -341,9 +400,10 @@ CColor CVXS_SimGLView::GetCurVoxColor(int SIndex, int Selected)
             // forward model loss
 //            return GetJet(4*pSim->VoxArray[SIndex].currentForwardModelError);
 //            return GetJet(pSim->VoxArray[SIndex].StressContribution);
-
+			float R, G, B, A; //otherwise the material color
+			pSim->VoxArray[SIndex].GetpMaterial()->GetColorf(&R, &G, &B, &A);
+			return CColor(R, G, B, A);
 		}
-		break;
 //				float R, G, B, A;
 //	//			LocalVXC.GetLeafMat(VoxArray[SIndex].GetVxcIndex())->GetColorf(&R, &G, &B, &A);
 //				pSim->VoxArray[SIndex].GetpMaterial()->GetColorf(&R, &G, &B, &A);
@@ -534,7 +594,7 @@ void CVXS_SimGLView::DrawSurfMesh(int Selected)
 	//if simulation has a mesh, draw it...
 
 	//otherwise
-	SmoothMesh.UpdateMesh(Selected); //updates the generated mesh
+	SmoothMesh.UpdateMesh(Selected, pSnap); //updates the generated mesh
 	SmoothMesh.Draw();
 
 	PlotVectors curVectPlot;
@@ -546,44 +606,35 @@ void CVXS_SimGLView::DrawSurfMesh(int Selected)
 void CVXS_SimGLView::DrawVoxMesh(int Selected)
 {
 	// nac, this is the mesh we want
-	VoxMesh.UpdateMesh(Selected); //updates the generated mesh
+	VoxMesh.UpdateMesh(Selected, pSnap); //updates the generated mesh
 	VoxMesh.Draw(plottingForces, curVectPlot, vectorsScalingView);
 }
 
 
 void CVXS_SimGLView::DrawBonds(void)
 {
-//	bool DrawInputBond = true;
-
-	Vec3D<> P1, P2, Axis;
-	CVXS_Voxel* pV1, *pV2;
-	vfloat AngleAmt;
+	Vec3D<> P1, P2;
 	int NumSegs = 12; //number segments for smooth bonds
 
+	int iT = (int)pSnap->Bonds.size();
+	if (iT != pSim->NumBond()) iT = 0; //captured before the view switched to bonds
 
-	float PrevLineWidth;
-	glGetFloatv(GL_LINE_WIDTH, &PrevLineWidth);
-	glLineWidth(3.0);
-	glDisable(GL_LIGHTING);
-
-	int iT = pSim->NumBond();
-
+	Lines.Clear();
+	Lines.Reserve((CurViewVox == RVV_SMOOTH ? NumSegs : 1)*iT + (int)pSnap->ColBonds.size());
 	for (int i = 0; i<iT; i++) //go through all the bonds...
 	{
-		CVXS_BondInternal* pBond = &pSim->BondArrayInternal[i];
-		pV1 = pBond->GetpV1(); pV2 = pBond->GetpV2();
-
-		//set color
-		CColor ThisColor = GetInternalBondColor(pBond);
-		glColor4f(ThisColor.r, ThisColor.g, ThisColor.b, ThisColor.a);
+		const CVXS_RenderBond& ThisBond = pSnap->Bonds[i];
+		const CVXS_BondInternal* pBond = &pSim->BondArrayInternal[i]; //(only for its direction)
+		const CVXS_RenderVoxel& V1 = pSnap->Voxels[ThisBond.V1];
+		const CVXS_RenderVoxel& V2 = pSnap->Voxels[ThisBond.V2];
+		const CColor& ThisColor = ThisBond.Color;
 
-		P1 = pV1->GetCurPos();
-		P2 = pV2->GetCurPos();
+		P1 = V1.Pos;
+		P2 = V2.Pos;
 
 		if (CurViewVox == RVV_SMOOTH){
-			CQuat<>A1 = pV1->GetCurAngle();
-			CQuat<>A2 = pV2->GetCurAngle();
-			A1.AngleAxis(AngleAmt, Axis); //get angle/axis for A1
+			CQuat<>A1 = V1.Angle;
+			CQuat<>A2 = V2.Angle;
 
 			Vec3D<> Pos2L = A1.RotateVec3DInv(P2-P1); //Get PosDif in local coordinate system
 			CQuat<> Angle2L = A2*A1.Conjugate(); //rotate A2 by A1
@@ -597,49 +648,26 @@ void CVXS_SimGLView::DrawBonds(void)
 			vfloat az = (-Angle2LV.y*L-2*Pos2L.z)/(L*L*L);
 			vfloat bz = (3*Pos2L.z+Angle2LV.y*L)/(L*L);
 
-			glPushMatrix();
-			glTranslated(P1.x, P1.y, P1.z);
-			glRotated(AngleAmt*180/3.1415926, Axis.x, Axis.y, Axis.z); //rotate to voxel 1's coordinate system
-			glBegin(GL_LINE_STRIP);
-			glLoadName (-1); //to disable picking
-
-			for (int i=0; i<=NumSegs; i++){
-				vfloat iL = ((float)i)/NumSegs*L;
+			Vec3D<> LastPoint = P1;
+			for (int j=1; j<=NumSegs; j++){ //curve in voxel 1's coordinate system
+				vfloat iL = ((float)j)/NumSegs*L;
 				Vec3D<> ThisPoint = Vec3D<>(iL, ay*iL*iL*iL + by*iL*iL, az*iL*iL*iL + bz*iL*iL);
 				pBond->ToOrigDirBond(&ThisPoint);
-				glVertex3d(ThisPoint.x, ThisPoint.y, ThisPoint.z);
+				ThisPoint = P1 + A1.RotateVec3D(ThisPoint);
+				Lines.AddLine(LastPoint, ThisPoint, ThisColor);
+				LastPoint = ThisPoint;
 			}
-
-			glEnd();
-			glPopMatrix();
-		}
-		else { //straight lines (faster)
-			glBegin(GL_LINES);
-			glLoadName (-1); //to disable picking
-
-			if (ThisColor.a != 0.0) {glVertex3f((float)P1.x, (float)P1.y, (float)P1.z); glVertex3f((float)P2.x, (float)P2.y, (float)P2.z);}
-
-			glEnd();
-
 		}
+		else if (ThisColor.a != 0.0) Lines.AddLine(P1, P2, ThisColor); //straight lines (faster)
 	}
 
-	iT = pSim->NumColBond();
-	glBegin(GL_LINES);
-	glLoadName (-1); //to disable picking
+	iT = (int)pSnap->ColBonds.size();
 	for (int i = 0; i<iT; i++) //go through all the bonds...
 	{
-		pV1 = pSim->BondArrayCollision[i].GetpV1(); pV2 = pSim->BondArrayCollision[i].GetpV2();
-
-		CColor ThisColor = GetCollisionBondColor(&pSim->BondArrayCollision[i]);
-		P1 = pV1->GetCurPos();
-		P2 = pV2->GetCurPos();
-
-		glColor4f(ThisColor.r, ThisColor.g, ThisColor.b, ThisColor.a);
-			if (ThisColor.a != 0.0) {glVertex3f((float)P1.x, (float)P1.y, (float)P1.z); glVertex3f((float)P2.x, (float)P2.y, (float)P2.z);}
+		const CVXS_RenderBond& ThisBond = pSnap->ColBonds[i];
+		if (ThisBond.Color.a != 0.0) Lines.AddLine(pSnap->Voxels[ThisBond.V1].Pos, pSnap->Voxels[ThisBond.V2].Pos, ThisBond.Color);
 	}
 
-
 	////input bond
 	//if (DrawInputBond && BondInput->GetpV1() && BondInput->GetpV2()){
 	//	glColor4f(1.0, 0, 0, 1.0);
@@ -648,12 +676,7 @@ void CVXS_SimGLView::DrawBonds(void)
 	//	glVertex3f((float)P1.x, (float)P1.y, (float)P1.z); glVertex3f((float)P2.x, (float)P2.y, (float)P2.z);
 	//}
 
-	glEnd();
-
-	glLineWidth(PrevLineWidth);
-	glEnable(GL_LIGHTING);
-
-
+	Lines.Draw(3.0); //all bonds in one call
 }
 //
 //void CVXS_SimGLView::DrawMiniVoxels() //draws grab-able mini voxels with space to show bonds or forces
@@ -696,37 +719,21 @@ void CVXS_SimGLView::DrawBonds(void)
 void CVXS_SimGLView::DrawAngles(void)
 {
 	//draw directions
-	float PrevLineWidth;
-	glGetFloatv(GL_LINE_WIDTH, &PrevLineWidth);
-	glLineWidth(2.0);
-	glDisable(GL_LIGHTING);
-
-	glBegin(GL_LINES);
-
-	for (int i = 0; i < pSim->NumVox(); i++){ //go through all the voxels... (GOOD FOR ONLY SMALL DISPLACEMENTS, I THINK... think through transformations here!)
-		glColor3f(1,0,0); //+X direction
-		glVertex3d(pSim->VoxArray[i].GetCurPos().x, pSim->VoxArray[i].GetCurPos().y, pSim->VoxArray[i].GetCurPos().z);
-		Vec3D<> Axis1(pSim->LocalVXC.GetLatticeDim()/4,0,0);
-		Vec3D<> RotAxis1 = (pSim->VoxArray[i].GetCurAngle()*CQuat<>(Axis1)*pSim->VoxArray[i].GetCurAngle().Conjugate()).ToVec();
-		glVertex3d(pSim->VoxArray[i].GetCurPos().x + RotAxis1.x, pSim->VoxArray[i].GetCurPos().y + RotAxis1.y, pSim->VoxArray[i].GetCurPos().z + RotAxis1.z);
-
-		glColor3f(0,1,0); //+Y direction
-		glVertex3d(pSim->VoxArray[i].GetCurPos().x, pSim->VoxArray[i].GetCurPos().y, pSim->VoxArray[i].GetCurPos().z);
-		Axis1 = Vec3D<>(0, pSim->LocalVXC.GetLatticeDim()/4,0);
-		RotAxis1 = (pSim->VoxArray[i].GetCurAngle()*CQuat<>(Axis1)*pSim->VoxArray[i].GetCurAngle().Conjugate()).ToVec();
-		glVertex3d(pSim->VoxArray[i].GetCurPos().x + RotAxis1.x, pSim->VoxArray[i].GetCurPos().y + RotAxis1.y, pSim->VoxArray[i].GetCurPos().z + RotAxis1.z);
-
-		glColor3f(0,0,1); //+Z direction
-		glVertex3d(pSim->VoxArray[i].GetCurPos().x, pSim->VoxArray[i].GetCurPos().y, pSim->VoxArray[i].GetCurPos().z);
-		Axis1 = Vec3D<>(0,0, pSim->LocalVXC.GetLatticeDim()/4);
-		RotAxis1 = (pSim->VoxArray[i].GetCurAngle()*CQuat<>(Axis1)*pSim->VoxArray[i].GetCurAngle().Conjugate()).ToVec();
-		glVertex3d(pSim->VoxArray[i].GetCurPos().x + RotAxis1.x, pSim->VoxArray[i].GetCurPos().y + RotAxis1.y, pSim->VoxArray[i].GetCurPos().z + RotAxis1.z);
-
+	vfloat AxisLength = pSim->LocalVXC.GetLatticeDim()/4;
+	int iT = (int)pSnap->Voxels.size();
+
+	Lines.Clear();
+	Lines.Reserve(3*iT);
+	for (int i = 0; i < iT; i++){ //go through all the voxels... (GOOD FOR ONLY SMALL DISPLACEMENTS, I THINK... think through transformations here!)
+		const Vec3D<>& Pos = pSnap->Voxels[i].Pos;
+		const CQuat<>& Angle = pSnap->Voxels[i].Angle;
+
+		Lines.AddLine(Pos, Pos + Angle.RotateVec3D(Vec3D<>(AxisLength, 0, 0)), CColor(1, 0, 0)); //+X direction
+		Lines.AddLine(Pos, Pos + Angle.RotateVec3D(Vec3D<>(0, AxisLength, 0)), CColor(0, 1, 0)); //+Y direction
+		Lines.AddLine(Pos, Pos + Angle.RotateVec3D(Vec3D<>(0, 0, AxisLength)), CColor(0, 0, 1)); //+Z direction
 	}
-	glEnd();
 
-	glLineWidth(PrevLineWidth);
-	glEnable(GL_LIGHTING);
+	Lines.Draw(2.0); //all axes in one call
 }
 
 void CVXS_SimGLView::DrawStaticFric(void)
@@ -735,11 +742,11 @@ void CVXS_SimGLView::DrawStaticFric(void)
 	glBegin(GL_TRIANGLES);
 	glColor4f(255, 255, 0, 1.0);
 	vfloat dist = pSim->VoxArray[0].GetNominalSize()/3; //needs work!!
-	int iT = pSim->NumVox();
+	int iT = (int)pSnap->Voxels.size();
 	Vec3D<> P1;
 	for (int i = 0; i<iT; i++){ //go through all the voxels...
-		if (pSim->VoxArray[i].GetCurStaticFric()){ //draw point if static friction...
-			P1 = pSim->VoxArray[i].GetCurPos();
+		if (pSnap->Voxels[i].StaticFric){ //draw point if static friction...
+			P1 = pSnap->Voxels[i].Pos;
 			glVertex3f((float)P1.x, (float)P1.y, (float)P1.z); 
 			glVertex3f((float)P1.x, (float)(P1.y - dist/2), (float)(P1.z + dist));
 			glVertex3f((float)P1.x, (float)(P1.y + dist/2), (float)(P1.z + dist));
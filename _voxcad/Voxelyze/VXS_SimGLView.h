@@ -12,6 +12,8 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #define VX_SIMGLUTILS_H
 
 #include "VX_Sim.h"
+#include "VXS_RenderSnapshot.h"
+#include "VXS_GLBatch.h"
 
 #ifdef QT_GUI_LIB
 #include <qgl.h>
@@ -81,6 +83,8 @@ public:
 	void SetViewAngles(bool Enabled) {ViewAngles=Enabled;}
 	bool GetViewForce() {return ViewForce;}
 	bool GetViewAngles() {return ViewAngles;}
+	void SetInstancedDrawing(bool Enabled) {UseInstancing=Enabled;} //draw box voxels with one instanced call per frame when the GL context supports it
+	bool GetInstancedDrawing() {return UseInstancing;}
 
 	int StatRqdToDraw(); //returns the stats bitfield that we need to calculate to draw the current view.
 
@@ -90,6 +94,14 @@ public:
 	bool NeedStatsUpdate; //do we need to re-calculate statistics relevant to the opengl view? i.e. maximums...
 	CColor GetJet(vfloat val){if (val > 0.75) return CColor(1, 4-val*4, 0, 1.0);	else if (val > 0.5) return CColor(val*4-2, 1, 0, 1.0); else if (val > 0.25) return CColor(0, 1, 2-val*4, 1.0); else return CColor(0, val*4, 1, 1.0);};
 	CColor GetCurVoxColor(int SIndex, int Selected);
+	bool ColorChangesWithStep(ViewColor Col); //false if GetCurVoxColor() gives the same colors every step in this view color (material colors without growth)
+	CColor GetInternalBondColor(CVXS_BondInternal* pBond);
+	CColor GetCollisionBondColor(CVXS_BondCollision* pBond);
+
+	//snapshots for drawing while the simulation runs in another thread
+	bool SnapshotWantsBonds(void) {return CurViewMode == RVM_BONDS;} //the bonds are only captured if they will be drawn
+	void PublishSnapshot(void); //captures the current state of the simulation for Draw() (call from the simulation thread, between time steps)
+	void StopPublishing(void) {Publishing = false;} //Draw() reads the simulation directly again (call when the simulation thread stops stepping)
 
 	void ChangeSkyColor(float r, float g, float b);
 
@@ -102,12 +114,23 @@ private:
 
 	bool ViewForce; //look at force vectors?
 	bool ViewAngles; //look at axes for each point?
+	bool UseInstancing; //draw voxels through BoxInstancer if possible?
 
 
 
-	CColor GetInternalBondColor(CVXS_BondInternal* pBond);
-	CColor GetCollisionBondColor(CVXS_BondCollision* pBond);
+	CVXS_SnapshotBuffer Snapshots; //published by the simulation thread
+	std::atomic<bool> Publishing; //true while the simulation thread publishes snapshots
+	CVXS_RenderSnapshot LocalSnapshot; //taken by Draw() itself when nothing is being published
+	const CVXS_RenderSnapshot* pSnap; //the snapshot being drawn
+	CColor GetDrawColor(const CVXS_RenderVoxel& Vox, int Selected) {return Vox.XIndex == Selected ? CColor(1.0f, 0.0f, 1.0f, 1.0f) : Vox.Color;} //highlights the selected voxel (as GetCurVoxColor())
 
+#ifdef USE_OPEN_GL
+	//batched drawing
+	CVXS_BoxInstancer BoxInstancer;
+	std::vector<CVXS_BoxInstance> BoxInstances; //kept between frames to avoid reallocating
+	CVXS_LineBatch Lines;
+	bool DrawGeometryInstanced(int Selected, bool ViewSection, int SectionLayer, vfloat ScaleVox); //returns false if the voxels must be drawn one by one
+#endif
 
 	//Drawing
 	void DrawGeometry(int Selected = -1, bool ViewSection=false, int SectionLayer=0, vfloat ScaleVox = 1.0);
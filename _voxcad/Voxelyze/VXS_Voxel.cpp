@@ -11,6 +11,7 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #include "VXS_Voxel.h"
 #include "VXS_Bond.h"
 #include "VX_Sim.h"
+#include "VX_SettleCache.h"
 #include <iostream>
 #include <math.h>
 #include <algorithm>
@@ -98,6 +99,7 @@ void CVXS_Voxel::ResetVoxel(void) //resets this voxel to its default (imported)
 	
 	StressIntegral = 0.0;
 	PressureIntegral = 0.0;
+	ForwardModelErrorIntegral = 0.0;
 
 	GrowthAccretion = 0;
 	SurpriseAccretion = 0;
@@ -131,6 +133,55 @@ void CVXS_Voxel::ResetVoxel(void) //resets this voxel to its default (imported)
 	StrainNegDirsCur = Vec3D<>(0,0,0);
 }
 
+void CVXS_Voxel::WriteState(std::ostream& os) const
+{
+	SCWrite(os, Pos); SCWrite(os, LinMom); SCWrite(os, Angle); SCWrite(os, AngMom);
+	SCWrite(os, Scale); SCWrite(os, lastScale); SCWrite(os, CornerPosCur); SCWrite(os, CornerNegCur);
+	SCWrite(os, StaticFricFlag); SCWrite(os, VYielded); SCWrite(os, VBroken);
+	SCWrite(os, Vel); SCWrite(os, KineticEnergy); SCWrite(os, AngVel);
+	SCWrite(os, Pressure); SCWrite(os, Stress); SCWrite(os, StressIntegral); SCWrite(os, PressureIntegral);
+	SCWrite(os, ForceCurrent); SCWrite(os, StrainPosDirsCur); SCWrite(os, StrainNegDirsCur);
+	SCWrite(os, m_Red); SCWrite(os, m_Green); SCWrite(os, m_Blue); SCWrite(os, m_Trans);
+	SCWrite(os, Vox_E); SCWrite(os, currSize); SCWrite(os, AdjTempAmp);
+
+	//controller, regeneration and forward model state
+	SCWrite(os, oldMotorOutput); SCWriteVec(os, ControllerNeuronValues);
+	SCWrite(os, currRegenModelOutput); SCWrite(os, GrowthDirection); SCWrite(os, lastSurprise); SCWrite(os, currSurprise);
+	SCWrite(os, RegenTimeLeft); SCWrite(os, SurpriseAccretion); SCWrite(os, GrowthAccretion); SCWriteVec(os, RegenerationModelNeuronValues);
+	SCWriteVec(os, ForwardModelNeuronValues); SCWrite(os, oldForwardModelError); SCWrite(os, currentForwardModelError); SCWrite(os, ForwardModelErrorIntegral);
+
+	//sensing and signaling
+	SCWrite(os, LightIntensity); SCWrite(os, DragForce);
+	SCWrite(os, ElectricallyActiveOld); SCWrite(os, ElectricallyActiveNew);
+	SCWrite(os, MembranePotentialOld); SCWrite(os, MembranePotentialNew);
+	SCWrite(os, RepolarizationStartTime); SCWrite(os, Voltage);
+}
+
+bool CVXS_Voxel::ReadState(std::istream& is)
+{
+	SCRead(is, &Pos); SCRead(is, &LinMom); SCRead(is, &Angle); SCRead(is, &AngMom);
+	SCRead(is, &Scale); SCRead(is, &lastScale); SCRead(is, &CornerPosCur); SCRead(is, &CornerNegCur);
+	SCRead(is, &StaticFricFlag); SCRead(is, &VYielded); SCRead(is, &VBroken);
+	SCRead(is, &Vel); SCRead(is, &KineticEnergy); SCRead(is, &AngVel);
+	SCRead(is, &Pressure); SCRead(is, &Stress); SCRead(is, &StressIntegral); SCRead(is, &PressureIntegral);
+	SCRead(is, &ForceCurrent); SCRead(is, &StrainPosDirsCur); SCRead(is, &StrainNegDirsCur);
+	SCRead(is, &m_Red); SCRead(is, &m_Green); SCRead(is, &m_Blue); SCRead(is, &m_Trans);
+	vfloat CachedE;
+	SCRead(is, &CachedE); SCRead(is, &currSize); SCRead(is, &AdjTempAmp);
+	if (CachedE != Vox_E) SetEMod(CachedE); //keeps the cached damping/stiffness quantities consistent
+
+	SCRead(is, &oldMotorOutput); SCReadVec(is, &ControllerNeuronValues);
+	SCRead(is, &currRegenModelOutput); SCRead(is, &GrowthDirection); SCRead(is, &lastSurprise); SCRead(is, &currSurprise);
+	SCRead(is, &RegenTimeLeft); SCRead(is, &SurpriseAccretion); SCRead(is, &GrowthAccretion); SCReadVec(is, &RegenerationModelNeuronValues);
+	SCReadVec(is, &ForwardModelNeuronValues); SCRead(is, &oldForwardModelError); SCRead(is, &currentForwardModelError); SCRead(is, &ForwardModelErrorIntegral);
+
+	SCRead(is, &LightIntensity); SCRead(is, &DragForce);
+	SCRead(is, &ElectricallyActiveOld); SCRead(is, &ElectricallyActiveNew);
+	SCRead(is, &MembranePotentialOld); SCRead(is, &MembranePotentialNew);
+	SCRead(is, &RepolarizationStartTime);
+	return SCRead(is, &Voltage);
+}
+
 
 bool CVXS_Voxel::LinkColBond(int CBondIndex) //simulation bond index...
 {
@@ -414,11 +465,12 @@ Vec3D<> CVXS_Voxel::CalcTotalForce()
 
 
 	//Forces from permanent bonds:
-	for (int i=0; i<6; i++){
-		CVXS_Bond* pThisBond = InternalBondPointers[i];
+	int NumSlots = NumInternalBondSlots();
+	for (int i=0; i<NumSlots; i++){
+		CVXS_Bond* pThisBond = GetpInternalBondSlot(i);
 		if (!pThisBond) continue;
 
-		if (IAmInternalVox2(i)) TotalForce += pThisBond->GetForce2();
+		if (IAmInternalVox2Slot(i)) TotalForce += pThisBond->GetForce2();
 		else TotalForce += pThisBond->GetForce1();
 
 
@@ -528,24 +580,25 @@ Vec3D<> CVXS_Voxel::CalcTotalForce()
 
 		//TODO: get down to a force for this bond, then dump it (and current stiffness) to the bond
 //		for (int i=0; i<NumLocBond; i++){
-		for (int i=0; i<6; i++){
+		for (int i=0; i<NumSlots; i++){
 //			CVXS_Bond* pThisBond = GetBond(i);
-			CVXS_Bond* pThisBond = InternalBondPointers[i];
+			CVXS_Bond* pThisBond = GetpInternalBondSlot(i);
 			if (!pThisBond) continue;
 
-			bool IAmVox1 = !IAmInternalVox2(i); //IsMe(pThisBond->GetpV1()); //otherwise vox 2 of the bond
+			bool IAmVox1 = !IAmInternalVox2Slot(i); //IsMe(pThisBond->GetpV1()); //otherwise vox 2 of the bond
+			vfloat NomArea = pThisBond->GetNominalArea(); //NominalSize^2 unless bonded to a voxel of different size
 			switch (pThisBond->GetBondAxis()){
 			case AXIS_X:
-				if (IAmVox1) {pThisBond->TStrainSum1 = CurLocStrain.y + CurLocStrain.z; pThisBond->CSArea1 = (1+CurLocStrain.y)*(1+CurLocStrain.z)*NominalSize*NominalSize;}
-				else {pThisBond->TStrainSum2 = CurLocStrain.y + CurLocStrain.z; pThisBond->CSArea2 = (1+CurLocStrain.y)*(1+CurLocStrain.z)*NominalSize*NominalSize;}
+				if (IAmVox1) {pThisBond->TStrainSum1 = CurLocStrain.y + CurLocStrain.z; pThisBond->CSArea1 = (1+CurLocStrain.y)*(1+CurLocStrain.z)*NomArea;}
+				else {pThisBond->TStrainSum2 = CurLocStrain.y + CurLocStrain.z; pThisBond->CSArea2 = (1+CurLocStrain.y)*(1+CurLocStrain.z)*NomArea;}
 				break;
 			case AXIS_Y:
-				if (IAmVox1) {pThisBond->TStrainSum1 = CurLocStrain.x + CurLocStrain.z; pThisBond->CSArea1 = (1+CurLocStrain.x)*(1+CurLocStrain.z)*NominalSize*NominalSize;}
-				else {pThisBond->TStrainSum2 = CurLocStrain.x + CurLocStrain.z; pThisBond->CSArea2 = (1+CurLocStrain.x)*(1+CurLocStrain.z)*NominalSize*NominalSize;}
+				if (IAmVox1) {pThisBond->TStrainSum1 = CurLocStrain.x + CurLocStrain.z; pThisBond->CSArea1 = (1+CurLocStrain.x)*(1+CurLocStrain.z)*NomArea;}
+				else {pThisBond->TStrainSum2 = CurLocStrain.x + CurLocStrain.z; pThisBond->CSArea2 = (1+CurLocStrain.x)*(1+CurLocStrain.z)*NomArea;}
 				break;
 			case AXIS_Z:
-				if (IAmVox1) {pThisBond->TStrainSum1 = CurLocStrain.y + CurLocStrain.x;  pThisBond->CSArea1 = (1+CurLocStrain.y)*(1+CurLocStrain.x)*NominalSize*NominalSize;}
-				else {pThisBond->TStrainSum2 = CurLocStrain.y + CurLocStrain.x;  pThisBond->CSArea2 = (1+CurLocStrain.y)*(1+CurLocStrain.x)*NominalSize*NominalSize;}
+				if (IAmVox1) {pThisBond->TStrainSum1 = CurLocStrain.y + CurLocStrain.x;  pThisBond->CSArea1 = (1+CurLocStrain.y)*(1+CurLocStrain.x)*NomArea;}
+				else {pThisBond->TStrainSum2 = CurLocStrain.y + CurLocStrain.x;  pThisBond->CSArea2 = (1+CurLocStrain.y)*(1+CurLocStrain.x)*NomArea;}
 				break;
 			}
 		}
@@ -554,10 +607,10 @@ Vec3D<> CVXS_Voxel::CalcTotalForce()
 //		SizeCurrent = Vec3D<>(NominalSize, NominalSize, NominalSize);
 		//for (int i=0; i<NumLocBond; i++){
 		//	CVXS_Bond* pThisBond = GetBond(i);
-		for (int i=0; i<6; i++){ //update for collision bonds?
-			CVXS_Bond* pThisBond = InternalBondPointers[i];
+		for (int i=0; i<NumSlots; i++){ //update for collision bonds?
+			CVXS_Bond* pThisBond = GetpInternalBondSlot(i);
 			if (pThisBond){
-				pThisBond->CSArea1 = pThisBond->CSArea2 = NominalSize*NominalSize;
+				pThisBond->CSArea1 = pThisBond->CSArea2 = pThisBond->GetNominalArea();
 				//pThisBond->CSArea2 = NominalSize*NominalSize;
 			}
 		}
@@ -589,11 +642,12 @@ Vec3D<> CVXS_Voxel::CalcTotalMoment(void)
 	Vec3D<> TotalMoment(0,0,0);
 //	for (int i=0; i<GetNumLocalBonds(); i++) {
 	//permanent bonds
-	for (int i=0; i<6; i++){ //update for collision bonds?
-		CVXS_Bond* pThisBond = InternalBondPointers[i];
+	int NumSlots = NumInternalBondSlots();
+	for (int i=0; i<NumSlots; i++){ //update for collision bonds?
+		CVXS_Bond* pThisBond = GetpInternalBondSlot(i);
 		if (pThisBond){
-			if (IAmInternalVox2(i)){ TotalMoment -= InternalBondPointers[i]->GetMoment2(); } //if this is voxel 2		//add moments from bond
-			else { TotalMoment -= InternalBondPointers[i]->GetMoment1(); } //if this is voxel 1
+			if (IAmInternalVox2Slot(i)){ TotalMoment -= pThisBond->GetMoment2(); } //if this is voxel 2		//add moments from bond
+			else { TotalMoment -= pThisBond->GetMoment1(); } //if this is voxel 1
 		}
 	}
 
@@ -684,9 +738,9 @@ Vec3D<> CVXS_Voxel::CalcGndDampEffect() //damps everything to ground as qucik as
 vfloat CVXS_Voxel::GetMaxBondStrain(void) const
 {
 	vfloat MxSt = 0;
-	for (int i=0; i<6; i++){
-		if (InternalBondPointers[i] != NULL){
-			vfloat TSt = InternalBondPointers[i]->GetEngStrain();
+	for (int i=0; i<NumInternalBondSlots(); i++){
+		if (GetpInternalBondSlot(i) != NULL){
+			vfloat TSt = GetpInternalBondSlot(i)->GetEngStrain();
 			if (TSt>MxSt) MxSt = TSt; 
 		}
 	}
@@ -696,9 +750,9 @@ vfloat CVXS_Voxel::GetMaxBondStrain(void) const
 vfloat CVXS_Voxel::GetMaxBondStrainE(void) const
 {
 	vfloat MxSt = 0;
-	for (int i=0; i<6; i++){
-		if (InternalBondPointers[i] != NULL){
-			vfloat TSt = InternalBondPointers[i]->GetStrainEnergy();
+	for (int i=0; i<NumInternalBondSlots(); i++){
+		if (GetpInternalBondSlot(i) != NULL){
+			vfloat TSt = GetpInternalBondSlot(i)->GetStrainEnergy();
 			if (TSt>MxSt) MxSt = TSt; 
 		}
 	}
@@ -709,9 +763,9 @@ vfloat CVXS_Voxel::GetMaxBondStress(void) const
 {
 	vfloat MxSt = 0;
 //	for (int i=0; i<NumLocalBonds; i++){
-	for (int i=0; i<6; i++){
-		if (InternalBondPointers[i] != NULL){
-			vfloat TSt = InternalBondPointers[i]->GetEngStress();
+	for (int i=0; i<NumInternalBondSlots(); i++){
+		if (GetpInternalBondSlot(i) != NULL){
+			vfloat TSt = GetpInternalBondSlot(i)->GetEngStress();
 			if (TSt>MxSt) MxSt = TSt; 
 		}
 	}
@@ -737,14 +791,14 @@ void CVXS_Voxel::SetEMod(vfloat Vox_E_in)
 	// FC: Now that we've changed the Elastic Modulus of this voxel, we need to update all the involved permanent bonds:
 	// checking all of them
 
-	for (int i=0; i<6; i++)
+	for (int i=0; i<NumInternalBondSlots(); i++)
 	{
-		CVXS_Bond* pThisBond = InternalBondPointers[i];
+		CVXS_Bond* pThisBond = GetpInternalBondSlot(i);
 		if (!pThisBond) continue;
 
 		// A call to LinkVoxels should do.
 		pThisBond->LinkVoxels(pThisBond->GetpV1()->MySIndex, pThisBond->GetpV2()->MySIndex);
-
+		PROFILE_WORK(pSim, MySIndex, WC_BOND_RELINKS, 1);
 	}
 
 	// Need to update collision bonds too!
@@ -756,6 +810,7 @@ void CVXS_Voxel::SetEMod(vfloat Vox_E_in)
 
 		// A call to LinkVoxels should do.
 		pThisBond->LinkVoxels(pThisBond->GetpV1()->MySIndex, pThisBond->GetpV2()->MySIndex);
+		PROFILE_WORK(pSim, MySIndex, WC_BOND_RELINKS, 1);
 	}
 }
 
@@ -850,6 +905,7 @@ double CVXS_Voxel::getNewScale()
 //            if (RegenTempFact < -pSim->pEnv->getGrowthSpeedLimit()) {RegenTempFact = -pSim->pEnv->getGrowthSpeedLimit();}
 //            if (RegenTempFact > pSim->pEnv->getGrowthSpeedLimit()) {RegenTempFact = pSim->pEnv->getGrowthSpeedLimit();}
 	        GrowthAccretion += RegenTempFact;
+	        PROFILE_WORK(pSim, MySIndex, WC_GROWTH_STEPS, 1);
         }
     }
 
@@ -858,6 +914,7 @@ double CVXS_Voxel::getNewScale()
 	{
 		// cpg:
 		CtrlTempFact = thisCTE*TempAmplitude * sin(2*3.1415926f*(pSim->CurTime/TempPeriod + thisPhaseOffset+DevPhaseAddOn));
+		PROFILE_WORK(pSim, MySIndex, WC_SIN_CALLS, 1);
 		// neural net:
 		if (ControllerNeuronValues[7] > 0) {CtrlTempFact = thisCTE*TempAmplitude*ControllerNeuronValues[7];}
 	}
@@ -920,6 +977,7 @@ void CVXS_Voxel::UpdateElectricalSignaling()
             // std::cout << "IN REPOLARIZATION" << std::endl;
             ElectricallyActiveNew = false;
             Voltage = sin(2*3.1415926f*(pSim->CurTime - RepolarizationStartTime)/pSim->pEnv->GetTempPeriod()*pSim->pEnv->GetRepolarizationsPerTempCycle());
+            PROFILE_WORK(pSim, MySIndex, WC_SIN_CALLS, 1);
         }
         // if able to collect voltage
         else
@@ -952,6 +1010,8 @@ void CVXS_Voxel::UpdateController()
 
     // neuron 1: CPG node
     ControllerNeuronValues[1] = sin(2*3.1415926f * (pSim->CurTime/TempPeriod));
+    PROFILE_WORK(pSim, MySIndex, WC_SIN_CALLS, 1);
+    PROFILE_WORK(pSim, MySIndex, WC_NEURON_EVALS, ControllerNeuronValues.size());
 
     // neuron 2: touch sensor
     if (GetCurGroundPenetration() > 0.0) { ControllerNeuronValues[2] = 1.0; }
@@ -1037,6 +1097,7 @@ vfloat CVXS_Voxel::GetActualSensorData()
 void CVXS_Voxel::UpdateForwardModel()
 {
     oldForwardModelError = currentForwardModelError;
+    PROFILE_WORK(pSim, MySIndex, WC_NEURON_EVALS, ForwardModelNeuronValues.size());
     if (pSim->pEnv->GetSignalingUpdatesPerTempCycle() > 0)
     {
         UpdateForwardModel_With_Signaling();
@@ -1170,6 +1231,7 @@ void CVXS_Voxel::UpdateForwardModel_Without_Signaling()
 
 void CVXS_Voxel::UpdateRegenerationModel()
 {
+    PROFILE_WORK(pSim, MySIndex, WC_REGEN_UPDATES, 1);
     if (pSim->pEnv->getUsingGreedyGrowth())
     {
         UpdateGreedyGrowth();
@@ -1227,6 +1289,8 @@ void CVXS_Voxel::UpdateGreedyGrowth()
 
 void CVXS_Voxel::UpdateRegenerationNetwork()
 {
+    PROFILE_WORK(pSim, MySIndex, WC_NEURON_EVALS, RegenerationModelNeuronValues.size());
+
     // INPUT LAYER //
     int inputSize = 0;
     int thisSynapse = 0;
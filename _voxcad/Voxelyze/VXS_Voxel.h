@@ -33,6 +33,10 @@ public:
 
 	void EulerStep(); //updates the state of the voxel based on the current forces and moments.
 
+	//settled state caching
+	void WriteState(std::ostream& os) const; //writes all time-varying state of this voxel (binary). Collision bonds are not included.
+	bool ReadState(std::istream& is); //restores the state written by WriteState(). Returns false if the stream ran out.
+
 	//Collisions
 	bool LinkColBond(int CBondIndex); //collision bond index...
 	void UpdateColBondPointers(); //updates all links (pointers) to bonds according top current p_Sim
@@ -10,6 +10,13 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 
 #include "VX_Benchmark.h"
 #include "VX_Sim.h"
+#include "VX_SimGA.h"
+#include "VX_MeshUtil.h"
+#include "Utils/MeshBVH.h"
+#include <ctime>
+#include <sstream>
+#include <chrono>
+#include <math.h>
 
 CVX_Benchmark::CVX_Benchmark(void)
 {
@@ -80,3 +87,140 @@ bool CVX_Benchmark::AxialSimpleTest()
 
 	return true;
 }
+
+bool CVX_Benchmark::XMLParseTest(std::string filename, int Repeats, std::string* RetMessage)
+{
+	if (Repeats < 1) Repeats = 1;
+	const char* BackendNames[2] = {"TinyXML", "Streaming"};
+	std::string Reloaded[2]; //each backend's result written back out, to check they agree
+	std::ostringstream Report;
+	Report << "Loading " << filename << " (" << Repeats << " repeats)\n";
+
+	for (int b=0; b<2; b++){
+		bool Pull = (b == 1);
+
+		//parse only
+		clock_t Start = clock();
+		for (int r=0; r<Repeats; r++){
+			CXML_Rip XML;
+			XML.SetPullParser(Pull);
+			if (!XML.LoadFile(filename, RetMessage)){
+				if (RetMessage) *RetMessage += "Could not load " + filename + ", not benchmarking.\n";
+				return false;
+			}
+		}
+		double ParseTime = (double)(clock() - Start) / CLOCKS_PER_SEC / Repeats;
+
+		//parse and read into a simulation
+		Start = clock();
+		for (int r=0; r<Repeats; r++){
+			CVX_Object ThisObj;
+			CVX_Environment ThisEnv;
+			CVX_SimGA ThisSim;
+			CVX_MeshUtil ThisMesh;
+			ThisSim.pEnv = &ThisEnv;
+			ThisEnv.pObj = &ThisObj;
+			ThisSim.setInternalMesh(&ThisMesh);
+
+			CXML_Rip XML;
+			XML.SetPullParser(Pull);
+			if (!XML.LoadFile(filename, RetMessage)) return false;
+			ThisSim.ReadVXA(&XML, RetMessage);
+
+			if (r == 0){
+				CXML_Rip OutXML;
+				ThisSim.WriteVXA(&OutXML);
+				OutXML.toXMLText(&Reloaded[b]);
+			}
+		}
+		double LoadTime = (double)(clock() - Start) / CLOCKS_PER_SEC / Repeats;
+
+		Report << BackendNames[b] << ": parse " << ParseTime*1000 << " ms, parse+read " << LoadTime*1000 << " ms\n";
+	}
+
+	bool Same = (Reloaded[0] == Reloaded[1]);
+	Report << (Same ? "Both backends read identical simulations.\n" : "WARNING: the backends read different simulations!\n");
+	if (RetMessage) *RetMessage += Report.str();
+	return Same;
+}
+
+bool CVX_Benchmark::VoxelizeTest(std::string StlFile, int Resolution, std::string* RetMessage)
+{
+	if (Resolution < 1) Resolution = 1;
+	std::ostringstream Report;
+	std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+	CMesh Mesh;
+	if (StlFile != ""){
+		if (!Mesh.LoadSTL(StlFile)){if (RetMessage) *RetMessage += "Could not load " + StlFile + "\n"; return false;}
+		Report << "Loaded " << StlFile;
+	}
+	else { //torus with a bumpy tube, 2*NumU*NumV facets
+		int NumU = 1200, NumV = 550;
+		vfloat R = 1.0, r = 0.35;
+		for (int u=0; u<NumU; u++){
+			for (int v=0; v<NumV; v++){
+				vfloat a = 2*3.14159265358979*u/NumU, b = 2*3.14159265358979*v/NumV;
+				vfloat rr = r*(1 + 0.1*sin(7*a)*sin(5*b));
+				Mesh.Vertices.push_back(CVertex(Vec3D<>((R+rr*cos(b))*cos(a), (R+rr*cos(b))*sin(a), rr*sin(b))));
+			}
+		}
+		for (int u=0; u<NumU; u++){
+			for (int v=0; v<NumV; v++){
+				int v00 = u*NumV+v, v10 = ((u+1)%NumU)*NumV+v, v01 = u*NumV+(v+1)%NumV, v11 = ((u+1)%NumU)*NumV+(v+1)%NumV;
+				Mesh.Facets.push_back(CFacet(v00, v10, v11));
+				Mesh.Facets.push_back(CFacet(v00, v11, v01));
+			}
+		}
+		Mesh.MeshChanged();
+		Report << "Generated a torus";
+	}
+	Report << ": " << Mesh.Facets.size() << " facets (" << std::chrono::duration<double>(std::chrono::steady_clock::now()-Start).count() << " s)\n";
+
+	//fit the mesh into a workspace of Resolution voxels along its longest side
+	Vec3D<> Min, Max;
+	Mesh.ComputeBoundingBox(Min, Max);
+	Vec3D<> Size = Max-Min;
+	vfloat Longest = Size.x > Size.y ? (Size.x > Size.z ? Size.x : Size.z) : (Size.y > Size.z ? Size.y : Size.z);
+	if (Longest <= 0){if (RetMessage) *RetMessage += "Mesh has no volume\n"; return false;}
+	vfloat VoxSize = 0.001;
+	Mesh.Translate(-Min);
+	Mesh.Scale(Vec3D<>(Resolution*VoxSize/Longest, Resolution*VoxSize/Longest, Resolution*VoxSize/Longest));
+	int Dims[3] = {(int)ceil(Size.x*Resolution/Longest), (int)ceil(Size.y*Resolution/Longest), (int)ceil(Size.z*Resolution/Longest)};
+	for (int i=0; i<3; i++) if (Dims[i] < 1) Dims[i] = 1;
+
+	CVX_Object Objects[2];
+	int MatIndex = 0;
+	for (int i=0; i<2; i++){
+		Objects[i].InitializeMatter(VoxSize, Dims[0], Dims[1], Dims[2]);
+		Objects[i].ClearPalette();
+		MatIndex = Objects[i].AddMat("Solid");
+	}
+	Report << "Workspace " << Dims[0] << "x" << Dims[1] << "x" << Dims[2] << "\n";
+
+	Start = std::chrono::steady_clock::now();
+	CMeshBVH BVH;
+	BVH.Build(&Mesh);
+	Report << "Facet hierarchy: " << BVH.GetDepth() << " levels (" << std::chrono::duration<double>(std::chrono::steady_clock::now()-Start).count() << " s)\n";
+
+	CVX_MeshUtil MeshUtil;
+	Start = std::chrono::steady_clock::now();
+	MeshUtil.FromStl(&Mesh, &Objects[0], MatIndex);
+	double NewTime = std::chrono::duration<double>(std::chrono::steady_clock::now()-Start).count();
+
+	Start = std::chrono::steady_clock::now();
+	Vec3D<> Loc;
+	for (int i=0; i<Objects[1].GetStArraySize(); i++){ //one voxel at a time, as FromStl() used to
+		Loc = Objects[1].GetXYZ(i);
+		if (Mesh.IsInside(&Loc)) Objects[1].SetMat(i, MatIndex);
+	}
+	double OldTime = std::chrono::duration<double>(std::chrono::steady_clock::now()-Start).count();
+
+	int NumDiff = 0;
+	for (int i=0; i<Objects[0].GetStArraySize(); i++) if (Objects[0].GetMat(i) != Objects[1].GetMat(i)) NumDiff++;
+
+	Report << "FromStl: " << NewTime << " s, per voxel IsInside(): " << OldTime << " s (" << Objects[0].GetNumVox() << " voxels inside)\n";
+	Report << (NumDiff == 0 ? "Both set identical voxels.\n" : "WARNING: the methods differ!\n");
+	if (RetMessage) *RetMessage += Report.str();
+	return NumDiff == 0;
+}
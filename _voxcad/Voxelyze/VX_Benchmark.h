@@ -11,6 +11,8 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #ifndef VX_BENCHMARK_H
 #define VX_BENCHMARK_H
 
+#include <string>
+
 class CVX_Benchmark
 {
 public:
@@ -19,6 +21,8 @@ public:
 	CVX_Benchmark& operator=(const CVX_Benchmark& rBenchmark); //!< Overload "=" 
 
 	bool AxialSimpleTest();
+	bool XMLParseTest(std::string filename, int Repeats = 10, std::string* RetMessage = NULL); //!< Times loading a VXA file with the TinyXML and the streaming CXML_Rip backends and checks that both produce the same simulation. @param[in] filename The VXA file to load. @param[in] Repeats Number of times each backend loads the file. @param[out] RetMessage Timing report.
+	bool VoxelizeTest(std::string StlFile, int Resolution = 100, std::string* RetMessage = NULL); //!< Times voxelizing a mesh with CVX_MeshUtil::FromStl() and with the per-voxel CMesh::IsInside() test, and checks that both set the same voxels. @param[in] StlFile The STL file to voxelize, or "" for a generated torus of about 1.3 million facets. @param[in] Resolution Voxels along the longest side of the mesh. @param[out] RetMessage Timing report.
 
 };
 
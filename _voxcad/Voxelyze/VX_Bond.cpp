@@ -26,6 +26,8 @@ CVX_Bond::CVX_Bond(CVX_Sim* p_SimIn)
 	E=0; u=0; CTE=0; Eh=0;
 	E1=0; E2=0; u1=0; u2=0; CTE1=0; CTE2=0;
 	L = Vec3D<>(0, 0, 0);
+	OffsetBond = ArmOnVox1 = false;
+	RestOffset = Vec3D<>(0, 0, 0);
 	
 	UpdateConstants(); //updates all the dependent variables based on zeros above.
 }
@@ -45,6 +47,9 @@ CVX_Bond& CVX_Bond::operator=(const CVX_Bond& Bond)
 	LinearBond = Bond.LinearBond;
 	ThisBondAxis = Bond.ThisBondAxis;
 	L = Bond.L;
+	OffsetBond = Bond.OffsetBond;
+	ArmOnVox1 = Bond.ArmOnVox1;
+	RestOffset = Bond.RestOffset;
 	E = Bond.E;
 	//std::cout << "[VX_Bond.cpp] debugmsg : operator=() (1) E = " << E << std::endl;
 	u = Bond.u;
@@ -81,6 +86,22 @@ bool CVX_Bond::LinkVoxels(const int V1SIndIn, const int V2SIndIn)
 	else if (OrigDist.y == 0 && OrigDist.z == 0) ThisBondAxis = AXIS_X;
 	else ThisBondAxis = AXIS_NONE;
 
+	//a coarsened voxel touches several smaller ones on each face: bond along the face normal and remember the sideways offset
+	OffsetBond = false;
+	RestOffset = Vec3D<>(0,0,0);
+	if (ThisBondAxis == AXIS_NONE && pVox1->GetNominalSize() != pVox2->GetNominalSize()){
+		Vec3D<> AbsDist(fabs(OrigDist.x), fabs(OrigDist.y), fabs(OrigDist.z));
+		if (AbsDist.x > AbsDist.y && AbsDist.x > AbsDist.z) ThisBondAxis = AXIS_X;
+		else if (AbsDist.y > AbsDist.z) ThisBondAxis = AXIS_Y;
+		else ThisBondAxis = AXIS_Z;
+
+		RestOffset = OrigDist;
+		ToXDirBond(&RestOffset);
+		RestOffset.x = 0;
+		OffsetBond = true;
+		ArmOnVox1 = (pVox1->GetNominalSize() > pVox2->GetNominalSize());
+	}
+
 	E1 = pVox1->GetEMod(); E2 = pVox2->GetEMod();
 
 	//std::cout << "[VX_Bond.cpp] debugmsg : linkVoxels() (2) E1 = " << E1 << " E2 = " << E2 << std::endl;
@@ -106,7 +127,8 @@ bool CVX_Bond::LinkVoxels(const int V1SIndIn, const int V2SIndIn)
 
 	//for now we are only using the nominal size of the voxel, although we could change this later if needed
 	vfloat NominalSize = (pVox1->GetNominalSize() + pVox2->GetNominalSize())*0.5;
-	L = Vec3D<>(NominalSize, NominalSize, NominalSize);
+	vfloat FaceSize = pVox1->GetNominalSize() < pVox2->GetNominalSize() ? pVox1->GetNominalSize() : pVox2->GetNominalSize(); //contact area is the smaller face
+	L = Vec3D<>(NominalSize, FaceSize, FaceSize);
 
 
 	if (!UpdateConstants()) return false;
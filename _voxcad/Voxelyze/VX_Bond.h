@@ -28,6 +28,7 @@ public:
 	//Bond setup
 	bool LinkVoxels(const int V1SIndIn, const int V2SIndIn); 
 	bool UpdateVoxelPtrs(); //call whenever VoxArray may have been reallocated
+	void LinkToSim(CVX_Sim* p_SimIn) {p_Sim = p_SimIn;} //moves this bond to another simulation with identical voxels (call UpdateVoxelPtrs afterwards)
 
 	//Get information about this bond
 	int GetVox1SInd() const {return Vox1SInd;}
@@ -36,6 +37,8 @@ public:
 	CVXS_Voxel* GetpV2() const {return pVox2;}
 
 	Axis GetBondAxis() const {return ThisBondAxis;}
+	vfloat GetNominalArea() const {return L.y*L.z;} //cross section of the bond (the smaller voxel face if the voxels differ in size)
+	bool HasRestOffset() const {return OffsetBond;} //true if the voxels are not centered on each other (a coarsened voxel bonded to a smaller one)
 
 	vfloat GetLinearStiffness(void) const {return a1;}
 	vfloat GetDampingFactorM1() const {return _2xSqA1xM1;}
@@ -59,6 +62,8 @@ protected:
 	vfloat E, u, CTE, Eh; //Eh is the effective modulus accounting for poissons ratio
 	vfloat E1, E2, u1, u2, CTE1, CTE2; //remember the original paramters
 	Vec3D<> L;
+	bool OffsetBond, ArmOnVox1; //voxels of different size: vox2 rests RestOffset away from the bond axis, which is a rigid arm of the larger voxel
+	Vec3D<> RestOffset; //in the +X bond direction frame
 	
 	bool UpdateConstants(void); //fills in the constant parameters for the bond... returns false if unsensible material properties
 	//Everything below updated by UpdateConstants().
@@ -62,6 +62,13 @@ enum StopCondition {
 	SC_MIN_MAXMOVE //!<runs until maximum voxel displacement/timestep (of any voxel in the simulation) is below a threshhold (in mm?)
 };
 
+//!Reason an evaluation was stopped before its stop condition.
+enum EarlyAbortReason {
+	EA_NONE, //!<Not aborted
+	EA_UNREACHABLE, //!<The target displacement can no longer be reached before the stop time at the highest plausible speed
+	EA_CHECKPOINT //!<The displacement at a checkpoint time was below the required minimum
+};
+
 enum Axis {  //which axis do we refer to?
 	AXIS_NONE,
 	AXIS_X,
@@ -43,6 +43,37 @@ CVX_Environment::CVX_Environment(void)
 	aggregateDragCoefficient = 0.0;
 	FloorSlope = 0.0;
 	FloorSlopeEnabled = true; // when false, it masks any floor slope that is eventually present
+	ContractOnly = false;
+	ExpandOnly = false;
+	BlockPushing = false;
+	BlockMaterial = 0;
+
+	//everything below is only read if present in the vxa: defaults as ReadXML() uses when it is missing
+	NeuralNetUpdatesPerTempCycle = 0.0;
+	TouchSensorsEnabled = false;
+	ProprioceptionSensorsEnabled = false;
+	PacemakerSensorsEnabled = false;
+	NumHiddenNeuronsPerLayer = 0;
+	NumHiddenLayers = 0;
+	outputSmoothing = 0;
+
+	TiltVectorsUpdatesPerTempCycle = 0.0;
+	RegenerationModelUpdatesPerTempCycle = 0.0;
+	NumHiddenRegenerationNeurons = 2;
+	RegenerationModelInputBias = false;
+	ForwardModelUpdatesPerTempCycle = 0.0;
+	ControllerUpdatesPerTempCycle = 0.0;
+	SignalingUpdatesPerTempCycle = 0.0;
+	DepolarizationsPerTempCycle = 1.0;
+	RepolarizationsPerTempCycle = 1.0;
+	lightX = lightY = lightZ = 0.0;
+
+	growthAmplitude = 0;
+	GrowthSpeedLimit = 0;
+	GreedyGrowth = false;
+	GreedyThreshold = 0;
+	TimeBetweenTraces = 0.0;
+	SavePassiveData = false;
 }
 
 CVX_Environment::~CVX_Environment(void)
@@ -311,10 +342,7 @@ int CVX_Environment::GetNumTouching(int BCIndex)
 	Vec3D<> WSSize = pObj->GetWorkSpace();
 	int NumTouching = 0;
 
-	int StArraySize = pObj->GetStArraySize();
-	for (int i=0; i<StArraySize; i++){
-		if (pObj->GetMat(i) == 0) continue; //if there's no voxel here keep going...
-
+	for (int i=pObj->Structure.GetNextVoxel(0); i!=-1; i=pObj->Structure.GetNextVoxel(i+1)){ //only the cells with voxels
 		BCpoint = pObj->GetXYZ(i);
 		if (pThisPrim->IsTouching(&BCpoint, &BCsize, &WSSize)) NumTouching++;
 	}
@@ -13,6 +13,10 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #include <iomanip>
 #include <iostream>
 #include <fstream>
+#include <thread>
+
+#define FEA_PARALLEL_MIN 4096 //voxels below which the stiffness matrix is assembled on one thread
+#define FEA_UPDATE_FRACTION 0.05 //fraction of the voxels whose rows may be updated in place before the matrix is refactored
 
 //#include <stdio.h>
 
@@ -63,6 +67,12 @@ CVX_FEA::CVX_FEA(void)
 	b = NULL;
 	x = NULL;
 	DOF = -1;
+	SymElType = FRAME;
+	SymXDim = SymYDim = 0;
+	Factorized = false;
+	UpdatedSinceFactor = 0;
+	FactorIterations = 0;
+	LastSolvePath = FSP_NEW;
 
 	//Pardiso Params!
 	//...that don't change
@@ -152,17 +162,17 @@ bool CVX_FEA::ImportObj(CVX_Environment* EnvIn , std::string* RetMessage) //link
 		FixedList = new bool[numVox];
 
 	}
-	else { //just delete the pardiso matrices...
-		if (a != NULL) delete [] a; a = NULL;
-		if (ia != NULL) delete [] ia; ia = NULL;
-		if (ja != NULL) delete [] ja; ja = NULL;
-	}
+	//otherwise keep the pardiso matrices: Solve() reuses their structure if the voxels haven't changed
 
 	return true;
 }
 
 void CVX_FEA::ResetFEA(void) //clears everything and returns to initial state. (leaves VXC object linked)
 {
+	ReleaseFactorization();
+	AsmE.clear();
+	AsmNu.clear();
+	LastX.clear();
 	if (b != NULL) delete [] b; b = NULL;
 	if (x != NULL) delete [] x; x = NULL;
 	if (F != NULL) delete [] F; F = NULL;
@@ -204,6 +214,17 @@ void CVX_FEA::ResetFEA(void) //clears everything and returns to initial state. (
 
 
 bool CVX_FEA::Solve(std::string* RetMessage) //formulates and solves system!
+{
+	return SolveCases(NULL, NULL, RetMessage);
+}
+
+bool CVX_FEA::SolveLoadCases(const std::vector<CVX_FEALoadCase>& Cases, std::vector<std::vector<Vec3D<> > >* pDisps, std::string* RetMessage)
+{
+	if (Cases.empty()){ if (RetMessage) *RetMessage += "No load cases to solve.\n"; return false;}
+	return SolveCases(&Cases, pDisps, RetMessage);
+}
+
+bool CVX_FEA::SolveCases(const std::vector<CVX_FEALoadCase>* pCases, std::vector<std::vector<Vec3D<> > >* pDisps, std::string* RetMessage) //formulates and solves system for the environment's loads or each of pCases
 {
 //	int Before = (int)GetTickCount();
 	CurProgTick = 0;
@@ -221,14 +242,32 @@ bool CVX_FEA::Solve(std::string* RetMessage) //formulates and solves system!
 
 	CalcDOF();
 	CalcBonds();
-	CalcStiffness();
-	ApplyForces();
-	ApplyFixed(); //needs to be called after apply forces for prescribed displacement to work
-	ConsolidateA(); //removes zeros, help, but only marginally. (maybe pardiso does this internally?)
+	ApplyFixed(); //which voxels are fixed
+	if (DOF == 0){ if (RetMessage) *RetMessage +=  "No free degrees of freedom found. Aborting.\n"; return false;}
 
-//	int Before2 = (int)GetTickCount();
+	std::vector<int> Updated; //blocks whose rows changed, for FSP_UPDATED
+	LastSolvePath = CalcStiffness(&Updated); //reuses the sparsity pattern and values of the last solve as far as possible
 
-	if (DOF == 0){ if (RetMessage) *RetMessage +=  "No free degrees of freedom found. Aborting.\n"; return false;}
+	//right hand sides: one per load case
+	int NumCases = pCases ? (int)pCases->size() : 1;
+	std::vector<double> AllB, AllX; //all cases but a single one
+	if (NumCases > 1){
+		AllB.resize((size_t)NumCases*DOF);
+		AllX.resize((size_t)NumCases*DOF);
+	}
+	for (int c=0; c<NumCases; c++){
+		const CVX_FEALoadCase* pCase = pCases ? &(*pCases)[c] : NULL;
+		ApplyForces(pCase);
+		ApplyFixed(pCase); //needs to be called after apply forces for prescribed displacement to work
+		ApplyPrescribed();
+		if (NumCases > 1) for (int i=0; i<DOF; i++) AllB[(size_t)c*DOF+i] = b[i];
+	}
+	double* pB = NumCases > 1 ? &AllB[0] : b;
+	double* pX = NumCases > 1 ? &AllX[0] : x;
+	bool WarmStart = (NumCases == 1 && LastSolvePath != FSP_NEW && (int)LastX.size() == DOF); //similar system: start from the last solution
+	if (WarmStart) for (int i=0; i<DOF; i++) x[i] = LastX[i];
+
+//	int Before2 = (int)GetTickCount();
 
 	iparm[0] = 0;
 	iparm[2] = -1;
@@ -237,20 +276,29 @@ bool CVX_FEA::Solve(std::string* RetMessage) //formulates and solves system!
 	int idum = 0; //Integer dummy var
 
 #ifdef USE_PARDISO
-	CurProgTick = 2;
-	CurProgMsg = "Pardiso: Analyzing...";
-	phase = 11;
-	PARDISO(pt, &maxfct, &mnum, &mtype, &phase, &DOF, a, ia, ja, &idum, &nrhs, iparm, &msglvl, b, x, &error, dparm);
-
-	CurProgTick = 5;
-	CurProgMsg = "Pardiso: Numerical factorization...";
-	phase = 22;
-	PARDISO(pt, &maxfct, &mnum, &mtype, &phase, &DOF, a, ia, ja, &idum, &nrhs, iparm, &msglvl, b, x, &error, dparm);
-
-	CurProgTick = 79;
-	CurProgMsg = "Pardiso: Solving, iterative refinement...";
-	phase = 33;
-	PARDISO(pt, &maxfct, &mnum, &mtype, &phase, &DOF, a, ia, ja, &idum, &nrhs, iparm, &msglvl, b, x, &error, dparm);
+	error = 0;
+	if (!Factorized || LastSolvePath == FSP_NEW){
+		CurProgTick = 2;
+		CurProgMsg = "Pardiso: Analyzing...";
+		phase = 11;
+		PARDISO(pt, &maxfct, &mnum, &mtype, &phase, &DOF, a, ia, ja, &idum, &nrhs, iparm, &msglvl, pB, pX, &error, dparm);
+	}
+	if (error == 0 && (!Factorized || LastSolvePath != FSP_REUSED)){ //the analysis is kept while the pattern is the same
+		CurProgTick = 5;
+		CurProgMsg = "Pardiso: Numerical factorization...";
+		phase = 22;
+		PARDISO(pt, &maxfct, &mnum, &mtype, &phase, &DOF, a, ia, ja, &idum, &nrhs, iparm, &msglvl, pB, pX, &error, dparm);
+	}
+	Factorized = (error == 0);
+
+	if (error == 0){
+		CurProgTick = 79;
+		CurProgMsg = "Pardiso: Solving, iterative refinement...";
+		phase = 33;
+		nrhs = NumCases; //all load cases at once
+		PARDISO(pt, &maxfct, &mnum, &mtype, &phase, &DOF, a, ia, ja, &idum, &nrhs, iparm, &msglvl, pB, pX, &error, dparm);
+		nrhs = 1;
+	}
 	//We recommend using the in-core PARDISO for all cases where the memory required for storing PARDISO factors exceeds the RAM by less than 30%. The size of the factors in kbytes can be obtained with the help of  iparm(17) after phase 11 (see Intel MKL reference manual).
 
 	if (error == -1){ if (RetMessage) *RetMessage += "Pardiso error: Input inconsistent\n"; Success = false;}
@@ -261,22 +309,52 @@ bool CVX_FEA::Solve(std::string* RetMessage) //formulates and solves system!
 	else if (error == -11){ if (RetMessage) *RetMessage += "License is expired\n"; Success = false;}
 	else if (error == -12){ if (RetMessage) *RetMessage += "Wrong username or hostname\n"; Success = false;}
 	else if (error != 0){ if (RetMessage) *RetMessage += "Pardiso Error\n"; Success = false;}
-
-	CurProgTick = 80;
-	CurProgMsg = "Pardiso cleaning...";
-	phase = -1; /* Release internal memory. */
-	PARDISO(pt, &maxfct, &mnum, &mtype, &phase, &DOF, &ddum, ia, ja, &idum, &nrhs, iparm, &msglvl, &ddum, &ddum, &error, dparm);
+	if (!Success) ReleaseFactorization();
 #else
-	Success = false;
+	if (Factorized && LastSolvePath == FSP_UPDATED){ //keep the preconditioner, unless it has got much worse for the changed matrix
+		if (PCGSolver.GetIterations() > FactorIterations*5/4 || !PCGSolver.UpdateValues(a, ia, ja, Updated)) Factorized = false;
+	}
+	bool NewPreconditioner = (!Factorized || LastSolvePath == FSP_NEW || LastSolvePath == FSP_REASSEMBLED);
+	if (NewPreconditioner){
+		CurProgTick = 2;
+		CurProgMsg = "Building preconditioner...";
+		Factorized = PCGSolver.Setup(DOF, a, ia, ja, DOFperBlock, RetMessage);
+		UpdatedSinceFactor = 0;
+		Success = Factorized;
+	}
+
+	if (Success){
+		CurProgTick = 5;
+		CurProgMsg = "Solving (preconditioned conjugate gradient)...";
+		PCGSolver.UseInitialGuess = WarmStart;
+		for (int c=0; c<NumCases && Success; c++){ //stops if CancelFlag is set
+			int EndTick = 5 + 84*(c+1)/NumCases;
+			Success = PCGSolver.Solve(pB + (size_t)c*DOF, pX + (size_t)c*DOF, RetMessage, &CurProgTick, EndTick, &CancelFlag);
+		}
+		PCGSolver.UseInitialGuess = false;
+		if (NewPreconditioner) FactorIterations = PCGSolver.GetIterations();
+	}
 #endif
 
 //	int After = Before2 - Before;
 //	int After2 = (int)GetTickCount() - Before2;
 
-	if (!Success) return false;
+	if (!Success) {LastX.clear(); return false;}
 
 	CurProgTick = 90;
 	CurProgMsg = "Processing results...";
+	if (NumCases > 1) for (int i=0; i<DOF; i++) x[i] = AllX[(size_t)(NumCases-1)*DOF+i]; //view the last case
+	LastX.assign(x, x+DOF);
+
+	if (pDisps){
+		pDisps->resize(NumCases);
+		for (int c=0; c<NumCases; c++){
+			std::vector<Vec3D<> >& Disps = (*pDisps)[c];
+			Disps.resize(DOF/DOFperBlock);
+			for (int i=0; i<DOF/DOFperBlock; i++) Disps[i] = Vec3D<>(pX[(size_t)c*DOF+i*DOFperBlock], pX[(size_t)c*DOF+i*DOFperBlock+1], pX[(size_t)c*DOF+i*DOFperBlock+2]);
+		}
+	}
+
 	FindMaxOverall(&Disp, x, MaxDisps);
 	if (Disp.Max == 0){
 		if (RetMessage) *RetMessage += "No forces or displacements acting on structure. (Zero displacement)\n";
@@ -287,11 +365,6 @@ bool CVX_FEA::Solve(std::string* RetMessage) //formulates and solves system!
 		CalcForces();
 
 //	OutputMatrices();
-	if (a != NULL) {delete [] a; a = NULL;}
-	if (ia != NULL) {delete [] ia; ia = NULL;}
-	if (ja != NULL) {delete [] ja; ja = NULL;}
-
-
 
 	ViewMode = VIEW_DISP; //automatically view the result, with default settings
 	ViewModeDir = MAXDIR;
@@ -305,15 +378,33 @@ bool CVX_FEA::Solve(std::string* RetMessage) //formulates and solves system!
 	return true;
 }
 
+void CVX_FEA::ReleaseFactorization(void)
+{
+#ifdef USE_PARDISO
+	if (Factorized){
+		double ddum = 0; //float dummy var
+		int idum = 0; //Integer dummy var
+		phase = -1; /* Release internal memory. */
+		PARDISO(pt, &maxfct, &mnum, &mtype, &phase, &DOF, &ddum, ia, ja, &idum, &nrhs, iparm, &msglvl, &ddum, &ddum, &error, dparm);
+	}
+#else
+	PCGSolver.Clear();
+#endif
+	Factorized = false;
+	UpdatedSinceFactor = 0;
+}
+
 void CVX_FEA::CalcDOF()
 {
 	DOF = pEnv->pObj->GetNumVox()*DOFperBlock; //set this to our new DOF value
 
 	//pre compute DOFtoIndex
 	int DOFInd = 0;
+	BlockVox.clear();
 	for (int i=0; i<pEnv->pObj->GetStArraySize(); i++){ //for all posible voxels:
 		if (pEnv->pObj->GetMat(i) != 0){ //if there's a voxel here...
 			IndextoDOF[i] = DOFInd++;
+			BlockVox.push_back(i);
 		}
 		else IndextoDOF[i] = -1;
 	}
@@ -354,165 +445,214 @@ void CVX_FEA::CalcBonds() //creates list of connecting voxel indicies!
 	}
 }
 
-void CVX_FEA::CalcStiffness() //calculates the big stiffness matrix!
+//columns of the FRAME stiffness terms in each row of a block (one bit per column of the block, see MakeBond())
+static const unsigned char FrameOwnPattern[3][6] = { //upper triangle of a voxel's own block, for each direction it has a bond in
+	{0x01, 0x22, 0x14, 0x08, 0x10, 0x20}, //X
+	{0x21, 0x02, 0x0C, 0x08, 0x10, 0x20}, //Y
+	{0x11, 0x0A, 0x04, 0x08, 0x10, 0x20}}; //Z
+static const unsigned char FrameBondPattern[3][6] = { //block of a bond to the neighbor in the positive direction
+	{0x01, 0x22, 0x14, 0x08, 0x14, 0x22}, //X
+	{0x21, 0x02, 0x0C, 0x0C, 0x10, 0x21}, //Y
+	{0x11, 0x0A, 0x04, 0x0A, 0x11, 0x20}}; //Z
+
+static int CountBits(int Mask) {int Count = 0; for (; Mask; Mask >>= 1) Count += Mask & 1; return Count;}
+
+FeaSolvePath CVX_FEA::CalcStiffness(std::vector<int>* pUpdated) //calculates the big stiffness matrix!
 {
-	int NumEl = DOF/DOFperBlock*ELperDBlock + NumBonds*ELperOBlock; // - NumFixed; //approximate number of metablocks in our K matrix (overestimates slightly)
+	int NumBlocks = DOF/DOFperBlock;
+	FeaSolvePath Path = FSP_REUSED;
+	if (!SymbolicMatches()){
+		ReleaseFactorization(); //of the old pattern
+
+		//index the bonds of each block: bonds are listed in order of their first voxel, so those are contiguous
+		BondStart.assign(NumBlocks+1, 0);
+		LowerStart.assign(NumBlocks+1, 0);
+		BlockDirs.assign(NumBlocks, 0);
+		for (int i=0; i<NumBonds; i++){
+			int El1 = IndextoDOF[Indi[i]], El2 = IndextoDOF[Indj[i]];
+			BondStart[El1+1]++;
+			LowerStart[El2+1]++;
+			BlockDirs[El1] |= 1<<BondDir[i];
+			BlockDirs[El2] |= 1<<BondDir[i];
+		}
+		for (int i=0; i<NumBlocks; i++){BondStart[i+1] += BondStart[i]; LowerStart[i+1] += LowerStart[i];}
+		LowerBond.resize(NumBonds);
+		std::vector<int> Next(LowerStart.begin(), LowerStart.end()-1);
+		for (int i=0; i<NumBonds; i++) LowerBond[Next[IndextoDOF[Indj[i]]]++] = i;
+
+		//symbolic pass: count the terms of each row, then fill in their columns
+		if (ia != NULL) {delete [] ia; ia = NULL;}
+		ia = new int[DOF+1]; //row index
+		AssembleParallel(&CVX_FEA::CountRange);
+		ia[0] = 1; //first element is always 1!
+		for (int i=0; i<DOF; i++) ia[i+1] += ia[i];
+
+		if (ja != NULL) {delete [] ja; ja = NULL;}
+		ja = new int[ia[DOF]-1]; //columns each value is in
+		if (a != NULL) {delete [] a; a = NULL;}
+		a = new double[ia[DOF]-1]; //values of sparse matrix
+		AssembleParallel(&CVX_FEA::FilljARange);
+
+		SymElType = Element_type;
+		SymXDim = pEnv->pObj->GetVXDim();
+		SymYDim = pEnv->pObj->GetVYDim();
+		SymBlockVox = BlockVox;
+		SymFixed.assign(FixedList, FixedList+NumBlocks);
+		Path = FSP_NEW;
+	}
 
-	if (a != NULL) {delete [] a; a = NULL;}
-	a = new double[NumEl]; //values of sparse matrix
-	if (ja != NULL) {delete [] ja; ja = NULL;}
-	ja = new int[NumEl]; //columns each value is in
-	if (ia != NULL) {delete [] ia; ia = NULL;}
-	ia = new int[DOF+1]; //row index
+	//numeric pass: only needed for the rows of voxels whose material changed and their neighbors
+	std::vector<float> E(NumBlocks), Nu(NumBlocks);
+	for (int i=0; i<NumBlocks; i++){
+		CVXC_Material* pMat = pEnv->pObj->GetLeafMat(BlockVox[i]);
+		E[i] = (float)pMat->GetElasticMod();
+		Nu[i] = (float)pMat->GetPoissonsRatio();
+	}
+	Vec3D<> LatDim = pEnv->pObj->GetLatDimEnv();
+	if (Path == FSP_REUSED && ((int)AsmE.size() != NumBlocks || LatDim != AsmLatDim)) Path = FSP_REASSEMBLED;
+	if (Path == FSP_REUSED){
+		std::vector<char> Touched(NumBlocks, 0);
+		for (int i=0; i<NumBlocks; i++){
+			if (E[i] == AsmE[i] && Nu[i] == AsmNu[i]) continue;
+			Touched[i] = 1;
+			for (int Bond=BondStart[i]; Bond<BondStart[i+1]; Bond++) Touched[IndextoDOF[Indj[Bond]]] = 1;
+			for (int l=LowerStart[i]; l<LowerStart[i+1]; l++) Touched[IndextoDOF[Indi[LowerBond[l]]]] = 1;
+		}
+		for (int i=0; i<NumBlocks; i++) if (Touched[i]) pUpdated->push_back(i);
+		if (!pUpdated->empty()) Path = (UpdatedSinceFactor + (int)pUpdated->size() <= NumBlocks*FEA_UPDATE_FRACTION) ? FSP_UPDATED : FSP_REASSEMBLED;
+	}
 
-	for (int i=0; i<NumEl; i++){ a[i] = 0; } //initialize A;
+	if (Path == FSP_UPDATED){
+		for (int n=0; n<(int)pUpdated->size(); n++) FillARange((*pUpdated)[n], (*pUpdated)[n]+1);
+		UpdatedSinceFactor += (int)pUpdated->size();
+	}
+	else if (Path != FSP_REUSED) AssembleParallel(&CVX_FEA::FillARange);
 
-	CalciA();
-	CalcjA();
-	CalcA();
+	AsmE.swap(E);
+	AsmNu.swap(Nu);
+	AsmLatDim = LatDim;
+	return Path;
+}
 
+bool CVX_FEA::SymbolicMatches() //true if ia and ja were built for the current voxels and fixed voxels
+{
+	if (a == NULL || ia == NULL || ja == NULL) return false;
+	if (SymElType != Element_type || SymXDim != pEnv->pObj->GetVXDim() || SymYDim != pEnv->pObj->GetVYDim() || SymBlockVox != BlockVox) return false;
+	for (int i=0; i<(int)SymFixed.size(); i++) if (SymFixed[i] != FixedList[i]) return false;
+	return true;
 }
 
-void CVX_FEA::CalciA() //populate ia!
+void CVX_FEA::AssembleParallel(void (CVX_FEA::*pRangeFunc)(int, int))
 {
-	int IndIndex = 0;
-	int iaIndex = 0;
-	ia[iaIndex] = 1; //first element is always 1!
+	int NumBlocks = DOF/DOFperBlock;
+	int NumThreads = 1;
+	if (NumBlocks >= FEA_PARALLEL_MIN){
+		NumThreads = (int)std::thread::hardware_concurrency();
+		if (NumThreads > 8) NumThreads = 8;
+		if (NumThreads < 1) NumThreads = 1;
+	}
+	if (NumThreads == 1){(this->*pRangeFunc)(0, NumBlocks); return;}
 
-	int NumLocBonds; //number of bonds in a given row 
-	int NumToAdd; //number to add
+	std::vector<std::thread> Threads;
+	for (int t=0; t<NumThreads; t++) Threads.push_back(std::thread(pRangeFunc, this, NumBlocks*t/NumThreads, NumBlocks*(t+1)/NumThreads));
+	for (int t=0; t<NumThreads; t++) Threads[t].join();
+}
 
-	for (int i=0; i<DOF/DOFperBlock; i++){ //iterate through each meta-row
-		NumLocBonds = 0; //number of bonds in this row 
+int CVX_FEA::PatternMask(bool OwnBlock, int Dirs, int Row) //columns (one bit each) of the terms in this row of a block
+{
+	if (Element_type == BARSHEAR) return 1<<Row;
+	int Mask = OwnBlock ? 1<<Row : 0; //the diagonal is always kept
+	for (int Dim=0; Dim<3; Dim++) if (Dirs & (1<<Dim)) Mask |= (OwnBlock ? FrameOwnPattern : FrameBondPattern)[Dim][Row];
+	return Mask;
+}
 
-		while (IndIndex<NumBonds && IndextoDOF[Indi[IndIndex]] <= i){ //calculate how many bonds involve this block
-			NumLocBonds++;
-			IndIndex++;
+void CVX_FEA::CountRange(int First, int Last) //number of terms in each row of these blocks (stored in ia[row+1])
+{
+	for (int i=First; i<Last; i++){
+		for (int j=0; j<DOFperBlock; j++){
+			int Count = 1; //fixed rows keep only their diagonal
+			if (!FixedList[i]){
+				Count = CountBits(PatternMask(true, BlockDirs[i], j));
+				for (int Bond=BondStart[i]; Bond<BondStart[i+1]; Bond++){
+					if (!FixedList[IndextoDOF[Indj[Bond]]]) Count += CountBits(PatternMask(false, 1<<BondDir[Bond], j)); //columns of fixed voxels are left out
+				}
+			}
+			ia[i*DOFperBlock+j+1] = Count;
 		}
+	}
+}
 
-		for (int j=0; j<DOFperBlock; j++){ //now go through each row of the metarow
-			if (Element_type == BARSHEAR)
-				ia[++iaIndex] = ia[iaIndex-1] + 1 + NumLocBonds; //add number of elements in this row!
-			else { //if Element_type == FRAME
-				NumToAdd = 1 + 3*(NumLocBonds);; //1 for diagonal elements, 3*(NumLocBonds) = 3 more elements for every bond metablock
-				if (j<3) NumToAdd +=2; //the off-diag terms of diagonal metablocks
-				ia[++iaIndex] = ia[iaIndex-1] + NumToAdd; //add number of elements in this row!
+void CVX_FEA::FilljARange(int First, int Last) //columns of the rows of these blocks
+{
+	for (int i=First; i<Last; i++){
+		for (int j=0; j<DOFperBlock; j++){
+			int Row = i*DOFperBlock+j;
+			int Index = ia[Row]-1;
+			if (FixedList[i]){ja[Index] = Row+1; continue;}
+
+			int Mask = PatternMask(true, BlockDirs[i], j); //diagonal first, then the rest of this block and the neighbors' blocks in increasing order
+			for (int k=0; k<DOFperBlock; k++) if (Mask & (1<<k)) ja[Index++] = i*DOFperBlock+k+1;
+			for (int Bond=BondStart[i]; Bond<BondStart[i+1]; Bond++){
+				int El2 = IndextoDOF[Indj[Bond]];
+				if (FixedList[El2]) continue;
+				Mask = PatternMask(false, 1<<BondDir[Bond], j);
+				for (int k=0; k<DOFperBlock; k++) if (Mask & (1<<k)) ja[Index++] = El2*DOFperBlock+k+1;
 			}
 		}
 	}
 }
 
-void CVX_FEA::CalcjA() //calculate ja!
+void CVX_FEA::FillARange(int First, int Last) //values of the rows of these blocks
 {
-	int IndIndex = 0;
-	int CurInd;
-	int NumRowBonds; //number of bonds in this row
-
-	int jaIndex; //tmp ja index
-	int ElNum; //tmp number of elements
-
-	for (int i=0; i<DOF/DOFperBlock; i++){ //iterate through each meta-row
-		NumRowBonds = 0; //number of bonds in this row
-
-		//diagonal elements
-		for (int j=0; j<DOFperBlock; j++){ //now go through each row of the metarow
-			//all diagonal elements are set no matter what...+
-			CurInd = i*DOFperBlock+j;
-			jaIndex = ia[CurInd]-1;
-			ja[jaIndex] = CurInd +1; //this will get redone for more complicated elements...
-			
-			if (Element_type == FRAME){
-				switch (j){
-					case 0:
-						ja[++jaIndex] = CurInd + 5; //+4 for offset to next term... + 1 for silly offset (1-based index)
-						ja[++jaIndex] = CurInd + 6; //+5
-						break;
-					case 1:
-						ja[++jaIndex] = CurInd + 3; //+2
-						ja[++jaIndex] = CurInd + 5; //+4
-						break;
-					case 2:
-						ja[++jaIndex] = CurInd + 2; //+1
-						ja[++jaIndex] = CurInd + 3; //+2
-						break;
-				}
-			}
+	int B = DOFperBlock, B2 = 2*DOFperBlock;
+	std::vector<double> K(B2*B2); //stiffness of one bond
+	std::vector<double> Own(B*B); //this voxel's own block
+	std::vector<double> Off(3*B*B); //blocks of the (up to 3) bonds to neighbors in the positive directions
+
+	for (int i=First; i<Last; i++){
+		if (FixedList[i]){ //only the diagonal is left (see ApplyPrescribed())
+			for (int j=0; j<B; j++) a[ia[i*B+j]-1] = 1;
+			continue;
 		}
+		for (int k=0; k<B*B; k++) Own[k] = 0;
 
-		//for each bond
-		while (IndIndex<NumBonds && IndextoDOF[Indi[IndIndex]] <= i){ //calculate how many bonds involve this 
-			for (int j=0; j<DOFperBlock; j++){ //now go through each row of the metarow
-				if (Element_type == BARSHEAR){
-					jaIndex = ia[i*DOFperBlock+j] + NumRowBonds;
-					ja[jaIndex] = IndextoDOF[Indj[IndIndex]]*DOFperBlock+j+1; //this will get overwritten with more complicated types...
-				}
-				else if (Element_type == FRAME){
-					if (j<3) ElNum = 3; //number of elements taken in the diagonal block...
-					else ElNum = 1;
-					ElNum += 3*NumRowBonds;
-
-					jaIndex = ia[i*DOFperBlock+j]-1 + ElNum;
-					CurInd = IndextoDOF[Indj[IndIndex]]*DOFperBlock+j;
-
-					switch (j){
-						case 0:
-							ja[jaIndex] = CurInd+1; //+0 (after accounting for 1-based index)
-							ja[++jaIndex] = CurInd+5; //+4
-							ja[++jaIndex] = CurInd+6; //+5
-							break;
-						case 1:
-							ja[jaIndex] = CurInd+1; //+0
-							ja[++jaIndex] = CurInd+3; //+2
-							ja[++jaIndex] = CurInd+5; //+4
-							break;
-						case 2:
-							ja[jaIndex] = CurInd+1; //+0
-							ja[++jaIndex] = CurInd+2; //+1
-							ja[++jaIndex] = CurInd+3; //+2
-							break;
-						case 3:
-							ja[jaIndex] = CurInd-1; //-2
-							ja[++jaIndex] = CurInd; //-1
-							ja[++jaIndex] = CurInd+1; //+0
-							break;
-						case 4:
-							ja[jaIndex] = CurInd-3; //-4
-							ja[++jaIndex] = CurInd-1; //-2
-							ja[++jaIndex] = CurInd+1; //+0
-							break;
-						case 5:
-							ja[jaIndex] = CurInd-4; //-5
-							ja[++jaIndex] = CurInd-3; //-4
-							ja[++jaIndex] = CurInd+1; //+0
-							break;
-					}
-				}
-			}
+		for (int l=LowerStart[i]; l<LowerStart[i+1]; l++){ //bonds to neighbors in the negative directions (in bond order, so the sums match the bond by bond assembly)
+			for (int k=0; k<B2*B2; k++) K[k] = 0;
+			MakeBond(&K[0], LowerBond[l]);
+			for (int j=0; j<B; j++) for (int k=j; k<B; k++) Own[j*B+k] += K[(B+j)*B2+B+k];
+		}
 
-			IndIndex++;
-			NumRowBonds++;
+		int NumUp = BondStart[i+1]-BondStart[i];
+		for (int u=0; u<NumUp; u++){ //bonds to neighbors in the positive directions
+			double* pOff = &Off[u*B*B];
+			for (int k=0; k<B2*B2; k++) K[k] = 0;
+			MakeBond(&K[0], BondStart[i]+u);
+			for (int j=0; j<B; j++){
+				for (int k=j; k<B; k++) Own[j*B+k] += K[j*B2+k];
+				for (int k=0; k<B; k++) pOff[j*B+k] = K[j*B2+B+k];
+			}
 		}
-	}
-}
 
-void CVX_FEA::CalcA() //populate "a" matrix!
-{
-	for(int b=0; b<NumBonds; b++){ //for each bond!
-		MakeBond(a, b);
+		for (int j=0; j<B; j++){
+			int Index = ia[i*B+j]-1;
+			int Mask = PatternMask(true, BlockDirs[i], j);
+			for (int k=0; k<B; k++) if (Mask & (1<<k)) a[Index++] = Own[j*B+k];
+			for (int u=0; u<NumUp; u++){
+				int Bond = BondStart[i]+u;
+				if (FixedList[IndextoDOF[Indj[Bond]]]) continue;
+				Mask = PatternMask(false, 1<<BondDir[Bond], j);
+				for (int k=0; k<B; k++) if (Mask & (1<<k)) a[Index++] = Off[u*B*B+j*B+k];
+			}
+		}
 	}
 }
 
-
 void CVX_FEA::MakeBond(double* Ain, int BondIndex)
 {
 //	bool FullOnlyFlag;
 
-	int El1 = IndextoDOF[Indi[BondIndex]];
-	int El2 = IndextoDOF[Indj[BondIndex]];
-	if (Ain != a) { //tmp
-		El1 = 0;
-		El2 = 1;
-	}
+	int El1 = 0; //Ain is the 2*DOFperBlock square matrix of this bond's two voxels
+	int El2 = 1;
 
 	int BondDirec = BondDir[BondIndex]; //which direction is this?
 
@@ -835,47 +975,14 @@ void CVX_FEA::MakeBond(double* Ain, int BondIndex)
 	}
 }
 
-void CVX_FEA::ImposeValA(int El1, int El2, int i, int j, float val, double* Ain, bool FullOnly) //adds a bond to the A matrix
+void CVX_FEA::ImposeValA(int El1, int El2, int i, int j, float val, double* Ain, bool FullOnly) //adds a bond term to a 2-block matrix
 {
-	if (Ain == a){ //if we're making the main matrix
-		//assumes IA, JA, set up to include this position!!!!!
-		//El1, El2 are element indices of meta-block, i, j are sub-indicies, val is value to impose, FullOnly if we don't want in a matrix to solve... 
-		//get the index of a:
-		int ThisIndex = ia[El1*DOFperBlock+j]-1; //the row we want!
-		while (ja[ThisIndex] != El2*DOFperBlock+i + 1) //go through jA until we find the right index!
-			ThisIndex++;
-
-		if (!FullOnly)
-			a[ThisIndex] += val;
-
-	}
-	else { //if making little post-processing matrices
+	//El1, El2 are element indices of meta-block (0 or 1), i, j are sub-indicies, val is value to impose, FullOnly if we don't want it in the matrix
+	if (!FullOnly)
 		Ain[(El2*DOFperBlock+i) + 2*DOFperBlock*(El1*DOFperBlock+j)] += val;
-	}
-
-}
-
-void CVX_FEA::ConsolidateA() //gets rid of all the zeros for quicker solving! (maybe...)
-{
-	int index = 0; //master index of longer arrays
-	int Shift = 0;
-
-	for (int i=0; i<DOF; i++){ //for each element of ia;
-		ia[i+1] -= Shift;
-		while (index < ia[i+1]-1){ //for everything on this row...
-			while (a[index + Shift] == 0){ //if this is an element to remove
-				Shift++;
-				ia[i+1] --;
-			}
-			a[index] = a[index+Shift];
-			ja[index] = ja[index+Shift];
-
-			index++;
-		}
-	}
 }
 
-void CVX_FEA::ApplyFixed()
+void CVX_FEA::ApplyFixed(const CVX_FEALoadCase* pCase)
 {
 	int DOFInd = 0;
 	Vec3D<> point;
@@ -885,7 +992,6 @@ void CVX_FEA::ApplyFixed()
 	if(PrescribedDisp) for (int i=0; i<DOF; i++) x[i] =0; //zero out displacement vector to fill in with prescribed displacements (will be overwritten by pardiso eventually)
 
 	int NumPossVox = pEnv->pObj->GetStArraySize();
-	int NumVox =  pEnv->pObj->GetNumVox();
 	for (int i=0; i<NumPossVox; i++){ //for all posible voxels:
 		if (pEnv->pObj->GetMat(i) != 0){ //if there's a voxel here...
 			FixedList[DOFInd] = false; //assume not fixed
@@ -893,13 +999,14 @@ void CVX_FEA::ApplyFixed()
 
 			//Do fixed constraints
 			for (int j = 0; j<(int)pEnv->GetNumBCs(); j++){ //go through each primitive defined as a constraint!
-				CVX_FRegion* pThisBC = pEnv->GetBC(i);
+				CVX_FRegion* pThisBC = pEnv->GetBC(j);
 				if (IS_FIXED(DOF_ALL, pThisBC->DofFixed) && pThisBC->GetRegion()->IsTouching(&point, &size, &WSSize)){ //if this point is within
 					FixedList[DOFInd] = true; //set this one as fixed
 					if (PrescribedDisp){
-						x[DOFInd*DOFperBlock] += pThisBC->Displace.x; //note if there's a prescribed displacement...
-						x[DOFInd*DOFperBlock+1] += pThisBC->Displace.y;
-						x[DOFInd*DOFperBlock+2] += pThisBC->Displace.z;
+						Vec3D<> Displace = (pCase && j < (int)pCase->Displace.size()) ? pCase->Displace[j] : pThisBC->Displace;
+						x[DOFInd*DOFperBlock] += Displace.x; //note if there's a prescribed displacement...
+						x[DOFInd*DOFperBlock+1] += Displace.y;
+						x[DOFInd*DOFperBlock+2] += Displace.z;
 					}
 
 				}
@@ -908,75 +1015,46 @@ void CVX_FEA::ApplyFixed()
 		}
 	}
 
+}
 
-	//aply reverse forces to make prescribed displacements... (x vector should have non-zero parts in it...)
-	if (PrescribedDisp){
-		double ToSubtractForce = 0;
-		for (int i=0; i<NumVox; i++){
-//			if (!FixedList[i]){ //if this one is NOT fixed 
-				for (int k=0; k<DOFperBlock; k++){
-					ToSubtractForce = 0;
-
-					int Index = i*DOFperBlock+k;
-
-					//get everything in this row: (EXCEPT the digaonal element)
-					int BeginInd_0B = ia[Index]; //-1 at end includes the diagonal
-					int EndInd_0B = ia[Index+1]-1;
-
-					for (int j=BeginInd_0B; j<EndInd_0B; j++) ToSubtractForce += x[ja[j]-1]*a[j];
-						
-					//get everything in this column (INCLUDING the diagonal element)
-					int Col_1B = ja[ia[Index]-1]; //this column in 0-based index!
-					int tmpRow_1B = 1;
-					for (int j=0; j<ia[Index]-1; j++){ // (was ia[NumVox*DOFperBlock]-1)
-						if (j+1 == ia[tmpRow_1B-1+1]) tmpRow_1B++;
-
-
-						if (ja[j] == Col_1B) ToSubtractForce += x[tmpRow_1B-1]*a[j];
-						
-
-					}
-
-					if (ToSubtractForce != 0)
-						int stop = 1;
+void CVX_FEA::ApplyPrescribed() //moves the forces of the prescribed displacements (in x) to the right hand side, and sets it for the fixed rows
+{
+	int B = DOFperBlock, B2 = 2*DOFperBlock;
+	int NumBlocks = DOF/DOFperBlock;
 
-					b[Index] -= ToSubtractForce;
+	if (PrescribedDisp){
+		std::vector<char> Displaced(NumBlocks, 0);
+		for (int i=0; i<DOF; i++) if (x[i] != 0) Displaced[i/B] = 1;
+
+		std::vector<double> K(B2*B2);
+		for (int Bond=0; Bond<NumBonds; Bond++){ //off-diagonal terms of the whole matrix times the displacements, from the bonds that have any
+			int El[2] = {IndextoDOF[Indi[Bond]], IndextoDOF[Indj[Bond]]};
+			if (!Displaced[El[0]] && !Displaced[El[1]]) continue;
+
+			for (int k=0; k<B2*B2; k++) K[k] = 0;
+			MakeBond(&K[0], Bond);
+			for (int p=0; p<B2; p++){
+				double ToSubtractForce = 0;
+				for (int q=0; q<B2; q++){
+					double Disp = x[El[q/B]*B + q%B];
+					if (q != p && Disp != 0) ToSubtractForce += (p<q ? K[p*B2+q] : K[q*B2+p])*Disp;
 				}
-//			}
+				b[El[p/B]*B + p%B] -= ToSubtractForce;
+			}
 		}
 	}
 
-
-	//zero out all fixed degrees of freedom (row and column!)
-	for (int i=0; i<NumVox; i++){
-		if (FixedList[i]){ //if this one is fixed 
-			for (int k=0; k<DOFperBlock; k++){
-				int Index = i*DOFperBlock+k;
-
-				//get everything in this row:
-				int BeginInd_0B = ia[Index]; //-1 to get the diagonal
-				int EndInd_0B = ia[Index+1]-1;
-
-				for (int j=BeginInd_0B; j<EndInd_0B; j++) a[j] = 0.0;
-					
-				//get everything in this column
-				int Col_1B = ja[ia[Index]-1]; //this column in 0-based index!
-				for (int j=0; j<ia[Index]-1; j++){ //ia[NumVox*DOFperBlock]-1; j++){
-					if (ja[j] == Col_1B) a[j] = 0.0;
-				}
-
-				//add back the one on the diagonal...
-				if (x[Index] != 0 && b[Index] != 0)
-					a[ia[Index]-1] = b[Index]/x[Index]; //add in the exact opposite so that the displacement calculates correctly
-				else 
-					a[ia[Index]-1] = 1;
-			}
+	//fixed rows only have a diagonal of 1: their right hand side is the solution
+	for (int i=0; i<NumBlocks; i++){
+		if (!FixedList[i]) continue;
+		for (int k=i*B; k<(i+1)*B; k++){
+			if (x[k] == 0 || b[k] == 0) continue; //(no prescribed displacement: keep the remaining force)
+			b[k] = x[k];
 		}
 	}
-
 }
 
-void CVX_FEA::ApplyForces()
+void CVX_FEA::ApplyForces(const CVX_FEALoadCase* pCase)
 {
 //	int NumFixed = pEnv->GetNumFixedBCs();
 	int NumBCs = pEnv->GetNumBCs();
@@ -1010,9 +1088,10 @@ void CVX_FEA::ApplyForces()
 				if (IS_ALL_FIXED(pEnv->GetBC(j)->DofFixed)) continue;
 //				int size = Sizes[j];
 				if (pEnv->GetBC(j)->GetRegion()->IsTouching(&point, &size3D, &WSSize)){
-					b[IndextoDOF[i]*DOFperBlock] += pEnv->GetBC(j)->Force.x/Sizes[j];
-					b[IndextoDOF[i]*DOFperBlock+1] += pEnv->GetBC(j)->Force.y/Sizes[j];
-					b[IndextoDOF[i]*DOFperBlock+2] += pEnv->GetBC(j)->Force.z/Sizes[j];
+					Vec3D<> Force = (pCase && j < (int)pCase->Force.size()) ? pCase->Force[j] : pEnv->GetBC(j)->Force;
+					b[IndextoDOF[i]*DOFperBlock] += Force.x/Sizes[j];
+					b[IndextoDOF[i]*DOFperBlock+1] += Force.y/Sizes[j];
+					b[IndextoDOF[i]*DOFperBlock+2] += Force.z/Sizes[j];
 				}
 			}
 		}
@@ -1162,15 +1241,15 @@ void CVX_FEA::DrawFEA(int Selected)
 	if (SolnExists){ //will draw VXC if no simulation data
 		
 		Vec3D<> Center;
-		char curMat = 0;
-		char thismat = 0;
+		int curMat = 0;
+		int thismat = 0;
 		CVXC_Material* pMaterial;
 
 		int ToLayer = (int)(ViewZChop*pEnv->pObj->GetVZDim());
 
 		for (int i = 0; i<ToLayer*pEnv->pObj->GetVXDim()*pEnv->pObj->GetVYDim(); i++) //go through all the voxels...
 		{
-			thismat = (char)pEnv->pObj->GetMat(i);
+			thismat = pEnv->pObj->GetMat(i);
 			if (thismat != 0) // present AND visible
 			{
 				pMaterial = pEnv->pObj->GetLeafMat(i);
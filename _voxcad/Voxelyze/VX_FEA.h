@@ -12,6 +12,8 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #define CVX_FEA_H
 
 #include "VX_Environment.h"
+#include "VX_PCGSolver.h"
+#include <vector>
 
 //Jonathan Hiller (jdh74)
 //VERSION 6
@@ -21,6 +23,20 @@ enum FeaDirections{XDIR, YDIR, ZDIR, MAXDIR}; //filters for directions
 
 struct INFO3D { float Max; float MaxX; float MaxY; float MaxZ;};  //info about maximum properties for the 3D stucture
 
+//how much of the previous solve was reused (see CVX_FEA::GetLastSolvePath())
+enum FeaSolvePath {
+	FSP_NEW, //new sparsity pattern and factorization (voxels or fixed voxels changed)
+	FSP_REASSEMBLED, //same pattern, all values reassembled and refactored
+	FSP_UPDATED, //the rows of a few voxels with new materials updated in place (PARDISO refactors, the iterative solver keeps its preconditioner)
+	FSP_REUSED //same matrix and factorization: only the loads changed
+};
+
+struct CVX_FEALoadCase //loads of one static load case for CVX_FEA::SolveLoadCases()
+{
+	std::vector<Vec3D<> > Force; //force of each boundary condition of the environment, by index (the boundary condition's own force past the end)
+	std::vector<Vec3D<> > Displace; //prescribed displacement of each fixed boundary condition, by index (the boundary condition's own past the end)
+};
+
 class CVX_FEA
 {
 
@@ -42,7 +58,10 @@ public: //variables and flags to be interacted with
 	FeaElType Element_type; //the type of element!
 	bool WantForces; //calculate forces in post-processing step? (recomended: minimal overhead)
 	bool PrescribedDisp; //include analysis for prescribed displacements? (recommended: minimal overhead!)
-	bool Solve(std::string* RetMessage = NULL); //formulates and solves system!
+	bool Solve(std::string* RetMessage = NULL); //formulates and solves system! Reuses as much of the last solve as possible if only the loads or a few materials changed.
+	bool SolveLoadCases(const std::vector<CVX_FEALoadCase>& Cases, std::vector<std::vector<Vec3D<> > >* pDisps = NULL, std::string* RetMessage = NULL); //solves several load cases with one factorization. pDisps gets the displacement of each voxel (in order of voxel index) for each case. The last case is kept as the solution to view.
+	FeaSolvePath GetLastSolvePath(void) {return LastSolvePath;} //how much of the previous solve the last one reused
+	void ReleaseFactorization(void); //frees the factorization (or preconditioner) kept for the next solve
 
 	FeaViewMode ViewMode; //what to view (force, displacement, etc.)
 	FeaDirections ViewModeDir; //what direction to view (XDIR, YDIR, ZDIR, or MAXDIR for max
@@ -86,6 +105,8 @@ public: //variables and flags to be interacted with
 	std::string CurProgMsg;
 	bool CancelFlag;
 
+	CVX_PCGSolver PCGSolver; //iterative solver used when built without PARDISO (its preconditioner and tolerance may be changed before Solve())
+
 private: //off limits variable and functions (internal)
 	int DOFperBlock; //the dimension of each metablock
 	int ELperDBlock; //the number of elements per metablock on diagonal
@@ -98,6 +119,26 @@ private: //off limits variable and functions (internal)
 	bool* FixedList; //keep track of which are fixed
 //	int NumFixed; //number of fixed
 	int NumBonds;
+	std::vector<int> BlockVox; //voxel index of each block (inverse of IndextoDOF)
+
+	//sparsity pattern of the last stiffness matrix, kept for the next solve
+	FeaElType SymElType;
+	int SymXDim, SymYDim;
+	std::vector<int> SymBlockVox; //BlockVox it was built for
+	std::vector<bool> SymFixed; //FixedList it was built for
+	std::vector<int> BondStart; //first bond of each block (bonds are sorted by their first voxel)
+	std::vector<int> LowerStart, LowerBond; //bonds in which each block is the second voxel
+	std::vector<unsigned char> BlockDirs; //directions (bits) each block has bonds in
+
+	//values and factorization kept for the next solve
+	bool Factorized; //the solver holds a factorization (or preconditioner) of a
+	std::vector<float> AsmE, AsmNu; //elastic modulus and poisson's ratio of each block a was assembled with
+	Vec3D<> AsmLatDim; //lattice dimensions a was assembled with
+	int UpdatedSinceFactor; //blocks updated in place since the last factorization
+	int FactorIterations; //iterations of the iterative solver right after its preconditioner was built
+	std::vector<double> LastX; //last solution, to start the next one from
+	FeaSolvePath LastSolvePath;
+	bool SolveCases(const std::vector<CVX_FEALoadCase>* pCases, std::vector<std::vector<Vec3D<> > >* pDisps, std::string* RetMessage); //Solve() for the environment's loads (pCases = NULL) or SolveLoadCases()
 
 	double* F; //to store forces in! (dimension = Num DOF)
 	double* e; //to store strains in (dimension = Num DOF)
@@ -122,17 +163,20 @@ private: //off limits variable and functions (internal)
 	void CalcBonds(); //creates list of connecting voxel indicies!
 	void CalcDOF(); //does some pre-processing to figure out DOF stuff
 
-	void CalcStiffness(); //calculates the a (stiffness) matrix!
-	void CalciA(); //calculates the ia matrix
-	void CalcjA(); //calculates the ja matrix
-	void CalcA(); //calculates the a matrix!
-	void MakeBond(double* Ain, int BondIndex); //adds values for specified bond to the specified matrix
-	void ImposeValA(int El1, int El2, int i, int j, float val, double* Ain, bool FullOnly = false); //adds a bond to the A matrix
-	void ConsolidateA(); //gets rid of all the zeros for solving!
+	FeaSolvePath CalcStiffness(std::vector<int>* pUpdated); //calculates the a (stiffness) matrix! (and ia, ja if the voxels or fixed voxels changed). pUpdated gets the blocks updated in place.
+	bool SymbolicMatches(); //true if ia and ja can be reused
+	void AssembleParallel(void (CVX_FEA::*pRangeFunc)(int, int)); //calls pRangeFunc(First, Last) on ranges of blocks covering them all, in parallel for large objects
+	int PatternMask(bool OwnBlock, int Dirs, int Row); //columns of the terms in one row of a block (bit field)
+	void CountRange(int First, int Last); //symbolic pass 1: number of terms in each row
+	void FilljARange(int First, int Last); //symbolic pass 2: ja
+	void FillARange(int First, int Last); //numeric pass: a
+	void MakeBond(double* Ain, int BondIndex); //fills the 2*DOFperBlock square stiffness matrix of the specified bond (upper triangle)
+	void ImposeValA(int El1, int El2, int i, int j, float val, double* Ain, bool FullOnly = false); //adds a bond term to a bond stiffness matrix
 	void CalcForces();
 
-	void ApplyFixed(); //builds FixedList
-	void ApplyForces();
+	void ApplyFixed(const CVX_FEALoadCase* pCase = NULL); //builds FixedList, and x with the prescribed displacements
+	void ApplyForces(const CVX_FEALoadCase* pCase = NULL);
+	void ApplyPrescribed(); //right hand side terms of the prescribed displacements and fixed rows
 
 	//Pardiso variables:
 	double* a; //values of sparse matrix for solving
@@ -14,7 +14,13 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #include "VX_Sim.h"
 #include "VXS_SimGLView.h"
 #include "Utils/MarchCube.h"
+#include "Utils/MeshBVH.h"
 #include <iostream>
+#include <algorithm>
+#include <thread>
+
+#define STL_PARALLEL_MIN 256 //rows of voxels below which voxelizing is not worth extra threads
+#define MESH_PARALLEL_MIN 8192 //vertices or facets below which updating the deformed mesh is not worth extra threads
 
 
 CVX_MeshUtil::CVX_MeshUtil(void)
@@ -23,6 +29,11 @@ CVX_MeshUtil::CVX_MeshUtil(void)
 	pSimView = NULL;
 	pFEA = NULL;
 	usingGUI = false;	
+	ColorViewCol = -1;
+	ColorSel = -1;
+	ColorStep = -1;
+	UpdatingColors = false;
+	pCurSnapshot = NULL;
 }
 
 CVX_MeshUtil::~CVX_MeshUtil(void)
@@ -35,6 +46,11 @@ void CVX_MeshUtil::Clear(void)
 	DefMesh.Clear();
 	CalcVerts.clear();
 	FacetToSIndex.clear();
+	TermStart.clear();
+	Terms.clear();
+	TermWeightSum.clear();
+	VoxColors.clear();
+	ColorStep = -1;
 	pSim = NULL;
 	pFEA = NULL;
 }
@@ -83,6 +99,7 @@ void CVX_MeshUtil::LinkSimExisting(CVX_Sim* pSimIn, CVXS_SimGLView* pSimViewIn,
 		}
 		CalcVerts.push_back(tmpVertCalc);
 	}
+	BuildVertexTable();
 
 	DefMesh.DrawSmooth = true;
 
@@ -115,11 +132,10 @@ void CVX_MeshUtil::LinkSimVoxels(CVX_Sim* pSimIn, CVXS_SimGLView* pSimViewIn)
 	CalcVertsAll.clear();
 	int tVX = pDM->GetVXDim()+1;
 	int tVY = pDM->GetVYDim()+1;
-	int tVZ = pDM->GetVZDim()+1;
 	Vec3D<> Offset, tmp;
 
 	FacetToSIndex.clear();
-	CalcVertsAll.resize(tVX*tVY*tVZ); //each row in x, rolling around to consecutive Y's, then z.
+	CalcVertsAll.reserve(8*pSim->NumVox()); //only corners of voxels are stored, so memory scales with the voxels rather than the workspace
 
 	int NumVox = pSim->NumVox();
 	for (int i=0; i<NumVox; i++){ //for every voxel in the simulation...
@@ -221,55 +237,50 @@ void CVX_MeshUtil::LinkSimVoxels(CVX_Sim* pSimIn, CVXS_SimGLView* pSimViewIn)
 	}
 
 
-	Vec3D<> tmpOffset = pDM->GetLatDimEnv()/2;
-	CVX_Object tmpDM = *pDM;
-	tmpDM.Resize(tVX, tVY, tVZ);
-	//add all vertices..
-	for (int k=0; k<tVZ; k++){
-		for (int j=0; j<tVY; j++){
-			for (int i=0; i<tVX; i++){
-				Vec3D<> pos = tmpDM.GetXYZ(i, j, k)-tmpOffset;
-				tmpMesh.Vertices.push_back(CVertex(pos));
-			}
-		}
-	}
-
 	tmpMesh.RemoveDupLines();
 
-	//tmpMesh is now complete, but with way too many vertices, most unused.
-
-	//commit to DefMesh, minus all the extra vertices!!!
+	//commit to DefMesh: only the vertices on the surface (touched by 1 to 7 voxels), in lattice order
 	DefMesh.Clear();
 	CalcVerts.clear();
 
-	int* Map = new int[tVX*tVY*tVZ];
-	int NewInd = 0;
-	for (int i=0; i<tVX*tVY*tVZ; i++){
-		if (CalcVertsAll[i].ConVoxels.size() != 0 && CalcVertsAll[i].ConVoxels.size() != 8){
-			DefMesh.Vertices.push_back(tmpMesh.Vertices[i]);
-			CalcVerts.push_back(CalcVertsAll[i]);
-			Map[i] = NewInd++;
+	std::vector<int> SurfVerts;
+	for (std::unordered_map<int, CVertexCalc>::iterator it = CalcVertsAll.begin(); it != CalcVertsAll.end(); it++){
+		if (it->second.ConVoxels.size() != 8) SurfVerts.push_back(it->first);
+	}
+	std::sort(SurfVerts.begin(), SurfVerts.end());
 
-		}
-		else Map[i] = -1;
+	Vec3D<> tmpOffset = pDM->GetLatDimEnv()/2;
+	std::unordered_map<int, int> Map; //lattice vertex index to DefMesh vertex index
+	Map.reserve(SurfVerts.size());
+	for (int i=0; i<(int)SurfVerts.size(); i++){
+		int ThisVert = SurfVerts[i];
+		Vec3D<> pos;
+		pDM->GetLatticeXYZ(&pos, ThisVert%tVX, (ThisVert/tVX)%tVY, ThisVert/(tVX*tVY));
+		DefMesh.Vertices.push_back(CVertex(pos-tmpOffset));
+		CalcVerts.push_back(CalcVertsAll[ThisVert]);
+		Map[ThisVert] = i;
 	}
 
 	DefMesh.Facets = tmpMesh.Facets;
 	for (int i=0; i<(int)DefMesh.Facets.size(); i++){
 		for (int j=0; j<3; j++){
-			DefMesh.Facets[i].vi[j] = Map[tmpMesh.Facets[i].vi[j]];
+			std::unordered_map<int, int>::iterator it = Map.find(tmpMesh.Facets[i].vi[j]);
+			DefMesh.Facets[i].vi[j] = (it == Map.end()) ? -1 : it->second;
 		}
 	}
 
 	DefMesh.Lines = tmpMesh.Lines;
 	for (int i=0; i<(int)DefMesh.Lines.size(); i++){
 		for (int j=0; j<2; j++){
-			DefMesh.Lines[i].vi[j] = Map[tmpMesh.Lines[i].vi[j]];
+			std::unordered_map<int, int>::iterator it = Map.find(tmpMesh.Lines[i].vi[j]);
+			DefMesh.Lines[i].vi[j] = (it == Map.end()) ? -1 : it->second;
 		}
 	}
+
+	BuildVertexTable();
 }
 
-void CVX_MeshUtil::UpdateMesh(int CurSel) //updates mesh based on linked FEA/Relaxation
+void CVX_MeshUtil::UpdateMesh(int CurSel, const CVXS_RenderSnapshot* pSnapshot) //updates mesh based on linked FEA/Relaxation
 {
 
 	if (pSim){/*
@@ -314,42 +325,20 @@ void CVX_MeshUtil::UpdateMesh(int CurSel) //updates mesh based on linked FEA/Rel
 		}*/
 
 
-		Vec3D<> NewPos;
-		for (int i=0; i<(int)CalcVerts.size(); i++){
-			GetCurVLoc(CalcVerts[i], &NewPos);
-			DefMesh.Vertices[i].DrawOffset = NewPos - DefMesh.Vertices[i].v; //yes, we're subtracting this out just to add it back.
-		
-#ifdef USE_OPEN_GL
-			GetCurVCol(CalcVerts[i], &DefMesh.Vertices[i].VColor, CurSel);
-#endif
-		}
+		UpdateDeformed(true, CurSel, pSnapshot); //positions, colors and facet normals
 
-
-		//update colors that aren't by vertex!
 #ifdef USE_OPEN_GL
-
-		if (FacetToSIndex.size() != 0){ //if pulling color for full fact
+		if (FacetToSIndex.size() != 0 && pSim->fluidEnvironment){
 			for (int i=0; i<(int)DefMesh.Facets.size(); i++){
-				DefMesh.Facets[i].FColor = pSimView->GetCurVoxColor(FacetToSIndex[i], CurSel);
-
-				if(pSim->fluidEnvironment)
-				{
-					DefMesh.Facets[i].drag = pSim->VoxMesh.DefMesh.Facets[i].drag; //  In voxelyze this shouldn't have any effect. In VoxCad, we fetch the drag forces from the "physics mesh" and copy in the "view mesh".  pSim->VoxArray[FacetToSIndex[i]].DragForce; // It's more correct to assign and plot the drag force experienced by each facet, instead of plotting the resulting voxel drag. 
-					DefMesh.Facets[i].speed = pSim->VoxMesh.DefMesh.Facets[i].speed;
-				}
-				//DefMesh.Facets[i].FColor = pSim->GetCurColor(i, CurSel);
+				DefMesh.Facets[i].drag = pSim->VoxMesh.DefMesh.Facets[i].drag; //  In voxelyze this shouldn't have any effect. In VoxCad, we fetch the drag forces from the "physics mesh" and copy in the "view mesh".  pSim->VoxArray[FacetToSIndex[i]].DragForce; // It's more correct to assign and plot the drag force experienced by each facet, instead of plotting the resulting voxel drag. 
+				DefMesh.Facets[i].speed = pSim->VoxMesh.DefMesh.Facets[i].speed;
 			}
 		}
-		//else { //color by vertex!!!...
-
-		//}
 #endif
 
 		//update normals!
-		if (!DefMesh.DrawSmooth) //if drawing faces...
-			DefMesh.CalcFaceNormals();
-		else
-			DefMesh.CalcVertNormals();
+		if (DefMesh.DrawSmooth) //if not drawing faces...
+			DefMesh.CalcVertNormals(); //(from the facet normals)
 		
 	}
 	else if (pFEA){
@@ -361,21 +350,137 @@ void CVX_MeshUtil::UpdateMesh(int CurSel) //updates mesh based on linked FEA/Rel
 
 void CVX_MeshUtil::UpdateMeshPhysicsOnlyNoColors(int CurSel) //updates mesh based on linked FEA/Relaxation
 {
+	if (pSim) UpdateDeformed(false, CurSel); //facet normals are always updated: they are needed for swimming
+}
 
-	if (pSim)
-	{
-		Vec3D<> NewPos;
-		for (int i=0; i<(int)CalcVerts.size(); i++)
-		{
-			GetCurVLoc(CalcVerts[i], &NewPos);
-			DefMesh.Vertices[i].DrawOffset = NewPos - DefMesh.Vertices[i].v; //yes, we're subtracting this out just to add it back.
+void CVX_MeshUtil::BuildVertexTable(void)
+{
+	int NumVerts = (int)CalcVerts.size();
+	int NumTerms = 0;
+	for (int i=0; i<NumVerts; i++) NumTerms += (int)CalcVerts[i].ConVoxels.size();
+
+	TermStart.resize(NumVerts+1);
+	TermWeightSum.resize(NumVerts);
+	Terms.resize(NumTerms);
+	int CurTerm = 0;
+	for (int i=0; i<NumVerts; i++){
+		TermStart[i] = CurTerm;
+		TermWeightSum[i] = 0;
+		for (int j=0; j<(int)CalcVerts[i].ConVoxels.size(); j++){
+			const CVertexComp& CurComp = CalcVerts[i].ConVoxels[j];
+			CVertexTerm& ThisTerm = Terms[CurTerm++];
+			ThisTerm.SIndex = pSim ? pSim->XtoSIndexMap[CurComp.XIndex] : -1;
+			ThisTerm.Corner = CurComp.Corner;
+			ThisTerm.Off = CurComp.Off;
+			ThisTerm.Weight = CurComp.Weight;
+			TermWeightSum[i] += CurComp.Weight;
 		}
+	}
+	TermStart[NumVerts] = CurTerm;
 
-		//update normals!
-		//if (!DefMesh.DrawSmooth) //if drawing faces...
-		DefMesh.CalcFaceNormals(); // FC: this must be done always for swimming!
-		//else
-		//	DefMesh.CalcVertNormals(); // what about this?
+	ColorStep = -1;
+}
+
+void CVX_MeshUtil::UpdateDeformed(bool WantColors, int CurSel, const CVXS_RenderSnapshot* pSnapshot)
+{
+	if (TermStart.size() != CalcVerts.size()+1) BuildVertexTable();
+	if (pSnapshot && (int)pSnapshot->Voxels.size() != pSim->NumVox()) return; //not of this simulation
+
+	UpdatingColors = false;
+#ifdef USE_OPEN_GL
+	if (WantColors && pSimView){ //the color of each voxel is looked up once, and only if anything it depends on may have changed
+		int ViewCol = pSnapshot ? pSnapshot->ViewCol : (int)pSimView->GetCurViewCol();
+		int Step = pSnapshot ? pSnapshot->StepCount : pSim->CurStepCount;
+		if (!pSimView->ColorChangesWithStep((ViewColor)ViewCol)) Step = 0; //material colors: computed once, not every step
+		if (ColorStep == -1 || ViewCol != ColorViewCol || CurSel != ColorSel || Step != ColorStep){
+			VoxColors.resize(pSim->NumVox());
+			if (pSnapshot){
+				for (int i=0; i<pSim->NumVox(); i++){
+					const CVXS_RenderVoxel& ThisVox = pSnapshot->Voxels[i];
+					VoxColors[i] = (ThisVox.XIndex == CurSel) ? CColor(1.0f, 0.0f, 1.0f, 1.0f) : ThisVox.Color; //highlight selected voxel (as GetCurVoxColor())
+				}
+			}
+			else for (int i=0; i<pSim->NumVox(); i++) VoxColors[i] = pSimView->GetCurVoxColor(i, CurSel);
+			ColorViewCol = ViewCol;
+			ColorSel = CurSel;
+			ColorStep = Step;
+			UpdatingColors = true;
+		}
+	}
+#endif
+
+	pCurSnapshot = pSnapshot;
+	RunThreads(&CVX_MeshUtil::UpdateVertexRange, (int)CalcVerts.size());
+	RunThreads(&CVX_MeshUtil::UpdateFacetRange, (int)DefMesh.Facets.size()); //needs all the vertices in place
+	UpdatingColors = false;
+	pCurSnapshot = NULL;
+}
+
+void CVX_MeshUtil::RunThreads(void (CVX_MeshUtil::*pFunc)(int, int), int Count)
+{
+	int NumThreads = 1;
+	if (Count >= MESH_PARALLEL_MIN){
+		NumThreads = (int)std::thread::hardware_concurrency();
+		if (NumThreads > 8) NumThreads = 8;
+		if (NumThreads < 1) NumThreads = 1;
+	}
+	if (NumThreads == 1){(this->*pFunc)(0, Count); return;}
+
+	std::vector<std::thread> Threads;
+	for (int t=1; t<NumThreads; t++) Threads.push_back(std::thread(pFunc, this, Count*t/NumThreads, Count*(t+1)/NumThreads));
+	(this->*pFunc)(0, Count/NumThreads); //first range on this thread
+	for (int t=0; t<(int)Threads.size(); t++) Threads[t].join();
+}
+
+void CVX_MeshUtil::UpdateVertexRange(int First, int Last)
+{
+	for (int i=First; i<Last; i++){
+		Vec3D<> avgPos(0,0,0);
+		vfloat Ra = 0, Ga = 0, Ba = 0;
+
+		for (int j=TermStart[i]; j<TermStart[i+1]; j++){
+			const CVertexTerm& ThisTerm = Terms[j];
+			Vec3D<> VoxPos, Neg, Pos;
+			CQuat<> VoxAngle;
+			vfloat ScaleFact;
+			if (pCurSnapshot){
+				const CVXS_RenderVoxel& CurVox = pCurSnapshot->Voxels[ThisTerm.SIndex];
+				VoxPos = CurVox.Pos; VoxAngle = CurVox.Angle; Neg = CurVox.CornerNeg; Pos = CurVox.CornerPos; ScaleFact = CurVox.ScaleFact;
+			}
+			else {
+				const CVXS_Voxel& CurVox = pSim->VoxArray[ThisTerm.SIndex];
+				VoxPos = CurVox.GetCurPos(); VoxAngle = CurVox.GetCurAngle(); Neg = CurVox.GetCornerNeg(); Pos = CurVox.GetCornerPos();
+				ScaleFact = CurVox.GetCurScale() / CurVox.GetNominalSize(); //Assumes square, isotropic expansion
+			}
+
+			Vec3D<> ThisOffset; //offset to this point (as in GetCurVLoc())
+			if (ThisTerm.Corner != -1) //bits of the corner: P in x, y, z
+				ThisOffset = Vec3D<>((ThisTerm.Corner & 4) ? Pos.x : Neg.x, (ThisTerm.Corner & 2) ? Pos.y : Neg.y, (ThisTerm.Corner & 1) ? Pos.z : Neg.z);
+			else
+				ThisOffset = ScaleFact*ThisTerm.Off;
+			avgPos += ThisTerm.Weight*(VoxPos + VoxAngle.RotateVec3D(ThisOffset));
+
+			if (UpdatingColors){
+				const CColor& Tmp = VoxColors[ThisTerm.SIndex];
+				Ra += ThisTerm.Weight*Tmp.r;
+				Ga += ThisTerm.Weight*Tmp.g;
+				Ba += ThisTerm.Weight*Tmp.b;
+			}
+		}
+
+		DefMesh.Vertices[i].DrawOffset = avgPos/TermWeightSum[i] - DefMesh.Vertices[i].v; //yes, we're subtracting this out just to add it back.
+		if (UpdatingColors) DefMesh.Vertices[i].VColor = CColor(Ra/TermWeightSum[i], Ga/TermWeightSum[i], Ba/TermWeightSum[i], 1.0);
+	}
+}
+
+void CVX_MeshUtil::UpdateFacetRange(int First, int Last)
+{
+	for (int i=First; i<Last; i++){
+		CFacet& ThisFacet = DefMesh.Facets[i];
+		Vec3D<> v0 = DefMesh.Vertices[ThisFacet.vi[0]].OffPos();
+		ThisFacet.n = ((DefMesh.Vertices[ThisFacet.vi[1]].OffPos()-v0).Cross(DefMesh.Vertices[ThisFacet.vi[2]].OffPos()-v0)).Normalized(); //as CMesh::CalcFaceNormals()
+
+		if (UpdatingColors && FacetToSIndex.size() != 0) ThisFacet.FColor = VoxColors[FacetToSIndex[i]]; //colors that aren't by vertex
 	}
 }
 
@@ -644,10 +749,31 @@ bool CVX_MeshUtil::ToStl(std::string BasePath, CVX_Object* pObj, bool WantDefMes
 
 bool CVX_MeshUtil::FromStl(CMesh* pMeshIn, CVX_Object* pObj, int MatIndex)
 {
-	Vec3D<> Loc;
-	for (int i=0; i<pObj->GetStArraySize(); i++){
-		Loc = pObj->GetXYZ(i);
-		if(pMeshIn->IsInside(&Loc)) pObj->SetMat(i, MatIndex);
+	//same result as testing each voxel with pMeshIn->IsInside(), but the facets crossing each row are found through a hierarchy built once, and the rows are split over several threads
+	CMeshBVH BVH;
+	BVH.Build(pMeshIn);
+
+	int NumRows = pObj->GetVYDim()*pObj->GetVZDim();
+	int NumThreads = 1;
+	if (NumRows >= STL_PARALLEL_MIN){
+		NumThreads = (int)std::thread::hardware_concurrency();
+		if (NumThreads > 8) NumThreads = 8;
+		if (NumThreads < 1) NumThreads = 1;
+	}
+
+	std::vector<std::vector<int> > Runs(NumThreads); //runs of voxels inside the mesh found by each thread
+	if (NumThreads == 1) FromStlRows(&BVH, pObj, 0, NumRows, &Runs[0]);
+	else {
+		std::vector<std::thread> Threads;
+		for (int t=0; t<NumThreads; t++) Threads.push_back(std::thread(&CVX_MeshUtil::FromStlRows, this, &BVH, pObj, NumRows*t/NumThreads, NumRows*(t+1)/NumThreads, &Runs[t]));
+		for (int t=0; t<NumThreads; t++) Threads[t].join();
+	}
+
+	//the structure allocates its pages as they are set, so it is only written from here
+	for (int t=0; t<NumThreads; t++){
+		for (int r=0; r<(int)Runs[t].size(); r+=2){
+			for (int i=Runs[t][r]; i<Runs[t][r]+Runs[t][r+1]; i++) pObj->SetMat(i, MatIndex);
+		}
 	}
 
 	return true;
@@ -725,6 +851,42 @@ bool CVX_MeshUtil::FromStl(CMesh* pMeshIn, CVX_Object* pObj, int MatIndex)
 
 
 
+void CVX_MeshUtil::FromStlRows(const CMeshBVH* pBVH, const CVX_Object* pObj, int FirstRow, int LastRow, std::vector<int>* pRuns)
+{
+	int Xv = pObj->GetVXDim(), Yv = pObj->GetVYDim();
+	std::vector<vfloat> Intersections;
+	Vec3D<> Loc;
+
+	for (int Row=FirstRow; Row<LastRow; Row++){
+		int RowStart = pObj->GetIndex(0, Row%Yv, Row/Yv);
+		bool HaveLine = false;
+		vfloat LineY = 0, LineZ = 0;
+		int RunStart = -1;
+
+		for (int i=0; i<Xv; i++){
+			pObj->GetXYZ(&Loc, RowStart+i);
+			if (!HaveLine || Loc.y != LineY || Loc.z != LineZ){ //one ray per row, unless the lattice is offset along it
+				pBVH->GetXIntersections(Loc.y, Loc.z, &Intersections);
+				HaveLine = true;
+				LineY = Loc.y;
+				LineZ = Loc.z;
+			}
+
+			bool Inside = CMeshBVH::IsInside(Loc.x, Intersections);
+			if (Inside && RunStart == -1) RunStart = RowStart+i;
+			else if (!Inside && RunStart != -1){
+				pRuns->push_back(RunStart);
+				pRuns->push_back(RowStart+i-RunStart);
+				RunStart = -1;
+			}
+		}
+		if (RunStart != -1){
+			pRuns->push_back(RunStart);
+			pRuns->push_back(RowStart+Xv-RunStart);
+		}
+	}
+}
+
 void CVX_MeshUtil::printMeshNormals()
 {
 	std::cout << " -----------------------------------------------------------"  << std::endl;
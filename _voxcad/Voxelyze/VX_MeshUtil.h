@@ -13,11 +13,14 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 
 #include "Utils/Mesh.h"
 #include <fstream>
+#include <unordered_map>
 
 class CVX_Sim;
 class CVX_FEA;
 class CVX_Object;
 class CVXS_SimGLView;
+class CMeshBVH;
+class CVXS_RenderSnapshot;
 
 //corners
 #define NNN 0
@@ -55,6 +58,13 @@ struct CVertexCalc {
 
 };
 
+struct CVertexTerm { //one voxel's contribution to a vertex, flattened from CVertexCalc::ConVoxels for UpdateMesh()
+	int SIndex; //simulation index of the voxel
+	int Corner; //as CVertexComp::Corner
+	Vec3D<> Off; //as CVertexComp::Off
+	vfloat Weight;
+};
+
 class CVX_MeshUtil
 {
 public:
@@ -65,7 +75,7 @@ public:
 
 	CMesh DefMesh;
 	std::vector<CVertexCalc> CalcVerts; //same size (and order) as the vertices in the mesh
-	std::vector<CVertexCalc> CalcVertsAll; //Every possible vertex point! (iterating in x, y,z, size one greater than number of voxels in each dimension
+	std::unordered_map<int, CVertexCalc> CalcVertsAll; //Every vertex point touched by a voxel, keyed by its index in the (x+1, y+1, z+1) lattice of corner points (iterating in x, y, z)
 	std::vector<int> FacetToSIndex; //same size as the number of facets, contains the Simulation index of this voxel (to grab current color info!)
 
 	void LinkSimExisting(CVX_Sim* pSimIn, CVXS_SimGLView* pSimViewIn, CMesh* pMeshIn=NULL); //Links existing mesh and simulation
@@ -77,7 +87,7 @@ public:
 	void GetCurVCol(CVertexCalc& VertCalc, CColor* pColOut, int CurSel);
 	inline void GetCornerDir(int Corner, Vec3D<>* pOut); //returns vector with component +/- 1 dependeind on which corner
 
-	void UpdateMesh(int CurSel = -1); //updates mesh based on linked FEA/Relaxation
+	void UpdateMesh(int CurSel = -1, const CVXS_RenderSnapshot* pSnapshot = NULL); //updates mesh based on linked FEA/Relaxation (from pSnapshot instead of the simulation's voxels if given)
 	void UpdateMeshPhysicsOnlyNoColors(int CurSel = -1); //updates mesh based on linked FEA/Relaxation
 	
 
@@ -85,7 +95,7 @@ public:
 
 	//misc
 	bool ToStl(std::string BasePath, CVX_Object* pObj, bool WantDefMes = false);
-	bool FromStl(CMesh* pMeshIn, CVX_Object* pObj, int MatIndex);
+	bool FromStl(CMesh* pMeshIn, CVX_Object* pObj, int MatIndex); //sets every voxel of pObj inside the closed mesh to MatIndex
 
 //	// VOLUMETRIC FUNCTIONS
 	void initializeDeformableMesh(CVX_Sim* pSimIn){ LinkSimVoxels(pSimIn, NULL); DefMesh.DrawSmooth=false; }
@@ -111,6 +121,24 @@ private:
 	inline int D3IndCorner(int XInd, int YInd, int ZInd, int XSize, int YSize, const int Corner); //returns the vertex index in the [x+1, y+1, z+1] CalcVertsAll array corresponding to the specified corner of this voxel.
 	inline int D3Ind(const int X, const int Y, const int Z, const int sX, const int sY){return Z*sX*sY + Y*sX + X;};
 
+	//flat copy of CalcVerts, so UpdateMesh() does not chase the vectors of each vertex or look up simulation indices
+	std::vector<int> TermStart; //terms of vertex i are Terms[TermStart[i]] to Terms[TermStart[i+1]-1]
+	std::vector<CVertexTerm> Terms;
+	std::vector<vfloat> TermWeightSum; //total weight of each vertex
+	void BuildVertexTable(void); //call whenever CalcVerts changes
+
+	std::vector<CColor> VoxColors; //color of each simulation voxel at the last color update
+	int ColorViewCol, ColorSel, ColorStep; //view color, selection and simulation step (0 in view colors that don't change with it) of the last color update (ColorStep -1: none). Colors are only recomputed when one of these changes: the simulation reads material colors from its own copy of the palette, so nothing else changes them.
+	bool UpdatingColors; //set while UpdateMesh() is recomputing colors
+	const CVXS_RenderSnapshot* pCurSnapshot; //set while UpdateMesh() reads the voxels from a snapshot
+
+	void RunThreads(void (CVX_MeshUtil::*pFunc)(int, int), int Count); //calls pFunc(First, Last) on contiguous ranges covering 0 to Count-1, on several threads for large meshes
+	void UpdateVertexRange(int First, int Last); //deformed positions (and colors if UpdatingColors) of vertices First to Last-1
+	void UpdateFacetRange(int First, int Last); //normals (and colors if UpdatingColors) of facets First to Last-1
+	void UpdateDeformed(bool WantColors, int CurSel, const CVXS_RenderSnapshot* pSnapshot = NULL); //updates positions, colors and normals in one pass over the vertices and one over the facets
+
+	void FromStlRows(const CMeshBVH* pBVH, const CVX_Object* pObj, int FirstRow, int LastRow, std::vector<int>* pRuns); //casts a ray along each row of voxels (y, z) from FirstRow to LastRow-1, and appends the start and length of each run of voxels inside the mesh to pRuns
+
 };
 
 #endif
\ No newline at end of file
@@ -20,6 +20,12 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #include <cstdlib> //for rand(), srand()
 #include <climits>
 #include <stdlib.h>  // for atof
+#include <cstring>
+#include <thread>
+#include <locale.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
 
 #ifdef USE_OPEN_GL
 #ifdef QT_GUI_LIB
@@ -47,6 +53,7 @@ CVX_Object& CVX_Object::operator=(const CVX_Object& RefObj)
 	Voxel = RefObj.Voxel; 
 	Structure = RefObj.Structure;
 	Palette = RefObj.Palette;
+	ClearLeafMatCache(); //copies are usually made to be edited or imported: they build their own
 
 	return *this;
 }
@@ -137,6 +144,7 @@ void CVX_Object::LoadDefaultPalette(void)
 */
 void CVX_Object::ClearPalette()
 {
+	ClearLeafMatCache();
 	int VecSize = (int)Palette.size();
 	if (VecSize != 0)
 		Palette.erase(Palette.begin(), Palette.begin()+VecSize); //erase the materials array
@@ -152,6 +160,7 @@ void CVX_Object::ClearPalette()
 bool CVX_Object::ReplaceMaterial(int IndexToReplace, int NewIndex, bool DeleteReplaced, std::string* RetMessage)
 {
 	if (IndexToReplace == NewIndex) return true; //if replacing with the same one...
+	ClearLeafMatCache();
 	if (IndexToReplace == 0 && DeleteReplaced) DeleteReplaced = false; //never delete the null material
 	if (IndexToReplace < 0 || IndexToReplace >= (int)Palette.size()){ if (RetMessage) *RetMessage += "Invalid material to replace\n"; return false;}
 	if (NewIndex<0 || NewIndex >= (int)Palette.size()){ if (RetMessage) *RetMessage += "Invalid material to replace to\n";return false;}
@@ -174,6 +183,7 @@ bool CVX_Object::ReplaceMaterial(int IndexToReplace, int NewIndex, bool DeleteRe
 bool CVX_Object::FlattenMaterial(int IndexToFlatten, std::string* RetMessage) //converts a compound material into its subsidiary materials
 {
 	if (IndexToFlatten < 0 || IndexToFlatten >= (int)Palette.size() || Palette[IndexToFlatten].GetMatType() == SINGLE){ if (RetMessage) *RetMessage += "Cannot Flatten a non-compound material\n"; return false;}
+	ClearLeafMatCache();
 	
 	int LastMatIndex, NextMatIndex;
 	for (int i=0; i<Structure.GetArraySize(); i++){
@@ -208,6 +218,7 @@ bool CVX_Object::DeleteMat(int Index, bool FlattenFirst, std::string* RetMessage
 int CVX_Object::AddMat(CVXC_Material& MatToAdd, bool ForceBasic, std::string* RetMessage)
 {
 	CVXC_Material MatCopy = MatToAdd;
+	ClearLeafMatCache();
 	//checks
 	if (MatCopy.GetName() == "" || MatCopy.GetName() == " "){
 		if (RetMessage) *RetMessage += "Invalid material Name\n";
@@ -226,7 +237,7 @@ int CVX_Object::AddMat(CVXC_Material& MatToAdd, bool ForceBasic, std::string* Re
 	if (ForceBasic) MatCopy.SetMatType(SINGLE); //if we want to avoid any recursion headaches, force to a local single material
 
 	int NextIndex = (int)Palette.size(); //not plus one!
-	if (NextIndex<=256){ //if we have a material slot left...
+	if (NextIndex<=MAX_NUM_MATERIALS){ //if we have a material slot left...
 		Palette.push_back(MatCopy);
 		return NextIndex;
 	}
@@ -516,7 +527,12 @@ bool CVX_Object::GetXYZ(Vec3D<>* Point, int index, bool WithOff) const //gets th
 	int iy = 0;
 	int ix = 0;
 	GetXYZNom(&ix, &iy, &iz, index); //get nominal x, y, z indicies
+	GetLatticeXYZ(Point, ix, iy, iz, WithOff);
+	return true;
+}
 
+void CVX_Object::GetLatticeXYZ(Vec3D<>* Point, int ix, int iy, int iz, bool WithOff) const
+{
 	if (WithOff){
 		vfloat Eps = (vfloat)0.000001; //hack, offset to make sure its all on the right side of zero
 		vfloat TotalXOffP = (vfloat)0.0; //running variables to add the offsets to. (in percentage of width
@@ -542,8 +558,6 @@ bool CVX_Object::GetXYZ(Vec3D<>* Point, int index, bool WithOff) const //gets th
 	else {
 		*Point = GetLatDimEnv().Scale(Vec3D<>(ix+0.5, iy+0.5, iz+0.5));
 	}
-	return true;
-	
 }
 
 /*! Only touching face-to-face is considered, not edge to edge or corner to corner. 
@@ -588,44 +602,34 @@ bool CVX_Object::IsAdjacent(int Index1, int Index2, bool IncludeEmpty, Vec3D<>*
 void CVX_Object::Transform(Vec3D<> Trans) //shift the structure within the workspace (Caution! Trucates!)
 {
 	//create a copy of current object...
-	char* pTmpVoxArray = NULL;
-	pTmpVoxArray = new char[Structure.GetArraySize()];
-	for (int i=0; i<Structure.GetArraySize(); i++){
-		*(pTmpVoxArray+i) = Structure[i];
-	}
+	CVXC_Structure TmpStructure = Structure;
+	Structure.ResetStructure();
+	ClearLeafMatCache();
 
 	int tX = 0, tY = 0, tZ = 0;
-	//overwrite with transformed values:
-	for (int i=0; i<Structure.GetArraySize(); i++){
+	//write the voxels to their transformed locations:
+	for (int i=TmpStructure.GetNextVoxel(0); i!=-1; i=TmpStructure.GetNextVoxel(i+1)){
 		GetXYZNom(&tX, &tY, &tZ, i);
-		int NewIndex = GetIndex(tX-(int)Trans.x, tY-(int)Trans.y, tZ-(int)Trans.z);
-		if(NewIndex != -1){ //if it was within bounds
-			Structure[i] = *(pTmpVoxArray+NewIndex);
-		}
-		else {
-			Structure[i] = 0;
-		}
+		int NewIndex = GetIndex(tX+(int)Trans.x, tY+(int)Trans.y, tZ+(int)Trans.z);
+		if(NewIndex != -1) Structure.SetData(NewIndex, TmpStructure[i]); //if it stays within bounds
 	}
-
-	delete [] pTmpVoxArray;
-	pTmpVoxArray = NULL;
 }
 
 int CVX_Object::GetNumVox(void)
 {
 	int NumVox = 0;
-	for (int i=0; i<Structure.GetArraySize(); i++){ //for each voxel in the array
-		if(Structure[i]!=0){ //if this is stuff we want to replace
-			NumVox++;
-		}
-	}
+	for (int i=Structure.GetNextVoxel(0); i!=-1; i=Structure.GetNextVoxel(i+1)) NumVox++; //for each voxel in the array
 	return NumVox;
 }
 
 int CVX_Object::GetNumVox(int MatIndex, bool OnlyLeafMat)
 {
 	int NumVox = 0;
-	for (int i=0; i<Structure.GetArraySize(); i++){ //for each voxel in the array
+	if (MatIndex == 0){ //counting empty cells
+		for (int i=0; i<Structure.GetArraySize(); i++) if (Structure[i] == 0) NumVox++;
+		return NumVox;
+	}
+	for (int i=Structure.GetNextVoxel(0); i!=-1; i=Structure.GetNextVoxel(i+1)){ //for each voxel in the array
 		if(OnlyLeafMat && GetLeafMatIndex(i)== MatIndex) NumVox++;
 		else if (!OnlyLeafMat && Structure[i] == MatIndex) NumVox++;
 	}
@@ -720,9 +724,20 @@ bool CVX_Object::IsInRecursivePath(int MatIndexStart, int MatIndexRef) //returns
 @param[out] pVisible Set to false if this material is currently to be hidden for visualization. Otherwise true.
 */
 int CVX_Object::GetLeafMatIndex(int StructIndex, bool*pVisible) //get the final material to display
+{
+	if (StructIndex >= 0 && StructIndex < (int)LeafMatCache.size()){ //resolved by CacheLeafMats()
+		if (pVisible) *pVisible = LeafMatVisible[StructIndex];
+		return LeafMatCache[StructIndex];
+	}
+	return FindLeafMatIndex(StructIndex, pVisible);
+}
+
+int CVX_Object::FindLeafMatIndex(int StructIndex, bool*pVisible)
 {
 	if (pVisible) *pVisible = true; //assume its visible. Any sub-step along the way can set this to false and it will not be shown.
 	int LastMatIndex = Structure.GetData(StructIndex);
+	if (LastMatIndex == 0) return 0; //empty
+
 	int NextMatIndex, CurXInd, CurYInd, CurZInd;
 	GetXYZNom(&CurXInd, &CurYInd, &CurZInd, StructIndex);
 
@@ -734,6 +749,20 @@ int CVX_Object::GetLeafMatIndex(int StructIndex, bool*pVisible) //get the final
 	return 0; //didn't find a material
 }
 
+void CVX_Object::CacheLeafMats(void)
+{
+	int NumCells = Structure.GetArraySize();
+	std::vector<unsigned short> Leaf(NumCells);
+	std::vector<bool> Visible(NumCells);
+	for (int i=0; i<NumCells; i++){
+		bool ThisVisible;
+		Leaf[i] = (unsigned short)FindLeafMatIndex(i, &ThisVisible);
+		Visible[i] = ThisVisible;
+	}
+	LeafMatCache.swap(Leaf);
+	LeafMatVisible.swap(Visible);
+}
+
 /*! Used for recursivly determining the leaf material.
 @param[in] StructIndex The global voxel structure index to query. 
 @param[in] MatIndex The current sub-material we are evaluating at this location.
@@ -880,6 +909,7 @@ bool CVX_Object::SetMat(int StructIndex, int MatIndex) //sets the material index
 {
 	if (MatIndex >=0 && MatIndex < GetNumMaterials() && StructIndex >=0 && StructIndex < Structure.GetArraySize()){
 		Structure.SetData(StructIndex, MatIndex);
+		ClearLeafMatCache();
 		return true; //successful
 	}
 	else return false; //error out
@@ -1609,6 +1639,38 @@ bool CVXC_Material::ValidateSSData(std::string* RetMsg) //Does all the checks in
 
 
 
+////////////////////////////////GENOME////////////////////////////////
+
+CVXC_Genome::CVXC_Genome(int NumVoxIn, const int* pWidths, const CVXC_Genome* pCopyFrom)
+{
+	NumVox = NumVoxIn > 0 ? NumVoxIn : 0;
+	size_t Total = 0;
+	for (int c=0; c<GC_NUM_CHANNELS; c++){
+		Width[c] = pWidths[c] > 0 ? pWidths[c] : 0;
+		Stride[c] = (Width[c]+3)&~3; //rows padded to 4 doubles
+		Offset[c] = Total;
+		Total += ((size_t)NumVox*Stride[c]+7)&~(size_t)7; //channels start on a 64 byte boundary
+	}
+
+	pRaw = new double[Total+8];
+	pBlock = (double*)(((size_t)pRaw + 63) & ~(size_t)63);
+	memset(pBlock, 0, Total*sizeof(double));
+
+	if (pCopyFrom){
+		int CopyVox = NumVox < pCopyFrom->NumVox ? NumVox : pCopyFrom->NumVox;
+		for (int c=0; c<GC_NUM_CHANNELS; c++){
+			int CopyWidth = Width[c] < pCopyFrom->Width[c] ? Width[c] : pCopyFrom->Width[c];
+			if (CopyWidth <= 0) continue;
+			for (int v=0; v<CopyVox; v++) memcpy(MutableRow(c, v), pCopyFrom->Row(c, v), CopyWidth*sizeof(double));
+		}
+	}
+}
+
+CVXC_Genome::~CVXC_Genome(void)
+{
+	delete [] pRaw;
+}
+
 ////////////////////////////////STRUCTURE////////////////////////////////
 
 CVXC_Structure& CVXC_Structure::operator=(const CVXC_Structure& RefStruct)
@@ -1619,29 +1681,79 @@ CVXC_Structure& CVXC_Structure::operator=(const CVXC_Structure& RefStruct)
 	Z_Voxels = RefStruct.Z_Voxels;
 
 	if (RefStruct.DataInit){ 
-		IniData(RefStruct.GetArraySize());
-		for (int i=0; i<RefStruct.GetArraySize(); i++)
-			SetData(i, RefStruct.GetData(i));
+		m_SizeOfArray = RefStruct.m_SizeOfArray;
+		Cells = RefStruct.Cells; //copies only the allocated pages
+		DataInit = true;
 	}
 
+	Genome = RefStruct.Genome; //shared, not copied
+	numForwardModelSynapses = RefStruct.numForwardModelSynapses;
+	numControllerSynapses = RefStruct.numControllerSynapses;
+	numRegenerationModelSynapses = RefStruct.numRegenerationModelSynapses;
+	MinElasticMod = RefStruct.MinElasticMod;
+	MaxElasticMod = RefStruct.MaxElasticMod;
+	MinDevo = RefStruct.MinDevo;
+	MAX_STIFFNESS_VARIATION_STEP = RefStruct.MAX_STIFFNESS_VARIATION_STEP;
+	MaxAdaptationRate = RefStruct.MaxAdaptationRate;
+	growthModel = RefStruct.growthModel;
+
 	return *this;
 }
 
+CVXC_Genome* CVXC_Structure::GenomeForWrite(void)
+{
+	if (!Genome){
+		int NumVox = 0;
+		for (int i=GetNextVoxel(0); i!=-1; i=GetNextVoxel(i+1)) if (GetData(i) > 0) NumVox++;
+		int Widths[GC_NUM_CHANNELS] = {0};
+		Genome.reset(new CVXC_Genome(NumVox, Widths));
+	}
+	else if (Genome.use_count() > 1){ //someone else is looking at this one
+		int Widths[GC_NUM_CHANNELS];
+		for (int c=0; c<GC_NUM_CHANNELS; c++) Widths[c] = Genome->GetWidth(c);
+		Genome.reset(new CVXC_Genome(Genome->GetNumVox(), Widths, Genome.get()));
+	}
+	return Genome.get();
+}
+
+void CVXC_Structure::AddGenomeChannel(int Channel, int Width)
+{
+	CVXC_Genome* pGenome = GenomeForWrite();
+	if (pGenome->GetWidth(Channel) >= Width) return;
+
+	int Widths[GC_NUM_CHANNELS];
+	for (int c=0; c<GC_NUM_CHANNELS; c++) Widths[c] = pGenome->GetWidth(c);
+	Widths[Channel] = Width;
+	Genome.reset(new CVXC_Genome(pGenome->GetNumVox(), Widths, pGenome));
+}
+
+void CVXC_Structure::SetGenomeValue(int Channel, int VoxelIndex, int Index, double Value)
+{
+	if (VoxelIndex < 0 || Index < 0) return;
+	CVXC_Genome* pGenome = GenomeForWrite();
+	if (pGenome->GetWidth(Channel) <= Index || pGenome->GetNumVox() <= VoxelIndex){ //grow to fit
+		int Widths[GC_NUM_CHANNELS];
+		for (int c=0; c<GC_NUM_CHANNELS; c++) Widths[c] = pGenome->GetWidth(c);
+		if (Widths[Channel] <= Index) Widths[Channel] = Index+1;
+		int NumVox = pGenome->GetNumVox() > VoxelIndex ? pGenome->GetNumVox() : VoxelIndex+1;
+		Genome.reset(new CVXC_Genome(NumVox, Widths, pGenome));
+		pGenome = Genome.get();
+	}
+	pGenome->MutableRow(Channel, VoxelIndex)[Index] = Value;
+}
+
 void CVXC_Structure::DeleteData(void) //sandbox the creation and destruction...
 {
 	DataInit = false;
 	m_SizeOfArray = 0;
-	if (pData != NULL){ //clear current array
-		delete [] pData;
-		pData = NULL;
-	}
+	Cells.Clear();
 }
 
 void CVXC_Structure::IniData(int Size)
 {
 	DeleteData();
 	if (Size > 0){
-		pData = new char[Size];
+		Cells.Resize(Size, 0); //all empty, nothing allocated until voxels are set
 		m_SizeOfArray = Size;
 		DataInit = true;
 	}
@@ -1660,8 +1772,14 @@ bool CVXC_Structure::WriteXML(CXML_Rip* pXML, int Compression, std::string* RetM
 		default: Compress = "CP_ASCIIREADABLE"; break;
 	}
 
+	vmat MaxData = GetMaxData();
+	int BytesPerCell = (MaxData > 255) ? 2 : 1; //material indices above 255 are stored as two bytes (low byte first)
+	if (BytesPerCell == 2 && Compress != "ZLIB") Compress = "BASE64"; //the only other format that can hold them
+	if (Compress == "ASCII_READABLE" && MaxData > 255-48) Compress = "BASE64"; //would not fit in one character
+
 	pXML->DownLevel("Structure");
 	pXML->SetElAttribute("Compression", Compress);
+	if (BytesPerCell == 2) pXML->SetElAttribute("IndexBytes", BytesPerCell);
 
 	pXML->Element("X_Voxels", X_Voxels);
 	pXML->Element("Y_Voxels", Y_Voxels);
@@ -1675,13 +1793,15 @@ bool CVXC_Structure::WriteXML(CXML_Rip* pXML, int Compression, std::string* RetM
 	for (int i=0; i<Z_Voxels; i++){
 		RawData.clear();
 		for (int j=0; j<X_Voxels*Y_Voxels; j++){
-			RawData.push_back(GetData(i*X_Voxels*Y_Voxels + j));
+			vmat ThisData = GetData(i*X_Voxels*Y_Voxels + j);
+			RawData.push_back((char)(ThisData & 0xFF));
+			if (BytesPerCell == 2) RawData.push_back((char)((ThisData >> 8) & 0xFF));
 		} //convert to QByteArray to use qcompress
 		
 		if (Compress == "ASCII_READABLE"){ for (int k=0; k < X_Voxels*Y_Voxels; k++){ WriteData.resize(X_Voxels*Y_Voxels); WriteData[k] = RawData[k]+48;}}
 		else if (Compress == "ZLIB"){
 			#ifdef USE_ZLIB_COMPRESSION
-				unsigned long DataSize = 10+2*X_Voxels*Y_Voxels;
+				unsigned long DataSize = 10+2*BytesPerCell*X_Voxels*Y_Voxels;
 				std::string tmpData;
 				tmpData.resize(DataSize);
 				int ErrorReturn = compress((unsigned char*)tmpData.c_str(), &DataSize, (unsigned char*)RawData.c_str(), RawData.size());
@@ -1731,17 +1851,199 @@ std::vector<std::string> split(const std::string &s, char delim)
     return elems;
 }
 
+static inline bool IsValueSpace(char c) {return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';}
+
+//Parses the number in one comma separated token [p, TokEnd) the way atof() would, without copying it or depending on the locale.
+//Decimal values whose digits fit in 53 bits with small exponents (everything our own writers produce) are converted exactly (Clinger's fast path), anything else goes through strtod() in the "C" locale.
+static double ParseValueToken(const char* p, const char* TokEnd)
+{
+	static const double Pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+	const char* q = p;
+	while (q < TokEnd && IsValueSpace(*q)) q++;
+	bool Neg = false;
+	if (q < TokEnd && (*q == '-' || *q == '+')) Neg = (*q++ == '-');
+
+	unsigned long long Mant = 0;
+	int SigDigits = 0, Exp10 = 0;
+	bool AnyDigits = false;
+	for (; q < TokEnd && *q >= '0' && *q <= '9'; q++){
+		AnyDigits = true;
+		if (Mant || *q != '0'){Mant = Mant*10 + (*q-'0'); SigDigits++;}
+		if (SigDigits > 18) break;
+	}
+	if (q < TokEnd && *q == '.' && SigDigits <= 18){
+		for (q++; q < TokEnd && *q >= '0' && *q <= '9'; q++){
+			AnyDigits = true;
+			if (Mant || *q != '0'){Mant = Mant*10 + (*q-'0'); SigDigits++;}
+			Exp10--;
+			if (SigDigits > 18) break;
+		}
+	}
+	if (AnyDigits && q < TokEnd && (*q == 'e' || *q == 'E')){
+		const char* e = q+1;
+		bool ExpNeg = false;
+		if (e < TokEnd && (*e == '-' || *e == '+')) ExpNeg = (*e++ == '-');
+		if (e < TokEnd && *e >= '0' && *e <= '9'){
+			int Exp = 0;
+			for (; e < TokEnd && *e >= '0' && *e <= '9'; e++) if (Exp < 10000) Exp = Exp*10 + (*e-'0');
+			Exp10 += ExpNeg ? -Exp : Exp;
+			q = e;
+		}
+	}
+	while (q < TokEnd && IsValueSpace(*q)) q++;
+
+	if (AnyDigits && q == TokEnd && Mant < (1ULL << 53) && Exp10 >= -22 && Exp10 <= 22){
+		double Value = (double)Mant; //exact, as is the power of ten, so the result is correctly rounded
+		Value = (Exp10 < 0) ? Value / Pow10[-Exp10] : Value * Pow10[Exp10];
+		return Neg ? -Value : Value;
+	}
+
+	char Buf[128]; //long, unusual or malformed token: let the C library deal with it
+	int Len = (int)(TokEnd-p);
+	if (Len > (int)sizeof(Buf)-1) Len = (int)sizeof(Buf)-1;
+	memcpy(Buf, p, Len);
+	Buf[Len] = 0;
+#ifdef _WIN32
+	static _locale_t CLocale = _create_locale(LC_NUMERIC, "C"); //'.' decimal point whatever the user's locale
+	return _strtod_l(Buf, NULL, CLocale);
+#else
+	static locale_t CLocale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0); //'.' decimal point whatever the user's locale
+	return strtod_l(Buf, NULL, CLocale);
+#endif
+}
+
+//xml tags of each GenomeChannel
+static const char* GenomeChannelTags[GC_NUM_CHANNELS] = {"PhaseOffset", "FinalPhaseOffset", "InitialVoxelSize", "FinalVoxelSize", "VestibularContribution",
+	"PreDamageRoll", "PreDamagePitch", "PreDamageYaw", "StressContribution", "PreDamageStress",
+	"PressureContribution", "PreDamagePressure", "Stiffness", "StressAdaptationRate", "PressureAdaptationRate",
+	"ControllerSynapseWeights", "ForwardModelSynapseWeights", "RegenerationModelSynapseWeights"};
+
+//one z layer of per-voxel values to decode
+struct CVoxelValueLayer
+{
+	const char* pText; //comma separated values (view into the xml buffer)
+	int Length;
+	const CVXC_Structure* pStructure; //material indices (values are stored for filled cells only)
+	int FirstCell; //structure index of the first cell of this layer
+	double* pOut; //where the first filled cell's values go
+	bool Ok; //false if the layer ran out of values
+};
+
+static void DecodeVoxelValueLayers(CVoxelValueLayer* pLayers, int First, int Last, int NumCells, int ValsPerVoxel, int OutStride)
+{
+	for (int i=First; i<Last; i++){
+		CVoxelValueLayer& ThisLayer = pLayers[i];
+		const char* p = ThisLayer.pText;
+		const char* End = p + ThisLayer.Length;
+		double* pOut = ThisLayer.pOut;
+		ThisLayer.Ok = true;
+
+		for (int k=0; k<NumCells && ThisLayer.Ok; k++){
+			bool Filled = (ThisLayer.pStructure->GetData(ThisLayer.FirstCell+k) > 0);
+			for (int s=0; s<ValsPerVoxel; s++){
+				if (!p){if (Filled) ThisLayer.Ok = false; break;} //trailing empty cells may be left out
+				const char* TokEnd = (const char*)memchr(p, ',', End-p);
+				if (!TokEnd) TokEnd = End;
+				if (Filled) pOut[s] = ParseValueToken(p, TokEnd);
+				p = (TokEnd < End) ? TokEnd+1 : NULL; //NULL: no more tokens
+			}
+			if (Filled) pOut += OutStride;
+		}
+	}
+}
+
+#define VOXEL_LAYERS_PARALLEL_MIN 262144 //decode on several threads once there are this many characters of values
+/*! Expects the current element to contain one <Layer> per z slice, each a comma separated list of values for every lattice cell (as many per cell as the channel is wide). The values of the filled cells are written straight into the rows of this genome channel. The layers are parsed in place (no per-value strings) and, for large structures, on several threads. Leaves the XML stack above the current element.
+@param[in] pXML The XML tree positioned at the element containing the layers.
+@param[in] Channel The GenomeChannel to fill. Must already be allocated in a genome that is not shared.
+@param[out] RetMessage Error description if the data does not match the structure.
+*/
+bool CVXC_Structure::ReadVoxelLayers(CXML_Rip* pXML, int Channel, std::string* RetMessage)
+{
+	int ValsPerVoxel = 0, OutStride = 0, MaxVoxels = 0;
+	double* pOut = NULL;
+	if (Genome && Genome->Has(Channel)){
+		ValsPerVoxel = Genome->GetWidth(Channel);
+		OutStride = Genome->GetStride(Channel);
+		MaxVoxels = Genome->GetNumVox();
+		pOut = Genome->MutableRow(Channel, 0);
+	}
+	if (!pOut){ //nothing to store (e.g. zero synapses): just step over the element
+		pXML->UpLevel();
+		return true;
+	}
+
+	int NumCells = X_Voxels*Y_Voxels;
+	std::vector<CVoxelValueLayer> Layers(Z_Voxels);
+	int NumVox = 0;
+	size_t TotalLength = 0;
+
+	for (int i=0; i<Z_Voxels; i++){ //the xml has to be walked in order...
+		CVoxelValueLayer& ThisLayer = Layers[i];
+		if (!pXML->FindLoadElementView("Layer", &ThisLayer.pText, &ThisLayer.Length, true)){
+			if (RetMessage) *RetMessage += "Voxel value layer missing.\n";
+			return false;
+		}
+		ThisLayer.pStructure = this;
+		ThisLayer.FirstCell = NumCells*i;
+		ThisLayer.pOut = pOut + NumVox*OutStride;
+		for (int k=GetNextVoxel(ThisLayer.FirstCell); k!=-1 && k<ThisLayer.FirstCell+NumCells; k=GetNextVoxel(k+1)) if (GetData(k) > 0) NumVox++;
+		TotalLength += ThisLayer.Length;
+	}
+	pXML->UpLevel(); //Layer
+	pXML->UpLevel(); //this element
+
+	if (NumVox > MaxVoxels){
+		if (RetMessage) *RetMessage += "Too many voxel values for the storage available.\n";
+		return false;
+	}
+
+	//...but the values can be decoded in any order
+	int NumThreads = 1;
+	if (TotalLength >= VOXEL_LAYERS_PARALLEL_MIN){
+		NumThreads = (int)std::thread::hardware_concurrency();
+		if (NumThreads > 8) NumThreads = 8;
+		if (NumThreads > Z_Voxels) NumThreads = Z_Voxels;
+		if (NumThreads < 1) NumThreads = 1;
+	}
+	if (NumThreads == 1) DecodeVoxelValueLayers(&Layers[0], 0, Z_Voxels, NumCells, ValsPerVoxel, OutStride);
+	else {
+		std::vector<std::thread> Threads;
+		for (int t=0; t<NumThreads; t++){
+			int First = Z_Voxels*t/NumThreads, Last = Z_Voxels*(t+1)/NumThreads;
+			Threads.push_back(std::thread(DecodeVoxelValueLayers, &Layers[0], First, Last, NumCells, ValsPerVoxel, OutStride));
+		}
+		for (int t=0; t<NumThreads; t++) Threads[t].join();
+	}
+
+	for (int i=0; i<Z_Voxels; i++){
+		if (!Layers[i].Ok){
+			if (RetMessage) *RetMessage += "Voxel value layer data does not match expected size.\n";
+			return false;
+		}
+	}
+	return true;
+}
+
 bool CVXC_Structure::ReadXML(CXML_Rip* pXML, std::string Version, std::string* RetMessage)
 {
 	// Default values
 	MaxAdaptationRate = 1.0;
 	MAX_STIFFNESS_VARIATION_STEP = 0.0;
 	growthModel = 0.0;	
-	//MinElasticMod = 
-	//MaxElasticMod = 
+	MinElasticMod = 0.0;
+	MaxElasticMod = 0.0;
+	MinDevo = 0.0;
 
-	std::string Compression;
+	std::string Compression, IndexBytes;
 	pXML->GetElAttribute("Compression", &Compression);
+	pXML->GetElAttribute("IndexBytes", &IndexBytes);
+	int BytesPerCell = (IndexBytes == "2") ? 2 : 1; //wide (16 bit) material indices
+	if (BytesPerCell == 2 && Compression != "ZLIB" && Compression != "BASE64"){
+		if (RetMessage) *RetMessage += "Two byte material indices are only supported with BASE64 or ZLIB compression.";
+		return false;
+	}
 
 	if (!pXML->FindLoadElement("X_Voxels", &X_Voxels)) X_Voxels = 1;
 	if (!pXML->FindLoadElement("Y_Voxels", &Y_Voxels)) Y_Voxels = 1;
@@ -1760,8 +2062,21 @@ bool CVXC_Structure::ReadXML(CXML_Rip* pXML, std::string Version, std::string* R
 		for (int i=0; i<Z_Voxels; i++)
 		{
 			std::string DataIn;
+			const char* pRawData = NULL;
+			int RawLength = 0;
+			pXML->FindLoadElementView("Layer", &pRawData, &RawLength, true);
+
+			if (Compression == "ASCII_READABLE") //decode straight from the xml buffer
+			{
+				if (RawLength != X_Voxels*Y_Voxels){
+					if (RetMessage) *RetMessage += "Voxel layer data not present or does not match expected size.";
+					return false;
+				}
+				for(int k=0; k<RawLength; k++) SetData(X_Voxels*Y_Voxels*i + k, (unsigned char)pRawData[k]-48);
+				continue;
+			}
 			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
+			if (pRawData) RawData.assign(pRawData, RawLength);
 		
 			//different compression types
 			if (Compression == "QT_ZLIB") //DEPRECATED
@@ -1782,7 +2097,7 @@ bool CVXC_Structure::ReadXML(CXML_Rip* pXML, std::string Version, std::string* R
 			else if (Compression == "ZLIB")
 			{
 				#ifdef USE_ZLIB_COMPRESSION
-					unsigned long DestLength = X_Voxels*Y_Voxels;
+					unsigned long DestLength = BytesPerCell*X_Voxels*Y_Voxels;
 					DataIn.resize(DestLength);
 
 					std::string tmpData = FromBase64(RawData);
@@ -1792,14 +2107,6 @@ bool CVXC_Structure::ReadXML(CXML_Rip* pXML, std::string Version, std::string* R
 					return false;
 				#endif
 			}
-			else if (Compression == "ASCII_READABLE") 
-			{
-				DataIn.resize(RawData.size());
-				for (int i=0; i<(int)RawData.size(); i++)
-				{
-					DataIn[i] = RawData[i]-48; //if compressed using this scheme
-				}
-			}
 			else if (Compression == "RAW_DATA") //DEPRECATED!!!
 			{	
 				DataIn = RawData; 
@@ -1808,14 +2115,16 @@ bool CVXC_Structure::ReadXML(CXML_Rip* pXML, std::string Version, std::string* R
 				DataIn = FromBase64(RawData); //otherwise uncompressed
 			}
 
-			if (DataIn.length() != X_Voxels*Y_Voxels){
+			if (DataIn.length() != BytesPerCell*X_Voxels*Y_Voxels){
 				if (RetMessage) *RetMessage += "Voxel layer data not present or does not match expected size.";
 				return false;
 			}
 
+			const unsigned char* pBytes = (const unsigned char*)DataIn.data();
 			for(int k=0; k<X_Voxels*Y_Voxels; k++){
 				//the object's internal representation at this stage is as a long array, starting at (x0,xy,z0), proceeding to (xn,y0,z0), next to (xn,yn,z0), and on to (xn,yn,zn)
-				SetData(X_Voxels*Y_Voxels*i + k, DataIn[k]); //pDataIn[k];
+				if (BytesPerCell == 2) SetData(X_Voxels*Y_Voxels*i + k, (vmat)(pBytes[2*k] | (pBytes[2*k+1] << 8)));
+				else SetData(X_Voxels*Y_Voxels*i + k, pBytes[k]);
 			}
 
 		}
@@ -1886,158 +2195,48 @@ bool CVXC_Structure::ReadXML(CXML_Rip* pXML, std::string Version, std::string* R
 
 	// }
 
+	//allocate the genome once for every per-voxel channel present in the file
+	int Widths[GC_NUM_CHANNELS];
+	bool AnyChannel = false;
+	for (int c=0; c<GC_NUM_CHANNELS; c++){
+		Widths[c] = 0;
+		if (pXML->FindElement(GenomeChannelTags[c])){
+			if (c == GC_CONTROLLER_SYNAPSES) Widths[c] = numControllerSynapses;
+			else if (c == GC_FORWARD_MODEL_SYNAPSES) Widths[c] = numForwardModelSynapses;
+			else if (c == GC_REGENERATION_MODEL_SYNAPSES) Widths[c] = numRegenerationModelSynapses;
+			else Widths[c] = 1;
+			if (Widths[c] > 0) AnyChannel = true;
+			pXML->UpLevel();
+		}
+	}
+	if (AnyChannel){
+		int NumVox = 0;
+		for (int i=GetNextVoxel(0); i!=-1; i=GetNextVoxel(i+1)) if (GetData(i) > 0) NumVox++;
+		Genome.reset(new CVXC_Genome(NumVox, Widths));
+	}
+
 	// nac: load phase offset
 	if (pXML->FindElement("ControllerSynapseWeights")){
-		int voxCounter = 0;
 		// std::cout << "here1" << std::endl;
 		// InitSynapseWeightArray(X_Voxels*Y_Voxels*Z_Voxels,numSynapses); //nac: hard coded... for now
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			// std::cout << "here2" << std::endl;
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
-
-			std::vector<std::string> dataArray;
-			// dataArray = split(RawData,'|',dataArray);
-			dataArray = split(RawData,',',dataArray);
-
-			// for (int k=0; k<X_Voxels*Y_Voxels; k++)	{ std::cout << dataArray[k] << std::endl; } // debugging
-
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				// std::cout << "k: " << k << ",layer: " << dataArray[k] << std::endl;
-				// std::cout << "here3" << std::endl;
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					// std::cout << "here4" << std::endl;
-					// std::vector<std::string> dataArraySynapse;
-					// dataArray = split(dataArray[k],',',dataArraySynapse);
-					for (int s=0; s<numControllerSynapses; s++)
-					{
-						// std::cout << "here5, vox: " << voxCounter << ", s: " << s << std::endl;
-						// std::cout << "data: " <<  atof(dataArray[numSynapses*k+s].c_str()) << std::endl;
-						SetControllerSynapseWeight(voxCounter,s,atof(dataArray[numControllerSynapses*k+s].c_str()));
-				// 		std::cout << "here6" << std::endl;
-					}
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_CONTROLLER_SYNAPSES, RetMessage)) return false;
 	}
 
 	if (pXML->FindElement("ForwardModelSynapseWeights")){
-		int voxCounter = 0;
 		// std::cout << "here1" << std::endl;
 		// InitSynapseWeightArray(X_Voxels*Y_Voxels*Z_Voxels,numSynapses); //nac: hard coded... for now
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			// std::cout << "here2" << std::endl;
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
-
-			std::vector<std::string> dataArray;
-			// dataArray = split(RawData,'|',dataArray);
-			dataArray = split(RawData,',',dataArray);
-
-			// for (int k=0; k<X_Voxels*Y_Voxels; k++)	{ std::cout << dataArray[k] << std::endl; } // debugging
-
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				// std::cout << "k: " << k << ",layer: " << dataArray[k] << std::endl;
-				// std::cout << "here3" << std::endl;
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					// std::cout << "here4" << std::endl;
-					// std::vector<std::string> dataArraySynapse;
-					// dataArray = split(dataArray[k],',',dataArraySynapse);
-					for (int s=0; s<numForwardModelSynapses; s++)
-					{
-						// std::cout << "here5, vox: " << voxCounter << ", s: " << s << std::endl;
-						// std::cout << "data: " <<  atof(dataArray[numSynapses*k+s].c_str()) << std::endl;
-						SetForwardModelSynapseWeight(voxCounter,s,atof(dataArray[numForwardModelSynapses*k+s].c_str()));
-				// 		std::cout << "here6" << std::endl;
-					}
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_FORWARD_MODEL_SYNAPSES, RetMessage)) return false;
 	}
 
 
 	if (pXML->FindElement("RegenerationModelSynapseWeights")){
-		int voxCounter = 0;
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
-
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					for (int s=0; s<numRegenerationModelSynapses; s++)
-					{
-						SetRegenerationModelSynapseWeight(voxCounter,s,atof(dataArray[numRegenerationModelSynapses*k+s].c_str()));
-					}
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_REGENERATION_MODEL_SYNAPSES, RetMessage)) return false;
 	}
 
 
 	if (pXML->FindElement("PhaseOffset")){ 
-		usingPhaseOffset = true;
-		int voxCounter = 0;
 		// std::cout << "found weights!" << std::endl;
-		InitPhaseOffsetArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			// std::string thisValue;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
-		
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			// std::cout << "rawData, Layer " << i << ": " << RawData << std::endl;
-			// std::cout << "rawData, Layer " << i << ": " << dataArray[0] << std::endl;
-			// DataIn.resize(RawData.size());
-			// for (int k=0; k<(int)RawData.size(); k++)
-			// std::istringstream iss(RawData);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				// std::getline(iss,thisValue,",");
-				// std::cout << thisValue << std::endl;
-				// DataIn[k] = RawData[k]-48; 
-				// SetPhaseOffset((X_Voxels*Y_Voxels)*i+k,atof(dataArray[k].c_str()));
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetPhaseOffset(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-
-			// for(int j=0; j<NumNuerons; j++)
-			// {
-			// 	SetData(j, atof(DataIn[j]); 
-			// }
-
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_PHASE_OFFSET, RetMessage)) return false;
 
 		// for (int i=0; i<NumNuerons; i++)
 		// {
@@ -2049,415 +2248,110 @@ bool CVXC_Structure::ReadXML(CXML_Rip* pXML, std::string Version, std::string* R
 		// }
 
 	}
-	else
-	{
-		usingPhaseOffset = false;
-	}
 
 
 	if (pXML->FindElement("FinalPhaseOffset")){
-		usingFinalPhaseOffset = true;
-		int voxCounter = 0;
 
-		InitFinalPhaseOffsetArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
-
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetFinalPhaseOffset(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_FINAL_PHASE_OFFSET, RetMessage)) return false;
 
 	}
-	else
-	{
-		usingFinalPhaseOffset = false;
-	}
 
 
 	if (pXML->FindElement("InitialVoxelSize"))
 	{
-		usingInitialVoxelSize = true;
-		int voxCounter = 0;
-
-		InitInitialVoxelSizeArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
 
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetInitialVoxelSize(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_INITIAL_VOXEL_SIZE, RetMessage)) return false;
 
 	}
-	else
-	{
-		usingInitialVoxelSize = false;
-	}
 
 
 	if (pXML->FindElement("FinalVoxelSize"))
 	{
-		usingFinalVoxelSize = true;
-		int voxCounter = 0;
 
-		InitFinalVoxelSizeArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
-
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetFinalVoxelSize(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_FINAL_VOXEL_SIZE, RetMessage)) return false;
 
 	}
-	else
-	{
-		usingFinalVoxelSize = false;
-	}
 
 
 	if (pXML->FindElement("VestibularContribution"))
 	{
-		usingVestibularContribution = true;
-		int voxCounter = 0;
-
-		InitVestibularContributionArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
 
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetVestibularContribution(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_VESTIBULAR_CONTRIBUTION, RetMessage)) return false;
 
 	}
-	else
-	{
-		usingVestibularContribution = false;
-	}
 	
 	
 	if (pXML->FindElement("PreDamageRoll"))
 	{
-		usingPreDamageRoll = true;
-		int voxCounter = 0;
 
-		InitPreDamageRollArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
-
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetPreDamageRoll(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_PRE_DAMAGE_ROLL, RetMessage)) return false;
 
 	}
-	else
-	{
-		usingPreDamageRoll = false;
-	}
 	
 	
 	if (pXML->FindElement("PreDamagePitch"))
 	{
-		usingPreDamagePitch = true;
-		int voxCounter = 0;
 
-		InitPreDamagePitchArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
-
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetPreDamagePitch(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_PRE_DAMAGE_PITCH, RetMessage)) return false;
 
 	}
-	else
-	{
-		usingPreDamagePitch = false;
-	}
 	
 	
 	if (pXML->FindElement("PreDamageYaw"))
 	{
-		usingPreDamageYaw = true;
-		int voxCounter = 0;
 
-		InitPreDamageYawArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
+		if (!ReadVoxelLayers(pXML, GC_PRE_DAMAGE_YAW, RetMessage)) return false;
 
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetPreDamageYaw(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
-
-	}
-	else
-	{
-		usingPreDamageYaw = false;
 	}
 
 
 	if (pXML->FindElement("StressContribution"))
 	{
-		usingStressContribution = true;
-		int voxCounter = 0;
-
-		InitStressContributionArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
 
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetStressContribution(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_STRESS_CONTRIBUTION, RetMessage)) return false;
 
 	}
-	else
-	{
-		usingStressContribution = false;
-	}
 
 
 	if (pXML->FindElement("PreDamageStress"))
 	{
-		usingPreDamageStress = true;
-		int voxCounter = 0;
-
-		InitPreDamageStressArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
 
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetPreDamageStress(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_PRE_DAMAGE_STRESS, RetMessage)) return false;
 
 	}
-	else
-	{
-		usingPreDamageStress = false;
-	}
 
 
 	if (pXML->FindElement("PressureContribution"))
 	{
-		usingPressureContribution = true;
-		int voxCounter = 0;
 
-		InitPressureContributionArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
-
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetPressureContribution(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_PRESSURE_CONTRIBUTION, RetMessage)) return false;
 
 	}
-	else
-	{
-		usingPressureContribution = false;
-	}
 
 
 	if (pXML->FindElement("PreDamagePressure"))
 	{
-		usingPreDamagePressure = true;
-		int voxCounter = 0;
 
-		InitPreDamagePressureArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
-
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetPreDamagePressure(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_PRE_DAMAGE_PRESSURE, RetMessage)) return false;
 
 	}
-	else
-	{
-		usingPreDamagePressure = false;
-	}
 
 
 	if (pXML->FindElement("Stiffness"))
 	{ 
-		evolvingStiffness = true;
 
 		pXML->FindLoadElement("MinElasticMod", &MinElasticMod);
 		pXML->FindLoadElement("MaxElasticMod", &MaxElasticMod);		
 
-		int voxCounter = 0;
 
-		InitStiffnessArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
-		
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetStiffness(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_STIFFNESS, RetMessage)) return false;
 
 	}
-	else
-	{
-		evolvingStiffness = false;
-	}
 
 
 	// Now fetching parameters associated with stiffness plasticity
 	if (pXML->FindElement("StressAdaptationRate"))
 	{ 
-		usingStressAdaptationRate = true;
 
 		pXML->FindLoadElement("MinDevo", &MinDevo);
 		pXML->FindLoadElement("MinElasticMod", &MinElasticMod);
@@ -2467,39 +2361,14 @@ bool CVXC_Structure::ReadXML(CXML_Rip* pXML, std::string Version, std::string* R
 		pXML->FindLoadElement("GrowthModel", &growthModel);		
 		
 
-		int voxCounter = 0;
 
-		InitStressAdaptationRateArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
-		
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetStressAdaptationRate(voxCounter,atof(dataArray[k].c_str()));
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
+		if (!ReadVoxelLayers(pXML, GC_STRESS_ADAPTATION_RATE, RetMessage)) return false;
 
 	}
-	else
-	{
-		usingStressAdaptationRate = false;
-	}
 
 
 	if (pXML->FindElement("PressureAdaptationRate"))
 	{ 
-		usingPressureAdaptationRate = true;
 
         pXML->FindLoadElement("MinDevo", &MinDevo);
 		pXML->FindLoadElement("MinElasticMod", &MinElasticMod);
@@ -2508,34 +2377,9 @@ bool CVXC_Structure::ReadXML(CXML_Rip* pXML, std::string Version, std::string* R
 		pXML->FindLoadElement("MaxStiffnessChange", &MAX_STIFFNESS_VARIATION_STEP);		
 		pXML->FindLoadElement("GrowthModel", &growthModel);		
 
-		int voxCounter = 0;
 
-		InitPressureAdaptationRateArray(X_Voxels*Y_Voxels*Z_Voxels);
-		for (int i=0; i<Z_Voxels; i++)
-		{
-			std::string DataIn;
-			std::string RawData;
-			pXML->FindLoadElement("Layer", &RawData, true, true);
-		
-			std::vector<std::string> dataArray;
-			dataArray = split(RawData,',',dataArray);
-			for (int k=0; k<X_Voxels*Y_Voxels; k++)
-			{
-				if (pData[X_Voxels*Y_Voxels*i+k] > 0)
-				{
-					SetPressureAdaptationRate(voxCounter,atof(dataArray[k].c_str()));
+		if (!ReadVoxelLayers(pXML, GC_PRESSURE_ADAPTATION_RATE, RetMessage)) return false;
 
-					voxCounter++;
-				}
-			}
-		}
-		pXML->UpLevel(); //Layer
-		pXML->UpLevel(); //Weights
-
-	}
-	else
-	{
-		usingPressureAdaptationRate = false;
 	}
 
 	//std::cout << "DEBUGMSG VX_Object.cpp: Max Stiffness Change: "<< MAX_STIFFNESS_VARIATION_STEP << std::endl;
@@ -2613,6 +2457,7 @@ std::string CVXC_Structure::FromBase64(std::string const& encoded_string) // Ren
 void CVXC_Structure::ClearStructure() //completey erases, frees, and destroys the voxel array
 {
 	DeleteData();
+	Genome.reset();
 
 	Compression = "";
 	X_Voxels = 0;
@@ -2623,6 +2468,7 @@ void CVXC_Structure::ClearStructure() //completey erases, frees, and destroys th
 void CVXC_Structure::CreateStructure(int xV, int yV, int zV) //creates empty structure with these dimensions
 {
 	IniData(xV*yV*zV);
+	Genome.reset();
 
 	Compression = "";
 	X_Voxels = xV;
@@ -2634,28 +2480,39 @@ void CVXC_Structure::CreateStructure(int xV, int yV, int zV) //creates empty str
 
 void CVXC_Structure::ResetStructure() //erases all voxel imformation within voxel array
 {
-	for (int i=0; i<GetArraySize(); i++)
-		SetData(i, 0);
+	if (DataInit) Cells.Resize(GetArraySize(), 0);
 }
 
 void CVXC_Structure::Resize(int xS, int yS, int zS) //resizes a structure, preserving voxels in correct locations
 {
-	CVXC_Structure LStruct;
+	CVXC_Structure LStruct(*this); //keeps the genome parameters
 	LStruct.CreateStructure(xS, yS, zS);
 
 	int tX=0;
 	int tY=0;
 	int tZ=0;
 	int NewIndex = 0;
+	std::vector<int> KeptVoxels; //voxel (genome row) indices that survive, in order
 
 	//Populate the Temporary new array
-	for (int i=0; i<GetArraySize(); i++){ //go through the existing array
-		if (GetData(i) != 0){ //If there is a voxel present
-			GetXYZNom(&tX, &tY, &tZ, i); //sets the current XYZ indices 
-			if (tX < LStruct.GetVXDim() && tY < LStruct.GetVYDim() && tZ < LStruct.GetVZDim()){ //if its within the new area... (X, Y, Z are totals- based from 1)
-				NewIndex = tX + LStruct.GetVXDim()*tY + LStruct.GetVXDim()*LStruct.GetVYDim()*tZ;
-				if (NewIndex <= LStruct.GetArraySize()) LStruct[NewIndex] = GetData(i);
-			}
+	int VoxIndex = 0;
+	for (int i=GetNextVoxel(0); i!=-1; i=GetNextVoxel(i+1)){ //go through the existing voxels
+		GetXYZNom(&tX, &tY, &tZ, i); //sets the current XYZ indices 
+		if (tX < LStruct.GetVXDim() && tY < LStruct.GetVYDim() && tZ < LStruct.GetVZDim()){ //if its within the new area... (X, Y, Z are totals- based from 1)
+			NewIndex = tX + LStruct.GetVXDim()*tY + LStruct.GetVXDim()*LStruct.GetVYDim()*tZ;
+			if (NewIndex < LStruct.GetArraySize()) LStruct.SetData(NewIndex, GetData(i));
+			if (GetData(i) > 0) KeptVoxels.push_back(VoxIndex);
+		}
+		if (GetData(i) > 0) VoxIndex++;
+	}
+
+	if (Genome){ //voxel order is unchanged, so only the rows of cropped voxels need to go
+		int Widths[GC_NUM_CHANNELS];
+		for (int c=0; c<GC_NUM_CHANNELS; c++) Widths[c] = Genome->GetWidth(c);
+		LStruct.Genome.reset(new CVXC_Genome((int)KeptVoxels.size(), Widths));
+		for (int c=0; c<GC_NUM_CHANNELS; c++){
+			for (int v=0; v<(int)KeptVoxels.size() && KeptVoxels[v] < Genome->GetNumVox(); v++)
+				memcpy(LStruct.Genome->MutableRow(c, v), Genome->Row(c, KeptVoxels[v]), Widths[c]*sizeof(double));
 		}
 	}
 	*this = LStruct;
@@ -2664,7 +2521,11 @@ void CVXC_Structure::Resize(int xS, int yS, int zS) //resizes a structure, prese
 void CVXC_Structure::ReplaceMaterial(int Matindex, int ReplaceWith, bool ShiftDown)
 {
 	//replace all voxels in the matrix made of this material and (optionally) shift down the rest...
-	for (int i=0; i<GetArraySize(); i++){
+	if (Matindex == 0){ //empty cells: have to look everywhere
+		for (int i=0; i<GetArraySize(); i++) if (GetData(i) == 0) SetData(i, ReplaceWith);
+		return;
+	}
+	for (int i=GetNextVoxel(0); i!=-1; i=GetNextVoxel(i+1)){
 		if (GetData(i) == Matindex) SetData(i, ReplaceWith);
 		if (ShiftDown && (int)GetData(i) > Matindex) SetData(i, abs(GetData(i))-1);
 	}
@@ -2683,16 +2544,18 @@ int CVXC_Structure::GetIndex(int x, int y, int z) const //returns the index of t
 
 bool CVXC_Structure::GetXYZNom(int* x, int* y, int* z, int index) const //gets the physical position of the voxels from index
 {
-	if (index<0 || index > X_Voxels*Y_Voxels*Z_Voxels){
+	if (index<0 || index > X_Voxels*Y_Voxels*Z_Voxels || X_Voxels*Y_Voxels == 0){
 		*x = -1;
 		*y = -1;
 		*z = -1;
 		return false;
 	}
 	else {
-		*z = (int)((vfloat)index / (X_Voxels*Y_Voxels)); //calculate the indices in x, y, z directions
-		*y = (int)(((vfloat)index - *z*X_Voxels*Y_Voxels)/X_Voxels);
-		*x = index - *z*X_Voxels*Y_Voxels - *y*X_Voxels;
+		int Layer = X_Voxels*Y_Voxels;
+		*z = index / Layer; //calculate the indices in x, y, z directions
+		int InLayer = index - *z*Layer;
+		*y = InLayer / X_Voxels;
+		*x = InLayer - *y*X_Voxels;
 		return true;
 	}
 }
@@ -12,8 +12,10 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #define CVX_OBJECT_H
 
 #include <vector>
+#include <memory>
 #include "Utils/Vec3D.h" //use this for portability, instead of Vec3D()
 #include "Utils/XML_Rip.h" 
+#include "Utils/PagedArray.h"
 #include <iostream>
 
 /*Written by: Jonathan Hiller (jdh74) */
@@ -34,6 +36,10 @@ enum CompType {
 //The maximum number of layers we'll ever have
 #define LAYERMAX 99999 
 
+//!Type of the material index stored for each voxel. 16 bits, so palettes may hold up to MAX_NUM_MATERIALS entries.
+typedef short vmat;
+#define MAX_NUM_MATERIALS 32767
+
 //!Voxel lattice information class.	
 /*!Defines voxel tiling scheme. By default a rectangular lattice is used, but incorporating line and layer offsets allows more complex lattices such as hexagonal close packed (HCP) and Face-centered cubic (FCC).*/
 class CVXC_Lattice //container for information about the lattice of possible voxel locations
@@ -134,17 +140,54 @@ protected:
 };
 
 static const std::string base64_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-static const char defaultReturn = -1;
+static const vmat defaultReturn = -1;
+
+//!Per-voxel value channels stored in a CVXC_Genome
+enum GenomeChannel {
+	GC_PHASE_OFFSET, GC_FINAL_PHASE_OFFSET, GC_INITIAL_VOXEL_SIZE, GC_FINAL_VOXEL_SIZE, GC_VESTIBULAR_CONTRIBUTION,
+	GC_PRE_DAMAGE_ROLL, GC_PRE_DAMAGE_PITCH, GC_PRE_DAMAGE_YAW, GC_STRESS_CONTRIBUTION, GC_PRE_DAMAGE_STRESS,
+	GC_PRESSURE_CONTRIBUTION, GC_PRE_DAMAGE_PRESSURE, GC_STIFFNESS, GC_STRESS_ADAPTATION_RATE, GC_PRESSURE_ADAPTATION_RATE,
+	GC_CONTROLLER_SYNAPSES, GC_FORWARD_MODEL_SYNAPSES, GC_REGENERATION_MODEL_SYNAPSES,
+	GC_NUM_CHANNELS
+};
+
+//!Flat storage for the per-voxel values of a structure
+/*!All channels live in one block. Each channel starts on a 64 byte boundary and holds one row of Width values per voxel (in voxel order, i.e. the rank of the voxel among the filled cells of the structure), with rows padded to a multiple of 4 doubles so that every row is 32 byte aligned. A genome is filled once while reading and then shared read-only (std::shared_ptr) between copies of its structure, such as the local copy CVX_Sim::Import makes of the CVX_Object.*/
+class CVXC_Genome
+{
+public:
+	CVXC_Genome(int NumVoxIn, const int* pWidths, const CVXC_Genome* pCopyFrom = NULL); //!< Allocates storage for NumVoxIn voxels with pWidths[c] values per voxel in channel c (0 if the channel is not present). Values are zero or, if pCopyFrom is given, copied from it where it has them. @param[in] NumVoxIn Number of voxels. @param[in] pWidths Array of GC_NUM_CHANNELS widths. @param[in] pCopyFrom Optional genome to copy values from.
+	~CVXC_Genome(void); //!< Destructor
+
+	int GetNumVox(void) const {return NumVox;} //!< Returns the number of voxels (rows per channel).
+	bool Has(int Channel) const {return Width[Channel] > 0;} //!< Returns true if this channel is present. @param[in] Channel A GenomeChannel.
+	int GetWidth(int Channel) const {return Width[Channel];} //!< Returns the number of values per voxel in this channel. @param[in] Channel A GenomeChannel.
+	int GetStride(int Channel) const {return Stride[Channel];} //!< Returns the distance in doubles between consecutive rows of this channel. @param[in] Channel A GenomeChannel.
+	const double* Row(int Channel, int VoxIndex) const {return pBlock + Offset[Channel] + (size_t)VoxIndex*Stride[Channel];} //!< Returns the (aligned) values of one voxel. Only valid for present channels. @param[in] Channel A GenomeChannel. @param[in] VoxIndex Voxel index.
+	double* MutableRow(int Channel, int VoxIndex) {return pBlock + Offset[Channel] + (size_t)VoxIndex*Stride[Channel];} //!< Writable version of Row(). Only to be used while the genome is not shared.
+	double Get(int Channel, int VoxIndex, int Index) const {return (Index >= 0 && Index < Width[Channel] && VoxIndex >= 0 && VoxIndex < NumVox) ? Row(Channel, VoxIndex)[Index] : 0.0;} //!< Returns one value, or 0 if it is not stored. @param[in] Channel A GenomeChannel. @param[in] VoxIndex Voxel index. @param[in] Index Index within the row.
+
+private:
+	CVXC_Genome(const CVXC_Genome&); //not copyable: use the pCopyFrom constructor
+	CVXC_Genome& operator=(const CVXC_Genome&);
+
+	double* pRaw; //allocation
+	double* pBlock; //64 byte aligned start within pRaw
+	int NumVox;
+	int Width[GC_NUM_CHANNELS];
+	int Stride[GC_NUM_CHANNELS];
+	size_t Offset[GC_NUM_CHANNELS];
+};
 
 class CVXC_Structure //contains voxel location information in vast 1D array
 {
 public:
-	CVXC_Structure() {pData = NULL; ClearStructure();};
-	CVXC_Structure(int xV, int yV, int zV) {pData = NULL; CreateStructure(xV, yV, zV);};
+	CVXC_Structure() {ClearStructure();};
+	CVXC_Structure(int xV, int yV, int zV) {CreateStructure(xV, yV, zV);};
 	~CVXC_Structure() {DeleteData();};
-	CVXC_Structure(const CVXC_Structure& RefStruct) {*this = RefStruct;}; //copy constructor
+	CVXC_Structure(const CVXC_Structure& RefStruct) {DataInit = false; m_SizeOfArray = 0; *this = RefStruct;}; //copy constructor
 	CVXC_Structure& operator=(const CVXC_Structure& RefStruct); //overload "=" 
-	char& operator [](int i) const {return GetData(i);}
+	vmat operator [](int i) const {return GetData(i);}
 
 	//I/O function for save/loading
 	bool WriteXML(CXML_Rip* pXML, int Compression = CP_ASCIIREADABLE, std::string* RetMessage = NULL);
@@ -154,17 +197,19 @@ public:
 	std::string FromBase64(std::string const& s);
 
 	//Get information about the structure:
-	inline char& GetData(int Index) const {if (DataInit) return pData[Index]; else return (char&)defaultReturn;} //Gets the material index here (this should be the only place we access pData)
+	inline vmat GetData(int Index) const {if (DataInit) return Cells[Index]; else return defaultReturn;} //Gets the material index here (this should be the only place we access Cells)
+	inline int GetNextVoxel(int Index) const {return DataInit ? Cells.NextSet(Index) : -1;} //returns the first index at or after Index that holds a voxel (non-zero data) or -1. Skips empty regions of the workspace without visiting them: for (int i=GetNextVoxel(0); i!=-1; i=GetNextVoxel(i+1))
 	inline int GetArraySize(void) const {return m_SizeOfArray;}; //gets the size of the master array of voxels
 	inline int GetVXDim(void) const {return X_Voxels;}; //get number of voxels in each dimension
 	inline int GetVYDim(void) const {return Y_Voxels;};
 	inline int GetVZDim(void) const {return Z_Voxels;};
 	int GetIndex(int x, int y, int z) const; //returns the index of the array from xyz indices
 	bool GetXYZNom(int* x, int* y, int* z, int index) const; //gets the physical position of the voxels from index
-	bool ContainsMatIndex(int MatIndex) const {for (int i=0; i<GetArraySize(); i++)if (GetData(i) == MatIndex) return true; return false;}; //returns true if the structure contains this material index
+	bool ContainsMatIndex(int MatIndex) const {if (MatIndex == 0) {for (int i=0; i<GetArraySize(); i++) if (GetData(i) == 0) return true; return false;} for (int i=GetNextVoxel(0); i!=-1; i=GetNextVoxel(i+1)) if (GetData(i) == MatIndex) return true; return false;}; //returns true if the structure contains this material index
 
 	//Functions to modify the lattice:
-	inline void SetData(int Index, char Data){if (DataInit) pData[Index] = Data;} //sets the material index here
+	inline void SetData(int Index, vmat Data){if (DataInit) Cells.Set(Index, Data);} //sets the material index here
+	vmat GetMaxData(void) const {vmat Max = 0; for (int i=GetNextVoxel(0); i!=-1; i=GetNextVoxel(i+1)) if (GetData(i) > Max) Max = GetData(i); return Max;} //returns the highest material index in the structure
 	void CreateStructure(int xV, int yV, int zV); //creates empty structure with these dimensions
 	void Resize(int xS, int yS, int zS); //resizes the structure preserving data
 	void ClearStructure(); //completly erases, frees, and destroys the voxel array
@@ -180,81 +225,81 @@ public:
 	// int getNumNuerons() {return NumNuerons;}
 
 	// nac: phase offsets
-	inline void SetPhaseOffset(int Index, double Value) {pPhaseOffsets[Index] = Value;} // nac: sets the material index here
-	inline double GetPhaseOffset(int Index) const {return pPhaseOffsets[Index];}
-	inline void InitPhaseOffsetArray(int Size) {pPhaseOffsets = new double[Size];}
-	inline bool GetUsingPhaseOffset(void) {return usingPhaseOffset;}
+	inline void SetPhaseOffset(int Index, double Value) {SetGenomeValue(GC_PHASE_OFFSET, Index, 0, Value);}
+	inline double GetPhaseOffset(int Index) const {return GetGenomeValue(GC_PHASE_OFFSET, Index);}
+	inline void InitPhaseOffsetArray(int Size) {AddGenomeChannel(GC_PHASE_OFFSET, 1);}
+	inline bool GetUsingPhaseOffset(void) {return HasGenomeChannel(GC_PHASE_OFFSET);}
 
-	inline void SetFinalPhaseOffset(int Index, double Value) {pFinalPhaseOffsets[Index] = Value;} // nac: sets the material index here
-	inline double GetFinalPhaseOffset(int Index) const {return pFinalPhaseOffsets[Index];}
-	inline void InitFinalPhaseOffsetArray(int Size) {pFinalPhaseOffsets = new double[Size];}
-	inline bool GetUsingFinalPhaseOffset(void) {return usingFinalPhaseOffset;}
+	inline void SetFinalPhaseOffset(int Index, double Value) {SetGenomeValue(GC_FINAL_PHASE_OFFSET, Index, 0, Value);}
+	inline double GetFinalPhaseOffset(int Index) const {return GetGenomeValue(GC_FINAL_PHASE_OFFSET, Index);}
+	inline void InitFinalPhaseOffsetArray(int Size) {AddGenomeChannel(GC_FINAL_PHASE_OFFSET, 1);}
+	inline bool GetUsingFinalPhaseOffset(void) {return HasGenomeChannel(GC_FINAL_PHASE_OFFSET);}
 
 	// EvolvedVoxelSize functions
-	inline void SetInitialVoxelSize(int Index, double Value) {pInitialVoxelSize[Index] = Value;}
-	inline double GetInitialVoxelSize(int Index) const {return pInitialVoxelSize[Index];}
-	inline void InitInitialVoxelSizeArray(int Size) {pInitialVoxelSize = new double[Size];}
-	inline bool GetUsingInitialVoxelSize(void) {return usingInitialVoxelSize;}
+	inline void SetInitialVoxelSize(int Index, double Value) {SetGenomeValue(GC_INITIAL_VOXEL_SIZE, Index, 0, Value);}
+	inline double GetInitialVoxelSize(int Index) const {return GetGenomeValue(GC_INITIAL_VOXEL_SIZE, Index);}
+	inline void InitInitialVoxelSizeArray(int Size) {AddGenomeChannel(GC_INITIAL_VOXEL_SIZE, 1);}
+	inline bool GetUsingInitialVoxelSize(void) {return HasGenomeChannel(GC_INITIAL_VOXEL_SIZE);}
 
 	// FinalVoxelSize functions
-	inline void SetFinalVoxelSize(int Index, double Value) {pFinalVoxelSize[Index] = Value;}
-	inline double GetFinalVoxelSize(int Index) const {return pFinalVoxelSize[Index];}
-	inline void InitFinalVoxelSizeArray(int Size) {pFinalVoxelSize = new double[Size];}
-	inline bool GetUsingFinalVoxelSize(void) {return usingFinalVoxelSize;}
+	inline void SetFinalVoxelSize(int Index, double Value) {SetGenomeValue(GC_FINAL_VOXEL_SIZE, Index, 0, Value);}
+	inline double GetFinalVoxelSize(int Index) const {return GetGenomeValue(GC_FINAL_VOXEL_SIZE, Index);}
+	inline void InitFinalVoxelSizeArray(int Size) {AddGenomeChannel(GC_FINAL_VOXEL_SIZE, 1);}
+	inline bool GetUsingFinalVoxelSize(void) {return HasGenomeChannel(GC_FINAL_VOXEL_SIZE);}
 
 	// VestibularContribution functions
-	inline void SetVestibularContribution(int Index, double Value) {pVestibularContribution[Index] = Value;}
-	inline double GetVestibularContribution(int Index) const {return pVestibularContribution[Index];}
-	inline void InitVestibularContributionArray(int Size) {pVestibularContribution = new double[Size];}
-	inline bool GetUsingVestibularContribution(void) {return usingVestibularContribution;}
-	
+	inline void SetVestibularContribution(int Index, double Value) {SetGenomeValue(GC_VESTIBULAR_CONTRIBUTION, Index, 0, Value);}
+	inline double GetVestibularContribution(int Index) const {return GetGenomeValue(GC_VESTIBULAR_CONTRIBUTION, Index);}
+	inline void InitVestibularContributionArray(int Size) {AddGenomeChannel(GC_VESTIBULAR_CONTRIBUTION, 1);}
+	inline bool GetUsingVestibularContribution(void) {return HasGenomeChannel(GC_VESTIBULAR_CONTRIBUTION);}
+
 	// PreDamageRoll functions
-	inline void SetPreDamageRoll(int Index, double Value) {pPreDamageRoll[Index] = Value;}
-	inline double GetPreDamageRoll(int Index) const {return pPreDamageRoll[Index];}
-	inline void InitPreDamageRollArray(int Size) {pPreDamageRoll = new double[Size];}
-	inline bool GetUsingPreDamageRoll(void) {return usingPreDamageRoll;}
-	
+	inline void SetPreDamageRoll(int Index, double Value) {SetGenomeValue(GC_PRE_DAMAGE_ROLL, Index, 0, Value);}
+	inline double GetPreDamageRoll(int Index) const {return GetGenomeValue(GC_PRE_DAMAGE_ROLL, Index);}
+	inline void InitPreDamageRollArray(int Size) {AddGenomeChannel(GC_PRE_DAMAGE_ROLL, 1);}
+	inline bool GetUsingPreDamageRoll(void) {return HasGenomeChannel(GC_PRE_DAMAGE_ROLL);}
+
 	// PreDamagePitch functions
-	inline void SetPreDamagePitch(int Index, double Value) {pPreDamagePitch[Index] = Value;}
-	inline double GetPreDamagePitch(int Index) const {return pPreDamagePitch[Index];}
-	inline void InitPreDamagePitchArray(int Size) {pPreDamagePitch = new double[Size];}
-	inline bool GetUsingPreDamagePitch(void) {return usingPreDamagePitch;}
-	
+	inline void SetPreDamagePitch(int Index, double Value) {SetGenomeValue(GC_PRE_DAMAGE_PITCH, Index, 0, Value);}
+	inline double GetPreDamagePitch(int Index) const {return GetGenomeValue(GC_PRE_DAMAGE_PITCH, Index);}
+	inline void InitPreDamagePitchArray(int Size) {AddGenomeChannel(GC_PRE_DAMAGE_PITCH, 1);}
+	inline bool GetUsingPreDamagePitch(void) {return HasGenomeChannel(GC_PRE_DAMAGE_PITCH);}
+
 	// PreDamageYaw functions
-	inline void SetPreDamageYaw(int Index, double Value) {pPreDamageYaw[Index] = Value;}
-	inline double GetPreDamageYaw(int Index) const {return pPreDamageYaw[Index];}
-	inline void InitPreDamageYawArray(int Size) {pPreDamageYaw = new double[Size];}
-	inline bool GetUsingPreDamageYaw(void) {return usingPreDamageYaw;}
+	inline void SetPreDamageYaw(int Index, double Value) {SetGenomeValue(GC_PRE_DAMAGE_YAW, Index, 0, Value);}
+	inline double GetPreDamageYaw(int Index) const {return GetGenomeValue(GC_PRE_DAMAGE_YAW, Index);}
+	inline void InitPreDamageYawArray(int Size) {AddGenomeChannel(GC_PRE_DAMAGE_YAW, 1);}
+	inline bool GetUsingPreDamageYaw(void) {return HasGenomeChannel(GC_PRE_DAMAGE_YAW);}
 
 	// StressContribution functions
-	inline void SetStressContribution(int Index, double Value) {pStressContribution[Index] = Value;}
-	inline double GetStressContribution(int Index) const {return pStressContribution[Index];}
-	inline void InitStressContributionArray(int Size) {pStressContribution = new double[Size];}
-	inline bool GetUsingStressContribution(void) {return usingStressContribution;}
+	inline void SetStressContribution(int Index, double Value) {SetGenomeValue(GC_STRESS_CONTRIBUTION, Index, 0, Value);}
+	inline double GetStressContribution(int Index) const {return GetGenomeValue(GC_STRESS_CONTRIBUTION, Index);}
+	inline void InitStressContributionArray(int Size) {AddGenomeChannel(GC_STRESS_CONTRIBUTION, 1);}
+	inline bool GetUsingStressContribution(void) {return HasGenomeChannel(GC_STRESS_CONTRIBUTION);}
 
 	// PreDamageStress functions
-	inline void SetPreDamageStress(int Index, double Value) {pPreDamageStress[Index] = Value;}
-	inline double GetPreDamageStress(int Index) const {return pPreDamageStress[Index];}
-	inline void InitPreDamageStressArray(int Size) {pPreDamageStress = new double[Size];}
-	inline bool GetUsingPreDamageStress(void) {return usingPreDamageStress;}
+	inline void SetPreDamageStress(int Index, double Value) {SetGenomeValue(GC_PRE_DAMAGE_STRESS, Index, 0, Value);}
+	inline double GetPreDamageStress(int Index) const {return GetGenomeValue(GC_PRE_DAMAGE_STRESS, Index);}
+	inline void InitPreDamageStressArray(int Size) {AddGenomeChannel(GC_PRE_DAMAGE_STRESS, 1);}
+	inline bool GetUsingPreDamageStress(void) {return HasGenomeChannel(GC_PRE_DAMAGE_STRESS);}
 
 	// PressureContribution functions
-	inline void SetPressureContribution(int Index, double Value) {pPressureContribution[Index] = Value;}
-	inline double GetPressureContribution(int Index) const {return pPressureContribution[Index];}
-	inline void InitPressureContributionArray(int Size) {pPressureContribution = new double[Size];}
-	inline bool GetUsingPressureContribution(void) {return usingPressureContribution;}
+	inline void SetPressureContribution(int Index, double Value) {SetGenomeValue(GC_PRESSURE_CONTRIBUTION, Index, 0, Value);}
+	inline double GetPressureContribution(int Index) const {return GetGenomeValue(GC_PRESSURE_CONTRIBUTION, Index);}
+	inline void InitPressureContributionArray(int Size) {AddGenomeChannel(GC_PRESSURE_CONTRIBUTION, 1);}
+	inline bool GetUsingPressureContribution(void) {return HasGenomeChannel(GC_PRESSURE_CONTRIBUTION);}
 
 	// PreDamagePressure functions
-	inline void SetPreDamagePressure(int Index, double Value) {pPreDamagePressure[Index] = Value;}
-	inline double GetPreDamagePressure(int Index) const {return pPreDamagePressure[Index];}
-	inline void InitPreDamagePressureArray(int Size) {pPreDamagePressure = new double[Size];}
-	inline bool GetUsingPreDamagePressure(void) {return usingPreDamagePressure;}
+	inline void SetPreDamagePressure(int Index, double Value) {SetGenomeValue(GC_PRE_DAMAGE_PRESSURE, Index, 0, Value);}
+	inline double GetPreDamagePressure(int Index) const {return GetGenomeValue(GC_PRE_DAMAGE_PRESSURE, Index);}
+	inline void InitPreDamagePressureArray(int Size) {AddGenomeChannel(GC_PRE_DAMAGE_PRESSURE, 1);}
+	inline bool GetUsingPreDamagePressure(void) {return HasGenomeChannel(GC_PRE_DAMAGE_PRESSURE);}
 
 	// stiffness functions
-	inline void SetStiffness(int Index, double Value) {pStiffness[Index] = Value;} // nac: sets the material index here
-	inline double GetStiffness(int Index) const {return pStiffness[Index];}
-	inline void InitStiffnessArray(int Size) {pStiffness = new double[Size];}
-	inline bool GetEvolvingStiffness(void) {return evolvingStiffness;}
+	inline void SetStiffness(int Index, double Value) {SetGenomeValue(GC_STIFFNESS, Index, 0, Value);}
+	inline double GetStiffness(int Index) const {return GetGenomeValue(GC_STIFFNESS, Index);}
+	inline void InitStiffnessArray(int Size) {AddGenomeChannel(GC_STIFFNESS, 1);}
+	inline bool GetEvolvingStiffness(void) {return HasGenomeChannel(GC_STIFFNESS);}
 
 	inline void SetMinElasticMod(double value){ MinElasticMod = value; }
 	inline void SetMaxElasticMod(double value){ MaxElasticMod = value; }
@@ -267,15 +312,15 @@ public:
 	inline double GetMaxAdaptationRate(void) {return MaxAdaptationRate; }
 
 	// Stiffness plasticity parameters
-	inline void SetStressAdaptationRate(int Index, double Value) {pStressAdaptationRate[Index] = Value;} // nac: sets the material index here
-	inline double GetStressAdaptationRate(int Index) const {return pStressAdaptationRate[Index];}
-	inline void InitStressAdaptationRateArray(int Size) {pStressAdaptationRate = new double[Size];}
-	inline bool GetUsingStressAdaptationRate(void) {return usingStressAdaptationRate;}
+	inline void SetStressAdaptationRate(int Index, double Value) {SetGenomeValue(GC_STRESS_ADAPTATION_RATE, Index, 0, Value);}
+	inline double GetStressAdaptationRate(int Index) const {return GetGenomeValue(GC_STRESS_ADAPTATION_RATE, Index);}
+	inline void InitStressAdaptationRateArray(int Size) {AddGenomeChannel(GC_STRESS_ADAPTATION_RATE, 1);}
+	inline bool GetUsingStressAdaptationRate(void) {return HasGenomeChannel(GC_STRESS_ADAPTATION_RATE);}
 
-	inline void SetPressureAdaptationRate(int Index, double Value) {pPressureAdaptationRate[Index] = Value;} // nac: sets the material index here
-	inline double GetPressureAdaptationRate(int Index) const {return pPressureAdaptationRate[Index];}
-	inline void InitPressureAdaptationRateArray(int Size) {pPressureAdaptationRate = new double[Size];}
-	inline bool GetUsingPressureAdaptationRate(void) {return usingPressureAdaptationRate;}
+	inline void SetPressureAdaptationRate(int Index, double Value) {SetGenomeValue(GC_PRESSURE_ADAPTATION_RATE, Index, 0, Value);}
+	inline double GetPressureAdaptationRate(int Index) const {return GetGenomeValue(GC_PRESSURE_ADAPTATION_RATE, Index);}
+	inline void InitPressureAdaptationRateArray(int Size) {AddGenomeChannel(GC_PRESSURE_ADAPTATION_RATE, 1);}
+	inline bool GetUsingPressureAdaptationRate(void) {return HasGenomeChannel(GC_PRESSURE_ADAPTATION_RATE);}
 
 	inline void SetMaxStiffnessVariation(double value){ MAX_STIFFNESS_VARIATION_STEP = value; }
 	inline double GetMaxStiffnessVariation(){ return MAX_STIFFNESS_VARIATION_STEP; }
@@ -283,76 +328,34 @@ public:
 	inline int GetGrowthModel(){return growthModel; }
 
 	// neural net
-	inline void SetForwardModelSynapseWeight(int VoxelIndex, int ForwardModelSynapseIndex, double Value) {pForwardModelSynapseWeights[VoxelIndex][ForwardModelSynapseIndex] = Value;} // nac: sets the material index here
-	inline double GetForwardModelSynapseWeight(int VoxelIndex, int ForwardModelSynapseIndex) const {return pForwardModelSynapseWeights[VoxelIndex][ForwardModelSynapseIndex];}
-	// inline void InitForwardModelSynapseWeightArray(int SizeVoxels, int SizeForwardModelSynapses) {pForwardModelSynapseWeights = new double[1000][10];}
-	// inline void InitForwardModelSynapseWeightArray(int SizeVoxels, int SizeForwardModelSynapses) {pForwardModelSynapseWeights = std::vector< std::vector<double >(SizeVoxels, std::vector<double>(SizeForwardModelSynapses,0.0));}
+	inline void SetForwardModelSynapseWeight(int VoxelIndex, int ForwardModelSynapseIndex, double Value) {SetGenomeValue(GC_FORWARD_MODEL_SYNAPSES, VoxelIndex, ForwardModelSynapseIndex, Value);}
+	inline double GetForwardModelSynapseWeight(int VoxelIndex, int ForwardModelSynapseIndex) const {return GetGenomeValue(GC_FORWARD_MODEL_SYNAPSES, VoxelIndex, ForwardModelSynapseIndex);}
 	inline int GetNumForwardModelSynapses() const {return numForwardModelSynapses;}
 
-	inline void SetControllerSynapseWeight(int VoxelIndex, int ControllerSynapseIndex, double Value) {pControllerSynapseWeights[VoxelIndex][ControllerSynapseIndex] = Value;} // nac: sets the material index here
-	inline double GetControllerSynapseWeight(int VoxelIndex, int ControllerSynapseIndex) const {return pControllerSynapseWeights[VoxelIndex][ControllerSynapseIndex];}
+	inline void SetControllerSynapseWeight(int VoxelIndex, int ControllerSynapseIndex, double Value) {SetGenomeValue(GC_CONTROLLER_SYNAPSES, VoxelIndex, ControllerSynapseIndex, Value);}
+	inline double GetControllerSynapseWeight(int VoxelIndex, int ControllerSynapseIndex) const {return GetGenomeValue(GC_CONTROLLER_SYNAPSES, VoxelIndex, ControllerSynapseIndex);}
 	inline int GetNumControllerSynapses() const {return numControllerSynapses;}
 
-	inline void SetRegenerationModelSynapseWeight(int VoxelIndex, int RegenerationModelSynapseIndex, double Value) {pRegenerationModelSynapseWeights[VoxelIndex][RegenerationModelSynapseIndex] = Value;} // nac: sets the material index here
-	inline double GetRegenerationModelSynapseWeight(int VoxelIndex, int RegenerationModelSynapseIndex) const {return pRegenerationModelSynapseWeights[VoxelIndex][RegenerationModelSynapseIndex];}
+	inline void SetRegenerationModelSynapseWeight(int VoxelIndex, int RegenerationModelSynapseIndex, double Value) {SetGenomeValue(GC_REGENERATION_MODEL_SYNAPSES, VoxelIndex, RegenerationModelSynapseIndex, Value);}
+	inline double GetRegenerationModelSynapseWeight(int VoxelIndex, int RegenerationModelSynapseIndex) const {return GetGenomeValue(GC_REGENERATION_MODEL_SYNAPSES, VoxelIndex, RegenerationModelSynapseIndex);}
 	inline int GetNumRegenerationModelSynapses() const {return numRegenerationModelSynapses;}
 
+	//genome storage (all of the per-voxel values above)
+	const CVXC_Genome* GetGenome(void) const {return Genome.get();} //returns the shared, read-only per-voxel value store (NULL if this structure has none). Rows are aligned for direct vectorized access.
+	bool HasGenomeChannel(int Channel) const {return Genome && Genome->Has(Channel);} //true if values of this GenomeChannel were loaded
+	double GetGenomeValue(int Channel, int VoxelIndex, int Index = 0) const {return Genome ? Genome->Get(Channel, VoxelIndex, Index) : 0.0;} //returns 0 for channels, voxels or indices that were not loaded
+	void SetGenomeValue(int Channel, int VoxelIndex, int Index, double Value); //copies the store first if it is shared with another structure, adds or widens the channel if needed
+	void AddGenomeChannel(int Channel, int Width); //adds (or widens) a channel with Width values per voxel, initialized to zero
+
 protected:
 	//variable from file
 	std::string Compression;
-	char* pData; //the main voxel array. This is an array of chars; the entries correspond with the material IDs, and the position in the array corresponds with the position in the 3D structure, where the array is ordered: starting at (x0,x0,z0), proceeding to (xn,y0,z0), next to (xn,yn,z0), and on to (xn,yn,zn)
-
-	// std::vector< std::vector<double> > pSynapseWeigths;
-	// double* pSynapseWeigths;
-	// int NumNuerons;
-	double pForwardModelSynapseWeights[1000][20];
-	double pControllerSynapseWeights[1000][20];
-	double pRegenerationModelSynapseWeights[1000][20];
-
-	bool usingPhaseOffset; 
-	double* pPhaseOffsets;
+	CPagedArray<vmat> Cells; //the main voxel array. This is a sparse array of 16 bit material indices (memory is only allocated around voxels); the entries correspond with the material IDs, and the position in the array corresponds with the position in the 3D structure, where the array is ordered: starting at (x0,x0,z0), proceeding to (xn,y0,z0), next to (xn,yn,z0), and on to (xn,yn,zn)
 
-    bool usingFinalPhaseOffset;
-	double* pFinalPhaseOffsets;
+	std::shared_ptr<CVXC_Genome> Genome; //per-voxel values (shared between copies, never modified while shared)
+	CVXC_Genome* GenomeForWrite(void); //makes Genome unique (copy on write) and returns it
 
-	bool usingInitialVoxelSize;
-	double* pInitialVoxelSize;
-
-	bool usingFinalVoxelSize;
-	double* pFinalVoxelSize;
-
-	bool usingVestibularContribution;
-	double* pVestibularContribution;
-	
-	bool usingPreDamageRoll;
-	double* pPreDamageRoll;
-	
-	bool usingPreDamagePitch;
-	double* pPreDamagePitch;
-	
-	bool usingPreDamageYaw;
-	double* pPreDamageYaw;
-
-	bool usingStressContribution;
-	double* pStressContribution;
-
-	bool usingPreDamageStress;
-	double* pPreDamageStress;
-
-	bool usingPressureContribution;
-	double* pPressureContribution;
-
-	bool usingPreDamagePressure;
-	double* pPreDamagePressure;
-
-	bool evolvingStiffness;
-	double* pStiffness;
-
-	bool usingStressAdaptationRate;
-	double* pStressAdaptationRate;
-
-	bool usingPressureAdaptationRate;
-	double* pPressureAdaptationRate;
+	bool ReadVoxelLayers(CXML_Rip* pXML, int Channel, std::string* RetMessage); //parses the comma separated per-voxel values of the current element (one <Layer> per z slice) directly into a genome channel
 
 	double MinElasticMod;
 	double MaxElasticMod;
@@ -416,7 +419,7 @@ public:
 	void ClearMatter(void); //!< Clears the entire voxel object. Must be re-initialized before subsequent use.
 	void Transform(Vec3D<> Trans); //!< Moves all voxels within the workspace the specified displacement.
 	void Resize(CVXC_Structure* Structure) {Resize(Structure->GetVXDim(), Structure->GetVYDim(), Structure->GetVZDim());} //!< Resizes the voxel object structure to size of the provided structure. Voxel data remaining within the new structure area is preserved. @param[in] Structure CVXC_Structure object to extract the desired size from.
-	void Resize(int xS, int yS, int zS) {Structure.Resize(xS, yS, zS);} //!< Resizes the voxel object structure to specified number of voxels in each dimension. Voxel data remaining within the new structure area is preserved. @param[in] xS Number of desired voxels in X direction. @param[in] yS Number of desired voxels in Y direction. @param[in] zS Number of desired voxels in Z direction.
+	void Resize(int xS, int yS, int zS) {ClearLeafMatCache(); Structure.Resize(xS, yS, zS);} //!< Resizes the voxel object structure to specified number of voxels in each dimension. Voxel data remaining within the new structure area is preserved. @param[in] xS Number of desired voxels in X direction. @param[in] yS Number of desired voxels in Y direction. @param[in] zS Number of desired voxels in Z direction.
 
 	//Basic editing of VXC object
 	bool SetMat(int x, int y, int z, int MatIndex) {return SetMat(GetIndex(x, y, z), MatIndex);} //!< Sets a single voxel to the specified material. Returns true if succesful. Returns false if indices are outside of workspace or material index is not contained within current palette. @param[in] x Integer X index of voxel location to set. @param[in] y Integer Y index of voxel location to set. @param[in] z Integer Z index of voxel location to set.  @param[in] MatIndex Specifies the index within the material palette to set this voxel to.
@@ -435,6 +438,8 @@ public:
 	
 	int GetSubMatIndex(int* pXIndex, int* pYIndex, int* pZIndex, int MatIndex, bool* pVisible = NULL);
 	int GetLeafMatIndex(int StructIndex, bool* pVisible = NULL); //!< Returns material index of the leaf material at this location after evaluating all sub materials.
+	void CacheLeafMats(void); //!< Resolves the leaf material of every voxel location once (internal and dither materials walk their sub-materials per location), so GetLeafMatIndex() becomes a lookup. Editing functions of this class discard the cache. Must be called again after the structure or palette is modified directly.
+	void ClearLeafMatCache(void) {LeafMatCache.clear(); LeafMatVisible.clear();} //!< Discards the cached leaf materials. GetLeafMatIndex() then always walks the sub-materials.
 
 
 	//Get information about the workspace:
@@ -451,6 +456,7 @@ public:
 	
 	//Get information about a voxel (location) within the workspace
 	bool GetXYZ(Vec3D<>* Point, int index, bool WithOff = true) const; //!< Calculates the XYZ coordinates of a voxel.
+	void GetLatticeXYZ(Vec3D<>* Point, int ix, int iy, int iz, bool WithOff = true) const; //!< Calculates the XYZ coordinates of the center of the lattice cell at integer indices ix, iy, iz, which may lie outside of the workspace. @param[out] Point The X, Y, and Z components of the location. @param[in] ix Integer X index. @param[in] iy Integer Y index. @param[in] iz Integer Z index. @param[in] WithOff True to apply lattice offsets.
 	inline bool GetXYZ(Vec3D<>* Point, int x, int y, int z, bool WithOff = true) const {return GetXYZ(Point, GetIndex(x, y, z), WithOff);} //!< Calculates the XYZ coordinates of a voxel. Returns true if a valid location was specified. Otherwise false. The resulting position is given in meters from the origin. @param[out] Point The X, Y, and Z components of the voxel location is stored in this structure. @param[in] x Integer X index of voxel location to get. @param[in] y Integer Y index of voxel location to get. @param[in] z Integer Z index of voxel location to get. 
 	inline Vec3D<> GetXYZ(int index, bool WithOff = true) const {Vec3D<> toReturn; if (GetXYZ(&toReturn, index, WithOff)) return toReturn; else return Vec3D<>(-1, -1, -1);} //!< Returns the XYZ coordinates of a voxel. The resulting position if the voxel at the specified global index is given in meters from the origin. @param[in] index The global structural index to query.
 	inline Vec3D<> GetXYZ(int x, int y, int z, bool WithOff = true) const {return GetXYZ(GetIndex(x, y, z), WithOff);} //!< Returns the XYZ coordinates of a voxel. The resulting position if the voxel at the specified X, Y, and Z indices is given in meters from the origin. @param[in] x Integer X index of voxel location to get. @param[in] y Integer Y index of voxel location to get. @param[in] z Integer Z index of voxel location to get. 
@@ -621,6 +627,12 @@ public:
 	
 
 #endif
+
+private:
+	std::vector<unsigned short> LeafMatCache; //leaf material at each voxel location (material indices are at most 16 bits). Empty if not built.
+	std::vector<bool> LeafMatVisible; //visibility of each entry of LeafMatCache
+
+	int FindLeafMatIndex(int StructIndex, bool* pVisible); //walks the sub-materials at this location
 };
 
 enum MatMode {SINGLE, INTERNAL, EXTERNAL, DITHER}; //don't change these orders!
@@ -0,0 +1,416 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#include "VX_PCGSolver.h"
+#include <math.h>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+#define PCG_PARALLEL_MIN 24576 //split the vector work over several threads from this many unknowns
+#define PCG_IC_SHIFTS 8 //attempts at the incomplete Cholesky factorization, with a growing diagonal shift after the first
+
+CVX_PCGSolver::CVX_PCGSolver(void)
+{
+	Preconditioner = PCG_INCOMPLETE_CHOLESKY;
+	Tolerance = 1e-8;
+	MaxIterations = 0;
+	NumThreads = 0;
+	UseInitialGuess = false;
+
+	N = B = NB = 0;
+	UsedThreads = 1;
+	Built = PCG_JACOBI;
+	LastIterations = 0;
+	LastRelResidual = 0;
+	pP = pAp = pX = pR = pZ = NULL;
+	Alpha = Beta = 0;
+}
+
+void CVX_PCGSolver::Clear(void)
+{
+	N = B = NB = 0;
+	std::vector<int>().swap(BRowStart);
+	std::vector<int>().swap(BCol);
+	std::vector<double>().swap(BVal);
+	std::vector<double>().swap(Diag);
+	std::vector<char>().swap(Decoupled);
+	std::vector<double>().swap(InvDiag);
+	std::vector<int>().swap(URowStart);
+	std::vector<int>().swap(UCol);
+	std::vector<double>().swap(UVal);
+	std::vector<double>().swap(R);
+	std::vector<double>().swap(Z);
+	std::vector<double>().swap(P);
+	std::vector<double>().swap(Ap);
+}
+
+bool CVX_PCGSolver::Setup(int NIn, const double* a, const int* ia, const int* ja, int BlockSizeIn, std::string* RetMessage)
+{
+	Clear();
+	if (NIn <= 0 || !a || !ia || !ja){if (RetMessage) *RetMessage += "Empty system of equations.\n"; return false;}
+
+	N = NIn;
+	B = (BlockSizeIn > 0 && N % BlockSizeIn == 0) ? BlockSizeIn : 1;
+	NB = N/B;
+
+	UsedThreads = 1;
+	if (N >= PCG_PARALLEL_MIN){
+		UsedThreads = NumThreads > 0 ? NumThreads : (int)std::thread::hardware_concurrency();
+		if (NumThreads <= 0 && UsedThreads > 8) UsedThreads = 8;
+		if (UsedThreads > NB) UsedThreads = NB;
+		if (UsedThreads < 1) UsedThreads = 1;
+	}
+	Partial1.assign(UsedThreads, 0.0);
+	Partial2.assign(UsedThreads, 0.0);
+
+	//diagonal, and which rows are coupled to others
+	Diag.assign(N, 0.0);
+	Decoupled.assign(N, 1);
+	for (int r=0; r<N; r++){
+		int Begin = ia[r]-1, End = ia[r+1]-1;
+		if (Begin >= End || ja[Begin]-1 != r){
+			std::ostringstream os; os << "Row " << r << " of the matrix has no diagonal entry.\n";
+			if (RetMessage) *RetMessage += os.str();
+			Clear(); return false;
+		}
+		Diag[r] = a[Begin];
+		for (int k=Begin+1; k<End; k++){
+			int c = ja[k]-1;
+			if (c <= r || c >= N){if (RetMessage) *RetMessage += "Matrix is not upper triangular.\n"; Clear(); return false;}
+			if (a[k] != 0){Decoupled[r] = 0; Decoupled[c] = 0;}
+		}
+	}
+	InvDiag.assign(N, 0.0);
+	for (int r=0; r<N; r++){
+		if (Diag[r] == 0 || (!Decoupled[r] && Diag[r] < 0)){
+			if (RetMessage) *RetMessage += "Matrix is not positive definite (is the structure fully constrained?)\n";
+			Clear(); return false;
+		}
+		if (!Decoupled[r]) InvDiag[r] = 1.0/Diag[r];
+	}
+
+	if (!BuildBlocks(a, ia, ja, RetMessage)){Clear(); return false;}
+	Built = Preconditioner;
+	if (Built == PCG_INCOMPLETE_CHOLESKY && !FactorIC(a, ia, ja, RetMessage)){Clear(); return false;}
+
+	R.assign(N, 0.0);
+	Z.assign(N, 0.0);
+	P.assign(N, 0.0);
+	Ap.assign(N, 0.0);
+	return true;
+}
+
+bool CVX_PCGSolver::UpdateValues(const double* a, const int* ia, const int* ja, const std::vector<int>& BlockRows, std::string* RetMessage)
+{
+	if (N <= 0){if (RetMessage) *RetMessage += "No system of equations to update.\n"; return false;}
+
+	int BB = B*B;
+	for (int n=0; n<(int)BlockRows.size(); n++){ //check first, so a failed update leaves the old matrix
+		for (int r=BlockRows[n]*B; r<(BlockRows[n]+1)*B; r++){
+			bool Ok = Decoupled[r] ? a[ia[r]-1] != 0 : a[ia[r]-1] > 0;
+			for (int k=ia[r]; k<ia[r+1]-1; k++) if (a[k] != 0 && (Decoupled[r] || Decoupled[ja[k]-1])) Ok = false; //newly coupled (rows whose terms all become zero can stay in the iteration)
+			if (!Ok){
+				if (RetMessage) *RetMessage += "Changed rows need a new preconditioner.\n";
+				return false;
+			}
+		}
+	}
+
+	for (int n=0; n<(int)BlockRows.size(); n++){
+		int I = BlockRows[n];
+		for (int r=I*B; r<(I+1)*B; r++){
+			Diag[r] = a[ia[r]-1];
+			if (!Decoupled[r]) InvDiag[r] = 1.0/Diag[r];
+			for (int k=ia[r]-1; k<ia[r+1]-1; k++){ //each term and its mirror have a place of their own: overwrite them
+				int c = ja[k]-1, J = c/B;
+				size_t Blk = std::lower_bound(BCol.begin()+BRowStart[I], BCol.begin()+BRowStart[I+1], J) - BCol.begin();
+				BVal[Blk*BB + (r%B)*B + c%B] = a[k];
+				if (r != c){
+					Blk = std::lower_bound(BCol.begin()+BRowStart[J], BCol.begin()+BRowStart[J+1], I) - BCol.begin();
+					BVal[Blk*BB + (c%B)*B + r%B] = a[k];
+				}
+			}
+		}
+	}
+	return true;
+}
+
+bool CVX_PCGSolver::BuildBlocks(const double* a, const int* ia, const int* ja, std::string* RetMessage)
+{
+	try {
+		//block pattern of the upper triangle
+		std::vector<int> UBStart(NB+1, 0), UBCol, Mark(NB, -1);
+		UBCol.reserve(ia[N]-1);
+		for (int I=0; I<NB; I++){
+			for (int r=I*B; r<(I+1)*B; r++){
+				for (int k=ia[r]-1; k<ia[r+1]-1; k++){
+					int J = (ja[k]-1)/B;
+					if (Mark[J] != I){Mark[J] = I; UBCol.push_back(J);}
+				}
+			}
+			std::sort(UBCol.begin()+UBStart[I], UBCol.end());
+			UBStart[I+1] = (int)UBCol.size();
+		}
+
+		//full pattern: the mirrored blocks (all with smaller columns) come first in each row
+		BRowStart.assign(NB+1, 0);
+		for (int I=0; I<NB; I++){
+			BRowStart[I+1] += UBStart[I+1]-UBStart[I];
+			for (int k=UBStart[I]; k<UBStart[I+1]; k++) if (UBCol[k] > I) BRowStart[UBCol[k]+1]++;
+		}
+		for (int I=0; I<NB; I++) BRowStart[I+1] += BRowStart[I];
+
+		BCol.resize(BRowStart[NB]);
+		std::vector<int> Fill(BRowStart.begin(), BRowStart.end()-1);
+		for (int I=0; I<NB; I++) for (int k=UBStart[I]; k<UBStart[I+1]; k++) if (UBCol[k] > I) BCol[Fill[UBCol[k]]++] = I;
+		for (int I=0; I<NB; I++) for (int k=UBStart[I]; k<UBStart[I+1]; k++) BCol[Fill[I]++] = UBCol[k];
+
+		//values
+		int BB = B*B;
+		BVal.assign((size_t)BRowStart[NB]*BB, 0.0);
+		for (int r=0; r<N; r++){
+			int I = r/B;
+			for (int k=ia[r]-1; k<ia[r+1]-1; k++){
+				int c = ja[k]-1, J = c/B;
+				size_t Blk = std::lower_bound(BCol.begin()+BRowStart[I], BCol.begin()+BRowStart[I+1], J) - BCol.begin();
+				BVal[Blk*BB + (r%B)*B + c%B] += a[k];
+				if (r != c){
+					Blk = std::lower_bound(BCol.begin()+BRowStart[J], BCol.begin()+BRowStart[J+1], I) - BCol.begin();
+					BVal[Blk*BB + (c%B)*B + r%B] += a[k];
+				}
+			}
+		}
+	}
+	catch (std::bad_alloc&){if (RetMessage) *RetMessage += "Insufficient memory for the solver. Reduce model size.\n"; return false;}
+	return true;
+}
+
+bool CVX_PCGSolver::FactorIC(const double* a, const int* ia, const int* ja, std::string* RetMessage)
+{
+	int NNZ = ia[N]-1;
+	std::vector<double> AVal;
+	try {
+		URowStart.resize(N+1);
+		UCol.resize(NNZ);
+		AVal.resize(NNZ);
+		UVal.resize(NNZ);
+	}
+	catch (std::bad_alloc&){if (RetMessage) *RetMessage += "Insufficient memory for the preconditioner. Try the Jacobi preconditioner.\n"; return false;}
+
+	//0-based copy of the upper triangle with the columns of each row sorted (the diagonal stays first)
+	std::vector<std::pair<int, double> > Row;
+	for (int r=0; r<=N; r++) URowStart[r] = ia[r]-1;
+	for (int r=0; r<N; r++){
+		Row.clear();
+		for (int k=ia[r]-1; k<ia[r+1]-1; k++) Row.push_back(std::make_pair(ja[k]-1, a[k]));
+		std::sort(Row.begin(), Row.end());
+		for (int k=0; k<(int)Row.size(); k++){UCol[URowStart[r]+k] = Row[k].first; AVal[URowStart[r]+k] = Row[k].second;}
+		if (Decoupled[r]) AVal[URowStart[r]] = fabs(AVal[URowStart[r]]);
+	}
+
+	//IC(0) may break down for matrices that are not diagonally dominant: retry with a growing shift of the diagonal
+	double Shift = 0;
+	for (int Attempt=0; Attempt<PCG_IC_SHIFTS; Attempt++){
+		UVal = AVal;
+		if (Shift != 0) for (int r=0; r<N; r++) UVal[URowStart[r]] *= 1+Shift;
+
+		bool Ok = true;
+		for (int k=0; k<N && Ok; k++){
+			int kb = URowStart[k], ke = URowStart[k+1];
+			double d = UVal[kb];
+			if (!(d > 0)){Ok = false; break;}
+			d = sqrt(d);
+			UVal[kb] = d;
+			for (int m=kb+1; m<ke; m++) UVal[m] /= d;
+
+			for (int m=kb+1; m<ke; m++){ //update the rows below with the outer product of this row, within their pattern
+				int i = UCol[m];
+				double uki = UVal[m];
+				int q = URowStart[i], qe = URowStart[i+1];
+				for (int n=m; n<ke && q<qe; n++){ //both rows sorted: merge
+					int j = UCol[n];
+					while (q<qe && UCol[q] < j) q++;
+					if (q<qe && UCol[q] == j) UVal[q] -= uki*UVal[n];
+				}
+			}
+		}
+		if (Ok) return true;
+		Shift = (Shift == 0) ? 1e-3 : Shift*4;
+	}
+
+	if (RetMessage) *RetMessage += "Incomplete Cholesky factorization failed. Try the Jacobi preconditioner.\n";
+	return false;
+}
+
+void CVX_PCGSolver::ApplyIC(const double* r, double* z)
+{
+	for (int i=0; i<N; i++) z[i] = r[i];
+
+	for (int k=0; k<N; k++){ //U^T*y = r
+		int kb = URowStart[k], ke = URowStart[k+1];
+		double zk = z[k] /= UVal[kb];
+		if (zk != 0) for (int m=kb+1; m<ke; m++) z[UCol[m]] -= UVal[m]*zk;
+	}
+	for (int k=N-1; k>=0; k--){ //U*z = y
+		int kb = URowStart[k], ke = URowStart[k+1];
+		double Sum = z[k];
+		for (int m=kb+1; m<ke; m++) Sum -= UVal[m]*z[UCol[m]];
+		z[k] = Sum/UVal[kb];
+	}
+}
+
+double CVX_PCGSolver::Residual(const double* b, double* x, double* r)
+{
+	pP = x; pAp = &Ap[0];
+	RunThreads(&CVX_PCGSolver::MultiplyRange);
+	double RR = 0;
+	for (int i=0; i<N; i++){r[i] = Decoupled[i] ? 0 : b[i]-Ap[i]; RR += r[i]*r[i];}
+	return RR;
+}
+
+void CVX_PCGSolver::RunThreads(void (CVX_PCGSolver::*pFunc)(int, int, int))
+{
+	if (UsedThreads <= 1){(this->*pFunc)(0, NB, 0); return;}
+
+	std::vector<std::thread> Threads;
+	for (int t=1; t<UsedThreads; t++) Threads.push_back(std::thread(pFunc, this, (int)((long long)NB*t/UsedThreads), (int)((long long)NB*(t+1)/UsedThreads), t));
+	(this->*pFunc)(0, (int)((long long)NB/UsedThreads), 0); //this thread takes the first range
+	for (int t=0; t<(int)Threads.size(); t++) Threads[t].join();
+}
+
+template <int BS> void CVX_PCGSolver::MultiplyBlocks(int First, int Last, int Thread)
+{
+	const int Bs = BS > 0 ? BS : B;
+	const int BB = Bs*Bs;
+	double Dot = 0;
+
+	for (int I=First; I<Last; I++){
+		double* y = pAp + I*Bs;
+		for (int k=0; k<Bs; k++) y[k] = 0;
+		for (int Blk=BRowStart[I]; Blk<BRowStart[I+1]; Blk++){
+			const double* v = &BVal[(size_t)Blk*BB];
+			const double* p = pP + BCol[Blk]*Bs;
+			for (int k=0; k<Bs; k++){
+				double Sum = 0;
+				for (int l=0; l<Bs; l++) Sum += v[k*Bs+l]*p[l];
+				y[k] += Sum;
+			}
+		}
+		for (int k=0; k<Bs; k++) Dot += y[k]*pP[I*Bs+k];
+	}
+	Partial1[Thread] = Dot;
+}
+
+void CVX_PCGSolver::MultiplyRange(int First, int Last, int Thread)
+{
+	switch (B){
+	case 6: MultiplyBlocks<6>(First, Last, Thread); break; //frame elements
+	case 3: MultiplyBlocks<3>(First, Last, Thread); break; //bar/shear elements
+	default: MultiplyBlocks<0>(First, Last, Thread); break;
+	}
+}
+
+void CVX_PCGSolver::UpdateRange(int First, int Last, int Thread)
+{
+	double RZ = 0, RR = 0;
+	bool Jacobi = (Built == PCG_JACOBI);
+	for (int i=First*B; i<Last*B; i++){
+		pX[i] += Alpha*pP[i];
+		pR[i] -= Alpha*pAp[i];
+		if (Jacobi){pZ[i] = InvDiag[i]*pR[i]; RZ += pR[i]*pZ[i];}
+		RR += pR[i]*pR[i];
+	}
+	Partial1[Thread] = RZ;
+	Partial2[Thread] = RR;
+}
+
+void CVX_PCGSolver::DirectionRange(int First, int Last, int Thread)
+{
+	for (int i=First*B; i<Last*B; i++) pP[i] = pZ[i] + Beta*pP[i];
+}
+
+bool CVX_PCGSolver::Solve(const double* b, double* x, std::string* RetMessage, int* pProgTick, int ProgTickEnd, const bool* pCancel)
+{
+	LastIterations = 0;
+	LastRelResidual = 0;
+	if (N <= 0){if (RetMessage) *RetMessage += "No system of equations to solve.\n"; return false;}
+
+	double BNorm2 = 0;
+	for (int i=0; i<N; i++) BNorm2 += b[i]*b[i];
+	if (BNorm2 == 0){for (int i=0; i<N; i++) x[i] = 0; if (pProgTick) *pProgTick = ProgTickEnd; return true;}
+
+	//start from the diagonal solution, which is exact for the decoupled rows
+	for (int i=0; i<N; i++) P[i] = b[i]/Diag[i];
+	double RR = Residual(b, &P[0], &R[0]);
+	bool FromGuess = false;
+	if (UseInitialGuess){ //or from the guess if it is closer
+		for (int i=0; i<N; i++) if (Decoupled[i]) x[i] = P[i];
+		double RRGuess = Residual(b, x, &Z[0]);
+		if (RRGuess < RR){RR = RRGuess; R.swap(Z); FromGuess = true;}
+	}
+	if (!FromGuess) for (int i=0; i<N; i++) x[i] = P[i];
+
+	if (Built == PCG_JACOBI) for (int i=0; i<N; i++) Z[i] = InvDiag[i]*R[i];
+	else ApplyIC(&R[0], &Z[0]);
+	double RZ = 0;
+	for (int i=0; i<N; i++){RZ += R[i]*Z[i]; P[i] = Z[i];}
+
+	int MaxIt = MaxIterations > 0 ? MaxIterations : N;
+	double Tol2 = Tolerance*Tolerance*BNorm2;
+	int StartTick = pProgTick ? *pProgTick : 0;
+	double LogSpan = (RR > Tol2) ? log(RR/Tol2) : 1;
+	double RR0 = RR;
+
+	pP = &P[0]; pX = x; pR = &R[0]; pZ = &Z[0];
+	int It = 0;
+	for (; It<MaxIt && RR > Tol2; It++){
+		if (pCancel && *pCancel){if (RetMessage) *RetMessage += "Solve cancelled.\n"; LastIterations = It; return false;}
+
+		RunThreads(&CVX_PCGSolver::MultiplyRange);
+		double PAp = 0;
+		for (int t=0; t<UsedThreads; t++) PAp += Partial1[t];
+		if (!(PAp > 0)){
+			if (RetMessage) *RetMessage += "Matrix is not positive definite (is the structure fully constrained?)\n";
+			LastIterations = It; return false;
+		}
+
+		Alpha = RZ/PAp;
+		RunThreads(&CVX_PCGSolver::UpdateRange);
+		double NewRZ = 0;
+		RR = 0;
+		for (int t=0; t<UsedThreads; t++){NewRZ += Partial1[t]; RR += Partial2[t];}
+		if (Built == PCG_INCOMPLETE_CHOLESKY){
+			ApplyIC(pR, pZ);
+			NewRZ = 0;
+			for (int i=0; i<N; i++) NewRZ += R[i]*Z[i];
+		}
+
+		Beta = NewRZ/RZ;
+		RZ = NewRZ;
+		RunThreads(&CVX_PCGSolver::DirectionRange);
+
+		if (pProgTick && RR > 0){ //progress on a log scale of the residual
+			double Frac = log(RR0/RR)/LogSpan;
+			if (Frac > 0 && Frac < 1) *pProgTick = StartTick + (int)(Frac*(ProgTickEnd-StartTick));
+		}
+	}
+
+	LastIterations = It;
+	LastRelResidual = sqrt(RR/BNorm2);
+	if (RR > Tol2){
+		std::ostringstream os;
+		os << "Iterative solver did not converge in " << It << " iterations (relative residual " << LastRelResidual << ").\n";
+		if (RetMessage) *RetMessage += os.str();
+		return false;
+	}
+	if (pProgTick) *pProgTick = ProgTickEnd;
+	return true;
+}
@@ -0,0 +1,86 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#ifndef VX_PCGSOLVER_H
+#define VX_PCGSOLVER_H
+
+#include <string>
+#include <vector>
+
+enum PCGPreconditioner {PCG_JACOBI, PCG_INCOMPLETE_CHOLESKY}; //preconditioners of CVX_PCGSolver
+
+//!Preconditioned conjugate gradient solver for sparse symmetric positive definite systems
+/*!Takes the matrix in the form PARDISO does: the upper triangle in 1-based compressed sparse rows (a, ia, ja) with the diagonal first in each row. Setup() copies it into a full symmetric block compressed sparse row matrix of BlockSize x BlockSize blocks (one per pair of connected voxels for FEA stiffness matrices) and builds the preconditioner. Solve() can then be called for any number of right hand sides.
+
+Rows that are not coupled to any other (such as fixed degrees of freedom, whose rows and columns have been cleared) are solved directly and left out of the iteration, so their diagonal may have either sign.
+
+The block matrix-vector products and vector updates are split over several threads for large systems. The incomplete Cholesky preconditioner (no fill-in) usually needs far fewer iterations than Jacobi, but its triangular solves are sequential.*/
+class CVX_PCGSolver
+{
+public:
+	CVX_PCGSolver(void); //!< Constructor
+	~CVX_PCGSolver(void) {} //!< Destructor
+
+	PCGPreconditioner Preconditioner; //!< Preconditioner to build at the next Setup().
+	double Tolerance; //!< Convergence criterion: norm of the residual relative to the norm of the right hand side.
+	int MaxIterations; //!< Maximum number of iterations. 0: as many as there are unknowns.
+	int NumThreads; //!< Threads for the matrix-vector products and vector updates. 0: one per core (at most 8).
+	bool UseInitialGuess; //!< If true, Solve() starts from the values passed in x (such as the solution of a similar system) instead of b divided by the diagonal.
+
+	bool Setup(int NIn, const double* a, const int* ia, const int* ja, int BlockSizeIn = 1, std::string* RetMessage = NULL); //!< Copies a matrix and builds the preconditioner. Returns false if the matrix is malformed or the preconditioner cannot be built. @param[in] NIn Number of unknowns. @param[in] a Values of the upper triangle. @param[in] ia NIn+1 1-based row starts. @param[in] ja 1-based column of each value. @param[in] BlockSizeIn Unknowns per node (6 for frame elements). Must divide NIn. @param[out] RetMessage Optional error message.
+	bool UpdateValues(const double* a, const int* ia, const int* ja, const std::vector<int>& BlockRows, std::string* RetMessage = NULL); //!< Copies new values of some rows of the matrix given to Setup(), whose pattern must not have changed. The preconditioner is kept: it was built for the old values, so Solve() may take a few more iterations, but it still converges to the solution of the new matrix. Returns false if the new values need a new Setup() (rows becoming coupled or decoupled, or diagonals that are not positive). @param[in] a Values of the upper triangle. @param[in] ia Row starts. @param[in] ja Columns. @param[in] BlockRows Block rows (groups of BlockSize rows) that changed. @param[out] RetMessage Optional error message.
+	bool Solve(const double* b, double* x, std::string* RetMessage = NULL, int* pProgTick = NULL, int ProgTickEnd = 0, const bool* pCancel = NULL); //!< Solves Ax=b. Returns false if it does not converge, the matrix turns out not to be positive definite, or it is cancelled. @param[in] b Right hand side. @param[out] x Solution. @param[out] RetMessage Optional error message. @param[in,out] pProgTick Optional progress counter, advanced from its current value towards ProgTickEnd as the residual decreases. @param[in] ProgTickEnd Value of *pProgTick at convergence. @param[in] pCancel Optional flag that stops the iteration as soon as it becomes true.
+	void Clear(void); //!< Releases the matrix and the preconditioner.
+
+	bool IsSetup(void) const {return N > 0;} //!< Returns true if a matrix is ready to solve.
+	int GetIterations(void) const {return LastIterations;} //!< Returns the number of iterations of the last Solve().
+	double GetRelResidual(void) const {return LastRelResidual;} //!< Returns the relative residual at the end of the last Solve().
+
+private:
+	int N; //unknowns
+	int B; //block size
+	int NB; //block rows
+	int UsedThreads;
+	PCGPreconditioner Built; //preconditioner built by the last Setup()
+	int LastIterations;
+	double LastRelResidual;
+
+	//full symmetric matrix in block CSR
+	std::vector<int> BRowStart; //NB+1 block row starts
+	std::vector<int> BCol; //block column of each block (sorted within a row)
+	std::vector<double> BVal; //B*B values per block, row by row
+
+	std::vector<double> Diag; //diagonal of the matrix
+	std::vector<char> Decoupled; //1 for rows not coupled to any other row
+	std::vector<double> InvDiag; //Jacobi preconditioner (0 for decoupled rows)
+
+	//incomplete Cholesky factor: A ~ U^T*U, U upper triangular with the pattern of the upper triangle of A (0-based CSR, diagonal first)
+	std::vector<int> URowStart, UCol;
+	std::vector<double> UVal;
+
+	//iteration state shared with the threaded kernels
+	double* pP; double* pAp; double* pX; double* pR; double* pZ;
+	double Alpha, Beta;
+	std::vector<double> Partial1, Partial2; //per-thread partial dot products
+	std::vector<double> R, Z, P, Ap; //residual, preconditioned residual, search direction, A*P
+
+	bool BuildBlocks(const double* a, const int* ia, const int* ja, std::string* RetMessage);
+	bool FactorIC(const double* a, const int* ia, const int* ja, std::string* RetMessage);
+	void ApplyIC(const double* r, double* z); //z = (U^T*U)^-1 * r
+
+	double Residual(const double* b, double* x, double* r); //r = b-A*x (0 for decoupled rows). Returns r.r
+	void RunThreads(void (CVX_PCGSolver::*pFunc)(int, int, int)); //calls pFunc(First, Last, Thread) on contiguous ranges of block rows covering them all
+	void MultiplyRange(int First, int Last, int Thread); //Ap = A*p and p.Ap over block rows First to Last-1
+	void UpdateRange(int First, int Last, int Thread); //x += Alpha*p, r -= Alpha*Ap and (Jacobi) z = M^-1*r, with r.z and r.r
+	void DirectionRange(int First, int Last, int Thread); //p = z + Beta*p
+	template <int BS> void MultiplyBlocks(int First, int Last, int Thread); //MultiplyRange() with a block size known at compile time (0: use B)
+};
+
+#endif //VX_PCGSOLVER_H
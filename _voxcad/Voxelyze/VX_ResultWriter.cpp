@@ -0,0 +1,271 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#include "VX_ResultWriter.h"
+#include "Utils/XML_Rip.h"
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#define RW_FLUSH_SIZE 65536 //bytes buffered before writing to the file
+
+CVX_ResultWriter::CVX_ResultWriter(void)
+{
+	Format = RF_XML;
+	pXML = NULL;
+}
+
+CVX_ResultWriter::CVX_ResultWriter(CXML_Rip* pXMLIn)
+{
+	Format = RF_XML;
+	pXML = pXMLIn;
+}
+
+CVX_ResultWriter::~CVX_ResultWriter(void)
+{
+	if (File.is_open()) Close();
+}
+
+bool CVX_ResultWriter::Open(std::string filename, ResultFormat FormatIn, std::string* RetMessage)
+{
+	if (FormatIn == RF_XML){if (RetMessage) *RetMessage += "XML results are written through a CXML_Rip.\n"; return false;}
+	Format = FormatIn;
+	pXML = NULL;
+	Nesting.clear();
+	NeedComma.clear();
+	Buffer.clear();
+	Buffer.reserve(RW_FLUSH_SIZE + 1024);
+
+	FileName = filename;
+	TmpFileName = TempFileName(filename);
+	File.open(TmpFileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!File.is_open()){if (RetMessage) *RetMessage += "Could not create result file " + TmpFileName + "\n"; return false;}
+
+	if (Format == RF_BINARY){
+		Buffer.append(RESULT_BINARY_MAGIC, 4);
+		BinPut((unsigned char)RESULT_BINARY_VERSION);
+	}
+	else {
+		Buffer += '{';
+		NeedComma.push_back(false);
+		Nesting.push_back('G');
+	}
+	return true;
+}
+
+bool CVX_ResultWriter::Close(void)
+{
+	if (!File.is_open()) return false;
+	while (Nesting.size() > (Format == RF_NDJSON ? 1u : 0u)) End(); //close anything left open
+	if (Format == RF_NDJSON) Buffer += "}\n";
+
+	Flush();
+	File.close();
+	if (File.fail()){remove(TmpFileName.c_str()); return false;}
+
+	if (rename(TmpFileName.c_str(), FileName.c_str()) != 0){remove(TmpFileName.c_str()); return false;} //appears complete or not at all
+	return true;
+}
+
+std::string CVX_ResultWriter::TempFileName(const std::string& FileName)
+{
+	size_t NameStart = FileName.find_last_of("/\\");
+	NameStart = (NameStart == std::string::npos) ? 0 : NameStart+1;
+
+	std::ostringstream TmpName;
+	TmpName << FileName.substr(0, NameStart) << "." << FileName.substr(NameStart) << "." << (long)getpid() << ".tmp"; //hidden (ls doesn't list it) and unique per process
+	return TmpName.str();
+}
+
+void CVX_ResultWriter::Flush(void)
+{
+	if (!Buffer.empty()) File.write(Buffer.data(), Buffer.size());
+	Buffer.clear();
+}
+
+void CVX_ResultWriter::BeginGroup(const char* Name)
+{
+	switch (Format){
+	case RF_XML: pXML->DownLevel(Name); return;
+	case RF_NDJSON: JSONKey(Name); Buffer += '{'; NeedComma.push_back(false); break;
+	case RF_BINARY: BinRecord('G', Name); break;
+	}
+	Nesting.push_back('G');
+}
+
+void CVX_ResultWriter::BeginList(const char* Name)
+{
+	switch (Format){
+	case RF_XML: pXML->DownLevel(Name); return;
+	case RF_NDJSON: JSONKey(Name); Buffer += '['; NeedComma.push_back(false); break;
+	case RF_BINARY: BinRecord('L', Name); break;
+	}
+	Nesting.push_back('L');
+}
+
+void CVX_ResultWriter::End(void)
+{
+	if (Format == RF_XML){pXML->UpLevel(); return;}
+	if (Nesting.empty()) return;
+
+	if (Format == RF_NDJSON){
+		Buffer += (Nesting.back() == 'L') ? ']' : '}';
+		NeedComma.pop_back();
+	}
+	else BinRecord('E', "");
+	Nesting.pop_back();
+
+	if (Buffer.size() > RW_FLUSH_SIZE) Flush();
+}
+
+void CVX_ResultWriter::Attribute(const char* Name, int Value)
+{
+	if (Format == RF_XML) pXML->SetElAttribute(Name, Value);
+	else this->Value(Name, Value);
+}
+
+void CVX_ResultWriter::Attribute(const char* Name, const std::string& Value)
+{
+	if (Format == RF_XML) pXML->SetElAttribute(Name, Value);
+	else this->Value(Name, Value);
+}
+
+void CVX_ResultWriter::Value(const char* Name, int Value)
+{
+	char Tmp[32];
+	switch (Format){
+	case RF_XML: pXML->Element(Name, Value); break;
+	case RF_NDJSON: JSONKey(Name); sprintf(Tmp, "%d", Value); Buffer += Tmp; break;
+	case RF_BINARY: BinRecord('i', Name); BinPut((long long)Value); break;
+	}
+}
+
+void CVX_ResultWriter::Value(const char* Name, long long Value)
+{
+	char Tmp[32];
+	sprintf(Tmp, "%lld", Value);
+	switch (Format){
+	case RF_XML: pXML->Element(Name, std::string(Tmp)); break;
+	case RF_NDJSON: JSONKey(Name); Buffer += Tmp; break;
+	case RF_BINARY: BinRecord('i', Name); BinPut(Value); break;
+	}
+}
+
+void CVX_ResultWriter::Value(const char* Name, double Value)
+{
+	switch (Format){
+	case RF_XML: pXML->Element(Name, Value); break;
+	case RF_NDJSON: JSONKey(Name); JSONNumber(Value); break;
+	case RF_BINARY: BinRecord('d', Name); BinPut(Value); break;
+	}
+}
+
+void CVX_ResultWriter::Value(const char* Name, const std::string& Value)
+{
+	switch (Format){
+	case RF_XML: pXML->Element(Name, Value); break;
+	case RF_NDJSON: JSONKey(Name); JSONString(Value); break;
+	case RF_BINARY: BinRecord('s', Name); BinPut((unsigned int)Value.size()); Buffer += Value; break;
+	}
+}
+
+void CVX_ResultWriter::Table(const char* Name, const char* RowName, const char* const* Columns, int NumColumns, const double* pData, int NumRows)
+{
+	switch (Format){
+	case RF_XML:
+		pXML->DownLevel(Name);
+		for (int r=0; r<NumRows; r++){
+			pXML->DownLevel(RowName);
+			for (int c=0; c<NumColumns; c++) pXML->Element(Columns[c], pData[r*NumColumns+c]);
+			pXML->UpLevel();
+		}
+		pXML->UpLevel();
+		break;
+	case RF_NDJSON: //column arrays: the names are written once instead of once per row
+		JSONKey(Name);
+		Buffer += '{';
+		for (int c=0; c<NumColumns; c++){
+			if (c != 0) Buffer += ',';
+			JSONString(Columns[c]);
+			Buffer += ":[";
+			for (int r=0; r<NumRows; r++){
+				if (r != 0) Buffer += ',';
+				JSONNumber(pData[r*NumColumns+c]);
+				if (Buffer.size() > RW_FLUSH_SIZE) Flush();
+			}
+			Buffer += ']';
+		}
+		Buffer += '}';
+		break;
+	case RF_BINARY: {
+		BinRecord('T', Name);
+		int RowNameLength = (int)strlen(RowName);
+		if (RowNameLength > 255) RowNameLength = 255;
+		BinPut((unsigned char)RowNameLength);
+		Buffer.append(RowName, RowNameLength);
+		BinPut((unsigned short)NumColumns);
+		for (int c=0; c<NumColumns; c++){
+			int Length = (int)strlen(Columns[c]);
+			if (Length > 255) Length = 255;
+			BinPut((unsigned char)Length);
+			Buffer.append(Columns[c], Length);
+		}
+		BinPut((unsigned int)NumRows);
+		Flush(); //the values go straight to the file
+		if (NumRows > 0 && NumColumns > 0) File.write((const char*)pData, (std::streamsize)NumRows*NumColumns*sizeof(double));
+		break;
+		}
+	}
+}
+
+void CVX_ResultWriter::JSONKey(const char* Name)
+{
+	if (NeedComma.back()) Buffer += ',';
+	NeedComma.back() = true;
+	if (Nesting.back() == 'L') return; //list members are anonymous
+	JSONString(Name);
+	Buffer += ':';
+}
+
+void CVX_ResultWriter::JSONString(const std::string& Str)
+{
+	Buffer += '"';
+	for (std::string::size_type i=0; i<Str.size(); i++){
+		unsigned char c = (unsigned char)Str[i];
+		if (c == '"' || c == '\\'){Buffer += '\\'; Buffer += (char)c;}
+		else if (c < 0x20){char Tmp[8]; sprintf(Tmp, "\\u%04x", c); Buffer += Tmp;}
+		else Buffer += (char)c;
+	}
+	Buffer += '"';
+}
+
+void CVX_ResultWriter::JSONNumber(double Val)
+{
+	if (Val != Val || Val - Val != 0){Buffer += "null"; return;} //NaN or infinite: not representable in JSON
+	char Tmp[32];
+	sprintf(Tmp, "%.17g", Val); //round-trips exactly
+	Buffer += Tmp;
+}
+
+void CVX_ResultWriter::BinRecord(char Type, const char* Name)
+{
+	int Length = (int)strlen(Name);
+	if (Length > 255) Length = 255;
+	Buffer += Type;
+	BinPut((unsigned char)Length);
+	Buffer.append(Name, Length);
+	if (Buffer.size() > RW_FLUSH_SIZE) Flush();
+}
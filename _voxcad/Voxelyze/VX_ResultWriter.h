@@ -0,0 +1,79 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#ifndef VX_RESULTWRITER_H
+#define VX_RESULTWRITER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+class CXML_Rip;
+
+enum ResultFormat {RF_XML, RF_NDJSON, RF_BINARY}; //don't change these orders! (stored as integers in vxa files)
+
+#define RESULT_BINARY_MAGIC "VXRB" //first four bytes of a binary result file
+#define RESULT_BINARY_VERSION 1
+
+//!Streaming writer for simulation result files
+/*!Results are described as a tree of named groups, lists of groups, scalar values and numeric tables, and written in one of three formats:
+- RF_XML: the classic Voxelyze_Sim_Result document, built through a CXML_Rip.
+- RF_NDJSON: a single line of JSON per file. Groups become objects, lists become arrays and tables become an object of column arrays.
+- RF_BINARY: a flat sequence of tagged records (see below) in native (little-endian) byte order.
+
+The NDJSON and binary writers stream straight to the file through a small buffer: nothing is kept in memory but the current nesting, so long traces cost no more than their bytes on disk. They write to a temporary file (TempFileName()) that Close() renames to the final name, so programs polling the output directory never read a partial result.
+
+Binary layout: the magic "VXRB" and a one byte version, then records of a one byte type, a one byte name length and the name, followed by:
+- 'G' group, 'L' list: nothing (closed by an 'E' record with an empty name).
+- 'i': int64. 'd': float64. 's': uint32 length and the characters.
+- 'T' table: a one byte row name length and the row name, uint16 number of columns, each column name as a one byte length and the characters, uint32 number of rows, then rows*columns float64 values row by row.*/
+class CVX_ResultWriter
+{
+public:
+	CVX_ResultWriter(void); //!< Constructor. Call Open() before writing.
+	CVX_ResultWriter(CXML_Rip* pXMLIn); //!< Constructor for an RF_XML writer that adds everything to an existing XML stream. @param[in] pXMLIn The XML stream to write to.
+	~CVX_ResultWriter(void); //!< Destructor. Closes the file if still open.
+
+	bool Open(std::string filename, ResultFormat FormatIn, std::string* RetMessage = NULL); //!< Starts a streamed NDJSON or binary result file. Returns false if the file cannot be created. @param[in] filename Path of the result file. @param[in] FormatIn RF_NDJSON or RF_BINARY. @param[out] RetMessage Optional error message.
+	bool Close(void); //!< Finishes the file and renames it to the name given to Open(). Returns false if anything failed to write.
+	static std::string TempFileName(const std::string& FileName); //!< Returns a hidden name unique to this process next to FileName (dir/.name.pid.tmp), to write a file under before renaming it into place. @param[in] FileName Final path of the file.
+	ResultFormat GetFormat(void) const {return Format;} //!< Returns the format being written.
+
+	void BeginGroup(const char* Name); //!< Opens a named group of values. Within a list the name is only used by the XML format. @param[in] Name Tag of the group.
+	void BeginList(const char* Name); //!< Opens a named list. Its children should be groups with the same name. @param[in] Name Tag of the list.
+	void End(void); //!< Closes the innermost open group or list.
+
+	void Attribute(const char* Name, int Value); //!< Adds an attribute to the current group. The XML format writes a real attribute, the others an ordinary value. @param[in] Name Attribute name. @param[in] Value Attribute value.
+	void Attribute(const char* Name, const std::string& Value); //!< Adds a string attribute to the current group. @param[in] Name Attribute name. @param[in] Value Attribute value.
+	void Value(const char* Name, int Value); //!< Writes an integer value. @param[in] Name Tag of the value. @param[in] Value The value.
+	void Value(const char* Name, long long Value); //!< Writes a 64 bit integer value (counters that can exceed the int range). @param[in] Name Tag of the value. @param[in] Value The value.
+	void Value(const char* Name, double Value); //!< Writes a floating point value. @param[in] Name Tag of the value. @param[in] Value The value.
+	void Value(const char* Name, float Value) {this->Value(Name, (double)Value);} //!< Writes a floating point value. @param[in] Name Tag of the value. @param[in] Value The value.
+	void Value(const char* Name, const std::string& Value); //!< Writes a string value. @param[in] Name Tag of the value. @param[in] Value The value.
+	void Table(const char* Name, const char* RowName, const char* const* Columns, int NumColumns, const double* pData, int NumRows); //!< Writes a table of numbers. The XML format expands it into one RowName element per row. @param[in] Name Tag of the table. @param[in] RowName Tag of each row in the XML format. @param[in] Columns Names of the columns. @param[in] NumColumns Number of columns. @param[in] pData NumRows*NumColumns values, row by row. @param[in] NumRows Number of rows.
+
+private:
+	ResultFormat Format;
+	CXML_Rip* pXML; //RF_XML only
+	std::ofstream File; //RF_NDJSON and RF_BINARY
+	std::string FileName, TmpFileName; //final name and the name written to until Close()
+	std::string Buffer; //pending output, flushed to File in large blocks
+	std::vector<char> Nesting; //for each open group: 'G' (object) or 'L' (list)
+	std::vector<bool> NeedComma; //for each open group (NDJSON): true once it has a member
+
+	void Flush(void);
+	void JSONKey(const char* Name); //comma, and the quoted key unless inside a list
+	void JSONString(const std::string& Str);
+	void JSONNumber(double Val);
+	void BinRecord(char Type, const char* Name);
+	template <typename T> void BinPut(T Val) {Buffer.append((const char*)&Val, sizeof(T));}
+};
+
+#endif //VX_RESULTWRITER_H
@@ -0,0 +1,91 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#include "VX_SettleCache.h"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#define SETTLE_CACHE_MAGIC "VXSETTLE1"
+
+CVX_SettleCache::CVX_SettleCache(void)
+{
+	Hits = 0;
+	Misses = 0;
+	Stores = 0;
+}
+
+CVX_SettleCache::~CVX_SettleCache(void)
+{
+}
+
+unsigned long long CVX_SettleCache::Hash(const std::string& Data)
+{
+	unsigned long long h = 14695981039346656037ULL; //FNV offset basis
+	for (std::string::size_type i=0; i<Data.size(); i++){
+		h ^= (unsigned char)Data[i];
+		h *= 1099511628211ULL; //FNV prime
+	}
+	return h;
+}
+
+std::string CVX_SettleCache::FileName(unsigned long long Key) const
+{
+	char KeyStr[17];
+	sprintf(KeyStr, "%016llx", Key);
+	std::string Path = Directory;
+	if (!Path.empty() && Path[Path.size()-1] != '/' && Path[Path.size()-1] != '\\') Path += "/";
+	return Path + "settle_" + KeyStr + ".vxs";
+}
+
+bool CVX_SettleCache::Load(unsigned long long Key, std::string* pData)
+{
+	if (!IsEnabled()) return false;
+
+	std::ifstream File(FileName(Key).c_str(), std::ios::in | std::ios::binary);
+	if (!File.is_open()) return false;
+
+	std::string Magic(sizeof(SETTLE_CACHE_MAGIC)-1, ' ');
+	unsigned long long FileKey;
+	if (!File.read(&Magic[0], Magic.size()) || Magic != SETTLE_CACHE_MAGIC) return false;
+	if (!SCRead(File, &FileKey) || FileKey != Key) return false; //guards against a renamed or truncated file
+
+	std::ostringstream Contents;
+	Contents << File.rdbuf();
+	*pData = Contents.str();
+	return !pData->empty();
+}
+
+bool CVX_SettleCache::Store(unsigned long long Key, const std::string& Data)
+{
+	if (!IsEnabled()) return false;
+
+	std::string Final = FileName(Key);
+	std::ostringstream TmpName;
+	TmpName << Final << "." << (long)getpid() << ".tmp"; //unique per process
+
+	std::ofstream File(TmpName.str().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!File.is_open()) return false;
+	File.write(SETTLE_CACHE_MAGIC, sizeof(SETTLE_CACHE_MAGIC)-1);
+	SCWrite(File, Key);
+	File.write(Data.data(), Data.size());
+	File.close();
+	if (File.fail()){remove(TmpName.str().c_str()); return false;}
+
+	if (rename(TmpName.str().c_str(), Final.c_str()) != 0){remove(TmpName.str().c_str()); return false;}
+	Stores++;
+	return true;
+}
@@ -0,0 +1,53 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#ifndef VX_SETTLECACHE_H
+#define VX_SETTLECACHE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <iostream>
+
+//binary stream helpers for the settled state snapshots (native byte order: the cache is only meant to be shared between identical builds)
+template <typename T> inline void SCWrite(std::ostream& os, const T& Val) {os.write((const char*)&Val, sizeof(T));}
+template <typename T> inline bool SCRead(std::istream& is, T* pVal) {is.read((char*)pVal, sizeof(T)); return !is.fail();}
+template <typename T> inline void SCWriteVec(std::ostream& os, const std::vector<T>& Vec) {int Size = (int)Vec.size(); SCWrite(os, Size); if (Size) os.write((const char*)&Vec[0], Size*sizeof(T));}
+template <typename T> inline bool SCReadVec(std::istream& is, std::vector<T>* pVec) {int Size; if (!SCRead(is, &Size) || Size < 0) return false; pVec->resize(Size); if (Size) is.read((char*)&(*pVec)[0], Size*sizeof(T)); return !is.fail();}
+template <typename T> inline void SCWriteDeque(std::ostream& os, const std::deque<T>& Deq) {int Size = (int)Deq.size(); SCWrite(os, Size); for (int i=0; i<Size; i++) SCWrite(os, Deq[i]);}
+template <typename T> inline bool SCReadDeque(std::istream& is, std::deque<T>* pDeq) {int Size; if (!SCRead(is, &Size) || Size < 0) return false; pDeq->resize(Size); for (int i=0; i<Size; i++) SCRead(is, &(*pDeq)[i]); return !is.fail();}
+
+//!On-disk cache of settled simulation states
+/*!Evolutionary runs evaluate the same morphology many times with different controllers. Everything before InitCmTime (the passive settling phase) is independent of the controller, so the state of the simulation at InitCmTime is stored here keyed by a hash of the morphology and the physics-relevant parameters, and restored by later evaluations with the same key. The key and the snapshot contents are defined by CVX_Sim.*/
+class CVX_SettleCache
+{
+public:
+	CVX_SettleCache(void); //!< Constructor
+	~CVX_SettleCache(void); //!< Destructor
+
+	void SetDirectory(std::string DirectoryIn) {Directory = DirectoryIn;} //!< Sets the directory cached states are stored in. An empty string disables the cache. @param[in] DirectoryIn Path to an existing, writable directory.
+	std::string GetDirectory(void) const {return Directory;} //!< Returns the current cache directory.
+	bool IsEnabled(void) const {return !Directory.empty();} //!< Returns true if a cache directory has been set.
+
+	static unsigned long long Hash(const std::string& Data); //!< Returns a 64-bit FNV-1a hash of arbitrary binary data. @param[in] Data The data to hash.
+	std::string FileName(unsigned long long Key) const; //!< Returns the path of the cache file for the specified key. @param[in] Key Hash of the settling-relevant simulation parameters.
+
+	bool Load(unsigned long long Key, std::string* pData); //!< Reads the cached state for this key into pData. Returns false if there is no (readable) entry. @param[in] Key Hash of the settling-relevant simulation parameters. @param[out] pData The raw snapshot.
+	bool Store(unsigned long long Key, const std::string& Data); //!< Writes a state for this key. The file is written under a temporary name and renamed so that concurrent evaluations never see a partial entry. @param[in] Key Hash of the settling-relevant simulation parameters. @param[in] Data The raw snapshot.
+
+	int Hits; //!< Number of lookups that found a cached state.
+	int Misses; //!< Number of lookups that did not find a cached state.
+	int Stores; //!< Number of states written to the cache.
+
+private:
+	std::string Directory;
+};
+
+#endif //VX_SETTLECACHE_H
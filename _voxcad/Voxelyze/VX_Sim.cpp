@@ -15,12 +15,17 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #include <sstream>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 #include <math.h>
 
 #ifdef USE_OPEN_GL
 #include "Utils/GL_Utils.h"
 #endif
 
+#define IMPORT_PARALLEL_MIN 16384 //spread the per-voxel stages of Import() over several threads from this many voxels
+
 
 CVX_Sim::CVX_Sim(void)// : VoxelInput(this), BondInput(this) // : out("Logfile.txt", std::ios::ate)
 {
@@ -86,6 +91,19 @@ CVX_Sim::CVX_Sim(void)// : VoxelInput(this), BondInput(this) // : out("Logfile.t
 	SetInitCmTime();
 	SetActuationStartTime();
 
+	SetAbortTargetDisp();
+	SetAbortSpeedFactor();
+	SetAbortCheckInterval();
+	SetCoarsening();
+	for (int i=0; i<IP_NUM_PHASES; i++) ImportTime[i] = 0;
+	WorkCountersEnabled = false;
+	ResetStepProfile();
+	AbortReason = EA_NONE;
+	AbortTime = AbortPeakSpeed = 0;
+	AbortWindowStart = -1;
+	AbortWindows = 0;
+	NextAbortCheckpoint = 0;
+
 	Rolls.clear();
     Pitches.clear();
     Yaws.clear();
@@ -113,6 +131,8 @@ CVX_Sim::CVX_Sim(void)// : VoxelInput(this), BondInput(this) // : out("Logfile.t
 	fluidEnvironment = false;
 	aggregateDragCoefficient = 0.0;
 
+	SettleKey = 0;
+
 	ClearAll();
 	OptimalDt = 0; //remove when hack in ClearAll is dealt with
 }
@@ -227,6 +247,19 @@ void CVX_Sim::WriteXML(CXML_Rip* pXML)
 		pXML->Element("StopConditionValue", StopConditionValue);
 		pXML->Element("InitCmTime", InitCmTime);
 		pXML->Element("ActuationStartTime", ActuationStartTime);
+		if (IsEarlyAbortEnabled()){
+			pXML->DownLevel("EarlyAbort");
+			pXML->Element("TargetDisplacement", AbortTargetDisp);
+			pXML->Element("SpeedFactor", AbortSpeedFactor);
+			pXML->Element("CheckInterval", AbortCheckInterval);
+			for (int i=0; i<NumAbortCheckpoints(); i++){
+				pXML->DownLevel("Checkpoint");
+				pXML->Element("Time", AbortCheckpoints[i].first);
+				pXML->Element("MinDisplacement", AbortCheckpoints[i].second);
+				pXML->UpLevel();
+			}
+			pXML->UpLevel();
+		}
 		pXML->UpLevel();
 
 		pXML->DownLevel("EquilibriumMode");
@@ -234,6 +267,9 @@ void CVX_Sim::WriteXML(CXML_Rip* pXML)
 	//	pXML->Element("StopConditionValue", StopConditionValue);
 		pXML->UpLevel();
 
+		if (SettleCache.IsEnabled()) pXML->Element("SettleCacheDir", SettleCache.GetDirectory());
+		if (CoarseMaxBlock > 1) pXML->Element("CoarsenBlockSize", CoarseMaxBlock);
+
 		if (ImportSurfMesh){
 			pXML->DownLevel("SurfMesh");
 			ImportSurfMesh->WriteXML(pXML, true);
@@ -298,6 +334,20 @@ bool CVX_Sim::ReadXML(CXML_Rip* pXML, std::string* RetMessage)
 		if (pXML->FindLoadElement("StopConditionValue", &tmpVFloat)) SetStopConditionValue(tmpVFloat); else SetStopConditionValue();
 		if (pXML->FindLoadElement("InitCmTime", &tmpVFloat)) SetInitCmTime(tmpVFloat); else SetInitCmTime();
 		if (pXML->FindLoadElement("ActuationStartTime", &tmpVFloat)) SetActuationStartTime(tmpVFloat); else SetActuationStartTime();
+		ClearAbortCheckpoints();
+		if (pXML->FindElement("EarlyAbort")){
+			if (pXML->FindLoadElement("TargetDisplacement", &tmpVFloat)) SetAbortTargetDisp(tmpVFloat); else SetAbortTargetDisp();
+			if (pXML->FindLoadElement("SpeedFactor", &tmpVFloat)) SetAbortSpeedFactor(tmpVFloat); else SetAbortSpeedFactor();
+			if (pXML->FindLoadElement("CheckInterval", &tmpVFloat)) SetAbortCheckInterval(tmpVFloat); else SetAbortCheckInterval();
+			while (pXML->FindElement("Checkpoint")){
+				vfloat CheckTime = 0, MinDisp = 0;
+				pXML->FindLoadElement("Time", &CheckTime);
+				pXML->FindLoadElement("MinDisplacement", &MinDisp);
+				AddAbortCheckpoint(CheckTime, MinDisp);
+			}
+			pXML->UpLevel();
+		}
+		else {SetAbortTargetDisp(); SetAbortSpeedFactor(); SetAbortCheckInterval();}
 		pXML->UpLevel();
 	}
 
@@ -320,6 +370,10 @@ bool CVX_Sim::ReadXML(CXML_Rip* pXML, std::string* RetMessage)
 
 	if (!pXML->FindLoadElement("MinTempFact", &MIN_TEMP_FACT)) MIN_TEMP_FACT = 0.1;
 
+	std::string tmpString;
+	if (pXML->FindLoadElement("SettleCacheDir", &tmpString)) SettleCache.SetDirectory(tmpString); //otherwise keep any directory set by the caller
+	if (pXML->FindLoadElement("CoarsenBlockSize", &tmpInt)) SetCoarsening(tmpInt);
+
 	return ReadAdditionalSimXML(pXML, RetMessage);
 }
 
@@ -333,9 +387,16 @@ void CVX_Sim::ClearAll(void) //Reset all initialized variables
 	//This should be all the stuff set by "Import()"
 	VoxArray.clear();
 	BondArrayInternal.clear();
-	XtoSIndexMap.clear();
+	XtoSIndexMap.Clear();
 	StoXIndexMap.clear();
 	SurfVoxels.clear();
+	BodyIndex.clear();
+	BodyNumVox.clear();
+	BodySurfVoxels.clear();
+	BodyIniCM.clear();
+	VoxBlockSize.clear();
+	VoxDataIndex.clear();
+	VoxWork.clear();
 
 	MaxDispSinceLastBondUpdate = (vfloat)FLT_MAX; //arbitrarily high as a flag to populate bonds
 
@@ -355,6 +416,9 @@ void CVX_Sim::ClearAll(void) //Reset all initialized variables
 	SS.Clear();
 	IniCM = Vec3D<>(0,0,0);
 
+	SettleRestored = false;
+	SettleStorePending = false;
+
 	delete ImportSurfMesh;
 	ImportSurfMesh=NULL;
 
@@ -456,6 +520,29 @@ void CVX_Sim::DeleteCollisionBonds(void)
 //	return &BondArrayInternal[InputBondInd];
 //}
 
+static double LapSeconds(std::chrono::steady_clock::time_point* pStart) //returns the seconds since *pStart and restarts it
+{
+	std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now();
+	double Seconds = std::chrono::duration<double>(Now - *pStart).count();
+	*pStart = Now;
+	return Seconds;
+}
+
+static void ApplyBC(CVX_Voxel* pVox, CVX_FRegion* pBC, int NumTouching) //constrains a voxel touched by a boundary condition and gives it its share of the force
+{
+	char ThisDofFixed = pBC->DofFixed;
+	pVox->FixDof(ThisDofFixed);
+	pVox->AddExternalForce(pBC->Force/NumTouching);
+	pVox->AddExternalTorque(pBC->Torque/NumTouching);
+
+	if (IS_FIXED(DOF_X, ThisDofFixed)) pVox->SetExternalDisp(AXIS_X, pBC->Displace.x);
+	if (IS_FIXED(DOF_Y, ThisDofFixed)) pVox->SetExternalDisp(AXIS_Y, pBC->Displace.y);
+	if (IS_FIXED(DOF_Z, ThisDofFixed)) pVox->SetExternalDisp(AXIS_Z, pBC->Displace.z);
+	if (IS_FIXED(DOF_TX, ThisDofFixed)) pVox->SetExternalTDisp(AXIS_X, pBC->AngDisplace.x);
+	if (IS_FIXED(DOF_TY, ThisDofFixed)) pVox->SetExternalTDisp(AXIS_Y, pBC->AngDisplace.y);
+	if (IS_FIXED(DOF_TZ, ThisDofFixed)) pVox->SetExternalTDisp(AXIS_Z, pBC->AngDisplace.z);
+}
+
 /*! The environment should have been previously initialized and linked with a single voxel object. 
 This function sets or resets the entire simulation with the new environment.
 @param[in] pEnvIn A pointer to initialized CVX_Environment to import into the simulator.
@@ -464,23 +551,18 @@ This function sets or resets the entire simulation with the new environment.
 bool CVX_Sim::Import(CVX_Environment* pEnvIn, CMesh* pSurfMeshIn, std::string* RetMessage)
 {
 	//std::cout << "[VX_Sim.cpp] debugmsg : Import" << std::endl;
+	std::chrono::steady_clock::time_point PhaseStart = std::chrono::steady_clock::now();
+	for (int i=0; i<IP_NUM_PHASES; i++) ImportTime[i] = 0;
 	ClearAll(); //clears out all arrays and stuff
 
 
 	if (pEnvIn != NULL) pEnv = pEnvIn;
 	if (pEnv == NULL) {if (RetMessage) *RetMessage += "Invalid Environment pointer"; return false;}
 
-	fluidEnvironment = pEnv->GetFluidEnvironment();
-	aggregateDragCoefficient = pEnv->GetAggregateDragCoefficient(); 
-
-
-	//get in sync with environment options
-	EnableFeature(VXSFEAT_GRAVITY, pEnv->IsGravityEnabled());
-	EnableFeature(VXSFEAT_FLOOR, pEnv->IsFloorEnabled());
-	EnableFeature(VXSFEAT_TEMPERATURE, pEnv->IsTempEnabled());
-	EnableFeature(VXSFEAT_TEMPERATURE_VARY, pEnv->IsTempVaryEnabled());
+	ImportEnvironmentSettings();
 
 	LocalVXC = *pEnv->pObj; //make a copy of the reference digital object!
+	LocalVXC.CacheLeafMats();
 	if (LocalVXC.GetNumVox() == 0) {if (RetMessage) *RetMessage += "No voxels in object"; return false;}
 
 	int SIndexIt = 0; //keep track of how many voxel we've added (for storing reverse lookup array...)
@@ -489,75 +571,87 @@ bool CVX_Sim::Import(CVX_Environment* pEnvIn, CMesh* pSurfMeshIn, std::string* R
 
 
 	//initialize XtoSIndexMap & StoXIndexMap
-	XtoSIndexMap.resize(LocalVXC.GetStArraySize(), -1); // = new int[LocalVXC.GetStArraySize()];
+	XtoSIndexMap.Resize(LocalVXC.GetStArraySize(), -1); //-1: no voxel here
 	StoXIndexMap.resize(LocalVXC.GetNumVox(), -1); // = new int [m_NumVox];
+	try {VoxArray.reserve(LocalVXC.GetNumVox()); BondArrayInternal.reserve(3*LocalVXC.GetNumVox());} //at most three bonds per voxel unless coarsened: no reallocation while adding them
+	catch (std::bad_alloc&){if (RetMessage) *RetMessage += "Insufficient memory. Reduce model size.\n"; return false;}
+	ImportTime[IP_COPY] = LapSeconds(&PhaseStart);
 
-
+	//Find the voxels touched by each boundary condition once (the number of them shares out its force)
+	std::vector<std::vector<int> > BCVoxels(NumBCs);
 	std::vector<int> Sizes(NumBCs, 0);
-	for (int i=0; i<NumBCs; i++) Sizes[i] = pEnv->GetNumTouching(i);
-//	pEnv->GetNumVoxTouchingForced(&Sizes); //get the number of voxels in each region (to apply equal force to each voxel within this region!)
+	std::vector<bool> BCTouched; //lattice voxels touched by any boundary condition (only needed for coarsening)
+	RasterizeBCs(&BCVoxels, &Sizes);
+	if (CoarseMaxBlock > 1){
+		BCTouched.assign(LocalVXC.GetStArraySize(), false);
+		for (int j=0; j<NumBCs; j++) for (int k=0; k<(int)BCVoxels[j].size(); k++) BCTouched[BCVoxels[j][k]] = true;
+	}
 
 //	Vec3D BCpoint;
 	Vec3D<> BCsize = pEnv->pObj->GetLatDimEnv()/2.0;
 	Vec3D<> WSSize = pEnv->pObj->GetWorkSpace();
 
+	std::vector<int> CellBlock; //super-voxels (empty unless coarsening)
+	std::vector<int> CellOwner; //first lattice voxel of the super-voxel covering each lattice voxel
+	if (CoarseMaxBlock > 1) FindCoarseBlocks(&CellBlock, BCTouched);
+	if (!CellBlock.empty()) CellOwner.resize(LocalVXC.GetStArraySize(), -1);
+	ImportTime[IP_BOUNDARY] = LapSeconds(&PhaseStart);
+
 	//Add all Voxels:
 	bool HasPlasticMaterial = false;
 	Vec3D<> ThisPos;
 	vfloat ThisScale = LocalVXC.GetLatDimEnv().x; //force to cubic
+	int DataIndexIt = 0; //index into the per-voxel object arrays
 	//Build voxel list
-	for (int i=0; i<LocalVXC.GetStArraySize(); i++){ //for each voxel in the array
-		XtoSIndexMap[i] = -1; //assume there is not a voxel here...
-
-		if(LocalVXC.Structure[i] != 0 ){ //if there's material here
-			int ThisMatIndex = LocalVXC.GetLeafMatIndex(i); 
-			int ThisMatModel = LocalVXC.Palette[ThisMatIndex].GetMatModel();
-			if (ThisMatModel == MDL_BILINEAR || ThisMatModel == MDL_DATA) HasPlasticMaterial = true; //enable plasticity in the sim
-
-			LocalVXC.GetXYZ(&ThisPos, i, false);//Get XYZ location
+	for (int i=LocalVXC.Structure.GetNextVoxel(0); i!=-1; i=LocalVXC.Structure.GetNextVoxel(i+1)){ //for each voxel in the array (empty regions are skipped)
+		int ThisBlock = CellBlock.empty() ? 1 : CellBlock[i];
+		if (ThisBlock == 0){XtoSIndexMap.Set(i, XtoSIndexMap[CellOwner[i]]); DataIndexIt++; continue;} //inside a super-voxel that was already added
+
+		int ThisMatIndex = LocalVXC.GetLeafMatIndex(i); 
+		int ThisMatModel = LocalVXC.Palette[ThisMatIndex].GetMatModel();
+		if (ThisMatModel == MDL_BILINEAR || ThisMatModel == MDL_DATA) HasPlasticMaterial = true; //enable plasticity in the sim
+
+		LocalVXC.GetXYZ(&ThisPos, i, false);//Get XYZ location
+
+		if (ThisBlock > 1){ //super-voxel: centered on its block
+			int X0, Y0, Z0;
+			LocalVXC.GetXYZNom(&X0, &Y0, &Z0, i);
+			Vec3D<> FarPos;
+			LocalVXC.GetXYZ(&FarPos, LocalVXC.GetIndex(X0+ThisBlock-1, Y0+ThisBlock-1, Z0+ThisBlock-1), false);
+			ThisPos = (ThisPos + FarPos)/2;
+			for (int z=Z0; z<Z0+ThisBlock; z++) for (int y=Y0; y<Y0+ThisBlock; y++) for (int x=X0; x<X0+ThisBlock; x++) CellOwner[LocalVXC.GetIndex(x, y, z)] = i;
+		}
+		if (!CellBlock.empty()){VoxBlockSize.push_back(ThisBlock); VoxDataIndex.push_back(DataIndexIt);}
+		DataIndexIt++;
 
-			CVXS_Voxel CurVox(this, SIndexIt, i, ThisMatIndex, ThisPos, ThisScale);
+		try{VoxArray.emplace_back(this, SIndexIt, i, ThisMatIndex, ThisPos, ThisScale*ThisBlock);} //built in place (the array was reserved)
+		catch (std::bad_alloc&){if (RetMessage) *RetMessage += "Insufficient memory. Reduce model size.\n"; return false;} //catch if we run out of memory
+		CVXS_Voxel& CurVox = VoxArray.back();
 
-			XtoSIndexMap[i] = SIndexIt; //so we can find this voxel based on it's original index
-			StoXIndexMap[SIndexIt] = i; //so we can find the original index based on its simulator position
-			
+		XtoSIndexMap.Set(i, SIndexIt); //so we can find this voxel based on it's original index
+		StoXIndexMap[SIndexIt] = i; //so we can find the original index based on its simulator position
+		
+		if (ThisBlock > 1){ //super-voxels are tested at their center (their lattice voxels are untouched by construction)
 			for (int j = 0; j<NumBCs; j++){ //go through each primitive defined as a constraint!
 				pCurBc = pEnv->GetBC(j);
-				char ThisDofFixed = pCurBc->DofFixed;
-				if (pCurBc->GetRegion()->IsTouching(&ThisPos, &BCsize, &WSSize)){ //if this point is within
-					CurVox.FixDof(ThisDofFixed);
-					CurVox.AddExternalForce(pCurBc->Force/Sizes[j]);
-					CurVox.AddExternalTorque(pCurBc->Torque/Sizes[j]);
-
-					if (IS_FIXED(DOF_X, ThisDofFixed)) CurVox.SetExternalDisp(AXIS_X, pCurBc->Displace.x);
-					if (IS_FIXED(DOF_Y, ThisDofFixed)) CurVox.SetExternalDisp(AXIS_Y, pCurBc->Displace.y);
-					if (IS_FIXED(DOF_Z, ThisDofFixed)) CurVox.SetExternalDisp(AXIS_Z, pCurBc->Displace.z);
-					if (IS_FIXED(DOF_TX, ThisDofFixed)) CurVox.SetExternalTDisp(AXIS_X, pCurBc->AngDisplace.x);
-					if (IS_FIXED(DOF_TY, ThisDofFixed)) CurVox.SetExternalTDisp(AXIS_Y, pCurBc->AngDisplace.y);
-					if (IS_FIXED(DOF_TZ, ThisDofFixed)) CurVox.SetExternalTDisp(AXIS_Z, pCurBc->AngDisplace.z);
-
-//					CurVox.SetExternalDisp(pCurBc->Displace);
-//					CurVox.SetExternalTDisp(pCurBc->AngDisplace);
-				}
+				if (pCurBc->GetRegion()->IsTouching(&ThisPos, &BCsize, &WSSize)) ApplyBC(&CurVox, pCurBc, Sizes[j]); //if this point is within
 			}
+		}
 
-			// nac: phase offset
-			// CurVox.thisPhaseOffset = pEnv->pObj->
+		// nac: phase offset
+		// CurVox.thisPhaseOffset = pEnv->pObj->
 
-			// CurVox.TempAmplitude = pEnv->GetTempAmplitude();
-			// CurVox.TempPeriod = pEnv->GetTempPeriod();
-			// CurVox.phaseOffset = pEnv->pObj->GetPhaseOffset(i);
+		// CurVox.TempAmplitude = pEnv->GetTempAmplitude();
+		// CurVox.TempPeriod = pEnv->GetTempPeriod();
+		// CurVox.phaseOffset = pEnv->pObj->GetPhaseOffset(i);
 
-			// std::cout << "Importing voxel: " << i << ", phase offset: " << CurVox.phaseOffset << std::endl;
-			// std::cout << "Importing voxel: " << i << ", temp amp: " << CurVox.TempAmplitude << std::endl;
-			// std::cout << "Importing voxel: " << i << ", temp per: " << CurVox.TempPeriod << std::endl;
+		// std::cout << "Importing voxel: " << i << ", phase offset: " << CurVox.phaseOffset << std::endl;
+		// std::cout << "Importing voxel: " << i << ", temp amp: " << CurVox.TempAmplitude << std::endl;
+		// std::cout << "Importing voxel: " << i << ", temp per: " << CurVox.TempPeriod << std::endl;
 
 //			if(BlendingEnabled) CurVox.CalcMyBlendMix(); //needs to be done basically last. Todo next: move to constructor and ditch blendmix and even p_sim from voxel?
-			try{VoxArray.push_back(CurVox);}
-			catch (std::bad_alloc&){if (RetMessage) *RetMessage += "Insufficient memory. Reduce model size.\n"; return false;} //catch if we run out of memory
 
-			SIndexIt++;
-		}
+		SIndexIt++;
 	}
 
 
@@ -567,28 +661,51 @@ bool CVX_Sim::Import(CVX_Environment* pEnvIn, CMesh* pSurfMeshIn, std::string* R
 //	TmpVox.LinkToVXSim(this);
 //	VoxArray.push_back(TmpVox);
 
+	if (!CellBlock.empty()) StoXIndexMap.resize(SIndexIt);
+
+	//boundary conditions of the lattice voxels, applied in the same order as the conditions
+	for (int j = 0; j<NumBCs; j++){
+		pCurBc = pEnv->GetBC(j);
+		for (int k=0; k<(int)BCVoxels[j].size(); k++){
+			int XIndex = BCVoxels[j][k];
+			if (!CellBlock.empty() && CellBlock[XIndex] != 1) continue; //part of a super-voxel
+			ApplyBC(&VoxArray[XtoSIndexMap[XIndex]], pCurBc, Sizes[j]);
+		}
+	}
+	ImportTime[IP_VOXELS] = LapSeconds(&PhaseStart);
+
 	SetVoxData();
+	ImportTime[IP_VOXEL_DATA] = LapSeconds(&PhaseStart);
 
 	//Set up all permanent bonds
 	//Between adjacent voxels in the lattice
 	int ThisX=0, ThisY=0, ThisZ=0, posXInd=0; //index of the nex voxel in positive directions
+	std::vector<int> FaceNeighbors; //voxels already bonded across this face (a super-voxel face touches several lattice voxels)
 	std::string BondFailMsg = "At least one bond creation failed during import.\n";
 	for (int i=0; i<NumVox(); i++){ //for each voxel in our newly-made array look in the +X, +Y and +Z directions to form a bond
 		LocalVXC.GetXYZNom(&ThisX, &ThisY, &ThisZ, StoXIndexMap[i]);
+		int ThisBlock = GetVoxBlockSize(i);
 
 		for (int j=0; j<3; j++){ //for each positive direction in the lattice
-			switch (j){ 
-				case 0: posXInd = LocalVXC.GetIndex(ThisX+1, ThisY, ThisZ); break; //X
-				case 1: posXInd = LocalVXC.GetIndex(ThisX, ThisY+1, ThisZ); break; //Y
-				case 2: posXInd = LocalVXC.GetIndex(ThisX, ThisY, ThisZ+1); break; //Z
-			}
-			if (posXInd != -1 && LocalVXC.Structure[posXInd]){
-				bool BondCreated;
-				try {BondCreated = CreatePermBond(i, XtoSIndexMap[posXInd]);}
-				catch (std::bad_alloc&){if (RetMessage) *RetMessage += "Insufficient memory. Reduce model size.\n"; return false;} //catch if we run out of memory
+			FaceNeighbors.clear();
+			for (int a=0; a<ThisBlock; a++) for (int b=0; b<ThisBlock; b++){ //each lattice voxel across this face
+				switch (j){ 
+					case 0: posXInd = LocalVXC.GetIndex(ThisX+ThisBlock, ThisY+a, ThisZ+b); break; //X
+					case 1: posXInd = LocalVXC.GetIndex(ThisX+a, ThisY+ThisBlock, ThisZ+b); break; //Y
+					case 2: posXInd = LocalVXC.GetIndex(ThisX+a, ThisY+b, ThisZ+ThisBlock); break; //Z
+				}
+				if (posXInd != -1 && LocalVXC.Structure[posXInd]){
+					int PosSIndex = XtoSIndexMap[posXInd];
+					if (std::find(FaceNeighbors.begin(), FaceNeighbors.end(), PosSIndex) != FaceNeighbors.end()) continue;
+					FaceNeighbors.push_back(PosSIndex);
 
-				if(!BondCreated && RetMessage) *RetMessage += BondFailMsg; //warning if it wasn't a memory throw
-		
+					bool BondCreated;
+					try {BondCreated = CreatePermBond(i, PosSIndex);}
+					catch (std::bad_alloc&){if (RetMessage) *RetMessage += "Insufficient memory. Reduce model size.\n"; return false;} //catch if we run out of memory
+
+					if(!BondCreated && RetMessage) *RetMessage += BondFailMsg; //warning if it wasn't a memory throw
+			
+				}
 			}
 		}
 	}
@@ -597,6 +714,7 @@ bool CVX_Sim::Import(CVX_Environment* pEnvIn, CMesh* pSurfMeshIn, std::string* R
 //	CreateBond(B_INPUT_LINEAR_NOROT, InputVoxSInd, InputVoxSInd, true, &InputBondInd, false); //create input bond, but initialize it to meaningless connection to self
 
 	UpdateAllBondPointers(); //necessary since we probably reallocated the bond array when adding pbonds the first time
+	ImportTime[IP_BONDS] = LapSeconds(&PhaseStart);
 
 	//Set up our surface list...
 	for (int i=0; i<NumVox(); i++){ //for each voxel in our newly-made array
@@ -606,11 +724,14 @@ bool CVX_Sim::Import(CVX_Environment* pEnvIn, CMesh* pSurfMeshIn, std::string* R
 			catch (std::bad_alloc&){if (RetMessage) *RetMessage += "Insufficient memory. Reduce model size.\n"; return false;} //catch if we run out of memory
 
 		}
-
-		//todo: only do for those on surfaces, I think.
-		VoxArray[i].CalcNearby(this, (int)(CollisionHorizon*1.5)); //populate the nearby array
 	}
 
+	//todo: only do for those on surfaces, I think.
+	ImportParallel(&CVX_Sim::CalcNearbyRange); //populate the nearby arrays
+	ImportTime[IP_NEARBY] = LapSeconds(&PhaseStart);
+
+	CalcBodies();
+
 	if (pSurfMeshIn){
 		if (!ImportSurfMesh) ImportSurfMesh = new CMesh;
 		*ImportSurfMesh = *pSurfMeshIn;
@@ -649,17 +770,96 @@ bool CVX_Sim::Import(CVX_Environment* pEnvIn, CMesh* pSurfMeshIn, std::string* R
 	// }
 
 
+	ImportTime[IP_BODIES] = LapSeconds(&PhaseStart);
+
+//	EnablePlasticity(HasPlasticMaterial); //turn off plasticity if we don't need it...
+	FinishImport(HasPlasticMaterial, RetMessage);
+	ImportTime[IP_FINISH] = LapSeconds(&PhaseStart);
+
+	if (RetMessage){
+		std::ostringstream os;
+		os << "Import time (s):";
+		for (int i=0; i<IP_NUM_PHASES; i++) os << " " << ImportPhaseName((ImportPhase)i) << " " << ImportTime[i];
+		os << "\n";
+		*RetMessage += os.str();
+	}
+
+	return true;
+}
+
+/*! The voxel and bond arrays of pTemplate are copied and relinked to this simulation instead of being rebuilt, so pTemplate must stay valid until this returns.
+Only used if everything baked into the voxels and bonds at import (see WriteStructureKey()) is identical. Otherwise this falls back to a normal Import().
+Per-voxel parameters (phase offsets, controller weights, etc.) are taken from this simulation's own environment.
+@param[in] pTemplate An imported simulation of the same structure.
+@param[in] pEnvIn The environment to simulate.
+@param[out] RetMessage Pointer to an initialized string. Messages generated in this function will be appended to the string.
+*/
+bool CVX_Sim::ImportShared(CVX_Sim* pTemplate, CVX_Environment* pEnvIn, std::string* RetMessage)
+{
+	if (pEnvIn != NULL) pEnv = pEnvIn;
+	if (pEnv == NULL) {if (RetMessage) *RetMessage += "Invalid Environment pointer"; return false;}
+	if (!pTemplate || !pTemplate->IsInitalized()) return Import(pEnv, NULL, RetMessage);
+
+	std::ostringstream ThisKey, TemplateKey;
+	WriteStructureKey(ThisKey);
+	pTemplate->WriteStructureKey(TemplateKey);
+	if (ThisKey.str() != TemplateKey.str()) return Import(pEnv, NULL, RetMessage);
+
+	std::chrono::steady_clock::time_point PhaseStart = std::chrono::steady_clock::now();
+	for (int i=0; i<IP_NUM_PHASES; i++) ImportTime[i] = 0;
+	ClearAll();
+	ImportEnvironmentSettings();
+	LocalVXC = *pEnv->pObj;
+	LocalVXC.CacheLeafMats();
+
+	VoxArray = pTemplate->VoxArray;
+	BondArrayInternal = pTemplate->BondArrayInternal;
+	XtoSIndexMap = pTemplate->XtoSIndexMap;
+	StoXIndexMap = pTemplate->StoXIndexMap;
+	SurfVoxels = pTemplate->SurfVoxels;
+	BodyIndex = pTemplate->BodyIndex;
+	BodyNumVox = pTemplate->BodyNumVox;
+	BodySurfVoxels = pTemplate->BodySurfVoxels;
+	VoxBlockSize = pTemplate->VoxBlockSize;
+	VoxDataIndex = pTemplate->VoxDataIndex;
+
+	for (std::vector<CVXS_Voxel>::iterator it = VoxArray.begin(); it != VoxArray.end(); it++) it->LinkToSim(this);
+	for (std::vector<CVXS_BondInternal>::iterator it = BondArrayInternal.begin(); it != BondArrayInternal.end(); it++) it->LinkToSim(this);
+	if (!UpdateAllVoxPointers()){if (RetMessage) *RetMessage += "Could not link shared bonds.\n"; return false;}
+	UpdateAllBondPointers();
+
+	ImportTime[IP_COPY] = LapSeconds(&PhaseStart); //everything else was done for the template
+
+	FinishImport(pTemplate->IsFeatureEnabled(VXSFEAT_PLASTICITY), RetMessage);
+	ImportTime[IP_FINISH] = LapSeconds(&PhaseStart);
+	return true;
+}
+
+void CVX_Sim::ImportEnvironmentSettings(void)
+{
+	fluidEnvironment = pEnv->GetFluidEnvironment();
+	aggregateDragCoefficient = pEnv->GetAggregateDragCoefficient(); 
+
+
+	//get in sync with environment options
+	EnableFeature(VXSFEAT_GRAVITY, pEnv->IsGravityEnabled());
+	EnableFeature(VXSFEAT_FLOOR, pEnv->IsFloorEnabled());
+	EnableFeature(VXSFEAT_TEMPERATURE, pEnv->IsTempEnabled());
+	EnableFeature(VXSFEAT_TEMPERATURE_VARY, pEnv->IsTempVaryEnabled());
+}
+
+void CVX_Sim::FinishImport(bool HasPlasticMaterial, std::string* RetMessage)
+{
 	ResetSimulation();
 	OptimalDt = CalcMaxDt(); //to set up dialogs parameter ranges, we need this before the first iteration.
 	EnableFeature(VXSFEAT_PLASTICITY, HasPlasticMaterial);
-//	EnablePlasticity(HasPlasticMaterial); //turn off plasticity if we don't need it...
 
 	Initalized = true;
 //	std::string tmpString;
 
 	std::ostringstream os;
 	os << "Completed Simulation Import: " << NumVox() << " Voxels, " << NumBond() << "Bonds.\n";
-	*RetMessage += os.str();
+	if (RetMessage) *RetMessage += os.str();
 
 	// nac: for island ring model
 	// std::cout << "GetVXDim:" << LocalVXC.GetVXDim() << std::endl;
@@ -677,9 +877,155 @@ bool CVX_Sim::Import(CVX_Environment* pEnvIn, CMesh* pSurfMeshIn, std::string* R
 		// std::cout << "pEnv->pObj->GetLatticeDim(): " << pEnv->pObj->GetLatticeDim() << std::endl;
 		//aggregateDragCoefficient = 750.0; // 
 	}
+}
 
+const char* CVX_Sim::ImportPhaseName(ImportPhase Phase)
+{
+	switch (Phase){
+	case IP_COPY: return "Copy";
+	case IP_BOUNDARY: return "Boundary";
+	case IP_VOXELS: return "Voxels";
+	case IP_VOXEL_DATA: return "VoxelData";
+	case IP_BONDS: return "Bonds";
+	case IP_NEARBY: return "Nearby";
+	case IP_BODIES: return "Bodies";
+	case IP_FINISH: return "Finish";
+	default: return "";
+	}
+}
 
-	return true;
+void CVX_Sim::RasterizeBCs(std::vector<std::vector<int> >* pBCVoxels, std::vector<int>* pSizes)
+{
+	int NumBCs = pEnv->GetNumBCs();
+	pBCVoxels->assign(NumBCs, std::vector<int>());
+	pSizes->assign(NumBCs, 0);
+
+	//each region is only ever tested by one thread (mesh regions cache their last slice)
+	if (NumBCs > 1 && LocalVXC.GetNumVox() >= IMPORT_PARALLEL_MIN){
+		std::vector<std::thread> Threads;
+		for (int j=0; j<NumBCs; j++) Threads.push_back(std::thread(&CVX_Sim::RasterizeBC, this, j, &(*pBCVoxels)[j], &(*pSizes)[j]));
+		for (int j=0; j<NumBCs; j++) Threads[j].join();
+	}
+	else for (int j=0; j<NumBCs; j++) RasterizeBC(j, &(*pBCVoxels)[j], &(*pSizes)[j]);
+}
+
+void CVX_Sim::RasterizeBC(int BCIndex, std::vector<int>* pTouching, int* pNumTouching)
+{
+	CPrimitive* pRegion = pEnv->GetBC(BCIndex)->GetRegion();
+	Vec3D<> BCsize = pEnv->pObj->GetLatDimEnv()/2.0;
+	Vec3D<> WSSize = pEnv->pObj->GetWorkSpace();
+	Vec3D<> Pos, OffPos;
+
+	pTouching->clear();
+	*pNumTouching = 0;
+	for (int i=LocalVXC.Structure.GetNextVoxel(0); i!=-1; i=LocalVXC.Structure.GetNextVoxel(i+1)){
+		LocalVXC.GetXYZ(&Pos, i, false);
+		bool Touching = pRegion->IsTouching(&Pos, &BCsize, &WSSize);
+		if (Touching) pTouching->push_back(i);
+
+		LocalVXC.GetXYZ(&OffPos, i); //the count (as in CVX_Environment::GetNumTouching()) uses the positions with line and layer offsets
+		if (OffPos == Pos ? Touching : pRegion->IsTouching(&OffPos, &BCsize, &WSSize)) (*pNumTouching)++;
+	}
+}
+
+void CVX_Sim::ImportParallel(void (CVX_Sim::*pRangeFunc)(int, int))
+{
+	int NumThreads = 1;
+	if (NumVox() >= IMPORT_PARALLEL_MIN){
+		NumThreads = (int)std::thread::hardware_concurrency();
+		if (NumThreads > 8) NumThreads = 8;
+		if (NumThreads < 1) NumThreads = 1;
+	}
+	if (NumThreads == 1){(this->*pRangeFunc)(0, NumVox()); return;}
+
+	std::vector<std::thread> Threads;
+	for (int t=0; t<NumThreads; t++) Threads.push_back(std::thread(pRangeFunc, this, NumVox()*t/NumThreads, NumVox()*(t+1)/NumThreads));
+	for (int t=0; t<NumThreads; t++) Threads[t].join();
+}
+
+void CVX_Sim::CalcNearbyRange(int First, int Last)
+{
+	std::vector<int> Found(NumVox(), -1); //scratch for CalcNearby() (holds the index of the voxel it was last found for)
+	int NumHops = (int)(CollisionHorizon*1.5);
+	for (int i=First; i<Last; i++) VoxArray[i].CalcNearby(this, NumHops, &Found);
+}
+
+void CVX_Sim::GetCoarseVoxelData(int DataIndex, std::vector<double>* pData)
+{
+	CVX_Object* pObj = pEnv->pObj;
+	pData->clear();
+	if (pObj->GetEvolvingStiffness()) pData->push_back(pObj->GetStiffness(DataIndex));
+	if (pObj->GetUsingStressAdaptationRate()) pData->push_back(pObj->GetStressAdaptationRate(DataIndex));
+	if (pObj->GetUsingPressureAdaptationRate()) pData->push_back(pObj->GetPressureAdaptationRate(DataIndex));
+	if (pObj->GetUsingInitialVoxelSize()) pData->push_back(pObj->GetInitialVoxelSize(DataIndex));
+	if (pObj->GetUsingFinalVoxelSize()) pData->push_back(pObj->GetFinalVoxelSize(DataIndex));
+}
+
+bool CVX_Sim::IsCoarseCandidate(int XIndex, const std::vector<int>& CellBlock, const std::vector<bool>& BCTouched)
+{
+	if (LocalVXC.Structure[XIndex] == 0 || CellBlock[XIndex] != 1) return false; //empty or already merged
+
+	CVXC_Material* pMat = LocalVXC.GetLeafMat(XIndex);
+	if (pMat->GetCTE() != 0) return false; //actuated
+
+	//interior: all six neighbors present
+	int X, Y, Z;
+	LocalVXC.GetXYZNom(&X, &Y, &Z, XIndex);
+	int Neighbors[6] = {LocalVXC.GetIndex(X+1, Y, Z), LocalVXC.GetIndex(X-1, Y, Z), LocalVXC.GetIndex(X, Y+1, Z), LocalVXC.GetIndex(X, Y-1, Z), LocalVXC.GetIndex(X, Y, Z+1), LocalVXC.GetIndex(X, Y, Z-1)};
+	for (int i=0; i<6; i++) if (Neighbors[i] == -1 || LocalVXC.Structure[Neighbors[i]] == 0) return false;
+
+	return !BCTouched[XIndex]; //not touched by any boundary condition
+}
+
+void CVX_Sim::FindCoarseBlocks(std::vector<int>* pCellBlock, const std::vector<bool>& BCTouched)
+{
+	pCellBlock->clear();
+
+	//anything that gives each voxel its own behavior (controllers, sensors) or a non-cubic lattice rules coarsening out
+	if (pEnv->GetControllerUpdatesPerTempCycle() > 0 || pEnv->GetForwardModelUpdatesPerTempCycle() > 0 || pEnv->GetRegenerationModelUpdatesPerTempCycle() > 0) return;
+	if (LocalVXC.Lattice.GetXLiO() != 0 || LocalVXC.Lattice.GetYLiO() != 0 || LocalVXC.Lattice.GetXLaO() != 0 || LocalVXC.Lattice.GetYLaO() != 0) return;
+	if (LocalVXC.Lattice.GetXDimAdj() != 1 || LocalVXC.Lattice.GetYDimAdj() != 1 || LocalVXC.Lattice.GetZDimAdj() != 1) return;
+
+	int ArraySize = LocalVXC.GetStArraySize();
+	std::vector<int> DataIndex(ArraySize, -1);
+	for (int i=0, d=0; i<ArraySize; i++) if (LocalVXC.Structure[i] != 0) DataIndex[i] = d++;
+
+	pCellBlock->assign(ArraySize, 1);
+	int nX = LocalVXC.GetVXDim(), nY = LocalVXC.GetVYDim(), nZ = LocalVXC.GetVZDim();
+	std::vector<double> FirstData, ThisData;
+	for (int Block = CoarseMaxBlock; Block >= 2; Block /= 2){ //largest blocks first, then fill in with smaller ones
+		for (int z=0; z+Block<=nZ; z+=Block) for (int y=0; y+Block<=nY; y+=Block) for (int x=0; x+Block<=nX; x+=Block){
+			int First = LocalVXC.GetIndex(x, y, z);
+			if (!IsCoarseCandidate(First, *pCellBlock, BCTouched)) continue;
+			int FirstMat = LocalVXC.GetLeafMatIndex(First);
+			GetCoarseVoxelData(DataIndex[First], &FirstData);
+
+			bool Homogeneous = true;
+			for (int k=z; k<z+Block && Homogeneous; k++) for (int j=y; j<y+Block && Homogeneous; j++) for (int i=x; i<x+Block && Homogeneous; i++){
+				int ThisIndex = LocalVXC.GetIndex(i, j, k);
+				if (ThisIndex == First) continue;
+				if (!IsCoarseCandidate(ThisIndex, *pCellBlock, BCTouched) || LocalVXC.GetLeafMatIndex(ThisIndex) != FirstMat){Homogeneous = false; break;}
+				GetCoarseVoxelData(DataIndex[ThisIndex], &ThisData);
+				if (ThisData != FirstData) Homogeneous = false;
+			}
+			if (!Homogeneous) continue;
+
+			for (int k=z; k<z+Block; k++) for (int j=y; j<y+Block; j++) for (int i=x; i<x+Block; i++) (*pCellBlock)[LocalVXC.GetIndex(i, j, k)] = 0;
+			(*pCellBlock)[First] = Block;
+		}
+	}
+}
+
+Vec3D<> CVX_Sim::GetCellPos(int XIndex)
+{
+	int SIndex = XtoSIndexMap[XIndex];
+	if (SIndex < 0) return Vec3D<>(0,0,0);
+	CVXS_Voxel& Owner = VoxArray[SIndex];
+	if (GetVoxBlockSize(SIndex) == 1) return Owner.GetCurPos();
+
+	Vec3D<> CellPos;
+	LocalVXC.GetXYZ(&CellPos, XIndex, false);
+	return Owner.GetCurPos() + Owner.GetCurAngle().RotateVec3D(CellPos - Owner.GetNominalPosition()); //rigidly attached to its super-voxel
 }
 
 /*! This bond is appended to the master bond array (BondArrayInternal). 
@@ -805,14 +1151,21 @@ int CVX_Sim::CreateColBond(int SIndex1In, int SIndex2In) //!< Creates a new coll
 void CVX_Sim::SetVoxData(void)
 {
 	//std::cout << "[VX_Sim.cpp] debugmsg : SetVoxData" << std::endl;
-	for (int i=0; i<NumVox(); i++) 
+	if (NumBond() > 0 || NumColBond() > 0) SetVoxDataRange(0, NumVox()); //SetEMod() relinks each voxel's bonds, which its neighbors share: one thread, as threads would race on bonds between their ranges
+	else ImportParallel(&CVX_Sim::SetVoxDataRange); //no bonds yet (first pass of Import()): each voxel only reads the object and writes itself
+}
+
+void CVX_Sim::SetVoxDataRange(int First, int Last)
+{
+	for (int i=First; i<Last; i++) 
 	{
+		int d = GetVoxDataIndex(i); //per-voxel object data (differs from i if voxels were coarsened)
 		VoxArray[i].TempAmplitude = pEnv->GetTempAmplitude();
 		VoxArray[i].TempPeriod = pEnv->GetTempPeriod();
 
-		VoxArray[i].phaseOffset = ( pEnv->pObj->GetUsingPhaseOffset() ) ? pEnv->pObj->GetPhaseOffset(i) : 0.0 ;
+		VoxArray[i].phaseOffset = ( pEnv->pObj->GetUsingPhaseOffset() ) ? pEnv->pObj->GetPhaseOffset(d) : 0.0 ;
 
-		VoxArray[i].evolvedStiffness = ( pEnv->pObj->GetEvolvingStiffness() ) ? pEnv->pObj->GetStiffness(i) : VoxArray[i].GetEMod() ;
+		VoxArray[i].evolvedStiffness = ( pEnv->pObj->GetEvolvingStiffness() ) ? pEnv->pObj->GetStiffness(d) : VoxArray[i].GetEMod() ;
 		VoxArray[i].SetEMod(VoxArray[i].evolvedStiffness);
 
 		//std::cout << "[VX_Sim.cpp] DEBUGMSG - OVERRIDING STIFFNESS " << VoxArray[i].GetEMod() << std::endl;
@@ -821,13 +1174,13 @@ void CVX_Sim::SetVoxData(void)
 		VoxArray[i].maxElasticMod = pEnv->pObj->GetMaxElasticMod();
 		VoxArray[i].maxStiffnessVariation = pEnv->pObj->GetMaxStiffnessVariation();
 
-		VoxArray[i].stressAdaptationRate = ( pEnv->pObj->GetUsingStressAdaptationRate() ) ? pEnv->pObj->GetStressAdaptationRate(i) : 0.0; 
-		VoxArray[i].pressureAdaptationRate = ( pEnv->pObj->GetUsingPressureAdaptationRate() ) ? pEnv->pObj->GetPressureAdaptationRate(i) : 0.0; 
+		VoxArray[i].stressAdaptationRate = ( pEnv->pObj->GetUsingStressAdaptationRate() ) ? pEnv->pObj->GetStressAdaptationRate(d) : 0.0; 
+		VoxArray[i].pressureAdaptationRate = ( pEnv->pObj->GetUsingPressureAdaptationRate() ) ? pEnv->pObj->GetPressureAdaptationRate(d) : 0.0; 
 
 	    // Initial Scale
 		if(pEnv->pObj->GetUsingInitialVoxelSize())
 		{
-			double initialTempFactFromVxa = 1 + (pEnv->getGrowthAmplitude()*pEnv->pObj->GetInitialVoxelSize(i)); // tempfact
+			double initialTempFactFromVxa = 1 + (pEnv->getGrowthAmplitude()*pEnv->pObj->GetInitialVoxelSize(d)); // tempfact
 		    double effectiveInitialTempFact = (initialTempFactFromVxa < getMinTempFact()) ? getMinTempFact() : initialTempFactFromVxa;
 		    double initialVoxelSize = effectiveInitialTempFact * VoxArray[i].GetNominalSize();	// size
 
@@ -843,7 +1196,7 @@ void CVX_Sim::SetVoxData(void)
         // Final Scale
         if(pEnv->pObj->GetUsingFinalVoxelSize())
         {
-            double finalTempFactFromVxa = 1 + (pEnv->getGrowthAmplitude()*pEnv->pObj->GetFinalVoxelSize(i)); // tempfact
+            double finalTempFactFromVxa = 1 + (pEnv->getGrowthAmplitude()*pEnv->pObj->GetFinalVoxelSize(d)); // tempfact
 		    double effectiveFinalTempFact = (finalTempFactFromVxa < getMinTempFact()) ? getMinTempFact() : finalTempFactFromVxa;
 		    double finalVoxelSize = effectiveFinalTempFact * VoxArray[i].GetNominalSize();	// size
 
@@ -858,7 +1211,7 @@ void CVX_Sim::SetVoxData(void)
         // Vestibular Contribution
         if(pEnv->pObj->GetUsingVestibularContribution())
         {
-			VoxArray[i].VestibularContribution = pEnv->pObj->GetVestibularContribution(i);
+			VoxArray[i].VestibularContribution = pEnv->pObj->GetVestibularContribution(d);
         }
         else
         {
@@ -868,7 +1221,7 @@ void CVX_Sim::SetVoxData(void)
         // Pre-damage Roll
         if(pEnv->pObj->GetUsingPreDamageRoll())
         {
-			VoxArray[i].PreDamageRoll = pEnv->pObj->GetPreDamageRoll(i);
+			VoxArray[i].PreDamageRoll = pEnv->pObj->GetPreDamageRoll(d);
         }
         else
         {
@@ -878,7 +1231,7 @@ void CVX_Sim::SetVoxData(void)
         // Pre-damage Pitch
         if(pEnv->pObj->GetUsingPreDamagePitch())
         {
-			VoxArray[i].PreDamagePitch = pEnv->pObj->GetPreDamagePitch(i);
+			VoxArray[i].PreDamagePitch = pEnv->pObj->GetPreDamagePitch(d);
         }
         else
         {
@@ -888,7 +1241,7 @@ void CVX_Sim::SetVoxData(void)
         // Pre-damage Yaw
         if(pEnv->pObj->GetUsingPreDamageYaw())
         {
-			VoxArray[i].PreDamageYaw = pEnv->pObj->GetPreDamageYaw(i);
+			VoxArray[i].PreDamageYaw = pEnv->pObj->GetPreDamageYaw(d);
         }
         else
         {
@@ -898,7 +1251,7 @@ void CVX_Sim::SetVoxData(void)
         // Stress Contribution
         if(pEnv->pObj->GetUsingStressContribution())
         {
-			VoxArray[i].StressContribution = pEnv->pObj->GetStressContribution(i);
+			VoxArray[i].StressContribution = pEnv->pObj->GetStressContribution(d);
         }
         else
         {
@@ -908,7 +1261,7 @@ void CVX_Sim::SetVoxData(void)
         // Pre-damage Stress
         if(pEnv->pObj->GetUsingPreDamageStress())
         {
-			VoxArray[i].PreDamageStress = pEnv->pObj->GetPreDamageStress(i);
+			VoxArray[i].PreDamageStress = pEnv->pObj->GetPreDamageStress(d);
         }
         else
         {
@@ -918,7 +1271,7 @@ void CVX_Sim::SetVoxData(void)
         // Pressure Contribution
         if(pEnv->pObj->GetUsingPressureContribution())
         {
-			VoxArray[i].PressureContribution = pEnv->pObj->GetPressureContribution(i);
+			VoxArray[i].PressureContribution = pEnv->pObj->GetPressureContribution(d);
         }
         else
         {
@@ -928,7 +1281,7 @@ void CVX_Sim::SetVoxData(void)
         // Pre-damage Pressure
         if(pEnv->pObj->GetUsingPreDamagePressure())
         {
-			VoxArray[i].PreDamagePressure = pEnv->pObj->GetPreDamagePressure(i);
+			VoxArray[i].PreDamagePressure = pEnv->pObj->GetPreDamagePressure(d);
         }
         else
         {
@@ -938,7 +1291,7 @@ void CVX_Sim::SetVoxData(void)
         // TODO: arbitrary architectures
 
         // forward model (10 neurons max)
-		VoxArray[i].VoxNum = i;
+		VoxArray[i].VoxNum = d;
 		VoxArray[i].oldForwardModelError = 0.0;
 		VoxArray[i].currentForwardModelError = 0.0;
 		VoxArray[i].ForwardModelNeuronValues.clear();
@@ -979,6 +1332,12 @@ void CVX_Sim::ResetSimulation(void)
 	CurStepCount = 0;
 	CmInitialized = false;
 
+	AbortReason = EA_NONE;
+	AbortTime = AbortPeakSpeed = 0;
+	AbortWindowStart = -1;
+	AbortWindows = 0;
+	NextAbortCheckpoint = 0;
+
 	fitPhase1 = -99999;
 	fitPhase2 = -99999;
 	avgStiffChange1 = -99999;
@@ -994,10 +1353,175 @@ void CVX_Sim::ResetSimulation(void)
 	MinPressureSoFar = -1e6;
 
 	ClearHistories();
+	ResetStepProfile();
 
 	SS.Clear();
 }
 
+#ifdef VX_PROFILE
+//!Adds the wall clock time until it goes out of scope to a step timer, and counts the call
+class CVX_StepTimer
+{
+public:
+	CVX_StepTimer(double* pSecondsIn, long long* pCallsIn) {pSeconds = pSecondsIn; (*pCallsIn)++; Start = std::chrono::steady_clock::now();}
+	~CVX_StepTimer(void) {*pSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();}
+
+private:
+	double* pSeconds;
+	std::chrono::steady_clock::time_point Start;
+};
+
+#define PROFILE_STEP() CVX_StepTimer StepTimer(&ProfiledStepTime, &ProfiledSteps)
+#define PROFILE_PHASE(Phase) CVX_StepTimer PhaseTimer_##Phase(&StepTime[Phase], &StepCalls[Phase]) //times the rest of the enclosing scope
+#define PROFILE_ITEMS(Phase, Num) (StepItems[Phase] += (Num))
+#else
+#define PROFILE_STEP()
+#define PROFILE_PHASE(Phase)
+#define PROFILE_ITEMS(Phase, Num)
+#endif
+
+bool CVX_Sim::IsStepProfileCompiled(void)
+{
+#ifdef VX_PROFILE
+	return true;
+#else
+	return false;
+#endif
+}
+
+void CVX_Sim::ResetStepProfile(void)
+{
+	for (int i=0; i<SP_NUM_PHASES; i++){StepTime[i] = 0; StepCalls[i] = 0; StepItems[i] = 0;}
+	ProfiledSteps = 0;
+	ProfiledStepTime = 0;
+	VoxWork.assign(WorkCountersEnabled ? NumVox()*WC_NUM_COUNTERS : 0, 0);
+}
+
+const char* CVX_Sim::StepPhaseName(StepPhase Phase)
+{
+	switch (Phase){
+	case SP_COLLISIONS: return "Collisions";
+	case SP_MAT_TEMPS: return "MatTemps";
+	case SP_BONDS: return "Bonds";
+	case SP_COLLISION_BONDS: return "CollisionBonds";
+	case SP_MAX_DT: return "MaxDt";
+	case SP_TILT: return "Tilt";
+	case SP_CONTROLLER: return "Controller";
+	case SP_FORWARD_MODEL: return "ForwardModel";
+	case SP_REGENERATION: return "Regeneration";
+	case SP_SIGNALING: return "Signaling";
+	case SP_OCCLUSION: return "Occlusion";
+	case SP_DRAG: return "Drag";
+	case SP_EULER_STEP: return "EulerStep";
+	case SP_STATS: return "Stats";
+	default: return "";
+	}
+}
+
+void CVX_Sim::GetStepProfile(std::string* RetMessage)
+{
+	if (!RetMessage) return;
+
+	std::ostringstream os;
+	os << "Step profile: " << ProfiledSteps << " steps, " << ProfiledStepTime << " s";
+	if (ProfiledSteps > 0) os << " (" << 1e6*ProfiledStepTime/ProfiledSteps << " us/step)";
+	os << "\n";
+
+	double Attributed = 0;
+	for (int i=0; i<SP_NUM_PHASES; i++){
+		if (StepCalls[i] == 0) continue;
+		Attributed += StepTime[i];
+		os << "  " << StepPhaseName((StepPhase)i) << ": " << StepTime[i] << " s";
+		if (ProfiledStepTime > 0) os << " (" << 100*StepTime[i]/ProfiledStepTime << "%)";
+		os << ", " << StepCalls[i] << " calls";
+		if (StepItems[i] > 0) os << ", " << StepItems[i] << " items (" << 1e9*StepTime[i]/StepItems[i] << " ns/item)";
+		os << "\n";
+	}
+	if (ProfiledSteps > 0) os << "  Other: " << ProfiledStepTime - Attributed << " s\n";
+	*RetMessage += os.str();
+}
+
+void CVX_Sim::EnableWorkCounters(bool Enabled)
+{
+	WorkCountersEnabled = Enabled;
+	VoxWork.assign(WorkCountersEnabled ? NumVox()*WC_NUM_COUNTERS : 0, 0);
+}
+
+const char* CVX_Sim::WorkCounterName(WorkCounter Counter)
+{
+	switch (Counter){
+	case WC_BOND_RELINKS: return "BondRelinks";
+	case WC_COLLISION_TESTS: return "CollisionTests";
+	case WC_NEURON_EVALS: return "NeuronEvals";
+	case WC_SIN_CALLS: return "SinCalls";
+	case WC_REGEN_UPDATES: return "RegenUpdates";
+	case WC_GROWTH_STEPS: return "GrowthSteps";
+	default: return "";
+	}
+}
+
+void CVX_Sim::GetMaterialWork(std::vector<long long>* pWork, std::vector<int>* pNumVox)
+{
+	int NumMats = LocalVXC.GetNumMaterials();
+	pWork->assign(NumMats*WC_NUM_COUNTERS, 0);
+	pNumVox->assign(NumMats, 0);
+	for (int i=0; i<NumVox(); i++){
+		int ThisMat = VoxArray[i].GetMaterialIndex();
+		if (ThisMat < 0 || ThisMat >= NumMats) continue;
+		(*pNumVox)[ThisMat]++;
+		for (int c=0; c<WC_NUM_COUNTERS; c++) (*pWork)[ThisMat*WC_NUM_COUNTERS + c] += GetVoxWork(i, (WorkCounter)c);
+	}
+}
+
+void CVX_Sim::GetWorkHistogram(std::string* RetMessage)
+{
+	if (!RetMessage || VoxWork.empty()) return;
+
+	std::vector<long long> MatWork;
+	std::vector<int> MatNumVox;
+	GetMaterialWork(&MatWork, &MatNumVox);
+
+	std::ostringstream os;
+	os << "Work per material (total, per voxel):\n";
+	for (int m=0; m<(int)MatNumVox.size(); m++){
+		if (MatNumVox[m] == 0) continue;
+		os << "  " << m << " " << LocalVXC.GetBaseMat(m)->GetName() << ": " << MatNumVox[m] << " voxels";
+		for (int c=0; c<WC_NUM_COUNTERS; c++){
+			long long Total = MatWork[m*WC_NUM_COUNTERS + c];
+			if (Total > 0) os << ", " << WorkCounterName((WorkCounter)c) << " " << Total << " (" << (double)Total/MatNumVox[m] << ")";
+		}
+		os << "\n";
+	}
+
+	//how many voxels did 0, 1, 2-3, 4-7, ... units of each kind of work
+	os << "Work per voxel (number of voxels in each range):\n";
+	for (int c=0; c<WC_NUM_COUNTERS; c++){
+		std::vector<int> Bins;
+		long long Max = 0;
+		int MaxVox = 0;
+		for (int i=0; i<NumVox(); i++){
+			long long ThisWork = GetVoxWork(i, (WorkCounter)c);
+			if (ThisWork > Max){Max = ThisWork; MaxVox = i;}
+			int Bin = 0;
+			while (ThisWork > 0){Bin++; ThisWork >>= 1;}
+			if (Bin >= (int)Bins.size()) Bins.resize(Bin+1, 0);
+			Bins[Bin]++;
+		}
+		if (Max == 0) continue;
+
+		os << "  " << WorkCounterName((WorkCounter)c) << ":";
+		const char* Separator = " ";
+		for (int b=0; b<(int)Bins.size(); b++){
+			if (Bins[b] == 0) continue;
+			if (b == 0) os << Separator << "0: " << Bins[b];
+			else os << Separator << (1LL << (b-1)) << "-" << (1LL << b)-1 << ": " << Bins[b];
+			Separator = ", ";
+		}
+		os << " (max " << Max << " at voxel " << MaxVox << ", material " << VoxArray[MaxVox].GetMaterialIndex() << ")\n";
+	}
+	*RetMessage += os.str();
+}
+
 /*! Given the current state of the simulation (Voxel positions and velocities) and information about the current environment, advances the simulation by the maximum stable timestep. 
 The integration scheme denoted by the CurIntegrator member variable is used.
 Calculates some relevant system statistics such as maximum displacements and velocities and total force.
@@ -1007,9 +1531,17 @@ Returns true if the time step was successful, false otherwise.
 bool CVX_Sim::TimeStep(std::string* pRetMessage)
 {
 	//std::cout << "[CVX_Sim::TimeStep] DEBUGMSG OptimalDt = " << OptimalDt << " dt = " << dt << " Recomputed:" << CalcMaxDt() << std::endl;
+	PROFILE_STEP();
 
 	if ((not CmInitialized) and CurTime > InitCmTime )
 	{
+		if (SettleStorePending){ //first evaluation of this configuration: remember the settled state for the next ones
+			SettleStorePending = false;
+			std::ostringstream State;
+			WriteSettledState(State);
+			SettleCache.Store(SettleKey, State.str());
+		}
+
 		IniCM = SS.CurCM;
 		COMZ = 0;
 		for (int i=0; i<NumVox(); i++) 
@@ -1018,6 +1550,7 @@ bool CVX_Sim::TimeStep(std::string* pRetMessage)
 			// numSamples++;
 		}
 		// std::cout << "height after initialization: " << COMZ << std::endl;
+		if (NumBodies() > 1) GetBodyCMs(&BodyIniCM);
 		CmInitialized = true;
 	}
 
@@ -1039,12 +1572,16 @@ bool CVX_Sim::TimeStep(std::string* pRetMessage)
 	bool EquilibriumEnabled = IsFeatureEnabled(VXSFEAT_EQUILIBRIUM_MODE);
 
 	if(SelfColEnabled){
+		PROFILE_PHASE(SP_COLLISIONS);
 		try {UpdateCollisions();} //update self intersection lists if necessary
 		catch (std::bad_alloc&){if (pRetMessage) *pRetMessage += "Insufficient memory. Reduce model size."; return false;} //catch if we run out of memory
 	}
 	else if (!SelfColEnabled && ColEnableChanged){ColEnableChanged=false; DeleteCollisionBonds();}
 
-	UpdateMatTemps(); //updates the temperatures
+	{
+		PROFILE_PHASE(SP_MAT_TEMPS);
+		UpdateMatTemps(); //updates the temperatures
+	}
 
 	//update information to calculate
 	switch (GetStopConditionType()){ //may need to calculate certain items depending on stop condition
@@ -1062,6 +1599,9 @@ bool CVX_Sim::TimeStep(std::string* pRetMessage)
 	
 	if (EquilibriumEnabled && KineticEDecreasing()){ ZeroAllMotion(); MotionZeroed = true;} 
 	else MotionZeroed = false;
+
+	PROFILE_PHASE(SP_STATS);
+	PROFILE_ITEMS(SP_STATS, NumVox());
 	UpdateStats(pRetMessage);
 	return true;
 }
@@ -1315,6 +1855,8 @@ bool CVX_Sim::StopConditionMet(void) //have we met the stop condition yet?
 		numJump = HISTORY_SIZE/10;
 	}
 
+	if (IsEarlyAbortEnabled() && EarlyAbortConditionMet()) return true;
+
 	switch(StopConditionType){
 		case SC_NONE: return false;
 		case SC_MAX_TIME_STEPS: return (CurStepCount>(int)(StopConditionValue+0.5))?true:false;
@@ -1358,6 +1900,73 @@ bool CVX_Sim::StopConditionMet(void) //have we met the stop condition yet?
 	}
 }
 
+vfloat CVX_Sim::GetStopTime(void)
+{
+	switch(StopConditionType){
+		case SC_MAX_SIM_TIME: return StopConditionValue;
+		case SC_TEMP_CYCLES: return pEnv->GetTempPeriod() > 0 ? pEnv->GetTempPeriod()*StopConditionValue : -1;
+		default: return -1;
+	}
+}
+
+void CVX_Sim::AddAbortCheckpoint(vfloat Time, vfloat MinDisp)
+{
+	std::vector< std::pair<vfloat, vfloat> >::iterator it = AbortCheckpoints.begin();
+	while (it != AbortCheckpoints.end() && it->first <= Time) it++; //keep sorted by time
+	AbortCheckpoints.insert(it, std::make_pair(Time, MinDisp));
+}
+
+/*! Displacement is only measured once the initial center of mass has been taken (after InitCmTime).
+Checkpoints compare the current normalized COM displacement against a fixed minimum. The minimum is supplied by the caller (i.e. a percentile of the displacements of the current population at that time).
+The reachability bound measures the COM speed over consecutive windows of AbortCheckInterval seconds (one actuation cycle by default, so that oscillations in place do not count as speed). Once two windows are complete, the evaluation is aborted if the current displacement plus AbortSpeedFactor times the peak window speed over the remaining time falls short of AbortTargetDisp. If the velocity limit is enabled it caps the assumed speed.
+*/
+bool CVX_Sim::EarlyAbortConditionMet(void)
+{
+	if (AbortReason != EA_NONE) return true;
+	if (!CmInitialized) return false;
+
+	vfloat NormDisp = getNormCOMdisplacement();
+
+	while (NextAbortCheckpoint < NumAbortCheckpoints() && CurTime >= AbortCheckpoints[NextAbortCheckpoint].first){
+		if (NormDisp < AbortCheckpoints[NextAbortCheckpoint].second){
+			AbortReason = EA_CHECKPOINT;
+			AbortTime = CurTime;
+			return true;
+		}
+		NextAbortCheckpoint++;
+	}
+
+	if (AbortTargetDisp <= 0) return false;
+	vfloat StopTime = GetStopTime();
+	vfloat Interval = AbortCheckInterval > 0 ? AbortCheckInterval : pEnv->GetTempPeriod();
+	if (StopTime <= 0 || Interval <= 0) return false; //no meaningful bound
+
+	Vec3D<> NormCM = SS.CurCM/LocalVXC.GetLatticeDim();
+	if (AbortWindowStart < 0){AbortWindowStart = CurTime; AbortWindowCM = NormCM; return false;}
+	if (CurTime - AbortWindowStart < Interval) return false;
+
+	vfloat WindowSpeed = (NormCM - AbortWindowCM).Length()/(CurTime - AbortWindowStart);
+	if (WindowSpeed > AbortPeakSpeed) AbortPeakSpeed = WindowSpeed;
+	AbortWindowStart = CurTime;
+	AbortWindowCM = NormCM;
+	AbortWindows++;
+	if (AbortWindows < 2) return false; //the first cycle is often spent getting going
+
+	vfloat SpeedBound = AbortSpeedFactor*AbortPeakSpeed;
+	if (IsFeatureEnabled(VXSFEAT_MAX_VELOCITY) && dt > 0){
+		vfloat VelLimitSpeed = MaxVoxVelLimit/dt; //no voxel moves more than MaxVoxVelLimit voxel sizes per step
+		if (AbortSpeedFactor <= 0 || VelLimitSpeed < SpeedBound) SpeedBound = VelLimitSpeed;
+	}
+	else if (AbortSpeedFactor <= 0) return false; //no speed bound at all
+
+	if (NormDisp + SpeedBound*(StopTime - CurTime) < AbortTargetDisp){
+		AbortReason = EA_UNREACHABLE;
+		AbortTime = CurTime;
+		return true;
+	}
+	return false;
+}
+
 bool CVX_Sim::UpdateStats(std::string* pRetMessage) //updates simulation state (SS)
 {
 	//if (SelfColEnabled) StatToCalc |= CALCSTAT_VEL; //always need velocities if self collisition is enabled
@@ -1635,10 +2244,14 @@ bool CVX_Sim::Integrate()
 //	BondInput->UpdateBond();
 
 	bool Diverged = false;
+	{
+		PROFILE_PHASE(SP_BONDS);
+		PROFILE_ITEMS(SP_BONDS, iT);
 //#pragma omp parallel for
-	for (int i=0; i<iT; i++){
-		BondArrayInternal[i].UpdateBond();
-		if (BondArrayInternal[i].GetEngStrain() > 100) Diverged = true; //catch divergent condition! (if any thread sets true we will fail, so don't need mutex...
+		for (int i=0; i<iT; i++){
+			BondArrayInternal[i].UpdateBond();
+			if (BondArrayInternal[i].GetEngStrain() > 100) Diverged = true; //catch divergent condition! (if any thread sets true we will fail, so don't need mutex...
+		}
 	}
 	if (Diverged) return false;
 
@@ -1648,15 +2261,22 @@ bool CVX_Sim::Integrate()
 //	Vec3D<> M1b = BondArrayInternal[2].GetMoment1();
 
 	iT = NumColBond();
+	if (iT > 0){
+		PROFILE_PHASE(SP_COLLISION_BONDS);
+		PROFILE_ITEMS(SP_COLLISION_BONDS, iT);
 //#pragma omp parallel for
-	for (int i=0; i<iT; i++){
-		BondArrayCollision[i].UpdateBond();
+		for (int i=0; i<iT; i++){
+			BondArrayCollision[i].UpdateBond();
+		}
 	}
 
 
 	//if (!DtFrozen){ //for now, dt cannot change within the simulation (and this is a cycle hog)
-	if (IsFeatureEnabled(VXSFEAT_VOLUME_EFFECTS) ||  pEnv->pObj->GetUsingStressAdaptationRate() ||  pEnv->pObj->GetUsingPressureAdaptationRate())
+	if (IsFeatureEnabled(VXSFEAT_VOLUME_EFFECTS) ||  pEnv->pObj->GetUsingStressAdaptationRate() ||  pEnv->pObj->GetUsingPressureAdaptationRate()){
+		PROFILE_PHASE(SP_MAX_DT);
+		PROFILE_ITEMS(SP_MAX_DT, NumBond());
 		OptimalDt = CalcMaxDt(); //calculate every time for now when volume effects are enabled, or when stiffness is varied
+	}
 	
 	dt = DtFrac*OptimalDt;
 	//}
@@ -1680,6 +2300,8 @@ bool CVX_Sim::Integrate()
 	{
         if (CurTime - TimeOfLastTiltVectorsUpdate >= pEnv->GetTempPeriod() / pEnv->GetTiltVectorsUpdatesPerTempCycle() )
         {
+            PROFILE_PHASE(SP_TILT);
+            PROFILE_ITEMS(SP_TILT, iT);
             Rolls.push_back(GetAvgRoll());
             Pitches.push_back(GetAvgPitch());
             Yaws.push_back(GetAvgYaw());
@@ -1693,7 +2315,8 @@ bool CVX_Sim::Integrate()
 	{
         if (CurTime - TimeOfLastControllerUpdate >= pEnv->GetTempPeriod() / pEnv->GetControllerUpdatesPerTempCycle() )
         {
-            UpdateControllerNow = true;
+            PROFILE_PHASE(SP_CONTROLLER);
+            UpdateControllerNow = true; //the neurons themselves are evaluated in EulerStep()
             TimeOfLastControllerUpdate = CurTime;
         }
 	}
@@ -1704,6 +2327,8 @@ bool CVX_Sim::Integrate()
         if (CurTime - TimeOfLastForwardModelUpdate >= pEnv->GetTempPeriod() / pEnv->GetForwardModelUpdatesPerTempCycle() )
         {
             // std::cout << MaxStressSoFar << ", " << MaxPressureSoFar << ", " << MinPressureSoFar << std::endl;
+            PROFILE_PHASE(SP_FORWARD_MODEL);
+            PROFILE_ITEMS(SP_FORWARD_MODEL, iT);
             TimeOfLastForwardModelUpdate = CurTime;
             for (int i=0; i<iT; i++)
             {
@@ -1719,6 +2344,8 @@ bool CVX_Sim::Integrate()
         if (CurTime - TimeOfLastRegenerationModelUpdate >= pEnv->GetTempPeriod() / pEnv->GetRegenerationModelUpdatesPerTempCycle() )
         {
             // std::cout << MaxStressSoFar << ", " << MaxPressureSoFar << ", " << MinPressureSoFar << std::endl;
+            PROFILE_PHASE(SP_REGENERATION);
+            PROFILE_ITEMS(SP_REGENERATION, iT);
             TimeOfLastRegenerationModelUpdate = CurTime;
             for (int i=0; i<iT; i++)
             {
@@ -1734,6 +2361,8 @@ bool CVX_Sim::Integrate()
 	{
         if (CurTime - TimeOfLastSignalingUpdate >= pEnv->GetTempPeriod() / pEnv->GetSignalingUpdatesPerTempCycle() )
         {
+            PROFILE_PHASE(SP_SIGNALING);
+            PROFILE_ITEMS(SP_SIGNALING, NumVox());
             for (int i=0; i<NumVox(); i++) {VoxArray[i].ElectricallyActiveOld = VoxArray[i].ElectricallyActiveNew;}
             UpdateSignalingNow = true;
             TimeOfLastSignalingUpdate = CurTime;
@@ -1749,6 +2378,7 @@ bool CVX_Sim::Integrate()
 
         if (CurTime - TimeOfLastOcclusionUpdate >= pEnv->GetTempPeriod()/OcclusionUpdatesPerTempCycle)
         {
+            PROFILE_PHASE(SP_OCCLUSION);
             TimeOfLastOcclusionUpdate = CurTime;
 
             if (surfaceVoxels.empty())
@@ -1756,6 +2386,7 @@ bool CVX_Sim::Integrate()
                 for (int i=0; i<NumVox(); i++){ if (VoxArray[i].IsSurfaceVoxel()) { surfaceVoxels.push_back(i);}}
             }
 
+            PROFILE_ITEMS(SP_OCCLUSION, surfaceVoxels.size());
             for (std::vector<int>::size_type j = 0; j != surfaceVoxels.size(); j++)
             {
                 int thisSurfVox = surfaceVoxels[j];
@@ -1898,11 +2529,13 @@ bool CVX_Sim::Integrate()
 
 	if (fluidEnvironment)
 	{
+		PROFILE_PHASE(SP_DRAG);
 
 		// FC: We'll have to accumulate drag contributions from each facet of a given voxel. We need to reset the drag force
 		for (int i=0; i < VoxArray.size(); i++) { VoxArray[i].DragForce = Vec3D<>(0,0,0); }
 
 		VoxMesh.UpdateMeshPhysicsOnlyNoColors();
+		PROFILE_ITEMS(SP_DRAG, VoxMesh.DefMesh.Facets.size());
 		
 		for (int i=0; i<(int)VoxMesh.DefMesh.Facets.size(); i++)
 		{	
@@ -1980,7 +2613,11 @@ bool CVX_Sim::Integrate()
 	}
 
 //#pragma omp parallel for
-	for (int i=0; i<iT; i++) { VoxArray[i].EulerStep();}
+	{
+		PROFILE_PHASE(SP_EULER_STEP);
+		PROFILE_ITEMS(SP_EULER_STEP, iT);
+		for (int i=0; i<iT; i++) { VoxArray[i].EulerStep();}
+	}
 
 	//End Euler integration
 
@@ -2419,6 +3056,137 @@ bool CVX_Sim::Integrate()
 //
 //#endif //OPENGL
 
+void CVX_Sim::CalcL1Bonds(const std::vector<int>& Vox1, const std::vector<int>& Vox2, vfloat Dist, vfloat FilterDist2)
+{
+	bool SameList = (&Vox1 == &Vox2);
+	int Count1 = (int)Vox1.size(), Count2 = (int)Vox2.size();
+	for (int i=0; i<Count1; i++){
+		int SIndex1 = Vox1[i];
+		CVXS_Voxel* pV1 = &VoxArray[SIndex1]; //could cache the pointers...
+
+		PROFILE_WORK(this, SIndex1, WC_COLLISION_TESTS, Count2 - (SameList ? i+1 : 0));
+		for (int j=(SameList ? i+1 : 0); j<Count2; j++){
+			int SIndex2 = Vox2[j];
+			CVXS_Voxel* pV2 = &VoxArray[SIndex2]; //could cache the pointers...
+			PROFILE_WORK(this, SIndex2, WC_COLLISION_TESTS, 1);
+
+			vfloat Dist2 = (pV1->GetCurPos() - pV2->GetCurPos()).Length2();
+			if (Dist2 < FilterDist2 && !pV1->IsNearbyVox(SIndex2)){ //quick filter...
+				vfloat ActDist = Dist*(pV1->GetCurScale() + pV1->GetCurScale())*0.5; //ASSUMES ISOTROPIC!!
+
+				if (Dist2 < ActDist*ActDist) CreateColBond(SIndex1, SIndex2); //if within the threshold create temporary bond...
+			}
+		}
+	}
+}
+
+static int BodyRoot(std::vector<int>& Parent, int i) //union-find with path halving
+{
+	while (Parent[i] != i){Parent[i] = Parent[Parent[i]]; i = Parent[i];}
+	return i;
+}
+
+void CVX_Sim::CalcBodies(void)
+{
+	int nVox = NumVox();
+	std::vector<int> Parent(nVox);
+	for (int i=0; i<nVox; i++) Parent[i] = i;
+	for (int j=0; j<NumBond(); j++){
+		int Root1 = BodyRoot(Parent, BondArrayInternal[j].GetVox1SInd()), Root2 = BodyRoot(Parent, BondArrayInternal[j].GetVox2SInd());
+		if (Root1 != Root2) Parent[Root1 > Root2 ? Root1 : Root2] = (Root1 < Root2 ? Root1 : Root2);
+	}
+
+	BodyIndex.assign(nVox, -1);
+	BodyNumVox.clear();
+	BodySurfVoxels.clear();
+	std::vector<int> RootBody(nVox, -1);
+	for (int i=0; i<nVox; i++){ //bodies are numbered in order of their lowest voxel index
+		int Root = BodyRoot(Parent, i);
+		if (RootBody[Root] < 0){
+			RootBody[Root] = (int)BodyNumVox.size();
+			BodyNumVox.push_back(0);
+			BodySurfVoxels.push_back(std::vector<int>());
+		}
+		BodyIndex[i] = RootBody[Root];
+		BodyNumVox[BodyIndex[i]]++;
+	}
+	for (int i=0; i<NumSurfVoxels(); i++) BodySurfVoxels[BodyIndex[SurfVoxels[i]]].push_back(SurfVoxels[i]);
+}
+
+struct BodyMinXLess { //orders bodies by the lower x bound of their bounding box
+	const std::vector< Vec3D<> >* pMin;
+	bool operator()(int a, int b) const {return (*pMin)[a].x < (*pMin)[b].x;}
+};
+
+void CVX_Sim::FindCloseBodies(vfloat Margin, std::vector< std::pair<int, int> >* pPairs)
+{
+	int nBody = NumBodies();
+	BodyMin.resize(nBody);
+	BodyMax.resize(nBody);
+	for (int b=0; b<nBody; b++){
+		if (BodySurfVoxels[b].empty()){BodyMin[b] = Vec3D<>(FLT_MAX, FLT_MAX, FLT_MAX); BodyMax[b] = -BodyMin[b]; continue;}
+		BodyMin[b] = BodyMax[b] = VoxArray[BodySurfVoxels[b][0]].GetCurPos();
+		for (int i=1; i<(int)BodySurfVoxels[b].size(); i++){
+			Vec3D<> Pos = VoxArray[BodySurfVoxels[b][i]].GetCurPos();
+			BodyMin[b] = BodyMin[b].Min(Pos);
+			BodyMax[b] = BodyMax[b].Max(Pos);
+		}
+		BodyMin[b] -= Vec3D<>(Margin/2, Margin/2, Margin/2); //voxel pairs closer than Margin have overlapping boxes
+		BodyMax[b] += Vec3D<>(Margin/2, Margin/2, Margin/2);
+	}
+
+	//sweep along x, keeping the bodies whose boxes span the current position active
+	std::vector<int> Order(nBody);
+	for (int b=0; b<nBody; b++) Order[b] = b;
+	BodyMinXLess Less;
+	Less.pMin = &BodyMin;
+	std::sort(Order.begin(), Order.end(), Less);
+
+	pPairs->clear();
+	std::vector<int> Active;
+	for (int o=0; o<nBody; o++){
+		int B = Order[o];
+		int Kept = 0;
+		for (int a=0; a<(int)Active.size(); a++){
+			int A = Active[a];
+			if (BodyMax[A].x < BodyMin[B].x) continue; //can no longer overlap anything further along
+			Active[Kept++] = A;
+			if (BodyMax[A].y >= BodyMin[B].y && BodyMin[A].y <= BodyMax[B].y && BodyMax[A].z >= BodyMin[B].z && BodyMin[A].z <= BodyMax[B].z){
+				pPairs->push_back(A < B ? std::make_pair(A, B) : std::make_pair(B, A));
+			}
+		}
+		Active.resize(Kept);
+		Active.push_back(B);
+	}
+}
+
+void CVX_Sim::GetBodyCMs(std::vector< Vec3D<> >* pCMs)
+{
+	int nBody = NumBodies();
+	std::vector<vfloat> Mass(nBody, 0);
+	pCMs->assign(nBody, Vec3D<>(0,0,0));
+	for (int i=0; i<NumVox(); i++){
+		vfloat ThisMass = VoxArray[i].GetMass();
+		(*pCMs)[BodyIndex[i]] += VoxArray[i].GetCurPos()*ThisMass;
+		Mass[BodyIndex[i]] += ThisMass;
+	}
+	for (int b=0; b<nBody; b++) if (Mass[b] > 0) (*pCMs)[b] /= Mass[b];
+}
+
+Vec3D<> CVX_Sim::GetBodyNormDisplacement(int Body)
+{
+	if (Body < 0 || Body >= (int)BodyIniCM.size()) return Vec3D<>(0,0,0);
+	vfloat TotalMass = 0;
+	Vec3D<> Sum(0,0,0);
+	for (int i=0; i<NumVox(); i++){
+		if (BodyIndex[i] != Body) continue;
+		Sum += VoxArray[i].GetCurPos()*VoxArray[i].GetMass();
+		TotalMass += VoxArray[i].GetMass();
+	}
+	if (TotalMass == 0) return Vec3D<>(0,0,0);
+	return (Sum/TotalMass - BodyIniCM[Body])/LocalVXC.GetLatticeDim();
+}
+
 void CVX_Sim::CalcL1Bonds(vfloat Dist) //creates contact bonds for all voxels within specified distance
 {
 //	Dist = Dist*LocalVXC.GetLatticeDim();
@@ -2432,31 +3200,40 @@ void CVX_Sim::CalcL1Bonds(vfloat Dist) //creates contact bonds for all voxels wi
 	DeleteCollisionBonds();
 
 	if (CurColSystem == COL_SURFACE || COL_SURFACE_HORIZON){
-		//clear bond array past the m_NumBonds position
-		int SurfVoxCount = NumSurfVoxels();
-		for (int i=0; i<SurfVoxCount; i++){ //go through each combination of surface voxels...
-			int SIndex1 = SurfVoxels[i];
-			CVXS_Voxel* pV1 = &VoxArray[SIndex1]; //could cache the pointers...
-
-			for (int j=i+1; j<SurfVoxCount; j++){
-				int SIndex2 = SurfVoxels[j];
-				CVXS_Voxel* pV2 = &VoxArray[SIndex2]; //could cache the pointers...
-
-				Dist2 = (pV1->GetCurPos() - pV2->GetCurPos()).Length2();
-				if (Dist2 < FilterDist2 && !pV1->IsNearbyVox(SIndex2)){ //quick filter...
-					vfloat ActDist = Dist*(pV1->GetCurScale() + pV1->GetCurScale())*0.5; //ASSUMES ISOTROPIC!!
-
-					if (Dist2 < ActDist*ActDist) CreateColBond(SIndex1, SIndex2); //if within the threshold create temporary bond...
+		if (NumBodies() <= 1) CalcL1Bonds(SurfVoxels, SurfVoxels, Dist, FilterDist2); //go through each combination of surface voxels...
+		else {
+			for (int b=0; b<NumBodies(); b++) CalcL1Bonds(BodySurfVoxels[b], BodySurfVoxels[b], Dist, FilterDist2); //self contact of each body
+
+			//between bodies: only bodies whose bounding boxes are close, and only the surface voxels within reach of the other body
+			std::vector< std::pair<int, int> > Pairs;
+			FindCloseBodies(FilterDist, &Pairs);
+			std::vector<int> Near1, Near2;
+			Vec3D<> Reach(FilterDist/2, FilterDist/2, FilterDist/2); //the boxes are padded by FilterDist/2: this grows them to the unpadded box plus the full FilterDist
+			for (int p=0; p<(int)Pairs.size(); p++){
+				int B1 = Pairs[p].first, B2 = Pairs[p].second;
+				Vec3D<> Min1 = BodyMin[B1]-Reach, Max1 = BodyMax[B1]+Reach, Min2 = BodyMin[B2]-Reach, Max2 = BodyMax[B2]+Reach;
+				Near1.clear(); Near2.clear();
+				for (int i=0; i<(int)BodySurfVoxels[B1].size(); i++){
+					Vec3D<> Pos = VoxArray[BodySurfVoxels[B1][i]].GetCurPos();
+					if (Pos.x >= Min2.x && Pos.y >= Min2.y && Pos.z >= Min2.z && Pos.x <= Max2.x && Pos.y <= Max2.y && Pos.z <= Max2.z) Near1.push_back(BodySurfVoxels[B1][i]);
 				}
+				if (Near1.empty()) continue;
+				for (int i=0; i<(int)BodySurfVoxels[B2].size(); i++){
+					Vec3D<> Pos = VoxArray[BodySurfVoxels[B2][i]].GetCurPos();
+					if (Pos.x >= Min1.x && Pos.y >= Min1.y && Pos.z >= Min1.z && Pos.x <= Max1.x && Pos.y <= Max1.y && Pos.z <= Max1.z) Near2.push_back(BodySurfVoxels[B2][i]);
+				}
+				CalcL1Bonds(Near1, Near2, Dist, FilterDist2);
 			}
 		}
 	}
 	else { //check against all!
 		for (int i=0; i<NumVox(); i++){ //go through each combination of voxels...
 			int SIndex1 = i;
+			PROFILE_WORK(this, SIndex1, WC_COLLISION_TESTS, NumVox()-i-1);
 
 			for (int j=i+1; j<NumVox(); j++){
 				int SIndex2 = j;
+				PROFILE_WORK(this, SIndex2, WC_COLLISION_TESTS, 1);
 				if (!VoxArray[SIndex1].IsNearbyVox(SIndex2)){
 
 					vfloat ActDist = Dist*(VoxArray[SIndex1].GetCurScale() + VoxArray[SIndex1].GetCurScale())*0.5; //ASSUMES ISOTROPIC!!
@@ -2715,3 +3492,209 @@ double CVX_Sim::GetAvgYaw()
     return CurAvgYaw/totalContribution;
 }
 
+
+void SimState::Write(std::ostream& os) const
+{
+	SCWrite(os, CurCM);
+	SCWriteVec(os, CMTrace); SCWriteVec(os, CMTraceTime); SCWriteVec(os, VoxelIndexTrace); SCWriteVec(os, FloorTouchTrace);
+	SCWriteVec(os, VoltageTrace); SCWriteVec(os, StrainTrace); SCWriteVec(os, StressTrace); SCWriteVec(os, PressureTrace);
+	SCWriteVec(os, TouchTrace); SCWriteVec(os, RollTrace); SCWriteVec(os, PitchTrace); SCWriteVec(os, YawTrace);
+	SCWrite(os, TotalObjDisp); SCWrite(os, NormObjDisp);
+	SCWrite(os, MaxVoxDisp); SCWrite(os, MaxVoxVel); SCWrite(os, MaxVoxKinE); SCWrite(os, MaxBondStrain); SCWrite(os, MaxBondStress); SCWrite(os, MaxBondStrainE); SCWrite(os, MaxPressure); SCWrite(os, MinPressure);
+	SCWrite(os, TotalObjKineticE); SCWrite(os, TotalObjStrainE);
+}
+
+bool SimState::Read(std::istream& is)
+{
+	SCRead(is, &CurCM);
+	SCReadVec(is, &CMTrace); SCReadVec(is, &CMTraceTime); SCReadVec(is, &VoxelIndexTrace); SCReadVec(is, &FloorTouchTrace);
+	SCReadVec(is, &VoltageTrace); SCReadVec(is, &StrainTrace); SCReadVec(is, &StressTrace); SCReadVec(is, &PressureTrace);
+	SCReadVec(is, &TouchTrace); SCReadVec(is, &RollTrace); SCReadVec(is, &PitchTrace); SCReadVec(is, &YawTrace);
+	SCRead(is, &TotalObjDisp); SCRead(is, &NormObjDisp);
+	SCRead(is, &MaxVoxDisp); SCRead(is, &MaxVoxVel); SCRead(is, &MaxVoxKinE); SCRead(is, &MaxBondStrain); SCRead(is, &MaxBondStress); SCRead(is, &MaxBondStrainE); SCRead(is, &MaxPressure); SCRead(is, &MinPressure);
+	SCRead(is, &TotalObjKineticE);
+	return SCRead(is, &TotalObjStrainE);
+}
+
+bool CVX_Sim::LoadSettledState(std::string* RetMessage)
+{
+	SettleRestored = false;
+	SettleStorePending = false;
+	if (!SettleCache.IsEnabled() || !Initalized || InitCmTime <= 0 || CurStepCount != 0) return false; //nothing to skip
+
+	std::ostringstream Key;
+	WriteSettleKey(Key);
+	SettleKey = CVX_SettleCache::Hash(Key.str());
+
+	std::string Data;
+	if (SettleCache.Load(SettleKey, &Data)){
+		if (RestoreSettledState(Data)){
+			SettleCache.Hits++;
+			if (RetMessage) *RetMessage += "Settled state restored from cache.\n";
+			return true;
+		}
+		if (RetMessage) *RetMessage += "Ignoring unreadable settled state cache entry.\n";
+	}
+
+	SettleCache.Misses++;
+	SettleStorePending = true;
+	return false;
+}
+
+void CVX_Sim::WriteStructureKey(std::ostream& os)
+{
+	CVX_Object* pObj = pEnv->pObj;
+
+	//Lattice, voxel shape, materials and boundary conditions/gravity/temperature in their XML form
+	CXML_Rip XML;
+	std::string Text;
+	pObj->Lattice.WriteXML(&XML);
+	pObj->Voxel.WriteXML(&XML);
+	for (int i=0; i<(int)pObj->Palette.size(); i++) pObj->Palette[i].WriteXML(&XML);
+	pEnv->WriteXML(&XML);
+	XML.toXMLText(&Text);
+	SCWriteVec(os, std::vector<char>(Text.begin(), Text.end()));
+
+	//morphology
+	SCWrite(os, pObj->GetVXDim()); SCWrite(os, pObj->GetVYDim()); SCWrite(os, pObj->GetVZDim());
+	SCWrite(os, pObj->GetNumVox());
+	for (int i=pObj->Structure.GetNextVoxel(0); i!=-1; i=pObj->Structure.GetNextVoxel(i+1)){SCWrite(os, i); SCWrite(os, pObj->Structure.GetData(i));} //occupied cells only
+
+	//bond constants are computed from the per-voxel stiffness, the nearby lists from the collision horizon
+	SCWrite(os, pObj->GetEvolvingStiffness());
+	if (pObj->GetEvolvingStiffness()) for (int i=0; i<pObj->GetNumVox(); i++) SCWrite(os, pObj->GetStiffness(i));
+	SCWrite(os, CollisionHorizon);
+
+	//which blocks are merged depends on these
+	SCWrite(os, CoarseMaxBlock);
+	if (CoarseMaxBlock > 1){
+		std::vector<double> Data;
+		for (int i=0; i<pObj->GetNumVox(); i++){GetCoarseVoxelData(i, &Data); SCWriteVec(os, Data);}
+	}
+}
+
+bool CVX_Sim::RestoreSettledState(const std::string& Data)
+{
+	std::istringstream State(Data);
+	if (!ReadSettledState(State)){
+		ResetSimulation(); //a partially read state is unusable
+		return false;
+	}
+	SettleRestored = true;
+	SettleStorePending = false;
+	return true;
+}
+
+void CVX_Sim::WriteSettleKey(std::ostream& os)
+{
+	CVX_Object* pObj = pEnv->pObj;
+	int nVox = NumVox();
+
+	WriteStructureKey(os);
+
+	//simulator settings
+	SCWrite(os, (int)sizeof(vfloat));
+	SCWrite(os, DtFrac); SCWrite(os, BondDampingZ); SCWrite(os, ColDampingZ); SCWrite(os, SlowDampingZ);
+	SCWrite(os, CurSimFeatures); SCWrite(os, (int)CurColSystem); SCWrite(os, CollisionHorizon); SCWrite(os, MaxVoxVelLimit);
+	SCWrite(os, MixRadius); SCWrite(os, (int)BlendModel); SCWrite(os, PolyExp); SCWrite(os, MIN_TEMP_FACT);
+	SCWrite(os, InitCmTime); SCWrite(os, ActuationStartTime); SCWrite(os, (int)StopConditionType);
+	if (pEnv->GetAlterGravityHalfway() != 1.0) SCWrite(os, StopConditionValue); //gravity may change during settling
+
+	//environment settings not covered by CVX_Environment::WriteXML()
+	SCWrite(os, pEnv->GetAlterGravityHalfway()); SCWrite(os, pEnv->GetFloorSlope()); SCWrite(os, pEnv->GetFluidEnvironment()); SCWrite(os, pEnv->GetAggregateDragCoefficient());
+	SCWrite(os, pEnv->IsFallingProhibited()); SCWrite(os, pEnv->getUsingDampEvolvedStiffness()); SCWrite(os, pEnv->IsPushingBlock()); SCWrite(os, pEnv->GetBlockMaterial());
+	SCWrite(os, pEnv->IsContractOnly()); SCWrite(os, pEnv->IsExpandOnly());
+	SCWrite(os, pEnv->GetNeuralNetUpdatesPerTempCycle()); SCWrite(os, pEnv->IsTouchSensorsEnabled()); SCWrite(os, pEnv->IsProprioceptionSensorsEnabled()); SCWrite(os, pEnv->IsPacemakerSensorsEnabled());
+	SCWrite(os, pEnv->GetNumHiddenNeuronsPerLayer()); SCWrite(os, pEnv->GetNumHiddenLayers()); SCWrite(os, pEnv->GetOutputSmoothing());
+	SCWrite(os, pEnv->GetTiltVectorsUpdatesPerTempCycle()); SCWrite(os, pEnv->GetRegenerationModelUpdatesPerTempCycle()); SCWrite(os, pEnv->GetForwardModelUpdatesPerTempCycle()); SCWrite(os, pEnv->GetControllerUpdatesPerTempCycle());
+	SCWrite(os, pEnv->GetSignalingUpdatesPerTempCycle()); SCWrite(os, pEnv->GetDepolarizationsPerTempCycle()); SCWrite(os, pEnv->GetRepolarizationsPerTempCycle());
+	SCWrite(os, pEnv->getLightSource()); SCWrite(os, pEnv->getGrowthAmplitude()); SCWrite(os, pEnv->getGrowthSpeedLimit());
+	SCWrite(os, pEnv->getUsingGreedyGrowth()); SCWrite(os, pEnv->getGreedyThreshold()); SCWrite(os, pEnv->getNumHiddenRegenerationNeurons()); SCWrite(os, pEnv->getUsingRegenerationModelInputBias());
+	SCWrite(os, pEnv->getUsingSavePassiveData()); SCWrite(os, pEnv->getTimeBetweenTraces());
+
+	//per-voxel parameters that act before InitCmTime (phase offsets, final sizes and adaptation rates only act afterwards)
+	SCWrite(os, pObj->GetMinElasticMod()); SCWrite(os, pObj->GetMaxElasticMod()); SCWrite(os, pObj->GetMinDevo()); SCWrite(os, pObj->GetMaxStiffnessVariation()); SCWrite(os, pObj->GetGrowthModel());
+	SCWrite(os, pObj->GetUsingStressAdaptationRate()); SCWrite(os, pObj->GetUsingPressureAdaptationRate()); //these change dt even before adaptation starts
+	for (int i=0; i<nVox; i++){
+		int d = GetVoxDataIndex(i); //per-voxel object data (differs from i if voxels were coarsened)
+		if (pObj->GetUsingInitialVoxelSize()) SCWrite(os, pObj->GetInitialVoxelSize(d));
+		if (pObj->GetUsingVestibularContribution()) SCWrite(os, pObj->GetVestibularContribution(d));
+		if (pObj->GetUsingPreDamageRoll()) SCWrite(os, pObj->GetPreDamageRoll(d));
+		if (pObj->GetUsingPreDamagePitch()) SCWrite(os, pObj->GetPreDamagePitch(d));
+		if (pObj->GetUsingPreDamageYaw()) SCWrite(os, pObj->GetPreDamageYaw(d));
+		if (pObj->GetUsingStressContribution()) SCWrite(os, pObj->GetStressContribution(d));
+		if (pObj->GetUsingPreDamageStress()) SCWrite(os, pObj->GetPreDamageStress(d));
+		if (pObj->GetUsingPressureContribution()) SCWrite(os, pObj->GetPressureContribution(d));
+		if (pObj->GetUsingPreDamagePressure()) SCWrite(os, pObj->GetPreDamagePressure(d));
+	}
+
+	//neural models are updated from the first step on, so their weights are part of the key whenever they run
+	int nController = pEnv->GetControllerUpdatesPerTempCycle() > 0 ? pObj->GetNumControllerSynapses() : 0;
+	int nForward = pEnv->GetForwardModelUpdatesPerTempCycle() > 0 ? pObj->GetNumForwardModelSynapses() : 0;
+	int nRegeneration = pEnv->GetRegenerationModelUpdatesPerTempCycle() > 0 ? pObj->GetNumRegenerationModelSynapses() : 0;
+	for (int i=0; i<nVox; i++){
+		int d = GetVoxDataIndex(i);
+		for (int j=0; j<nController; j++) SCWrite(os, pObj->GetControllerSynapseWeight(d, j));
+		for (int j=0; j<nForward; j++) SCWrite(os, pObj->GetForwardModelSynapseWeight(d, j));
+		for (int j=0; j<nRegeneration; j++) SCWrite(os, pObj->GetRegenerationModelSynapseWeight(d, j));
+	}
+}
+
+void CVX_Sim::WriteSettledState(std::ostream& os)
+{
+	int nVox = NumVox(), nBond = NumBond(), nColBond = NumColBond();
+	SCWrite(os, nVox); SCWrite(os, nBond);
+
+	SCWrite(os, CurTime); SCWrite(os, CurStepCount); SCWrite(os, dt); SCWrite(os, OptimalDt);
+	SCWrite(os, MaxDispSinceLastBondUpdate); SCWrite(os, ColEnableChanged); SCWrite(os, MotionZeroed); SCWrite(os, StatToCalc);
+	SCWrite(os, MaxStressSoFar); SCWrite(os, MaxPressureSoFar); SCWrite(os, MinPressureSoFar);
+	SCWrite(os, TimeOfLastRegenerationModelUpdate); SCWrite(os, TimeOfLastForwardModelUpdate); SCWrite(os, TimeOfLastTiltVectorsUpdate);
+	SCWrite(os, TimeOfLastControllerUpdate); SCWrite(os, TimeOfLastSignalingUpdate); SCWrite(os, TimeOfLastOcclusionUpdate);
+	SCWrite(os, avgRoll); SCWrite(os, avgPitch); SCWrite(os, avgYaw); SCWrite(os, avgStress); SCWrite(os, avgPressure); SCWrite(os, FellOver);
+	SCWriteVec(os, Rolls); SCWriteVec(os, Pitches); SCWriteVec(os, Yaws);
+	SCWriteDeque(os, KinEHistory); SCWriteDeque(os, TotEHistory); SCWriteDeque(os, MaxMoveHistory);
+	SS.Write(os);
+
+	for (int i=0; i<nVox; i++) VoxArray[i].WriteState(os);
+	for (int i=0; i<nBond; i++) BondArrayInternal[i].WriteState(os);
+
+	SCWrite(os, nColBond);
+	for (int i=0; i<nColBond; i++){
+		SCWrite(os, BondArrayCollision[i].GetVox1SInd());
+		SCWrite(os, BondArrayCollision[i].GetVox2SInd());
+		BondArrayCollision[i].WriteState(os);
+	}
+}
+
+bool CVX_Sim::ReadSettledState(std::istream& is)
+{
+	int nVox, nBond, nColBond;
+	if (!SCRead(is, &nVox) || !SCRead(is, &nBond) || nVox != NumVox() || nBond != NumBond()) return false;
+
+	SCRead(is, &CurTime); SCRead(is, &CurStepCount); SCRead(is, &dt); SCRead(is, &OptimalDt);
+	SCRead(is, &MaxDispSinceLastBondUpdate); SCRead(is, &ColEnableChanged); SCRead(is, &MotionZeroed); SCRead(is, &StatToCalc);
+	SCRead(is, &MaxStressSoFar); SCRead(is, &MaxPressureSoFar); SCRead(is, &MinPressureSoFar);
+	SCRead(is, &TimeOfLastRegenerationModelUpdate); SCRead(is, &TimeOfLastForwardModelUpdate); SCRead(is, &TimeOfLastTiltVectorsUpdate);
+	SCRead(is, &TimeOfLastControllerUpdate); SCRead(is, &TimeOfLastSignalingUpdate); SCRead(is, &TimeOfLastOcclusionUpdate);
+	SCRead(is, &avgRoll); SCRead(is, &avgPitch); SCRead(is, &avgYaw); SCRead(is, &avgStress); SCRead(is, &avgPressure); SCRead(is, &FellOver);
+	SCReadVec(is, &Rolls); SCReadVec(is, &Pitches); SCReadVec(is, &Yaws);
+	SCReadDeque(is, &KinEHistory); SCReadDeque(is, &TotEHistory); SCReadDeque(is, &MaxMoveHistory);
+	if (!SS.Read(is)) return false;
+
+	for (int i=0; i<nVox; i++) if (!VoxArray[i].ReadState(is)) return false;
+	for (int i=0; i<nBond; i++) if (!BondArrayInternal[i].ReadState(is)) return false;
+
+	DeleteCollisionBonds();
+	if (!SCRead(is, &nColBond) || nColBond < 0) return false;
+	for (int i=0; i<nColBond; i++){
+		int V1, V2;
+		SCRead(is, &V1);
+		if (!SCRead(is, &V2) || V1 < 0 || V1 >= nVox || V2 < 0 || V2 >= nVox) return false;
+		int ThisBond = CreateColBond(V1, V2);
+		if (ThisBond < 0 || !BondArrayCollision[ThisBond].ReadState(is)) return false;
+	}
+	for (std::vector<CVXS_Voxel>::iterator it = VoxArray.begin(); it != VoxArray.end(); it++) it->UpdateColBondPointers(); //collision array may have been reallocated
+
+	CmInitialized = false; //IniCM is taken on the next time step, exactly as in an uncached run
+	return true;
+}
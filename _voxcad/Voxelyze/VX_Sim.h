@@ -16,6 +16,7 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 #include "VXS_BondCollision.h"
 #include "VX_Environment.h"
 #include "VX_MeshUtil.h"
+#include "VX_SettleCache.h"
 #include <deque>
 #include <vector>
 #include <map>
@@ -55,8 +56,15 @@ struct SimState { //Information about current simulation state:
 	vfloat NormObjDisp; //reduced to a scalar (magnitude) 
 	vfloat MaxVoxDisp, MaxVoxVel, MaxVoxKinE, MaxBondStrain, MaxBondStress, MaxBondStrainE, MaxPressure, MinPressure;
 	vfloat TotalObjKineticE, TotalObjStrainE;
+
+	void Write(std::ostream& os) const; //binary snapshot (settled state caching)
+	bool Read(std::istream& is);
 };
 
+enum ImportPhase {IP_COPY, IP_BOUNDARY, IP_VOXELS, IP_VOXEL_DATA, IP_BONDS, IP_NEARBY, IP_BODIES, IP_FINISH, IP_NUM_PHASES}; //stages of CVX_Sim::Import(), in order
+enum StepPhase {SP_COLLISIONS, SP_MAT_TEMPS, SP_BONDS, SP_COLLISION_BONDS, SP_MAX_DT, SP_TILT, SP_CONTROLLER, SP_FORWARD_MODEL, SP_REGENERATION, SP_SIGNALING, SP_OCCLUSION, SP_DRAG, SP_EULER_STEP, SP_STATS, SP_NUM_PHASES}; //stages of CVX_Sim::TimeStep() measured in a VX_PROFILE build, in order
+enum WorkCounter {WC_BOND_RELINKS, WC_COLLISION_TESTS, WC_NEURON_EVALS, WC_SIN_CALLS, WC_REGEN_UPDATES, WC_GROWTH_STEPS, WC_NUM_COUNTERS}; //units of work counted per voxel in a VX_PROFILE build
+
 //!Dynamic simulation class for time simulation of voxel objects.
 /*!
 To enable openGL rendering functions, define USE_OPEN_GL somewhere in the compiler's pre-processing routine.
@@ -99,12 +107,24 @@ public:
 	inline int NumBond(void) const {return (int)BondArrayInternal.size();} //!< Returns the number of bonds in the simulation.
 	inline int NumColBond(void) const {return (int)BondArrayCollision.size();} //!< Returns the number of bonds in the simulation.
 
-	std::vector<int> XtoSIndexMap; //!< Maps the global CVX_Object index to the corresponding CVX_Sim voxel index.
+	CPagedArray<int> XtoSIndexMap; //!< Maps the global CVX_Object index to the corresponding CVX_Sim voxel index (-1 where there is none). Sparse, so only the regions of the workspace around voxels take up memory.
 	std::vector<int> StoXIndexMap; //!< Maps CVX_Sim voxel index to the original global CVX_Object index.
 	int GetVoxIndex(int i, int j, int k) {return XtoSIndexMap[LocalVXC.GetIndex(i, j, k)];} //!< Returns the CVX_SIM voxel index at specified voxel location. If there is no instantiated voxel here -1 is returned. @param[in] i The X Voxel index of the desired voxel. @param[in] j The Y Voxel index of the desired voxel. @param[in] k The Z Voxel index of the desired voxel.
 
+	//Coarsening
+	void SetCoarsening(int MaxBlockSizeIn = 1) {CoarseMaxBlock = (MaxBlockSizeIn >= 4) ? 4 : ((MaxBlockSizeIn >= 2) ? 2 : 1);} //!< Merges homogeneous blocks of passive interior voxels into single super-voxels at the next Import(). Surface, actuated and boundary condition voxels keep full resolution. @param[in] MaxBlockSizeIn Largest block edge in voxels (4: 4x4x4 and 2x2x2 blocks, 2: 2x2x2 blocks only, 1: disabled).
+	int GetCoarsening(void) const {return CoarseMaxBlock;} //!< Returns the largest block edge that is merged at import (1 if coarsening is disabled).
+	int GetVoxBlockSize(int SIndex) const {return VoxBlockSize.empty() ? 1 : VoxBlockSize[SIndex];} //!< Returns the edge length in lattice voxels of a simulation voxel (1 unless it is a super-voxel). @param[in] SIndex Simulation voxel index.
+	int GetVoxDataIndex(int SIndex) const {return VoxDataIndex.empty() ? SIndex : VoxDataIndex[SIndex];} //!< Returns the index into the per-voxel arrays of the object (phase offsets, stiffness, synapse weights) for a simulation voxel. @param[in] SIndex Simulation voxel index.
+	int NumCoarseVoxels(void) const {int Count=0; for (int i=0; i<(int)VoxBlockSize.size(); i++) if (VoxBlockSize[i] > 1) Count++; return Count;} //!< Returns the number of super-voxels.
+	Vec3D<> GetCellPos(int XIndex); //!< Returns the current position of a lattice voxel. Voxels merged into a super-voxel move rigidly with it. @param[in] XIndex Global CVX_Object index of the voxel.
+
 	//Simulation Management
 	bool Import(CVX_Environment* pEnvIn = NULL, CMesh* pSurfMeshIn = NULL, std::string* RetMessage = NULL); //!< Imports a physical environment into the simulator.
+	bool ImportShared(CVX_Sim* pTemplate, CVX_Environment* pEnvIn = NULL, std::string* RetMessage = NULL); //!< Imports a physical environment by reusing the voxels and bonds of an already imported simulation of the same structure. Falls back to Import() if the structures differ.
+	void WriteStructureKey(std::ostream& os); //!< Writes everything that is baked into the voxels and bonds at import (lattice, palette, environment, structure, per-voxel stiffness).
+	double GetImportTime(ImportPhase Phase) const {return ImportTime[Phase];} //!< Returns the wall clock time in seconds the last Import() spent in one of its stages. @param[in] Phase The stage of the import.
+	static const char* ImportPhaseName(ImportPhase Phase); //!< Returns a short name for a stage of the import. @param[in] Phase The stage of the import.
 	int CreatePermBond(int SIndexNegIn, int SIndexPosIn); //!< Creates a new permanent bond between two voxels. 
 	int CreateColBond(int SIndex1In, int SIndex2In); //!< Creates a new collision bond between two voxels. 
 //	bool UpdateBond(int BondIndex, int NewSIndex1In, int NewSIndex2In, bool LinkBond = true);
@@ -133,6 +153,26 @@ public:
 
 	bool CmInitialized; //nac
 
+	//Step profiling (only measured if the library is built with VX_PROFILE defined, otherwise everything reads zero)
+	static bool IsStepProfileCompiled(void); //!< Returns true if this library was built with VX_PROFILE, i.e. TimeStep() measures its stages.
+	void ResetStepProfile(void); //!< Zeroes all step timers and counters. Called by ResetSimulation().
+	long long GetProfiledSteps(void) const {return ProfiledSteps;} //!< Returns the number of TimeStep() calls measured since the last reset.
+	double GetProfiledStepTime(void) const {return ProfiledStepTime;} //!< Returns the wall clock time in seconds spent in TimeStep() since the last reset, including anything not attributed to a stage.
+	double GetStepTime(StepPhase Phase) const {return StepTime[Phase];} //!< Returns the wall clock time in seconds spent in one stage of TimeStep() since the last reset. @param[in] Phase The stage of the step.
+	long long GetStepCalls(StepPhase Phase) const {return StepCalls[Phase];} //!< Returns how many times a stage actually ran since the last reset (periodic updates don't run every step). @param[in] Phase The stage of the step.
+	long long GetStepItems(StepPhase Phase) const {return StepItems[Phase];} //!< Returns the number of bonds, voxels or facets a stage processed since the last reset. @param[in] Phase The stage of the step.
+	static const char* StepPhaseName(StepPhase Phase); //!< Returns a short name for a stage of the step. @param[in] Phase The stage of the step.
+	void GetStepProfile(std::string* RetMessage); //!< Appends a table of the time, calls and work items of each stage to RetMessage. @param[out] RetMessage The string to append to.
+
+	//Work counters (VX_PROFILE builds only): what each voxel made the simulation do
+	void EnableWorkCounters(bool Enabled = true); //!< Starts or stops counting work units per voxel. The counts are zeroed now and by every ResetSimulation(). @param[in] Enabled True to count.
+	bool AreWorkCountersEnabled(void) const {return WorkCountersEnabled;} //!< Returns true if work units are being counted.
+	void CountWork(int SIndex, WorkCounter Counter, long long Num = 1) {if (!VoxWork.empty()) VoxWork[SIndex*WC_NUM_COUNTERS + Counter] += Num;} //!< Adds work units to a voxel. Use through PROFILE_WORK() so it compiles out. @param[in] SIndex Simulation voxel index. @param[in] Counter Kind of work. @param[in] Num Number of units.
+	long long GetVoxWork(int SIndex, WorkCounter Counter) const {return VoxWork.empty() ? 0 : VoxWork[SIndex*WC_NUM_COUNTERS + Counter];} //!< Returns the work units of one kind counted for a voxel. @param[in] SIndex Simulation voxel index. @param[in] Counter Kind of work.
+	void GetMaterialWork(std::vector<long long>* pWork, std::vector<int>* pNumVox); //!< Sums the work counters over the voxels of each palette material. @param[out] pWork WC_NUM_COUNTERS totals per material, material by material. @param[out] pNumVox Number of simulation voxels of each material.
+	static const char* WorkCounterName(WorkCounter Counter); //!< Returns a short name for a kind of work. @param[in] Counter Kind of work.
+	void GetWorkHistogram(std::string* RetMessage); //!< Appends the work per material and a histogram of the work per voxel to RetMessage. @param[out] RetMessage The string to append to.
+
 
 	//Simulator features:
 
@@ -145,6 +185,14 @@ public:
 	std::vector<int> SurfVoxels; //A list of voxels that are on the surface (IE eligible for contact bonds...) (containts SIndex!)
 	int NumSurfVoxels(void) {return (int)SurfVoxels.size();}; //how 
 	void CalcL1Bonds(vfloat Dist); //creates contact bonds for all voxels within specified distance
+
+	//Bodies (groups of voxels connected by internal bonds, i.e. several robots or loose debris in one world)
+	int NumBodies(void) const {return (int)BodySurfVoxels.size();} //!< Returns the number of separate bodies in the simulation.
+	int GetBodyIndex(int SIndex) const {return BodyIndex[SIndex];} //!< Returns the body the specified simulation voxel belongs to. @param[in] SIndex Simulation voxel index.
+	int GetBodyNumVox(int Body) const {return BodyNumVox[Body];} //!< Returns the number of voxels in a body.
+	void GetBodyCMs(std::vector< Vec3D<> >* pCMs); //!< Calculates the center of mass of every body in one pass. @param[out] pCMs One entry per body.
+	Vec3D<> GetBodyNormDisplacement(int Body); //!< Returns the displacement of a body's center of mass since InitCmTime, normalized by the lattice dimension.
+	std::vector< Vec3D<> > BodyIniCM; //!< Center of mass of each body at InitCmTime (only tracked if there is more than one body).
 	vfloat MaxDispSinceLastBondUpdate;
 
 
@@ -186,6 +234,23 @@ public:
 	vfloat GetInitCmTime(void){return InitCmTime;}
 	vfloat GetActuationStartTime(void){return ActuationStartTime;}
 	bool StopConditionMet(void); //have we met the stop condition yet?
+	vfloat GetStopTime(void); //!< Returns the simulation time at which the stop condition will be met, or -1 if the stop condition is not time based.
+
+	//Early abort (hopeless locomotion evaluations)
+	void SetAbortTargetDisp(vfloat AbortTargetDispIn = 0.0) {AbortTargetDisp = AbortTargetDispIn;} //!< Aborts the evaluation as soon as this normalized COM displacement can no longer be reached before the stop time. 0 disables the check. @param[in] AbortTargetDispIn Target displacement in lattice dimensions.
+	void SetAbortSpeedFactor(vfloat AbortSpeedFactorIn = 1.0) {AbortSpeedFactor = AbortSpeedFactorIn;} //!< Sets the multiple of the peak observed COM speed assumed to be reachable for the rest of the evaluation. If 0, only the velocity limit (if enabled) bounds the speed.
+	void SetAbortCheckInterval(vfloat AbortCheckIntervalIn = 0.0) {AbortCheckInterval = AbortCheckIntervalIn;} //!< Sets the length (in seconds) of the windows the COM speed is measured over. 0 uses the temperature period (one actuation cycle).
+	void AddAbortCheckpoint(vfloat Time, vfloat MinDisp); //!< Aborts the evaluation if the normalized COM displacement is below MinDisp at simulation time Time. @param[in] Time Absolute simulation time in seconds. @param[in] MinDisp Minimum normalized displacement, e.g. a percentile of the current population.
+	void ClearAbortCheckpoints(void) {AbortCheckpoints.clear();} //!< Removes all checkpoints.
+	vfloat GetAbortTargetDisp(void) {return AbortTargetDisp;}
+	vfloat GetAbortSpeedFactor(void) {return AbortSpeedFactor;}
+	vfloat GetAbortCheckInterval(void) {return AbortCheckInterval;}
+	int NumAbortCheckpoints(void) const {return (int)AbortCheckpoints.size();}
+	bool IsEarlyAbortEnabled(void) const {return AbortTargetDisp > 0 || !AbortCheckpoints.empty();} //!< Returns true if any early abort criterion is set.
+	bool EarlyAbortConditionMet(void); //!< Returns true if the evaluation has been judged hopeless. Checked from StopConditionMet().
+	EarlyAbortReason GetAbortReason(void) const {return AbortReason;} //!< Returns why the evaluation was aborted, or EA_NONE if it was not.
+	vfloat GetAbortTime(void) const {return AbortTime;} //!< Returns the simulation time the evaluation was aborted at.
+	vfloat GetAbortPeakSpeed(void) const {return AbortPeakSpeed;} //!< Returns the peak windowed COM speed (lattice dimensions per second) observed so far.
 
 	//Information about current state:
 	SimState SS;
@@ -286,12 +351,47 @@ public:
 	Vec3D<> getNormCOMdisplacement3D(){ return (SS.CurCM-IniCM)/LocalVXC.GetLatticeDim(); }
 	float getNormCOMdisplacement(){ return getNormCOMdisplacement3D().Length(); }
 
+	//Settled state cache
+	CVX_SettleCache SettleCache; //!< On-disk cache of the simulation state at InitCmTime. Disabled unless a cache directory is set.
+	bool LoadSettledState(std::string* RetMessage = NULL); //!< Looks up the settled state of the imported configuration. On a hit the simulation continues directly from InitCmTime and true is returned; on a miss the state is stored once InitCmTime is reached. Call after Import() and any later environment changes.
+	bool IsSettledStateRestored(void) const {return SettleRestored;} //!< Returns true if the current run started from a cached settled state.
+	void WriteSettleKey(std::ostream& os); //!< Writes every parameter that can influence the simulation before InitCmTime. Controller phase offsets and anything else that only acts afterwards is left out so that it does not split the cache.
+	void WriteSettledState(std::ostream& os); //!< Writes the complete time-varying state of the simulation.
+	bool ReadSettledState(std::istream& is); //!< Restores a state written by WriteSettledState(). The same configuration must have been imported.
+	bool RestoreSettledState(const std::string& Data); //!< Restores a snapshot written by WriteSettledState() (e.g. by another simulation with the same settle key) and marks the run as started from a settled state. Resets the simulation and returns false if the snapshot is unreadable.
+
 protected:
 	CVX_MeshUtil* internalMesh;
 
 	double MIN_TEMP_FACT;
 
 	bool Initalized; //!< Flag to denote if simulation is runnable. True if there is an environement successfully loaded, false otherwise.
+	void ImportEnvironmentSettings(void); //syncs features with the environment (start of import)
+	void FinishImport(bool HasPlasticMaterial, std::string* RetMessage); //resets and flags the simulation as runnable (end of import)
+	double ImportTime[IP_NUM_PHASES]; //seconds spent in each stage of the last Import()
+	double StepTime[SP_NUM_PHASES]; //seconds spent in each stage of TimeStep() (VX_PROFILE builds)
+	long long StepCalls[SP_NUM_PHASES]; //times each stage ran
+	long long StepItems[SP_NUM_PHASES]; //bonds, voxels or facets each stage processed
+	long long ProfiledSteps; //TimeStep() calls measured
+	double ProfiledStepTime; //seconds spent in them
+	bool WorkCountersEnabled;
+	std::vector<long long> VoxWork; //WC_NUM_COUNTERS per voxel, voxel by voxel (empty unless counting)
+	void RasterizeBCs(std::vector<std::vector<int> >* pBCVoxels, std::vector<int>* pSizes); //lattice voxels touched by each boundary condition (ascending) and the number touching at their offset positions (shares out the force)
+	void RasterizeBC(int BCIndex, std::vector<int>* pTouching, int* pNumTouching); //one boundary condition of RasterizeBCs()
+	void ImportParallel(void (CVX_Sim::*pRangeFunc)(int, int)); //calls pRangeFunc on contiguous blocks of voxels covering them all, on several threads for large models
+	void SetVoxDataRange(int First, int Last); //SetVoxData() for voxels First to Last-1
+	void CalcNearbyRange(int First, int Last); //CalcNearby() for voxels First to Last-1
+
+	int CoarseMaxBlock; //largest super-voxel edge (1: no coarsening)
+	std::vector<int> VoxBlockSize; //edge of each simulation voxel in lattice voxels (empty if nothing was coarsened)
+	std::vector<int> VoxDataIndex; //index of each simulation voxel into the per-voxel object arrays (empty if nothing was coarsened)
+	void FindCoarseBlocks(std::vector<int>* pCellBlock, const std::vector<bool>& BCTouched); //block edge at the first lattice voxel of each super-voxel, 0 for the others it covers, 1 elsewhere. BCTouched flags the lattice voxels touched by a boundary condition.
+	bool IsCoarseCandidate(int XIndex, const std::vector<int>& CellBlock, const std::vector<bool>& BCTouched); //true if this lattice voxel may be merged (passive, interior, unconstrained)
+	void GetCoarseVoxelData(int DataIndex, std::vector<double>* pData); //per-voxel parameters that must match within a super-voxel
+
+	bool SettleRestored; //started from a cached settled state
+	bool SettleStorePending; //store the state when InitCmTime is reached
+	unsigned long long SettleKey; //cache key of the imported configuration
 
 	//Integration
 	bool Integrate();
@@ -303,6 +403,19 @@ protected:
 	vfloat InitCmTime;
 	vfloat ActuationStartTime;
 
+	vfloat AbortTargetDisp; //normalized COM displacement to reach by the stop time (0 = disabled)
+	vfloat AbortSpeedFactor; //multiple of peak observed speed considered reachable
+	vfloat AbortCheckInterval; //speed measurement window in seconds (0 = temp period)
+	std::vector< std::pair<vfloat, vfloat> > AbortCheckpoints; //(time, minimum normalized displacement), sorted by time
+
+	EarlyAbortReason AbortReason;
+	vfloat AbortTime;
+	vfloat AbortPeakSpeed; //peak windowed COM speed so far
+	vfloat AbortWindowStart; //start time of the current speed window (-1 = not started)
+	Vec3D<> AbortWindowCM; //normalized COM at the start of the current window
+	int AbortWindows; //number of complete speed windows
+	int NextAbortCheckpoint;
+
 	void EnableEquilibriumMode(bool Enabled);
 	
 //	int numOutputs;
@@ -318,6 +431,14 @@ protected:
 	ColSystem CurColSystem;
 	vfloat CollisionHorizon; //multiple of voxel dimension to add to potential collision bond list
 
+	std::vector<int> BodyIndex; //body of each voxel (SIndex)
+	std::vector<int> BodyNumVox; //voxel count of each body
+	std::vector< std::vector<int> > BodySurfVoxels; //surface voxels (SIndex) of each body
+	std::vector< Vec3D<> > BodyMin, BodyMax; //bounding boxes of the body surfaces (collision broad phase)
+	void CalcBodies(void); //finds the connected groups of voxels
+	void FindCloseBodies(vfloat Margin, std::vector< std::pair<int, int> >* pPairs); //sweep and prune: all pairs of bodies whose bounding boxes are within Margin of each other
+	void CalcL1Bonds(const std::vector<int>& Vox1, const std::vector<int>& Vox2, vfloat Dist, vfloat FilterDist2); //contact bonds between two lists of voxels (or within one list if both are the same)
+
 	int CurSimFeatures;
 
 	//temperature
@@ -392,4 +513,10 @@ protected:
 //#endif
 };
 
+#ifdef VX_PROFILE
+#define PROFILE_WORK(pSimIn, SIndex, Counter, Num) ((pSimIn)->CountWork(SIndex, Counter, Num)) //counts work units for a voxel if work counters are enabled
+#else
+#define PROFILE_WORK(pSimIn, SIndex, Counter, Num)
+#endif
+
 #endif //VX_SIM_H
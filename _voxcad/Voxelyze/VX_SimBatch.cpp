@@ -0,0 +1,155 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#include "VX_SimBatch.h"
+#include <sstream>
+#include <thread>
+
+CVX_SimBatch::CVX_SimBatch(void)
+{
+	NumSharedImports = 0;
+	NumSharedSettles = 0;
+}
+
+CVX_SimBatch::~CVX_SimBatch(void)
+{
+	for (int i=0; i<NumInstances(); i++) delete Instances[i];
+	Instances.clear();
+}
+
+bool CVX_SimBatch::AddInstance(std::string VXAFile, std::string ResultFile, std::string* RetMessage)
+{
+	Instance* pInst = new Instance; //heap allocated: the simulation keeps pointers to the environment, object and mesh
+	pInst->Sim.pEnv = &pInst->Environment;
+	pInst->Environment.pObj = &pInst->Object;
+	pInst->Sim.setInternalMesh(&pInst->Mesh);
+
+	if (!pInst->Sim.LoadVXAFile(VXAFile, RetMessage)){
+		if (RetMessage) *RetMessage += "Could not load " + VXAFile + "\n";
+		delete pInst;
+		return false;
+	}
+	pInst->ResultFile = ResultFile.empty() ? pInst->Sim.FitnessFileName : ResultFile;
+	Instances.push_back(pInst);
+	return true;
+}
+
+bool CVX_SimBatch::Import(std::string* RetMessage)
+{
+	NumSharedImports = 0;
+	std::vector<std::string> Keys; //structure keys of the instances imported from scratch
+	std::vector<int> Templates;
+
+	for (int i=0; i<NumInstances(); i++){
+		CVX_SimGA& Sim = Instances[i]->Sim;
+		std::ostringstream Key;
+		Sim.WriteStructureKey(Key);
+
+		int Template = -1;
+		for (int j=0; j<(int)Keys.size(); j++) if (Keys[j] == Key.str()) {Template = Templates[j]; break;}
+
+		if (Template >= 0){
+			if (!Sim.ImportShared(&Instances[Template]->Sim, &Instances[i]->Environment, &Instances[i]->Message)) {if (RetMessage) *RetMessage += Instances[i]->Message; return false;}
+			NumSharedImports++;
+		}
+		else {
+			if (!Sim.Import(&Instances[i]->Environment, NULL, &Instances[i]->Message)) {if (RetMessage) *RetMessage += Instances[i]->Message; return false;}
+			Keys.push_back(Key.str());
+			Templates.push_back(i);
+		}
+		Sim.pEnv->UpdateCurTemp(Sim.CurTime);
+		Sim.LoadSettledState(&Instances[i]->Message); //on-disk cache (if enabled)
+	}
+
+	if (RetMessage){
+		std::ostringstream os;
+		os << "Imported " << NumInstances() << " instances (" << NumSharedImports << " with shared structure).\n";
+		*RetMessage += os.str();
+	}
+	return true;
+}
+
+void CVX_SimBatch::Run(int NumThreads)
+{
+	ShareSettledStates();
+
+	if (NumThreads > NumInstances()) NumThreads = NumInstances();
+	if (NumThreads <= 1){RunBlock(0, NumInstances()); return;}
+
+	std::vector<std::thread> Threads;
+	int First = 0;
+	for (int t=0; t<NumThreads; t++){
+		int Last = (int)((long long)NumInstances()*(t+1)/NumThreads);
+		Threads.push_back(std::thread(&CVX_SimBatch::RunBlock, this, First, Last));
+		First = Last;
+	}
+	for (int t=0; t<NumThreads; t++) Threads[t].join();
+}
+
+void CVX_SimBatch::SaveResultFiles(void)
+{
+	for (int i=0; i<NumInstances(); i++){
+		Instances[i]->Sim.SaveResultFile(Instances[i]->ResultFile);
+	}
+}
+
+void CVX_SimBatch::ShareSettledStates(void)
+{
+	NumSharedSettles = 0;
+	std::vector<std::string> Keys(NumInstances());
+	for (int i=0; i<NumInstances(); i++){
+		CVX_SimGA& Sim = Instances[i]->Sim;
+		if (Sim.GetInitCmTime() <= 0 || Sim.CurStepCount != 0 || Sim.IsSettledStateRestored()) continue; //nothing to share
+		std::ostringstream Key;
+		Sim.WriteSettleKey(Key);
+		Keys[i] = Key.str();
+	}
+
+	for (int i=0; i<NumInstances(); i++){
+		if (Keys[i].empty()) continue;
+		std::vector<int> Followers;
+		for (int j=i+1; j<NumInstances(); j++) if (Keys[j] == Keys[i]) {Followers.push_back(j); Keys[j].clear();}
+		if (Followers.empty()) continue;
+
+		CVX_SimGA& Leader = Instances[i]->Sim;
+		while (!(Leader.CurTime > Leader.GetInitCmTime()) && !Leader.StopConditionMet()) Leader.RunStep(&Instances[i]->Message);
+		if (!(Leader.CurTime > Leader.GetInitCmTime())) continue; //stopped before settling
+
+		std::ostringstream State;
+		Leader.WriteSettledState(State);
+		std::string Data = State.str();
+		for (int f=0; f<(int)Followers.size(); f++){
+			CVX_SimGA& Sim = Instances[Followers[f]]->Sim;
+			if (!Sim.RestoreSettledState(Data)) continue; //simulates the settling itself
+			Sim.pEnv->UpdateCurTemp(Sim.CurTime);
+			NumSharedSettles++;
+		}
+	}
+}
+
+void CVX_SimBatch::RunBlock(int First, int Last)
+{
+	std::vector<bool> Done(Last-First, false);
+	bool Running = true;
+	while (Running){ //one step of every unfinished instance per pass
+		Running = false;
+		for (int i=First; i<Last; i++){
+			if (Done[i-First]) continue;
+			CVX_SimGA& Sim = Instances[i]->Sim;
+			if (Sim.StopConditionMet()){
+				Sim.FinishRun();
+				Done[i-First] = true;
+				continue;
+			}
+			Sim.RunStep(&Instances[i]->Message);
+			Running = true;
+		}
+	}
+}
@@ -0,0 +1,54 @@
+/*******************************************************************************
+Copyright (c) 2010, Jonathan Hiller (Cornell University)
+If used in publication cite "J. Hiller and H. Lipson "Dynamic Simulation of Soft Heterogeneous Objects" In press. (2011)"
+
+This file is part of Voxelyze.
+Voxelyze is free software: you can redistribute it and/or modify it under the terms of the GNU Lesser General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+Voxelyze is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
+*******************************************************************************/
+
+#ifndef VX_SIMBATCH_H
+#define VX_SIMBATCH_H
+
+#include "VX_SimGA.h"
+#include <string>
+#include <vector>
+
+//!Evaluates a batch of individuals side by side
+/*!Intended for batches where many individuals share the same body (controller or phase offset evolution, parameter sweeps). Each instance is loaded from its own VXA file and keeps its own state and result file.
+Instances whose structure matches an already imported one reuse its voxels and bonds (CVX_Sim::ImportShared()) instead of rebuilding them, and instances with the same settle key (CVX_Sim::WriteSettleKey()) simulate the passive settling phase only once.
+The instances are then stepped in lockstep, optionally split into contiguous blocks over several threads.*/
+class CVX_SimBatch
+{
+public:
+	CVX_SimBatch(void); //!< Constructor
+	~CVX_SimBatch(void); //!< Destructor
+
+	bool AddInstance(std::string VXAFile, std::string ResultFile = "", std::string* RetMessage = NULL); //!< Loads an individual. @param[in] VXAFile The VXA file describing the individual. @param[in] ResultFile The file to write the results to. If empty, the FitnessFileName of the VXA is used. @param[out] RetMessage Pointer to an initialized string. Messages generated in this function will be appended to the string.
+	int NumInstances(void) const {return (int)Instances.size();} //!< Returns the number of loaded individuals.
+	CVX_SimGA& GetSim(int Index) {return Instances[Index]->Sim;} //!< Returns the simulator of an individual (i.e. to change settings before Import()).
+
+	bool Import(std::string* RetMessage = NULL); //!< Imports all individuals. @param[out] RetMessage Pointer to an initialized string. Messages generated in this function will be appended to the string.
+	void Run(int NumThreads = 1); //!< Simulates all individuals until their stop conditions are met. @param[in] NumThreads Number of threads to divide the instances over.
+	void SaveResultFiles(void); //!< Writes one result file per individual.
+
+	int NumSharedImports; //!< Number of instances that reused the voxels and bonds of another instance.
+	int NumSharedSettles; //!< Number of instances that reused the settled state of another instance.
+
+private:
+	struct Instance {
+		CVX_Object Object;
+		CVX_Environment Environment;
+		CVX_MeshUtil Mesh;
+		CVX_SimGA Sim;
+		std::string ResultFile;
+		std::string Message;
+	};
+	std::vector<Instance*> Instances;
+
+	void ShareSettledStates(void); //simulates the settling phase once per settle key and copies the result
+	void RunBlock(int First, int Last); //steps instances [First, Last) in lockstep until all are done
+};
+
+#endif //VX_SIMBATCH_H
@@ -10,6 +10,7 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 
 #include "VX_SimGA.h"
 #include <iostream>
+#include <cstdio>
 
 CVX_SimGA::CVX_SimGA()
 {
@@ -19,18 +20,35 @@ CVX_SimGA::CVX_SimGA()
 //	print_scrn = false;
 	WriteFitnessFile = false;
 	FitnessType = FT_NONE;	//no reporting is default
+	ResultFileFormat = RF_XML;
+	AlteredGravity = false;
 
 }
 
 void CVX_SimGA::SaveResultFile(std::string filename, CVX_SimGA* simToCombine)
 {
-	CXML_Rip XML;
-	WriteResultFile(&XML, simToCombine);
-	XML.SaveFile(filename);
-}
+	if (ResultFileFormat == RF_XML){
+		CXML_Rip XML;
+		WriteResultFile(&XML, simToCombine);
+		std::string TmpName = CVX_ResultWriter::TempFileName(filename); //as the streamed formats: only complete files appear under filename
+		XML.SaveFile(TmpName);
+		if (rename(TmpName.c_str(), filename.c_str()) != 0) remove(TmpName.c_str());
+		return;
+	}
 
+	CVX_ResultWriter Writer; //streamed straight to the file
+	if (!Writer.Open(filename, ResultFileFormat)) return;
+	WriteResult(&Writer, simToCombine);
+	Writer.Close();
+}
 
 void CVX_SimGA::WriteResultFile(CXML_Rip* pXML, CVX_SimGA* simToCombine)
+{
+	CVX_ResultWriter Writer(pXML);
+	WriteResult(&Writer, simToCombine);
+}
+
+void CVX_SimGA::WriteResult(CVX_ResultWriter* pWriter, CVX_SimGA* simToCombine)
 {
 // 	float totalPoints = 0;
 // 	float goodSteps = 0;
@@ -91,58 +109,151 @@ void CVX_SimGA::WriteResultFile(CXML_Rip* pXML, CVX_SimGA* simToCombine)
 	}
 
 
-	pXML->DownLevel("Voxelyze_Sim_Result");
-	pXML->SetElAttribute("Version", "1.0");
-	pXML->DownLevel("Fitness");
-	pXML->Element("VoxelNumber", numVoxels);
-	pXML->Element("normAbsoluteDisplacement", normTotalDisplacement);
+	pWriter->BeginGroup("Voxelyze_Sim_Result");
+	pWriter->Attribute("Version", "1.0");
+	CVX_SimGA* pAborted = (GetAbortReason() != EA_NONE) ? this : ((simToCombine && simToCombine->GetAbortReason() != EA_NONE) ? simToCombine : NULL);
+
+	pWriter->BeginGroup("Fitness");
+	if (pAborted) pWriter->Attribute("Partial", 1); //values below were taken at the abort time, not the stop time
+	pWriter->Value("VoxelNumber", numVoxels);
+	pWriter->Value("normAbsoluteDisplacement", normTotalDisplacement);
 	
-	pXML->Element("avgForwardModelError", avgForwardModelError);
+	pWriter->Value("avgForwardModelError", avgForwardModelError);
 
-	pXML->Element("BlockPos", blockPos);
+	pWriter->Value("BlockPos", blockPos);
 
-	pXML->Element("avgRoll", avgRoll);
-	pXML->Element("avgPitch", avgPitch);
-	pXML->Element("avgYaw", avgYaw);
-	pXML->Element("avgStress", avgStress);
-	pXML->Element("avgPressure", avgPressure);
+	pWriter->Value("avgRoll", avgRoll);
+	pWriter->Value("avgPitch", avgPitch);
+	pWriter->Value("avgYaw", avgYaw);
+	pWriter->Value("avgStress", avgStress);
+	pWriter->Value("avgPressure", avgPressure);
 
-    pXML->Element("integratedTiltError", integratedTiltError);
+    pWriter->Value("integratedTiltError", integratedTiltError);
 
-	pXML->Element("avgProprioceptiveError", avgRoll + avgPitch + avgYaw );
+	pWriter->Value("avgProprioceptiveError", avgRoll + avgPitch + avgYaw );
 
-	pXML->Element("avgInteroceptiveError", avgStress + avgPressure);
+	pWriter->Value("avgInteroceptiveError", avgStress + avgPressure);
 
-	pXML->Element("AverageStiffnessChange", avgStiffnessChange);
+	pWriter->Value("AverageStiffnessChange", avgStiffnessChange);
 
-	pXML->Element("normDistX", normDistX);
-	pXML->Element("normDistY", normDistY);
-	pXML->Element("normDistZ", normDistZ);
+	pWriter->Value("normDistX", normDistX);
+	pWriter->Value("normDistY", normDistY);
+	pWriter->Value("normDistZ", normDistZ);
 
 	//if(pEnv->GetAlterGravityHalfway() != 1.0) // Saving extra stats that allow to break down some of the stats of the compound evaluation
 	//{
-		pXML->Element("normAbsDistPhase1", fitPhase1);
-		pXML->Element("normAbsDistPhase2", fitPhase2);
-		pXML->Element("avgStiffChange1", avgStiffChange1);
-		pXML->Element("avgStiffChange2", avgStiffChange2);
+		pWriter->Value("normAbsDistPhase1", fitPhase1);
+		pWriter->Value("normAbsDistPhase2", fitPhase2);
+		pWriter->Value("avgStiffChange1", avgStiffChange1);
+		pWriter->Value("avgStiffChange2", avgStiffChange2);
 	//}
 	
-	pXML->UpLevel();
+	pWriter->End();
+
+	if (pAborted)
+	{
+		pWriter->BeginGroup("EarlyAbort");
+		pWriter->Value("Reason", pAborted->GetAbortReason() == EA_CHECKPOINT ? std::string("Checkpoint") : std::string("Unreachable"));
+		pWriter->Value("Time", pAborted->GetAbortTime());
+		pWriter->Value("StopTime", pAborted->GetStopTime());
+		pWriter->Value("PeakNormSpeed", pAborted->GetAbortPeakSpeed());
+		pWriter->End();
+	}
+
+	int CacheHits = SettleCache.Hits + (simToCombine ? simToCombine->SettleCache.Hits : 0);
+	int CacheMisses = SettleCache.Misses + (simToCombine ? simToCombine->SettleCache.Misses : 0);
+	int CacheStores = SettleCache.Stores + (simToCombine ? simToCombine->SettleCache.Stores : 0);
+	if (SettleCache.IsEnabled() && CacheHits + CacheMisses + CacheStores > 0) //only if a settled state was looked up
+	{
+		pWriter->BeginGroup("SettleCache");
+		pWriter->Value("Hits", CacheHits);
+		pWriter->Value("Misses", CacheMisses);
+		pWriter->Value("Stores", CacheStores);
+		pWriter->End();
+	}
+
+	if (NumCoarseVoxels() > 0)
+	{
+		pWriter->BeginGroup("Coarsening");
+		pWriter->Value("LatticeVoxels", LocalVXC.GetNumVox());
+		pWriter->Value("SimVoxels", NumVox());
+		pWriter->Value("SuperVoxels", NumCoarseVoxels());
+		pWriter->End();
+	}
+
+	if (GetProfiledSteps() > 0) //VX_PROFILE builds only
+	{
+		pWriter->BeginGroup("StepProfile");
+		pWriter->Value("Steps", GetProfiledSteps() + (simToCombine ? simToCombine->GetProfiledSteps() : 0));
+		pWriter->Value("Time", GetProfiledStepTime() + (simToCombine ? simToCombine->GetProfiledStepTime() : 0));
+		pWriter->BeginList("Phases");
+		for (int i=0; i<SP_NUM_PHASES; i++)
+		{
+			StepPhase Phase = (StepPhase)i;
+			pWriter->BeginGroup("Phase");
+			pWriter->Value("Name", std::string(StepPhaseName(Phase)));
+			pWriter->Value("Time", GetStepTime(Phase) + (simToCombine ? simToCombine->GetStepTime(Phase) : 0));
+			pWriter->Value("Calls", GetStepCalls(Phase) + (simToCombine ? simToCombine->GetStepCalls(Phase) : 0));
+			pWriter->Value("Items", GetStepItems(Phase) + (simToCombine ? simToCombine->GetStepItems(Phase) : 0));
+			pWriter->End();
+		}
+		pWriter->End();
+		pWriter->End();
+	}
+
+	if (AreWorkCountersEnabled()) //VX_PROFILE builds only
+	{
+		std::vector<long long> MatWork, CombineWork;
+		std::vector<int> MatNumVox, CombineNumVox;
+		GetMaterialWork(&MatWork, &MatNumVox);
+		if (simToCombine && simToCombine->AreWorkCountersEnabled()) simToCombine->GetMaterialWork(&CombineWork, &CombineNumVox);
+		pWriter->BeginList("WorkCounters");
+		for (int m=0; m<(int)MatNumVox.size(); m++)
+		{
+			if (MatNumVox[m] == 0) continue;
+			pWriter->BeginGroup("Material");
+			pWriter->Value("Index", m);
+			pWriter->Value("Voxels", MatNumVox[m]);
+			for (int c=0; c<WC_NUM_COUNTERS; c++)
+			{
+				long long Total = MatWork[m*WC_NUM_COUNTERS + c] + (m < (int)CombineNumVox.size() ? CombineWork[m*WC_NUM_COUNTERS + c] : 0);
+				pWriter->Value(WorkCounterName((WorkCounter)c), Total);
+			}
+			pWriter->End();
+		}
+		pWriter->End();
+	}
+
+	if (NumBodies() > 1 && (int)BodyIniCM.size() == NumBodies())
+	{
+		pWriter->BeginList("Bodies");
+		for (int b=0; b<NumBodies(); b++)
+		{
+			Vec3D<> Disp = GetBodyNormDisplacement(b);
+			pWriter->BeginGroup("Body"); //own tags: readers that look up a tag anywhere in the file must still find the whole robot's values
+			pWriter->Value("BodyVoxelNumber", GetBodyNumVox(b));
+			pWriter->Value("BodyNormAbsoluteDisplacement", Disp.Length());
+			pWriter->Value("BodyNormDistX", Disp.x);
+			pWriter->Value("BodyNormDistY", Disp.y);
+			pWriter->Value("BodyNormDistZ", Disp.z);
+			pWriter->End();
+		}
+		pWriter->End();
+	}
 
 	if (SS.CMTraceTime.size() > 0)
     {
-        pXML->DownLevel("CMTrace");
-            for(std::vector<vfloat>::size_type i = 0; i != SS.CMTraceTime.size(); ++i)
-            {
-                pXML->DownLevel("TraceStep");
-                    pXML->Element("Time",SS.CMTraceTime[i]);
-                    pXML->Element("TraceX",SS.CMTrace[i].x);
-                    pXML->Element("TraceY",SS.CMTrace[i].y);
-                    pXML->Element("TraceZ",SS.CMTrace[i].z);
-                    pXML->Element("NumTouchingGround",SS.FloorTouchTrace[i]);
-                pXML->UpLevel();
-            }
-        pXML->UpLevel();
+        static const char* TraceColumns[] = {"Time", "TraceX", "TraceY", "TraceZ", "NumTouchingGround"};
+        std::vector<double> Trace(5*SS.CMTraceTime.size());
+        for(std::vector<vfloat>::size_type i = 0; i != SS.CMTraceTime.size(); ++i)
+        {
+            Trace[5*i] = SS.CMTraceTime[i];
+            Trace[5*i+1] = SS.CMTrace[i].x;
+            Trace[5*i+2] = SS.CMTrace[i].y;
+            Trace[5*i+3] = SS.CMTrace[i].z;
+            Trace[5*i+4] = SS.FloorTouchTrace[i];
+        }
+        pWriter->Table("CMTrace", "TraceStep", TraceColumns, 5, &Trace[0], (int)SS.CMTraceTime.size());
 
 //        pXML->DownLevel("SensorMotorData");
 //        for(std::vector<vfloat>::size_type i = 0; i != SS.VoxelIndexTrace.size(); ++i)
@@ -164,7 +275,7 @@ void CVX_SimGA::WriteResultFile(CXML_Rip* pXML, CVX_SimGA* simToCombine)
 //        pXML->UpLevel();
     }
 
-	pXML->UpLevel();
+	pWriter->End();
 
 	// std::cout << "dist: " << dist/LocalVXC.GetLatticeDim()  << std::endl;
 	// // std::cout << "height: " << COMZ << std::endl;
@@ -172,6 +283,36 @@ void CVX_SimGA::WriteResultFile(CXML_Rip* pXML, CVX_SimGA* simToCombine)
 
 }
 
+bool CVX_SimGA::RunStep(std::string* pRetMessage)
+{
+	if(pEnv->GetAlterGravityHalfway() != 1.0 && !AlteredGravity && GetStopConditionType() == SC_MAX_SIM_TIME && CurTime >= GetStopConditionValue()/2)
+	{
+		// Need to save some stats regarding the first phase
+		NormDistPhase1 = getNormCOMdisplacement3D();
+		fitPhase1 = NormDistPhase1.Length();
+		avgStiffChange1 = getAverageStiffnessChange();
+
+		// Altering gravity from this timestep, g = g*gravityMultiplier
+		pEnv->SetGravityAccel( pEnv->GetGravityAccel()*pEnv->GetAlterGravityHalfway() );
+		AlteredGravity = true;
+	}
+
+	bool Result = TimeStep(pRetMessage);
+	pEnv->UpdateCurTemp(CurTime);	//pass in the global time so material temps can be modified
+	return Result;
+}
+
+void CVX_SimGA::FinishRun(void)
+{
+	if(pEnv->GetAlterGravityHalfway() != 1.0 && AlteredGravity)
+	{
+		// Computing phase 2 stats
+		Vec3D<> NormDistPhase2 = NormDistPhase1 - getNormCOMdisplacement3D();
+		fitPhase2 = NormDistPhase2.Length();
+		avgStiffChange2 = getAverageStiffnessChange() - avgStiffChange1;
+	}
+}
+
 void CVX_SimGA::WriteAdditionalSimXML(CXML_Rip* pXML)
 {
 	pXML->DownLevel("GA");
@@ -180,6 +321,7 @@ void CVX_SimGA::WriteAdditionalSimXML(CXML_Rip* pXML)
 		pXML->Element("TrackVoxel", TrackVoxel);
 		pXML->Element("FitnessFileName", FitnessFileName);
 		pXML->Element("WriteFitnessFile", WriteFitnessFile);
+		pXML->Element("ResultFormat", (int)ResultFileFormat);
 	pXML->UpLevel();
 }
 
@@ -191,6 +333,7 @@ bool CVX_SimGA::ReadAdditionalSimXML(CXML_Rip* pXML, std::string* RetMessage)
 		if (pXML->FindLoadElement("FitnessType", &TmpInt)) FitnessType=(FitnessTypes)TmpInt; else Fitness = 0;
 		if (!pXML->FindLoadElement("TrackVoxel", &TrackVoxel)) TrackVoxel = 0;
 		if (!pXML->FindLoadElement("FitnessFileName", &FitnessFileName)) FitnessFileName = "";
+		if (pXML->FindLoadElement("ResultFormat", &TmpInt) && TmpInt >= RF_XML && TmpInt <= RF_BINARY) ResultFileFormat = (ResultFormat)TmpInt; else ResultFileFormat = RF_XML;
 //		if (!pXML->FindLoadElement("WriteFitnessFile", &WriteFitnessFile)) WriteFitnessFile = true;
 		pXML->UpLevel();
 	}
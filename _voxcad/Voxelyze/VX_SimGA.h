@@ -14,6 +14,7 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 //wrapper class for VX_Sim with convenience functions and nomenclature for using Voxelyze within a genetic algorithm.
 
 #include "VX_Sim.h"
+#include "VX_ResultWriter.h"
 
 enum FitnessTypes{FT_NONE, FT_CENTER_MASS_DIST, FT_VOXEL_DIST};
 class CVX_SimGA : public CVX_Sim
@@ -25,15 +26,23 @@ public:
 
 	void SaveResultFile(std::string filename, CVX_SimGA* simToCombine = NULL);
 	void WriteResultFile(CXML_Rip* pXML, CVX_SimGA* simToCombine = NULL); // second argument allows to pass an additional SimGA object and combine results between "this" and simToCombine (used when evaluating an individual in multiple environments and combining the fitness)
+	void WriteResult(CVX_ResultWriter* pWriter, CVX_SimGA* simToCombine = NULL); //!< Writes the results in any format. SaveResultFile() uses ResultFileFormat.
 
 	void WriteAdditionalSimXML(CXML_Rip* pXML);
 	bool ReadAdditionalSimXML(CXML_Rip* pXML, std::string* RetMessage = NULL);
 
+	bool RunStep(std::string* pRetMessage = NULL); //!< Advances one evaluation time step: alters gravity halfway through if requested, steps the simulation and updates the environment temperature.
+	void FinishRun(void); //!< Computes the statistics of the second gravity phase (if any). Call once the stop condition has been met.
+
 	float Fitness;	//!<Keeps track of whatever fitness we choose to track
 	FitnessTypes FitnessType; //!<Holds the fitness reporting type. For now =0 tracks the center of mass, =1 tracks a particular Voxel number
 	int	TrackVoxel;		//!<Holds the particular voxel that will be tracked (if used).
 	std::string FitnessFileName;	//!<Holds the filename of the fitness output file that might be used
 	bool WriteFitnessFile;
+	ResultFormat ResultFileFormat; //!<Format of the result file written by SaveResultFile(): XML (default), NDJSON or binary
+
+	bool AlteredGravity; //!<True once gravity has been altered halfway through the evaluation
+	Vec3D<> NormDistPhase1; //!<Normalized COM displacement when gravity was altered
 //	bool print_scrn;	//!<flags whether status will be sent to the console
 
 };
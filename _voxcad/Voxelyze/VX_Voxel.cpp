@@ -23,6 +23,9 @@ CVX_Voxel::CVX_Voxel(CVX_Sim* pSimIn, int SIndexIn, int XIndexIn, int MatIndexIn
 		InternalBondIndices[i] = NO_BOND;
 		InternalBondPointers[i] = NULL;
 	}
+	ExtraBondIndices.clear();
+	ExtraBondPointers.clear();
+	ExtraBondVox2.clear();
 	NearbyVoxInds.clear();
 
 	NominalPosition = NominalPositionIn; //nominal position, if this is fixed
@@ -53,6 +56,9 @@ CVX_Voxel& CVX_Voxel::operator=(const CVX_Voxel& VIn)
 		InternalBondIndices[i] = VIn.InternalBondIndices[i];
 		InternalBondPointers[i] = VIn.InternalBondPointers[i];		
 	}
+	ExtraBondIndices = VIn.ExtraBondIndices;
+	ExtraBondPointers = VIn.ExtraBondPointers;
+	ExtraBondVox2 = VIn.ExtraBondVox2;
 
 	NearbyVoxInds = VIn.NearbyVoxInds;
 
@@ -91,10 +97,16 @@ void CVX_Voxel::SetExternalTDisp(const Axis AxisIn, const vfloat TDispIn) //Sets
 	}
 }
 
+void CVX_Voxel::LinkToSim(CVX_Sim* pSimIn)
+{
+	pSim = pSimIn;
+	if (MatIndex >= 0 && MatIndex < (int)pSim->LocalVXC.Palette.size()) _pMat = pSim->LocalVXC.GetBaseMat(MatIndex); //material temperatures are per simulation
+}
+
 bool CVX_Voxel::SetMaterial(const int MatIndexIn) {
 	MatIndex = MatIndexIn;
 
-	if (MatIndexIn < 0 || MatIndexIn >= pSim->LocalVXC.Palette.size()){
+	if (MatIndexIn < 0 || MatIndexIn >= (int)pSim->LocalVXC.Palette.size()){
 //		CacheMaterial(NULL); //ensure everything is set to zero
 		_pMat = NULL;
 		Mass = Inertia = FirstMoment = _massInv = _inertiaInv = _2xSqMxExS = _2xSqIxExSxSxS = 0;
@@ -132,6 +144,13 @@ bool CVX_Voxel::LinkInternalBond(int SBondIndex, BondDir ThisBondDir) //simulati
 {
 	if (!pSim || SBondIndex >= pSim->BondArrayInternal.size()) return false;
 	
+	if (InternalBondIndices[(int)ThisBondDir] != NO_BOND){ //face already has a bond (coarsened voxel)
+		ExtraBondIndices.push_back(SBondIndex);
+		ExtraBondPointers.push_back(&(pSim->BondArrayInternal[SBondIndex]));
+		ExtraBondVox2.push_back(IAmInternalVox2((int)ThisBondDir));
+		return true;
+	}
+
 	InternalBondIndices[(int)ThisBondDir] = SBondIndex;
 	InternalBondPointers[(int)ThisBondDir] = &(pSim->BondArrayInternal[SBondIndex]);
 
@@ -145,6 +164,7 @@ void CVX_Voxel::UpdateInternalBondPtrs() //updates all links (pointers) to bonds
 		if (InternalBondIndices[i] == NO_BOND) InternalBondPointers[i] = NULL;
 		else InternalBondPointers[i] = &(pSim->BondArrayInternal[InternalBondIndices[i]]);
 	}
+	for (int i=0; i<(int)ExtraBondIndices.size(); i++) ExtraBondPointers[i] = &(pSim->BondArrayInternal[ExtraBondIndices[i]]);
 }
 
 
@@ -168,30 +188,34 @@ void CVX_Voxel::FixDof(char DofFixedIn) //fixes any of the degrees of freedom in
 
 }
 
-void CVX_Voxel::CalcNearby(CVX_Sim* pSim, int NumHops) //populates pNearbyVox
+void CVX_Voxel::CalcNearby(CVX_Sim* pSim, int NumHops, std::vector<int>* pFound) //populates pNearbyVox
 {
 	NearbyVoxInds.clear();
 	int StartPoint = 0; //our enter and exit point (so we don't repeat for each iteration
 	int StopPoint = 1;
 
 	NearbyVoxInds.push_back(MySIndex);
+	if (pFound) (*pFound)[MySIndex] = MySIndex;
 
 	for (int i=0; i<NumHops; i++){
 		for (int j=StartPoint; j<StopPoint; j++){ //go through the list from the most recent interation...
 			CVX_Voxel* pThisVox = &(pSim->VoxArray[NearbyVoxInds[j]]);
 
-			for (int k=0; k<6; k++){ //look at all the potential (permanent) bonds of this voxel
+			for (int k=0; k<pThisVox->NumInternalBondSlots(); k++){ //look at all the potential (permanent) bonds of this voxel
 //				if (pNearbyVox(j)->InternalBondIndices[k] != NO_BOND){
-				if (pThisVox->InternalBondIndices[k] != NO_BOND){
+				if (pThisVox->GetpInternalBondSlot(k) != NULL){
 //					int OtherSIndex = (pNearbyVox(j)->IAmInternalVox2(k)) ? pNearbyVox(j)->InternalBondPointers[k]->GetpV1()->MySIndex  : pNearbyVox(j)->InternalBondPointers[k]->GetpV2()->MySIndex;
-					int OtherSIndex = (pThisVox->IAmInternalVox2(k)) ? pThisVox->InternalBondPointers[k]->GetpV1()->MySIndex  : pThisVox->InternalBondPointers[k]->GetpV2()->MySIndex;
+					int OtherSIndex = (pThisVox->IAmInternalVox2Slot(k)) ? pThisVox->GetpInternalBondSlot(k)->GetpV1()->MySIndex  : pThisVox->GetpInternalBondSlot(k)->GetpV2()->MySIndex;
 
 					//get the other voxel in this bond...
 					//int OtherSIndex = pNearbyVox(j)->GetBond(k)->GetpV1()->MySIndex;
 					//if (pNearbyVox(j)->IsMe(pNearbyVox(j)->GetBond(k)->GetpV1()))  OtherSIndex = pNearbyVox(j)->GetBond(k)->GetpV2()->MySIndex; //if this voxel 1
 
 					//Add it to the list if its not already on it.
-					if (!IsNearbyVox(OtherSIndex)) NearbyVoxInds.push_back(OtherSIndex);
+					if (pFound){
+						if ((*pFound)[OtherSIndex] != MySIndex){(*pFound)[OtherSIndex] = MySIndex; NearbyVoxInds.push_back(OtherSIndex);}
+					}
+					else if (std::find(NearbyVoxInds.begin(), NearbyVoxInds.end(), OtherSIndex) == NearbyVoxInds.end()) NearbyVoxInds.push_back(OtherSIndex);
 				}
 			}
 			//for (int k=0; k<pNearbyVox(j)->GetNumLocalBonds(); k++){ //look at all the bonds of this voxel
@@ -206,6 +230,7 @@ void CVX_Voxel::CalcNearby(CVX_Sim* pSim, int NumHops) //populates pNearbyVox
 		StartPoint = StopPoint;
 		StopPoint = NumNearbyVox();
 	}
+	std::sort(NearbyVoxInds.begin(), NearbyVoxInds.end()); //for IsNearbyVox()
 }
 
 //bool CVX_Voxel::IsLinear() //returns true if the material model is linear
@@ -13,6 +13,7 @@ See <http://www.opensource.org/licenses/lgpl-3.0.html> for license details.
 
 #include "Utils/Vec3D.h"
 #include <vector>
+#include <algorithm>
 #include "VX_Enums.h"
 
 #include <iostream>
@@ -29,6 +30,7 @@ public:
 	~CVX_Voxel(void);
 	CVX_Voxel(const CVX_Voxel& VIn) {*this = VIn;} //copy constructor
 	CVX_Voxel& operator=(const CVX_Voxel& VIn);
+	void LinkToSim(CVX_Sim* pSimIn); //Moves this voxel to another simulation with an identical palette (keeps all material dependent parameters)
 
 	//internal info
 	bool LinkInternalBond(int SBondIndex, BondDir ThisBondDir); //Informs this voxel of it's participation in an internal bond to cache the link. (required to account for forces from this bond when summing for voxel)
@@ -37,6 +39,11 @@ public:
 	inline bool IAmInternalVox1(const int BondDirIndex) const {return !IAmInternalVox2(BondDirIndex);} //returns true if this voxel is Vox1 of the specified bond
 	inline bool IAmInternalVox2(const int BondDirIndex) const {return BondDirIndex%2;} //returns true if this voxel is Vox2 of the specified bond
 
+	//all internal bonds: the six face slots above followed by any extra bonds of a coarsened voxel (which can touch several smaller voxels per face)
+	inline int NumInternalBondSlots(void) const {return 6+(int)ExtraBondIndices.size();}
+	inline CVXS_BondInternal* GetpInternalBondSlot(const int Slot) const {return Slot<6 ? InternalBondPointers[Slot] : ExtraBondPointers[Slot-6];}
+	inline bool IAmInternalVox2Slot(const int Slot) const {return Slot<6 ? IAmInternalVox2(Slot) : ExtraBondVox2[Slot-6];}
+
 
 	inline Vec3D<> GetNominalPosition(void) const {return NominalPosition;}
 	inline vfloat GetNominalSize(void) const {return NominalSize;}
@@ -78,8 +85,8 @@ public:
 	inline char GetDofFixed(void) const {return DofFixed;}
 
 	//Nearby voxel info information
-	void CalcNearby(CVX_Sim* pSim, int NumHops); //populates NearbyVoxInds[] with all voxel within specified number of hops in the internal lattice. Does not jump gaps.
-	inline bool IsNearbyVox(int GlobalSVoxInd) {int NumNear=NumNearbyVox(); for (int i=0; i<NumNear; i++) if (NearbyVoxInds[i] == GlobalSVoxInd) return true; return false;} //returns true if the requested voxel is in the NearbyVoxInds[] list
+	void CalcNearby(CVX_Sim* pSim, int NumHops, std::vector<int>* pFound = NULL); //populates NearbyVoxInds[] with all voxel within specified number of hops in the internal lattice. Does not jump gaps. pFound: optional scratch array with an entry per voxel, none of them equal to this voxel's index beforehand, to check for voxels already found in constant time.
+	inline bool IsNearbyVox(int GlobalSVoxInd) {return std::binary_search(NearbyVoxInds.begin(), NearbyVoxInds.end(), GlobalSVoxInd);} //returns true if the requested voxel is in the NearbyVoxInds[] list
 	bool IsSurfaceVoxel() {for (int i=0; i<6; i++){if (InternalBondIndices[i] == NO_BOND) return true;} return false;}; //returns true if any face of the voxel is exposed
 
 
@@ -92,10 +99,13 @@ protected:
 	//internal connections
 	int InternalBondIndices[6]; //bonds in the six ordinate directions according to BD_PX, BD_NX, etc.
 	CVXS_BondInternal* InternalBondPointers[6]; //cached pointers to InternalBondIndices
+	std::vector<int> ExtraBondIndices; //further bonds on already occupied faces (coarsened voxels only)
+	std::vector<CVXS_BondInternal*> ExtraBondPointers; //cached pointers to ExtraBondIndices
+	std::vector<bool> ExtraBondVox2; //true where this voxel is Vox2 of the extra bond
 
 	//Nearby voxel information
 	int NumNearbyVox(void){return (int)NearbyVoxInds.size();} //how many voxels are nearby in the internal lattice according to last call of CalcNearby()
-	std::vector<int> NearbyVoxInds; //which voxels are close by in the internal lattice according to last call of CalcNearby()
+	std::vector<int> NearbyVoxInds; //which voxels are close by in the internal lattice according to last call of CalcNearby() (sorted)
 
 	//nominal (original) state...
 	Vec3D<> NominalPosition; //Original position upon import. This will  never change in the course of the simulation.
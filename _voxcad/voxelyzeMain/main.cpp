@@ -3,15 +3,88 @@
 #include "VX_Environment.h"
 #include "VX_Sim.h"
 #include "VX_SimGA.h"
+#include "VX_SimBatch.h"
+#include "VX_Benchmark.h"
+#ifdef USE_OPEN_GL
+#include "VXS_SimGLView.h"
+#include "VXS_OffscreenView.h"
+#include <iomanip>
+#include <sstream>
+#endif
+
+
+// command line overrides of the vxa settings
+struct Options
+{
+	std::string settleCacheDir;
+	float abortTargetDisp; // < 0: keep the vxa setting
+	std::vector< std::pair<float, float> > abortCheckpoints;
+	int coarsenBlock; // 0: keep the vxa setting
+	int resultFormat; // < 0: keep the vxa setting
+	bool workCounters; // count the work done per voxel and material (needs a library built with VX_PROFILE)
+};
+
+// headless video capture (only with an OpenGL build)
+struct VideoOptions
+{
+	std::string folder; // empty: no video
+	float fps; // frames per second of simulated time
+	int width, height;
+};
+
+void applyOptions(CVX_SimGA& Sim, const Options& opts)
+{
+	if (opts.settleCacheDir != "")
+	{
+		Sim.SettleCache.SetDirectory(opts.settleCacheDir);
+	}
+	if (opts.abortTargetDisp >= 0)
+	{
+		Sim.SetAbortTargetDisp(opts.abortTargetDisp);
+	}
+	if (opts.abortCheckpoints.size() > 0) // replace any checkpoints from the vxa
+	{
+		Sim.ClearAbortCheckpoints();
+		for (size_t c = 0; c < opts.abortCheckpoints.size(); c++) Sim.AddAbortCheckpoint(opts.abortCheckpoints[c].first, opts.abortCheckpoints[c].second);
+	}
+	if (opts.coarsenBlock > 0)
+	{
+		Sim.SetCoarsening(opts.coarsenBlock);
+	}
+	if (opts.resultFormat >= 0)
+	{
+		Sim.ResultFileFormat = (ResultFormat)opts.resultFormat;
+	}
+	Sim.EnableWorkCounters(opts.workCounters);
+}
 
 
 int main(int argc, char *argv[])
 {
-	char* InputFile;
+	char* InputFile = NULL;
+	std::vector<std::string> InputFiles; // more than one: evaluate them as a batch
+	int numThreads = 1;
 	bool print_scrn = false;
+	bool printProfile = false;
 	bool compoundTerrestrialEnvironment = false;
+	int parseBenchRepeats = 0;
+	std::string voxelizeBenchFile = "";
+	int voxelizeBenchRes = 0;
 
 	std::string fitnessFileName = "";
+	Options opts;
+	opts.abortTargetDisp = -1;
+	opts.coarsenBlock = 0;
+	opts.resultFormat = -1;
+	opts.workCounters = false;
+	VideoOptions video;
+	video.fps = 30;
+	video.width = 800;
+	video.height = 600;
+#ifdef USE_OPEN_GL
+	int videoFrameNumber = 0;
+#endif
+	CXML_Rip::DefaultPullParser = true; // load through the streaming backend unless -xmlparser tinyxml (only here, so VoxCad keeps its own parser)
 
 	//bool twoGravityLevels = false;
 	//float gravityMultiplier = 0.0;
@@ -29,6 +102,7 @@ int main(int argc, char *argv[])
 			if (strcmp(argv[i],"-f") == 0) 
 			{
 				InputFile = argv[i + 1];	// We know the next argument *should* be the filename:
+				InputFiles.push_back(InputFile);
 			}
 			else if (strcmp(argv[i], "-of") == 0)
 			{
@@ -42,6 +116,64 @@ int main(int argc, char *argv[])
 				//std::cout << "twoGravityLevels,  gravityMultiplier = " << gravityMultiplier << std::endl;
 
 			}*/
+			else if (strcmp(argv[i], "-cache") == 0)
+			{
+			    opts.settleCacheDir = argv[i + 1]; // directory of the settled state cache (overrides the vxa setting)
+			}
+			else if (strcmp(argv[i], "-abort") == 0)
+			{
+			    opts.abortTargetDisp = atof(argv[i + 1]); // give up once this normalized displacement is out of reach (overrides the vxa setting)
+			}
+			else if (strcmp(argv[i], "-checkpoint") == 0 && i + 2 < argc)
+			{
+			    opts.abortCheckpoints.push_back(std::make_pair((float)atof(argv[i + 1]), (float)atof(argv[i + 2]))); // give up if the normalized displacement at time argv[i+1] is below argv[i+2]
+			}
+			else if (strcmp(argv[i], "-coarsen") == 0)
+			{
+			    opts.coarsenBlock = atoi(argv[i + 1]); // merge passive interior blocks of up to this many voxels per edge (2 or 4, 1 disables)
+			}
+			else if (strcmp(argv[i], "-resultformat") == 0)
+			{
+			    if (strcmp(argv[i + 1], "xml") == 0) opts.resultFormat = RF_XML; // format of the result file: "xml", "ndjson" or "binary" (overrides the vxa setting)
+			    else if (strcmp(argv[i + 1], "ndjson") == 0) opts.resultFormat = RF_NDJSON;
+			    else if (strcmp(argv[i + 1], "binary") == 0) opts.resultFormat = RF_BINARY;
+			}
+			else if (strcmp(argv[i], "-xmlparser") == 0)
+			{
+			    CXML_Rip::DefaultPullParser = (strcmp(argv[i + 1], "tinyxml") != 0); // "tinyxml" or "stream" (default)
+			}
+			else if (strcmp(argv[i], "-parsebench") == 0)
+			{
+			    parseBenchRepeats = atoi(argv[i + 1]); // only time loading the input file with both xml backends
+			}
+			else if (strcmp(argv[i], "-voxelizebench") == 0 && i + 2 < argc)
+			{
+			    voxelizeBenchFile = argv[i + 1]; // only time voxelizing this stl file ("torus" for a generated mesh) at argv[i+2] voxels along its longest side
+			    if (voxelizeBenchFile == "torus") voxelizeBenchFile = "";
+			    voxelizeBenchRes = atoi(argv[i + 2]);
+			}
+			else if (strcmp(argv[i], "-video") == 0 && i + 2 < argc)
+			{
+			    video.folder = argv[i + 1]; // render a frame every 1/argv[i+2] seconds of simulated time into this folder (needs an OpenGL build)
+			    video.fps = atof(argv[i + 2]);
+			}
+			else if (strcmp(argv[i], "-videosize") == 0 && i + 2 < argc)
+			{
+			    video.width = atoi(argv[i + 1]); // frame size in pixels (default 800 600)
+			    video.height = atoi(argv[i + 2]);
+			}
+			else if (strcmp(argv[i], "-threads") == 0)
+			{
+			    numThreads = atoi(argv[i + 1]); // threads to divide a batch over
+			}
+			else if (strcmp(argv[i], "-profile") == 0)
+			{
+			    printProfile = true; // print where the time of each step went (needs a library built with VX_PROFILE)
+			}
+			else if (strcmp(argv[i], "-workcounts") == 0)
+			{
+			    opts.workCounters = true; // print the work done per material and a histogram of the work per voxel at the end of the run
+			}
 			else if (strcmp(argv[i],"-p") == 0) 
 			{
 				print_scrn=true;	//decide if output to the console is desired
@@ -55,10 +187,76 @@ int main(int argc, char *argv[])
 
 	} 
 
-	CVX_SimGA Simulator[2];
+	if ((printProfile || opts.workCounters) && !CVX_Sim::IsStepProfileCompiled())
+	{
+		std::cout << "This voxelyze was built without VX_PROFILE, not profiling steps or counting work.\n";
+		printProfile = false;
+		opts.workCounters = false;
+	}
+
+	if (parseBenchRepeats > 0)
+	{
+		if (InputFile == NULL)
+		{
+			std::cout << "\n-parsebench needs an input file (-f). Quitting.\n";
+			return(0);
+		}
+		CVX_Benchmark Bench;
+		std::string ReturnMessage;
+		bool Same = Bench.XMLParseTest(InputFile, parseBenchRepeats, &ReturnMessage);
+		std::cout << ReturnMessage;
+		return Same ? 1 : 0;
+	}
 
+	if (voxelizeBenchRes > 0)
+	{
+		CVX_Benchmark Bench;
+		std::string ReturnMessage;
+		bool Same = Bench.VoxelizeTest(voxelizeBenchFile, voxelizeBenchRes, &ReturnMessage);
+		std::cout << ReturnMessage;
+		return Same ? 1 : 0;
+	}
+
+	if (InputFiles.size() > 1) // several individuals (typically the same body with different controllers): one result file each, as named in their vxa files
+	{
+		if (compoundTerrestrialEnvironment) std::cout << "Compound environments are not supported for batches, ignoring." << std::endl;
+
+		CVX_SimBatch Batch;
+		std::string ReturnMessage;
+		for (size_t i = 0; i < InputFiles.size(); i++)
+		{
+			if (!Batch.AddInstance(InputFiles[i], "", &ReturnMessage))
+			{
+				if (print_scrn) std::cout << ReturnMessage << "\nProblem importing VXA file. Quitting\n";
+				return(0);
+			}
+			applyOptions(Batch.GetSim((int)i), opts);
+		}
+
+		if (!Batch.Import(&ReturnMessage))
+		{
+			if (print_scrn) std::cout << ReturnMessage << "\nProblem importing batch. Quitting\n";
+			return(0);
+		}
+		Batch.Run(numThreads);
+		if (print_scrn) std::cout << ReturnMessage << Batch.NumSharedSettles << " instances reused a settled state.\n";
+		if (printProfile || opts.workCounters)
+		{
+			for (int i = 0; i < Batch.NumInstances(); i++)
+			{
+				std::string ProfileMessage;
+				if (printProfile) Batch.GetSim(i).GetStepProfile(&ProfileMessage);
+				Batch.GetSim(i).GetWorkHistogram(&ProfileMessage);
+				std::cout << InputFiles[i] << ": " << ProfileMessage;
+			}
+		}
+
+		Batch.SaveResultFiles();
+		return 1;
+	}
+
+	CVX_SimGA Simulator[2];
 
-	Vec3D<> normDistPhase1, normDistPhase2;
 
 	for(int count = 0; count < 2; count++)
 	{
@@ -93,6 +291,7 @@ int main(int argc, char *argv[])
         {
         std::cout << fitnessFileName.c_str() << std::endl;
         }
+        applyOptions(Simulator[count], opts);
 
 		std::string ReturnMessage;
 		if (print_scrn) std::cout << "\nImporting Environment into simulator...\n";
@@ -120,10 +319,47 @@ int main(int argc, char *argv[])
 		}*/
 
 
-		bool alreadyAlteredGravity = false; 
+		// skip the passive settling phase if this configuration has been evaluated before
+		if (Simulator[count].LoadSettledState(&ReturnMessage))
+		{
+			Step = Simulator[count].CurStepCount;
+			Time = Simulator[count].CurTime;
+			Simulator[count].pEnv->UpdateCurTemp(Time);
+			if (print_scrn) std::cout << "Restored settled state at: " << Time << std::endl;
+		}
+
+#ifdef USE_OPEN_GL
+		// headless video: frames are rendered offscreen between steps and written by a background thread
+		CVXS_SimGLView VideoView(&Simulator[count]);
+		VideoView.SetCurViewVox(RVV_DISCRETE); // the deformed mesh view needs a mesh built from the object
+		CVXS_OffscreenView Offscreen(&VideoView);
+		CVXS_FrameWriter FrameWriter;
+		CVXS_Frame Frame;
+		vfloat NextFrameTime = Time;
+		if (video.folder != "" && video.fps > 0)
+		{
+			std::string VideoMessage;
+			if (Offscreen.Open(video.width, video.height, &VideoMessage)) FrameWriter.Start();
+			else std::cout << VideoMessage << "Not recording video.\n";
+		}
+#else
+		if (video.folder != "" && count == 0) std::cout << "This voxelyze was built without OpenGL, not recording video.\n";
+#endif
 
 		while (not Simulator[count].StopConditionMet())
 		{
+#ifdef USE_OPEN_GL
+			if (Offscreen.IsOpen() && Time >= NextFrameTime)
+			{
+				Offscreen.RenderFrame(&Frame);
+				std::ostringstream path;
+				path << video.folder << "/" << std::setw(6) << std::setfill('0') << videoFrameNumber++ << ".ppm";
+				Frame.FilePath = path.str();
+				FrameWriter.Push(Frame);
+				NextFrameTime += 1.0/video.fps;
+			}
+#endif
+
 			/*if(twoGravityLevels && !alreadyAlteredGravity && Time >= Simulator[count].GetStopConditionValue()/2)
 			{
 				// Altering gravity the second time, g = g*gravityMultiplier
@@ -132,21 +368,6 @@ int main(int argc, char *argv[])
 				alreadyAlteredGravity = true;
 			}*/
 
-			if(Environment.GetAlterGravityHalfway() != 1.0 && !alreadyAlteredGravity && Simulator[count].GetStopConditionType() == SC_MAX_SIM_TIME && Time >= Simulator[count].GetStopConditionValue()/2)
-			{
-				// Need to save some stats regarding the first phase
-				normDistPhase1 = Simulator[count].getNormCOMdisplacement3D();
-				Simulator[count].fitPhase1 = normDistPhase1.Length();				
-				Simulator[count].avgStiffChange1 = Simulator[count].getAverageStiffnessChange();
-
-				//std::cout << "About to alter gravity, norm dist phase 1 is: " << fitPhase1 << ", avgStiffChange1 = "<< avgStiffChange1 << std::endl;
-				// Altering gravity from this timestep, g = g*gravityMultiplier
-				Environment.SetGravityAccel( Environment.GetGravityAccel()*Environment.GetAlterGravityHalfway() );
-				//std::cout << "t = " << Time <<"/"<< Simulator[count].GetStopConditionValue() <<": altering gravity from now on: " << Environment.GetGravityAccel() << std::endl;
-				alreadyAlteredGravity = true;
-			}
-
-
 			// do some reporting via the stdoutput if required:
 			if (Step%100 == 0.0 && print_scrn) //Only output every n time steps
 			{
@@ -162,28 +383,37 @@ int main(int argc, char *argv[])
 				// std::cout << "Vox[10] Scale: " << Simulator.VoxArray[10].GetCurScale() << std::endl;
 			}
 
-			//do the actual simulation step
-			Simulator[count].TimeStep(&ReturnMessage);
+			//do the actual simulation step (alters gravity halfway through if requested and updates the temperature)
+			Simulator[count].RunStep(&ReturnMessage);
 			Step += 1;	//increment the step counter
-			Time += Simulator[count].dt;	//update the sim tim after the step
-			Simulator[count].pEnv->UpdateCurTemp(Time);	//pass in the global time, and a pointer to the local object so its material temps can be modified (nac: pointer removed for debugging)	
+			Time = Simulator[count].CurTime;	//update the sim tim after the step
 		}
 
 
-		if(Environment.GetAlterGravityHalfway() != 1.0 && alreadyAlteredGravity)
+		Simulator[count].FinishRun(); // phase 2 stats if gravity was altered
+
+		if (printProfile || opts.workCounters)
 		{
-			// Computing phase 2 stats
-			normDistPhase2 = normDistPhase1 - Simulator[count].getNormCOMdisplacement3D();
-			Simulator[count].fitPhase2 = normDistPhase2.Length();
-			Simulator[count].avgStiffChange2 = Simulator[count].getAverageStiffnessChange() - Simulator[count].avgStiffChange1;
+			std::string ProfileMessage;
+			if (printProfile) Simulator[count].GetStepProfile(&ProfileMessage);
+			Simulator[count].GetWorkHistogram(&ProfileMessage);
+			std::cout << ProfileMessage;
+		}
 
-			//std::cout << "Norm dist phase 2 is: " << fitPhase2 << ", avgStiffChange2 = "<< avgStiffChange2 << std::endl;			
+#ifdef USE_OPEN_GL
+		if (FrameWriter.IsRunning())
+		{
+			std::string VideoMessage;
+			FrameWriter.Finish(&VideoMessage);
+			if (print_scrn) std::cout << "Video: " << VideoMessage;
 		}
+#endif
 
 
 		if (print_scrn) std::cout << "Ended at: " << Time << std::endl;
+		if (print_scrn && Simulator[count].GetAbortReason() != EA_NONE) std::cout << "Evaluation aborted early, partial result" << std::endl;
 		
-		if( (!compoundTerrestrialEnvironment) ) // && (!twoGravityLevels)) // Returning if we had a single Simulator invokation (no need to combine results two instances)
+		if( (!compoundTerrestrialEnvironment) || (count == 0 && Simulator[count].GetAbortReason() != EA_NONE) ) // && (!twoGravityLevels)) // Returning if we had a single Simulator invokation (no need to combine results two instances), or if the first one was given up on
 		{
 			Simulator[count].SaveResultFile(Simulator[count].FitnessFileName);
 			return 1; //code for successful completion  // could return fitness value if greater efficiency is desired
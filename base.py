@@ -25,7 +25,7 @@ class Sim(VoxCadParams):
     def __init__(self, self_collisions_enabled=True, simulation_time=10.5, dt_frac=0.9, stop_condition=2,
                  fitness_eval_init_time=0.5, actuation_start_time=0, equilibrium_mode=0, min_temp_fact=0.1,
                  max_temp_fact_change=0.00001, max_stiffness_change=10000, min_elastic_mod=5e006,
-                 max_elastic_mod=5e008, damp_evolved_stiffness=True):
+                 max_elastic_mod=5e008, damp_evolved_stiffness=True, result_format=0):
 
         VoxCadParams.__init__(self)
 
@@ -45,6 +45,7 @@ class Sim(VoxCadParams):
         self.min_elastic_mod = min_elastic_mod
         self.max_elastic_mod = max_elastic_mod
         self.damp_evolved_stiffness = damp_evolved_stiffness
+        self.result_format = result_format  # 0: xml, 1: ndjson, 2: binary (see read_voxelyze_result_file)
 
 
 class Env(VoxCadParams):
@@ -1,5 +1,8 @@
 import hashlib
+import json
+from collections import OrderedDict
 import os
+import struct
 import time
 import random
 import numpy as np
@@ -16,16 +19,33 @@ def read_voxlyze_results(population, print_log, filename="softbotsOutput.xml"):
             file_size = os.stat(filename).st_size
             this_file = open(filename)
             this_file.close()
-        except ImportError:  # TODO: is this the correct exception?
+        except (IOError, OSError):
             file_size = 0
         i += 1
-        time.sleep(1)
+        if file_size == 0:
+            time.sleep(1)
 
     if file_size == 0:
         print_log.message("ERROR: Cannot find a non-empty fitness file in %d attempts: abort" % max_attempts)
         exit(1)
 
     results = {rank: None for rank in range(len(population.objective_dict))}
+
+    with open(filename, "rb") as this_file:
+        streamed = this_file.read(1) != b"<"  # ndjson or binary result file (see Sim.result_format)
+    if streamed:
+        result = read_voxelyze_result_file(filename)
+        for rank, details in population.objective_dict.items():
+            tag = details["tag"]
+            if tag is None:
+                continue
+            value = find_result_value(result, tag.strip("<>"))
+            if tag == "<CMTrace>" and value is not None:
+                results[rank] = list(zip(*[np.asarray(value[axis]).tolist() for axis in ["TraceX", "TraceY", "TraceZ"]]))
+            elif value is not None:
+                results[rank] = float(value)
+        return results
+
     for rank, details in population.objective_dict.items():
         this_file = open(filename)  # TODO: is there a way to just go back to the first line without reopening the file?
         tag = details["tag"]
@@ -62,6 +82,89 @@ def read_voxlyze_results(population, print_log, filename="softbotsOutput.xml"):
     return results
 
 
+def read_voxelyze_result_file(filename):
+    """Reads a result file written by voxelyze in the ndjson or binary format (-resultformat, or <ResultFormat> 1 or 2
+    in the vxa GA section) into nested dicts that mirror the xml result: groups are dicts, lists (e.g. Bodies) are lists
+    of dicts and tables (CMTrace) are dicts of columns. Values that were NaN or infinite are None in ndjson files.
+    """
+    with open(filename, "rb") as this_file:
+        data = this_file.read()
+
+    if data[:4] != b"VXRB":
+        return json.loads(data.decode("utf-8").split("\n", 1)[0], object_pairs_hook=OrderedDict)
+
+    # binary: magic, version, then records of type, name length, name and a payload (see VX_ResultWriter.h)
+    root = OrderedDict()
+    stack = [root]
+    pos = 5
+
+    def read_name(at):
+        length = struct.unpack_from("<B", data, at)[0]
+        return data[at + 1:at + 1 + length].decode("utf-8"), at + 1 + length
+
+    def add(name, value):
+        if isinstance(stack[-1], list):
+            stack[-1].append(value)
+        else:
+            stack[-1][name] = value
+
+    while pos < len(data):
+        kind = data[pos:pos + 1]
+        name, pos = read_name(pos + 1)
+        if kind == b"G" or kind == b"L":
+            child = OrderedDict() if kind == b"G" else []
+            add(name, child)
+            stack.append(child)
+        elif kind == b"E":
+            stack.pop()
+        elif kind == b"i":
+            add(name, struct.unpack_from("<q", data, pos)[0])
+            pos += 8
+        elif kind == b"d":
+            add(name, struct.unpack_from("<d", data, pos)[0])
+            pos += 8
+        elif kind == b"s":
+            length = struct.unpack_from("<I", data, pos)[0]
+            add(name, data[pos + 4:pos + 4 + length].decode("utf-8"))
+            pos += 4 + length
+        elif kind == b"T":
+            _, pos = read_name(pos)  # xml row tag
+            num_cols = struct.unpack_from("<H", data, pos)[0]
+            pos += 2
+            columns = []
+            for c in range(num_cols):
+                col, pos = read_name(pos)
+                columns += [col]
+            num_rows = struct.unpack_from("<I", data, pos)[0]
+            pos += 4
+            values = np.frombuffer(data, dtype="<f8", count=num_rows * num_cols, offset=pos).reshape(num_rows, num_cols)
+            pos += 8 * num_rows * num_cols
+            add(name, OrderedDict((col, values[:, c]) for c, col in enumerate(columns)))
+        else:
+            raise ValueError("Corrupt voxelyze result file %s (record type %r at byte %d)" % (filename, kind, pos))
+
+    return root
+
+
+def find_result_value(result, name):
+    """Returns the last value called name (in file order) in a result read by read_voxelyze_result_file, or None.
+    This is the match the xml path of read_voxlyze_results keeps, so both formats read the same value."""
+    found = None
+    if isinstance(result, dict):
+        items = result.items()
+    elif isinstance(result, list):
+        items = [(None, child) for child in result]
+    else:
+        return None
+    for key, child in items:
+        if key == name and child is not None:
+            found = child
+        value = find_result_value(child, name)
+        if value is not None:
+            found = value
+    return found
+
+
 def write_voxelyze_file(sim, env, individual, run_directory, run_name):
 
     # TODO: work in base.py to remove redundant static text in this function
@@ -170,6 +273,7 @@ def write_voxelyze_file(sim, env, individual, run_directory, run_name):
         <QhullTmpFile>" + run_directory + "/../_qhull/tempFiles/qhullInput--id_%05i.txt" % individual.id + "</QhullTmpFile>\n\
         <CurvaturesTmpFile>" + run_directory + "/../_qhull/tempFiles/curvatures--id_%05i.txt" % individual.id +
         "</CurvaturesTmpFile>\n\
+        <ResultFormat>" + str(int(getattr(sim, "result_format", 0))) + "</ResultFormat>\n\
         </GA>\n\
         <MinTempFact>" + str(sim.min_temp_fact) + "</MinTempFact>\n\
         <MaxTempFactChange>" + str(sim.max_temp_fact_change) + "</MaxTempFactChange>\n\